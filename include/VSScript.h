@@ -35,6 +35,13 @@ VS_API(int) vsscript_init(void);
 /* Free all scripting runtimes */
 VS_API(int) vsscript_finalize(void);
 
+/*
+* Keep size cores created in advance with all plugins loaded, new environments get one of them instead of creating their own core
+* Cores are never reused after an environment has been freed, the pool is refilled in the background
+* Returns non-zero if called before vsscript_init() or with a negative size, 0 (the default) disables the pool
+*/
+VS_API(int) vsscript_setCorePoolSize(int size);
+
 /*
 * Pass a pointer to a null handle to create a new one
 * The values returned by the query functions are only valid during the lifetime of the VSScript
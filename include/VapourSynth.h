@@ -24,7 +24,7 @@
 #include <stdint.h>
 
 #define VAPOURSYNTH_API_MAJOR 3
-#define VAPOURSYNTH_API_MINOR 5
+#define VAPOURSYNTH_API_MINOR 6
 #define VAPOURSYNTH_API_VERSION ((VAPOURSYNTH_API_MAJOR << 16) | (VAPOURSYNTH_API_MINOR))
 
 /* Convenience for C++ users. */
@@ -70,6 +70,7 @@ typedef struct VSFuncRef VSFuncRef;
 typedef struct VSMap VSMap;
 typedef struct VSAPI VSAPI;
 typedef struct VSFrameContext VSFrameContext;
+typedef struct VSMapKey VSMapKey;
 
 typedef enum VSColorFamily {
     /* all planar formats */
@@ -335,6 +336,13 @@ struct VSAPI {
 
     /* api 3.4 */
     void (VS_CC *logMessage)(int msgType, const char *msg) VS_NOEXCEPT;
+
+    /* api 3.6 */
+    const VSMapKey *(VS_CC *getMapKey)(const char *key) VS_NOEXCEPT;
+    int64_t (VS_CC *propGetIntByKey)(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT;
+    double (VS_CC *propGetFloatByKey)(const VSMap *map, const VSMapKey *key, int index, int *error) VS_NOEXCEPT;
+    int (VS_CC *propSetIntByKey)(VSMap *map, const VSMapKey *key, int64_t i, int append) VS_NOEXCEPT;
+    int (VS_CC *propSetFloatByKey)(VSMap *map, const VSMapKey *key, double d, int append) VS_NOEXCEPT;
 };
 
 VS_API(const VSAPI *) getVapourSynthAPI(int version) VS_NOEXCEPT;
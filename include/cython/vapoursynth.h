@@ -35,6 +35,7 @@ struct VPYScriptExport {
 __PYX_EXTERN_C DL_IMPORT(int) vpy_createScript(struct VPYScriptExport *);
 __PYX_EXTERN_C DL_IMPORT(int) vpy_evaluateScript(struct VPYScriptExport *, char const *, char const *, int);
 __PYX_EXTERN_C DL_IMPORT(int) vpy_evaluateFile(struct VPYScriptExport *, char const *, int);
+__PYX_EXTERN_C DL_IMPORT(int) vpy_setCore(struct VPYScriptExport *, VSCore *);
 __PYX_EXTERN_C DL_IMPORT(void) vpy_freeScript(struct VPYScriptExport *);
 __PYX_EXTERN_C DL_IMPORT(char) *vpy_getError(struct VPYScriptExport *);
 __PYX_EXTERN_C DL_IMPORT(VSNodeRef) *vpy_getOutput(struct VPYScriptExport *, int);
@@ -11,6 +11,8 @@ static int (*__pyx_api_f_11vapoursynth_vpy_evaluateScript)(struct VPYScriptExpor
 #define vpy_evaluateScript __pyx_api_f_11vapoursynth_vpy_evaluateScript
 static int (*__pyx_api_f_11vapoursynth_vpy_evaluateFile)(struct VPYScriptExport *, char const *, int) = 0;
 #define vpy_evaluateFile __pyx_api_f_11vapoursynth_vpy_evaluateFile
+static int (*__pyx_api_f_11vapoursynth_vpy_setCore)(struct VPYScriptExport *, VSCore *) = 0;
+#define vpy_setCore __pyx_api_f_11vapoursynth_vpy_setCore
 static void (*__pyx_api_f_11vapoursynth_vpy_freeScript)(struct VPYScriptExport *) = 0;
 #define vpy_freeScript __pyx_api_f_11vapoursynth_vpy_freeScript
 static char *(*__pyx_api_f_11vapoursynth_vpy_getError)(struct VPYScriptExport *) = 0;
@@ -125,6 +127,7 @@ static int import_vapoursynth(void) {
   if (__Pyx_ImportFunction(module, "vpy_createScript", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_createScript, "int (struct VPYScriptExport *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_evaluateScript", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_evaluateScript, "int (struct VPYScriptExport *, char const *, char const *, int)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_evaluateFile", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_evaluateFile, "int (struct VPYScriptExport *, char const *, int)") < 0) goto bad;
+  if (__Pyx_ImportFunction(module, "vpy_setCore", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_setCore, "int (struct VPYScriptExport *, VSCore *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_freeScript", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_freeScript, "void (struct VPYScriptExport *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_getError", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_getError, "char *(struct VPYScriptExport *)") < 0) goto bad;
   if (__Pyx_ImportFunction(module, "vpy_getOutput", (void (**)(void))&__pyx_api_f_11vapoursynth_vpy_getOutput, "VSNodeRef *(struct VPYScriptExport *, int)") < 0) goto bad;
@@ -0,0 +1,573 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "vscore.h"
+#include "filemapping.h"
+#include "internalfilters.h"
+#include "version.h"
+#include "VSHelper.h"
+#include <cinttypes>
+#include <cstdio>
+#ifdef VS_TARGET_OS_WINDOWS
+#    include <direct.h>
+#    include <locale>
+#    include <codecvt>
+#else
+#    include <sys/stat.h>
+#endif
+
+// The cache file starts with a header and an index entry for every frame. The
+// frames are stored wherever there's room after that, each is the planes laid
+// out like in a frame allocated by the core followed by the serialized frame
+// properties. A file only ever holds the output of a single filter graph.
+
+namespace {
+
+struct DiskCacheHeader {
+    char magic[16];
+    uint32_t version;
+    uint32_t coreVersion;
+    uint64_t graphHash;
+    int32_t colorFamily;
+    int32_t sampleType;
+    int32_t bitsPerSample;
+    int32_t subSamplingW;
+    int32_t subSamplingH;
+    int32_t width;
+    int32_t height;
+    int32_t numFrames;
+    int32_t alignment;
+    // only set when the file was closed properly, anything could be half written otherwise
+    int32_t clean;
+    uint64_t useCounter;
+};
+
+struct DiskCacheEntry {
+    // zero when the frame isn't stored
+    uint64_t offset;
+    uint64_t size;
+    uint64_t propsSize;
+    uint64_t lastUse;
+};
+
+static const char diskCacheMagic[16] = "VSDiskCache";
+static const uint32_t diskCacheVersion = 1;
+static const int64_t diskCacheHeaderSize = 4096;
+static const int64_t diskCacheGrowStep = 64 * 1024 * 1024;
+
+static_assert(sizeof(DiskCacheHeader) <= diskCacheHeaderSize, "DiskCache header too big");
+
+// holding a reference to this keeps a stored frame from being evicted
+struct DiskCacheFrameRef {
+    std::shared_ptr<MappedFileView> view;
+    explicit DiskCacheFrameRef(const std::shared_ptr<MappedFileView> &view) : view(view) {}
+};
+
+struct DiskCacheData {
+    VSNodeRef *node;
+    const VSVideoInfo *vi;
+    MappedFile file;
+    std::mutex lock;
+    std::shared_ptr<MappedFileView> view;
+    int64_t maxSize;
+    int64_t indexEnd;
+    int64_t dataEnd;
+    int64_t planeOffset[3];
+    int64_t planesSize;
+    // holes left by evicted frames, offset to size
+    std::map<int64_t, int64_t> freeRegions;
+    std::set<std::pair<uint64_t, int>> lru;
+    std::vector<std::weak_ptr<DiskCacheFrameRef>> frameRefs;
+
+    DiskCacheData() : node(nullptr), vi(nullptr), maxSize(0), indexEnd(0), dataEnd(0), planeOffset(), planesSize(0) {}
+
+    DiskCacheHeader *header() {
+        return reinterpret_cast<DiskCacheHeader *>(view->data());
+    }
+
+    DiskCacheEntry &entry(int n) {
+        return reinterpret_cast<DiskCacheEntry *>(view->data() + diskCacheHeaderSize)[n];
+    }
+
+    void open(const std::string &filename, uint64_t graphHash);
+    bool loadIndex(uint64_t graphHash);
+    void resetFile(uint64_t graphHash);
+    bool ensureMapped(int64_t end);
+    void freeRegion(int64_t offset, int64_t size);
+    void evict(int n);
+    bool allocate(int64_t size, int64_t &offset);
+    const VSFrameRef *load(int n, VSCore *core, const VSAPI *vsapi);
+    void store(int n, const VSFrameRef *src, const VSAPI *vsapi);
+    void close();
+};
+
+} // namespace
+
+static int64_t alignSize(int64_t size, int64_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+template<typename T>
+static void appendValue(std::string &s, const T &value) {
+    s.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename T>
+static bool readValue(const uint8_t *&ptr, const uint8_t *end, T &value) {
+    if (static_cast<size_t>(end - ptr) < sizeof(value))
+        return false;
+    memcpy(&value, ptr, sizeof(value));
+    ptr += sizeof(value);
+    return true;
+}
+
+// only the plain value types can be stored, frames with anything else are never cached
+static bool serializeProps(const VSMap *props, std::string &s, const VSAPI *vsapi) {
+    int numKeys = vsapi->propNumKeys(props);
+    appendValue(s, static_cast<uint32_t>(numKeys));
+    for (int i = 0; i < numKeys; i++) {
+        const char *key = vsapi->propGetKey(props, i);
+        char type = vsapi->propGetType(props, key);
+        int numElements = vsapi->propNumElements(props, key);
+        appendValue(s, static_cast<uint32_t>(strlen(key)));
+        s.append(key);
+        appendValue(s, type);
+        appendValue(s, static_cast<uint32_t>(numElements));
+        if (type == ptInt) {
+            const int64_t *arr = vsapi->propGetIntArray(props, key, nullptr);
+            s.append(reinterpret_cast<const char *>(arr), numElements * sizeof(int64_t));
+        } else if (type == ptFloat) {
+            const double *arr = vsapi->propGetFloatArray(props, key, nullptr);
+            s.append(reinterpret_cast<const char *>(arr), numElements * sizeof(double));
+        } else if (type == ptData) {
+            for (int j = 0; j < numElements; j++) {
+                int size = vsapi->propGetDataSize(props, key, j, nullptr);
+                appendValue(s, static_cast<uint32_t>(size));
+                s.append(vsapi->propGetData(props, key, j, nullptr), size);
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool deserializeProps(const uint8_t *ptr, const uint8_t *end, VSMap *props, const VSAPI *vsapi) {
+    uint32_t numKeys;
+    if (!readValue(ptr, end, numKeys))
+        return false;
+    for (uint32_t i = 0; i < numKeys; i++) {
+        uint32_t keyLength;
+        if (!readValue(ptr, end, keyLength) || static_cast<size_t>(end - ptr) < keyLength)
+            return false;
+        std::string key(reinterpret_cast<const char *>(ptr), keyLength);
+        ptr += keyLength;
+        char type;
+        uint32_t numElements;
+        if (!readValue(ptr, end, type) || !readValue(ptr, end, numElements))
+            return false;
+        if (type == ptInt) {
+            if (static_cast<size_t>(end - ptr) / sizeof(int64_t) < numElements)
+                return false;
+            std::vector<int64_t> values(numElements);
+            memcpy(values.data(), ptr, numElements * sizeof(int64_t));
+            ptr += numElements * sizeof(int64_t);
+            vsapi->propSetIntArray(props, key.c_str(), values.data(), numElements);
+        } else if (type == ptFloat) {
+            if (static_cast<size_t>(end - ptr) / sizeof(double) < numElements)
+                return false;
+            std::vector<double> values(numElements);
+            memcpy(values.data(), ptr, numElements * sizeof(double));
+            ptr += numElements * sizeof(double);
+            vsapi->propSetFloatArray(props, key.c_str(), values.data(), numElements);
+        } else if (type == ptData) {
+            for (uint32_t j = 0; j < numElements; j++) {
+                uint32_t size;
+                if (!readValue(ptr, end, size) || static_cast<size_t>(end - ptr) < size)
+                    return false;
+                vsapi->propSetData(props, key.c_str(), reinterpret_cast<const char *>(ptr), size, paAppend);
+                ptr += size;
+            }
+        } else {
+            return false;
+        }
+    }
+    return ptr == end;
+}
+
+void DiskCacheData::open(const std::string &filename, uint64_t graphHash) {
+    if (!file.open(filename, true))
+        throw std::string("failed to open ") + filename;
+
+    // several scripts or processes using the same cache at once would step on each other's frames
+    if (!file.tryLock()) {
+        file.close();
+        return;
+    }
+
+    int64_t fileSize = file.getSize();
+    if (fileSize >= indexEnd)
+        view = file.map(fileSize);
+
+    if (!view || !loadIndex(graphHash))
+        resetFile(graphHash);
+
+    // maxsize may have been lowered since the file was written
+    if (maxSize && static_cast<int64_t>(view->size()) > maxSize) {
+        for (int n = 0; n < vi->numFrames; n++)
+            if (entry(n).offset && static_cast<int64_t>(entry(n).offset + entry(n).size) > maxSize)
+                evict(n);
+        view.reset();
+        if (!file.resize(maxSize) || !(view = file.map(maxSize)))
+            throw std::string("failed to resize the cache file");
+    }
+
+    header()->clean = 0;
+}
+
+bool DiskCacheData::loadIndex(uint64_t graphHash) {
+    const DiskCacheHeader *h = header();
+    if (memcmp(h->magic, diskCacheMagic, sizeof(diskCacheMagic)) || h->version != diskCacheVersion || h->coreVersion != VAPOURSYNTH_CORE_VERSION
+        || h->graphHash != graphHash || h->colorFamily != vi->format->colorFamily || h->sampleType != vi->format->sampleType
+        || h->bitsPerSample != vi->format->bitsPerSample || h->subSamplingW != vi->format->subSamplingW || h->subSamplingH != vi->format->subSamplingH
+        || h->width != vi->width || h->height != vi->height || h->numFrames != vi->numFrames || h->alignment != VSFrame::alignment || !h->clean)
+        return false;
+
+    std::map<int64_t, int64_t> used;
+    for (int n = 0; n < vi->numFrames; n++) {
+        const DiskCacheEntry &e = entry(n);
+        if (!e.offset)
+            continue;
+        if (e.offset < static_cast<uint64_t>(indexEnd) || e.offset % VSFrame::alignment || e.size < planesSize + e.propsSize || e.offset + e.size > view->size())
+            return false;
+        used[e.offset] = e.size;
+        lru.insert(std::make_pair(e.lastUse, n));
+    }
+
+    int64_t pos = indexEnd;
+    for (const auto &iter : used) {
+        if (iter.first < pos)
+            return false;
+        if (iter.first > pos)
+            freeRegions[pos] = iter.first - pos;
+        pos = iter.first + iter.second;
+    }
+    dataEnd = pos;
+    return true;
+}
+
+void DiskCacheData::resetFile(uint64_t graphHash) {
+    view.reset();
+    freeRegions.clear();
+    lru.clear();
+    dataEnd = indexEnd;
+
+    // truncating first gets rid of all the old frames in one go
+    if (!file.resize(0) || !file.resize(indexEnd) || !(view = file.map(indexEnd)))
+        throw std::string("failed to create the cache file");
+
+    DiskCacheHeader *h = header();
+    memcpy(h->magic, diskCacheMagic, sizeof(diskCacheMagic));
+    h->version = diskCacheVersion;
+    h->coreVersion = VAPOURSYNTH_CORE_VERSION;
+    h->graphHash = graphHash;
+    h->colorFamily = vi->format->colorFamily;
+    h->sampleType = vi->format->sampleType;
+    h->bitsPerSample = vi->format->bitsPerSample;
+    h->subSamplingW = vi->format->subSamplingW;
+    h->subSamplingH = vi->format->subSamplingH;
+    h->width = vi->width;
+    h->height = vi->height;
+    h->numFrames = vi->numFrames;
+    h->alignment = VSFrame::alignment;
+    h->clean = 0;
+    h->useCounter = 0;
+}
+
+bool DiskCacheData::ensureMapped(int64_t end) {
+    int64_t mappedSize = static_cast<int64_t>(view->size());
+    if (end <= mappedSize)
+        return true;
+
+    // grow in big steps since every new mapping is a system call and some page table work
+    int64_t newSize = std::max(end, mappedSize + std::max(mappedSize / 4, diskCacheGrowStep));
+    if (maxSize)
+        newSize = std::min(newSize, maxSize);
+    if (newSize < end || !file.resize(newSize))
+        return false;
+
+    // frames returned earlier keep the old view alive for as long as they need it
+    std::shared_ptr<MappedFileView> newView = file.map(newSize);
+    if (!newView)
+        return false;
+    view = newView;
+    return true;
+}
+
+void DiskCacheData::freeRegion(int64_t offset, int64_t size) {
+    auto next = freeRegions.lower_bound(offset);
+    if (next != freeRegions.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeRegions.erase(next);
+    }
+    if (next != freeRegions.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            freeRegions.erase(prev);
+        }
+    }
+
+    if (offset + size == dataEnd)
+        dataEnd = offset;
+    else
+        freeRegions[offset] = size;
+}
+
+void DiskCacheData::evict(int n) {
+    DiskCacheEntry &e = entry(n);
+    lru.erase(std::make_pair(e.lastUse, n));
+    freeRegion(static_cast<int64_t>(e.offset), static_cast<int64_t>(e.size));
+    e.offset = 0;
+}
+
+bool DiskCacheData::allocate(int64_t size, int64_t &offset) {
+    while (true) {
+        for (auto iter = freeRegions.begin(); iter != freeRegions.end(); ++iter) {
+            if (iter->second >= size) {
+                offset = iter->first;
+                if (iter->second > size)
+                    freeRegions[offset + size] = iter->second - size;
+                freeRegions.erase(iter);
+                return true;
+            }
+        }
+
+        if ((!maxSize || dataEnd + size <= maxSize) && ensureMapped(dataEnd + size)) {
+            offset = dataEnd;
+            dataEnd += size;
+            return true;
+        }
+
+        // make room by throwing out the least recently used frame that nobody is looking at right now
+        auto victim = lru.begin();
+        while (victim != lru.end() && !frameRefs[victim->second].expired())
+            ++victim;
+        if (victim == lru.end())
+            return false;
+        evict(victim->second);
+    }
+}
+
+const VSFrameRef *DiskCacheData::load(int n, VSCore *core, const VSAPI *vsapi) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!view)
+        return nullptr;
+
+    DiskCacheEntry &e = entry(n);
+    if (!e.offset)
+        return nullptr;
+
+    std::shared_ptr<DiskCacheFrameRef> ref = frameRefs[n].lock();
+    if (!ref) {
+        ref = std::make_shared<DiskCacheFrameRef>(view);
+        frameRefs[n] = ref;
+    }
+
+    // an older view is still fine as long as it's the one that's kept alive
+    const uint8_t *base = ref->view->data() + e.offset;
+    const uint8_t *planes[3] = {};
+    int strides[3] = {};
+    for (int p = 0; p < vi->format->numPlanes; p++) {
+        planes[p] = base + planeOffset[p];
+        strides[p] = VSFrame::getAlignedStride(vi->format, vi->width, p);
+    }
+
+    VSFrameRef *dst;
+    if (VSFrame::canWrapPlanes(vi->format, vi->width, planes, strides)) {
+        dst = new VSFrameRef(std::make_shared<VSFrame>(vi->format, vi->width, vi->height, planes, ref, nullptr, core));
+    } else {
+        dst = vsapi->newVideoFrame(vi->format, vi->width, vi->height, nullptr, core);
+        for (int p = 0; p < vi->format->numPlanes; p++)
+            vs_bitblt(vsapi->getWritePtr(dst, p), vsapi->getStride(dst, p), planes[p], strides[p], vsapi->getFrameWidth(dst, p) * vi->format->bytesPerSample, vsapi->getFrameHeight(dst, p));
+    }
+
+    const uint8_t *props = base + planesSize;
+    if (!deserializeProps(props, props + e.propsSize, vsapi->getFramePropsRW(dst), vsapi)) {
+        vsapi->freeFrame(dst);
+        evict(n);
+        return nullptr;
+    }
+
+    lru.erase(std::make_pair(e.lastUse, n));
+    e.lastUse = ++header()->useCounter;
+    lru.insert(std::make_pair(e.lastUse, n));
+    return dst;
+}
+
+void DiskCacheData::store(int n, const VSFrameRef *src, const VSAPI *vsapi) {
+    std::string props;
+    if (!serializeProps(vsapi->getFramePropsRO(src), props, vsapi))
+        return;
+
+    int64_t size = alignSize(planesSize + static_cast<int64_t>(props.size()), VSFrame::alignment);
+    int64_t offset;
+    std::shared_ptr<MappedFileView> target;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!view || entry(n).offset || !allocate(size, offset))
+            return;
+        target = view;
+    }
+
+    // the region belongs to nobody else until it's entered in the index so the copying can be done unlocked
+    uint8_t *base = target->data() + offset;
+    for (int p = 0; p < vi->format->numPlanes; p++)
+        vs_bitblt(base + planeOffset[p], VSFrame::getAlignedStride(vi->format, vi->width, p), vsapi->getReadPtr(src, p), vsapi->getStride(src, p),
+            vsapi->getFrameWidth(src, p) * vi->format->bytesPerSample, vsapi->getFrameHeight(src, p));
+    memcpy(base + planesSize, props.data(), props.size());
+
+    std::lock_guard<std::mutex> guard(lock);
+    DiskCacheEntry &e = entry(n);
+    if (e.offset) {
+        freeRegion(offset, size);
+        return;
+    }
+    e.size = size;
+    e.propsSize = props.size();
+    e.lastUse = ++header()->useCounter;
+    e.offset = offset;
+    lru.insert(std::make_pair(e.lastUse, n));
+}
+
+void DiskCacheData::close() {
+    if (view)
+        header()->clean = 1;
+    view.reset();
+    file.close();
+}
+
+static void VS_CC diskCacheInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    DiskCacheData *d = static_cast<DiskCacheData *>(*instanceData);
+    vsapi->setVideoInfo(d->vi, 1, node);
+}
+
+static const VSFrameRef *VS_CC diskCacheGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    DiskCacheData *d = static_cast<DiskCacheData *>(*instanceData);
+
+    if (activationReason == arInitial) {
+        const VSFrameRef *f = d->load(n, core, vsapi);
+        if (f)
+            return f;
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrameRef *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+        d->store(n, src, vsapi);
+        return src;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC diskCacheFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    DiskCacheData *d = static_cast<DiskCacheData *>(instanceData);
+    d->close();
+    vsapi->freeNode(d->node);
+    delete d;
+}
+
+static void createDirectory(const std::string &path) {
+#ifdef VS_TARGET_OS_WINDOWS
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    _wmkdir(conversion.from_bytes(path).c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+static void VS_CC diskCacheCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<DiskCacheData> d(new DiskCacheData());
+    int err;
+
+    d->node = vsapi->propGetNode(in, "clip", 0, nullptr);
+    d->vi = vsapi->getVideoInfo(d->node);
+
+    try {
+        if (!isConstantFormat(d->vi))
+            throw std::string("only clips with constant format and dimensions supported");
+        if (d->vi->format->id == pfCompatBGR32 || d->vi->format->id == pfCompatYUY2)
+            throw std::string("compat formats not supported");
+
+        std::string path = vsapi->propGetData(in, "path", 0, nullptr);
+        if (path.empty())
+            throw std::string("path must not be empty");
+
+        uint64_t graphHash = UINT64_C(14695981039346656037);
+        bool hasGraphHash = d->node->clip->getGraphHash(d->node->index, graphHash);
+        const char *key = vsapi->propGetData(in, "key", 0, &err);
+        if (key) {
+            // FNV-1a like the node hashes
+            for (const char *c = key; *c; c++) {
+                graphHash ^= static_cast<uint8_t>(*c);
+                graphHash *= UINT64_C(1099511628211);
+            }
+        } else if (!hasGraphHash) {
+            throw std::string("the clip's filter graph contains functions and can't be recognized between runs, use key to name it instead");
+        }
+
+        int64_t maxSize = vsapi->propGetInt(in, "maxsize", 0, &err);
+        if (maxSize < 0)
+            throw std::string("maxsize can't be negative");
+        d->maxSize = maxSize * 1024 * 1024;
+
+        for (int p = 0; p < d->vi->format->numPlanes; p++) {
+            d->planeOffset[p] = d->planesSize;
+            d->planesSize += static_cast<int64_t>(VSFrame::getAlignedStride(d->vi->format, d->vi->width, p)) * (d->vi->height >> (p ? d->vi->format->subSamplingH : 0));
+        }
+        d->indexEnd = alignSize(diskCacheHeaderSize + static_cast<int64_t>(sizeof(DiskCacheEntry)) * d->vi->numFrames, 4096);
+        if (d->maxSize && d->maxSize < d->indexEnd + d->planesSize)
+            throw std::string("maxsize is too small to hold a single frame");
+        d->frameRefs.resize(d->vi->numFrames);
+
+        createDirectory(path);
+        char filename[32];
+        snprintf(filename, sizeof(filename), "%016" PRIx64 ".vscache", graphHash);
+        d->open(path + "/" + filename, graphHash);
+    } catch (std::string &error) {
+        vsapi->freeNode(d->node);
+        vsapi->setError(out, ("DiskCache: " + error).c_str());
+        return;
+    }
+
+    if (!d->view) {
+        vsWarning("DiskCache: the cache file for this clip is already in use, frames won't be cached");
+        vsapi->propSetNode(out, "clip", d->node, paReplace);
+        vsapi->freeNode(d->node);
+        return;
+    }
+
+    vsapi->createFilter(in, out, "DiskCache", diskCacheInit, diskCacheGetFrame, diskCacheFree, fmParallel, 0, d.release(), core);
+}
+
+void VS_CC diskCacheInitialize(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
+    registerFunc("DiskCache", "clip:clip;path:data;maxsize:int:opt;key:data:opt;", diskCacheCreate, nullptr, plugin);
+}
@@ -32,6 +32,7 @@
 #include "VapourSynth.h"
 #include "VSHelper.h"
 #include "internalfilters.h"
+#include "exprfilter.h"
 #include "cpufeatures.h"
 #ifdef VS_TARGET_CPU_X86
 #define NOMINMAX
@@ -551,6 +552,121 @@ struct ExprEval : public jitasm::function<void, ExprEval, uint8_t *, const intpt
 };
 #endif
 
+// Generic stack machine used when no jit is available and for filling tables.
+// The load callback receives the load operation and the input index and returns the value to push.
+template<typename LoadFunc>
+static inline float interpretExpression(const ExprOp *vops, float *stack, const LoadFunc &load) {
+    int si = 0;
+    float stacktop = 0;
+    for (int i = 0; true; i++) {
+        switch (vops[i].op) {
+        case opLoadSrc8:
+        case opLoadSrc16:
+        case opLoadSrcF32:
+            stack[si] = stacktop;
+            stacktop = load(vops[i].op, vops[i].e.ival);
+            ++si;
+            break;
+        case opLoadConst:
+            stack[si] = stacktop;
+            stacktop = vops[i].e.fval;
+            ++si;
+            break;
+        case opDup:
+            stack[si] = stacktop;
+            stacktop = stack[si - vops[i].e.ival];
+            ++si;
+            break;
+        case opSwap:
+            std::swap(stacktop, stack[si - vops[i].e.ival]);
+            break;
+        case opAdd:
+            --si;
+            stacktop += stack[si];
+            break;
+        case opSub:
+            --si;
+            stacktop = stack[si] - stacktop;
+            break;
+        case opMul:
+            --si;
+            stacktop *= stack[si];
+            break;
+        case opDiv:
+            --si;
+            stacktop = stack[si] / stacktop;
+            break;
+        case opMax:
+            --si;
+            stacktop = std::max(stacktop, stack[si]);
+            break;
+        case opMin:
+            --si;
+            stacktop = std::min(stacktop, stack[si]);
+            break;
+        case opExp:
+            stacktop = std::exp(stacktop);
+            break;
+        case opLog:
+            stacktop = std::log(stacktop);
+            break;
+        case opPow:
+            --si;
+            stacktop = std::pow(stack[si], stacktop);
+            break;
+        case opSqrt:
+            stacktop = std::sqrt(stacktop);
+            break;
+        case opAbs:
+            stacktop = std::abs(stacktop);
+            break;
+        case opGt:
+            --si;
+            stacktop = (stack[si] > stacktop) ? 1.0f : 0.0f;
+            break;
+        case opLt:
+            --si;
+            stacktop = (stack[si] < stacktop) ? 1.0f : 0.0f;
+            break;
+        case opEq:
+            --si;
+            stacktop = (stack[si] == stacktop) ? 1.0f : 0.0f;
+            break;
+        case opLE:
+            --si;
+            stacktop = (stack[si] <= stacktop) ? 1.0f : 0.0f;
+            break;
+        case opGE:
+            --si;
+            stacktop = (stack[si] >= stacktop) ? 1.0f : 0.0f;
+            break;
+        case opTernary:
+            si -= 2;
+            stacktop = (stack[si] > 0) ? stack[si + 1] : stacktop;
+            break;
+        case opAnd:
+            --si;
+            stacktop = (stacktop > 0 && stack[si] > 0) ? 1.0f : 0.0f;
+            break;
+        case opOr:
+            --si;
+            stacktop = (stacktop > 0 || stack[si] > 0) ? 1.0f : 0.0f;
+            break;
+        case opXor:
+            --si;
+            stacktop = ((stacktop > 0) != (stack[si] > 0)) ? 1.0f : 0.0f;
+            break;
+        case opNeg:
+            stacktop = (stacktop > 0) ? 0.0f : 1.0f;
+            break;
+        case opStore8:
+        case opStore16:
+        case opStoreF32:
+            return stacktop;
+        }
+    }
+}
+
 static void VS_CC exprInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     ExprData *d = static_cast<ExprData *>(*instanceData);
     vsapi->setVideoInfo(&d->vi, 1, node);
@@ -626,135 +742,26 @@ static const VSFrameRef *VS_CC exprGetFrame(int n, int activationReason, void **
                 int h = vsapi->getFrameHeight(src[0], plane);
                 int w = vsapi->getFrameWidth(src[0], plane);
                 const ExprOp *vops = d->ops[plane].data();
+                const uint32_t storeOp = d->ops[plane].back().op;
                 float *stack = stackVector.data();
-                float stacktop = 0;
 
                 for (int y = 0; y < h; y++) {
                     for (int x = 0; x < w; x++) {
-                        int si = 0;
-                        int i = -1;
-                        while (true) {
-                            i++;
-                            switch (vops[i].op) {
-                            case opLoadSrc8:
-                                stack[si] = stacktop;
-                                stacktop = srcp[vops[i].e.ival][x];
-                                ++si;
-                                break;
-                            case opLoadSrc16:
-                                stack[si] = stacktop;
-                                stacktop = reinterpret_cast<const uint16_t *>(srcp[vops[i].e.ival])[x];
-                                ++si;
-                                break;
-                            case opLoadSrcF32:
-                                stack[si] = stacktop;
-                                stacktop = reinterpret_cast<const float *>(srcp[vops[i].e.ival])[x];
-                                ++si;
-                                break;
-                            case opLoadConst:
-                                stack[si] = stacktop;
-                                stacktop = vops[i].e.fval;
-                                ++si;
-                                break;
-                            case opDup:
-                                stack[si] = stacktop;
-                                stacktop = stack[si - vops[i].e.ival];
-                                ++si;
-                                break;
-                            case opSwap:
-                                std::swap(stacktop, stack[si - vops[i].e.ival]);
-                                break;
-                            case opAdd:
-                                --si;
-                                stacktop += stack[si];
-                                break;
-                            case opSub:
-                                --si;
-                                stacktop = stack[si] - stacktop;
-                                break;
-                            case opMul:
-                                --si;
-                                stacktop *= stack[si];
-                                break;
-                            case opDiv:
-                                --si;
-                                stacktop = stack[si] / stacktop;
-                                break;
-                            case opMax:
-                                --si;
-                                stacktop = std::max(stacktop, stack[si]);
-                                break;
-                            case opMin:
-                                --si;
-                                stacktop = std::min(stacktop, stack[si]);
-                                break;
-                            case opExp:
-                                stacktop = std::exp(stacktop);
-                                break;
-                            case opLog:
-                                stacktop = std::log(stacktop);
-                                break;
-                            case opPow:
-                                --si;
-                                stacktop = std::pow(stack[si], stacktop);
-                                break;
-                            case opSqrt:
-                                stacktop = std::sqrt(stacktop);
-                                break;
-                            case opAbs:
-                                stacktop = std::abs(stacktop);
-                                break;
-                            case opGt:
-                                --si;
-                                stacktop = (stack[si] > stacktop) ? 1.0f : 0.0f;
-                                break;
-                            case opLt:
-                                --si;
-                                stacktop = (stack[si] < stacktop) ? 1.0f : 0.0f;
-                                break;
-                            case opEq:
-                                --si;
-                                stacktop = (stack[si] == stacktop) ? 1.0f : 0.0f;
-                                break;
-                            case opLE:
-                                --si;
-                                stacktop = (stack[si] <= stacktop) ? 1.0f : 0.0f;
-                                break;
-                            case opGE:
-                                --si;
-                                stacktop = (stack[si] >= stacktop) ? 1.0f : 0.0f;
-                                break;
-                            case opTernary:
-                                si -= 2;
-                                stacktop = (stack[si] > 0) ? stack[si + 1] : stacktop;
-                                break;
-                            case opAnd:
-                                --si;
-                                stacktop = (stacktop > 0 && stack[si] > 0) ? 1.0f : 0.0f;
-                                break;
-                            case opOr:
-                                --si;
-                                stacktop = (stacktop > 0 || stack[si] > 0) ? 1.0f : 0.0f;
-                                break;
-                            case opXor:
-                                --si;
-                                stacktop = ((stacktop > 0) != (stack[si] > 0)) ? 1.0f : 0.0f;
-                                break;
-                            case opNeg:
-                                stacktop = (stacktop > 0) ? 0.0f : 1.0f;
-                                break;
-                            case opStore8:
-                                dstp[x] = std::max(0.0f, std::min(stacktop, 255.0f)) + 0.5f;
-                                goto loopend;
-                            case opStore16:
-                                reinterpret_cast<uint16_t *>(dstp)[x] = std::max(0.0f, std::min(stacktop, 65535.0f)) + 0.5f;
-                                goto loopend;
-                            case opStoreF32:
-                                reinterpret_cast<float *>(dstp)[x] = stacktop;
-                                goto loopend;
-                            }
-                        }
-                        loopend:;
+                        float v = interpretExpression(vops, stack, [&](uint32_t op, int index) -> float {
+                            if (op == opLoadSrc8)
+                                return srcp[index][x];
+                            else if (op == opLoadSrc16)
+                                return reinterpret_cast<const uint16_t *>(srcp[index])[x];
+                            else
+                                return reinterpret_cast<const float *>(srcp[index])[x];
+                        });
+
+                        if (storeOp == opStore8)
+                            dstp[x] = std::max(0.0f, std::min(v, 255.0f)) + 0.5f;
+                        else if (storeOp == opStore16)
+                            reinterpret_cast<uint16_t *>(dstp)[x] = std::max(0.0f, std::min(v, 65535.0f)) + 0.5f;
+                        else
+                            reinterpret_cast<float *>(dstp)[x] = v;
                     }
                     dstp += dst_stride;
                     for (int i = 0; i < numInputs; i++)
@@ -1214,6 +1221,40 @@ static void foldConstants(std::vector<ExprOp> &ops) {
     }
 }
 
+//////////////////////////////////////////
+// Lut table evaluation
+
+struct ExprLutData {
+    std::vector<ExprOp> ops;
+    size_t maxStackSize;
+};
+
+ExprLutData *exprLutCreate(const std::string &expr, int numInputs) {
+    std::unique_ptr<ExprLutData> d(new ExprLutData);
+    // no video info makes all inputs load as float, x and y are then simply passed as values by the load callback
+    const VSVideoInfo *vi[MAX_EXPR_INPUTS] = {};
+    d->maxStackSize = parseExpression(expr, d->ops, vi, opStoreF32, numInputs);
+    if (d->ops.empty())
+        throw std::runtime_error("Empty expression");
+    foldConstants(d->ops);
+    return d.release();
+}
+
+void exprLutEvaluate(const ExprLutData *d, float *dst, int xrange, int ystart, int yend) {
+    std::vector<float> stackVector(d->maxStackSize);
+    const ExprOp *vops = d->ops.data();
+    float *stack = stackVector.data();
+
+    for (int y = ystart; y < yend; y++) {
+        for (int x = 0; x < xrange; x++)
+            dst[x + (y - ystart) * xrange] = interpretExpression(vops, stack, [x, y](uint32_t op, int index) -> float { return static_cast<float>(index ? y : x); });
+    }
+}
+
+void exprLutFree(ExprLutData *d) {
+    delete d;
+}
+
 static void VS_CC exprCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     std::unique_ptr<ExprData> d(new ExprData);
     int err;
@@ -0,0 +1,38 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef EXPRFILTER_H
+#define EXPRFILTER_H
+
+#include <string>
+
+// Lets other filters evaluate Expr syntax natively, currently used by Lut and Lut2
+// to build their tables. Only x and y (when numInputs is 2) can be referenced.
+
+struct ExprLutData;
+
+// Throws std::runtime_error if the expression can't be parsed
+ExprLutData *exprLutCreate(const std::string &expr, int numInputs);
+// Evaluates the rows [ystart, yend) of a table with xrange entries per row, y is always 0 for single input expressions
+// Safe to call from several threads at once as long as the rows don't overlap
+void exprLutEvaluate(const ExprLutData *d, float *dst, int xrange, int ystart, int yend);
+void exprLutFree(ExprLutData *d);
+
+#endif // EXPRFILTER_H
@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "filemapping.h"
+#include <algorithm>
+#ifdef VS_TARGET_OS_WINDOWS
+#    define WIN32_LEAN_AND_MEAN
+#    ifndef NOMINMAX
+#        define NOMINMAX
+#    endif
+#    include <windows.h>
+#    include <locale>
+#    include <codecvt>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/file.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+MappedFileView::~MappedFileView() {
+#ifdef VS_TARGET_OS_WINDOWS
+    UnmapViewOfFile(ptr);
+#else
+    munmap(ptr, length);
+#endif
+}
+
+#ifdef VS_TARGET_OS_WINDOWS
+
+// PrefetchVirtualMemory() only exists on windows 8 and later so it has to be looked up
+struct VSMemoryRangeEntry {
+    void *VirtualAddress;
+    SIZE_T NumberOfBytes;
+};
+
+typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE hProcess, ULONG_PTR NumberOfEntries, VSMemoryRangeEntry *VirtualAddresses, ULONG Flags);
+
+void MappedFileView::adviseSequential() const {
+}
+
+void MappedFileView::willNeed(size_t offset, size_t size) const {
+    static PrefetchVirtualMemoryFunc prefetch = reinterpret_cast<PrefetchVirtualMemoryFunc>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+    if (!prefetch || offset >= length)
+        return;
+    VSMemoryRangeEntry range = { ptr + offset, std::min(size, length - offset) };
+    prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
+MappedFile::MappedFile() : handle(INVALID_HANDLE_VALUE), writable(false) {
+}
+
+bool MappedFile::open(const std::string &filename, bool writable) {
+    close();
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    handle = CreateFileW(conversion.from_bytes(filename).c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    this->writable = writable;
+    return isOpen();
+}
+
+void MappedFile::close() {
+    if (isOpen())
+        CloseHandle(handle);
+    handle = INVALID_HANDLE_VALUE;
+}
+
+bool MappedFile::isOpen() const {
+    return handle != INVALID_HANDLE_VALUE;
+}
+
+bool MappedFile::tryLock() {
+    OVERLAPPED ov = {};
+    return !!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, MAXDWORD, MAXDWORD, &ov);
+}
+
+int64_t MappedFile::getSize() {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size))
+        return -1;
+    return size.QuadPart;
+}
+
+bool MappedFile::resize(int64_t size) {
+    LARGE_INTEGER pos;
+    pos.QuadPart = size;
+    return SetFilePointerEx(handle, pos, nullptr, FILE_BEGIN) && SetEndOfFile(handle);
+}
+
+std::shared_ptr<MappedFileView> MappedFile::map(int64_t size) {
+    if (size <= 0 || static_cast<uint64_t>(size) > SIZE_MAX)
+        return nullptr;
+    HANDLE mapping = CreateFileMappingW(handle, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+    if (!mapping)
+        return nullptr;
+    // the view keeps the mapping object alive by itself
+    void *ptr = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size));
+    CloseHandle(mapping);
+    if (!ptr)
+        return nullptr;
+    return std::shared_ptr<MappedFileView>(new MappedFileView(static_cast<uint8_t *>(ptr), static_cast<size_t>(size)));
+}
+
+#else
+
+void MappedFileView::adviseSequential() const {
+    madvise(ptr, length, MADV_SEQUENTIAL);
+}
+
+void MappedFileView::willNeed(size_t offset, size_t size) const {
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    if (offset >= length)
+        return;
+    size = std::min(size, length - offset);
+    // madvise() only accepts page aligned addresses
+    size_t start = offset & ~(pageSize - 1);
+    madvise(ptr + start, size + (offset - start), MADV_WILLNEED);
+}
+
+MappedFile::MappedFile() : fd(-1), writable(false) {
+}
+
+bool MappedFile::open(const std::string &filename, bool writable) {
+    close();
+    fd = ::open(filename.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    this->writable = writable;
+    return isOpen();
+}
+
+void MappedFile::close() {
+    if (isOpen())
+        ::close(fd);
+    fd = -1;
+}
+
+bool MappedFile::isOpen() const {
+    return fd >= 0;
+}
+
+bool MappedFile::tryLock() {
+    return !flock(fd, LOCK_EX | LOCK_NB);
+}
+
+int64_t MappedFile::getSize() {
+    struct stat st;
+    if (fstat(fd, &st))
+        return -1;
+    return st.st_size;
+}
+
+bool MappedFile::resize(int64_t size) {
+    return !ftruncate(fd, size);
+}
+
+std::shared_ptr<MappedFileView> MappedFile::map(int64_t size) {
+    if (size <= 0 || static_cast<uint64_t>(size) > SIZE_MAX)
+        return nullptr;
+    void *ptr = mmap(nullptr, static_cast<size_t>(size), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+        return nullptr;
+    return std::shared_ptr<MappedFileView>(new MappedFileView(static_cast<uint8_t *>(ptr), static_cast<size_t>(size)));
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
@@ -0,0 +1,75 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef FILEMAPPING_H
+#define FILEMAPPING_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// A view of the start of a file mapped into memory. It stays valid until the last
+// reference is gone, even if the file is closed or grown and mapped again.
+class MappedFileView {
+private:
+    uint8_t *ptr;
+    size_t length;
+    MappedFileView(uint8_t *ptr, size_t length) : ptr(ptr), length(length) {}
+    friend class MappedFile;
+public:
+    ~MappedFileView();
+    uint8_t *data() const {
+        return ptr;
+    }
+    size_t size() const {
+        return length;
+    }
+    // tells the system the view will mostly be read from front to back so it can read ahead more aggressively
+    void adviseSequential() const;
+    // starts reading a range in the background so it's already in memory when it's accessed
+    void willNeed(size_t offset, size_t size) const;
+};
+
+class MappedFile {
+private:
+#ifdef VS_TARGET_OS_WINDOWS
+    void *handle;
+#else
+    int fd;
+#endif
+    bool writable;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+public:
+    MappedFile();
+    ~MappedFile();
+    // writable files are created if they don't exist
+    bool open(const std::string &filename, bool writable);
+    void close();
+    bool isOpen() const;
+    // takes an exclusive lock on the whole file that's released when it's closed, fails if someone else holds it
+    bool tryLock();
+    int64_t getSize();
+    bool resize(int64_t size);
+    // maps the first size bytes, writes through a view of a writable file end up in the file
+    std::shared_ptr<MappedFileView> map(int64_t size);
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include "VSHelper.h"
 #include "filtershared.h"
 #include "filtersharedcpp.h"
+#include "exprfilter.h"
 
 #include <cstdlib>
 #include <cstdio>
@@ -30,6 +31,57 @@
 #include <limits>
 #include <string>
 #include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////
+// Shared
+
+static ExprLutData *getExprArg(const VSMap *in, const char *filterName, int numInputs, std::string &errstr, const VSAPI *vsapi) {
+    int err;
+    const char *expr = vsapi->propGetData(in, "expr", 0, &err);
+    if (err)
+        return nullptr;
+
+    try {
+        return exprLutCreate(expr, numInputs);
+    } catch (std::runtime_error &e) {
+        errstr = std::string(filterName) + ": " + e.what();
+        return nullptr;
+    }
+}
+
+// Integer results are rounded and clamped the same way Expr does it
+template<typename T>
+static void exprToLut(const ExprLutData *expr, int nxin, int nyin, int nout, void *vlut, int numThreads) {
+    std::vector<float> values(nxin * nyin);
+
+    // small tables are faster to evaluate than it is to start a thread
+    if (nxin * nyin < (1 << 16))
+        numThreads = 1;
+    numThreads = std::max(1, std::min(numThreads, nyin));
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        int ystart = (nyin * i) / numThreads;
+        int yend = (nyin * (i + 1)) / numThreads;
+        threads.emplace_back(exprLutEvaluate, expr, values.data() + ystart * nxin, nxin, ystart, yend);
+    }
+    exprLutEvaluate(expr, values.data(), nxin, 0, nyin / numThreads);
+    for (auto &iter : threads)
+        iter.join();
+
+    T *lut = reinterpret_cast<T *>(vlut);
+    const float maxval = static_cast<float>(nout - 1);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        if (std::numeric_limits<T>::is_integer)
+            lut[i] = static_cast<T>(std::max(0.0f, std::min(values[i], maxval)) + 0.5f);
+        else
+            lut[i] = static_cast<T>(values[i]);
+    }
+}
 
 //////////////////////////////////////////
 // Lut
@@ -58,12 +110,13 @@ static const VSFrameRef *VS_CC lutGetframe(int n, int activationReason, void **i
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrameRef *src = vsapi->getFrameFilter(n, d->node, frameCtx);
-        const VSFormat *fi = vsapi->getFrameFormat(src);
+        // the output format differs from the input when bits or floatout is set, like in Lut2
+        const VSFormat *fi = d->vi_out.format;
         const int pl[] = {0, 1, 2};
         const VSFrameRef *fr[] = {d->process[0] ? 0 : src, d->process[1] ? 0 : src, d->process[2] ? 0 : src};
         VSFrameRef *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        T maxval = static_cast<T>((static_cast<int64_t>(1) << fi->bitsPerSample) - 1);
+        T maxval = static_cast<T>((static_cast<int64_t>(1) << d->vi->format->bitsPerSample) - 1);
 
         for (int plane = 0; plane < fi->numPlanes; plane++) {
 
@@ -148,13 +201,16 @@ bool funcToLut(int nin, int nout, void *vlut, VSFuncRef *func, const VSAPI *vsap
 }
 
 template<typename T, typename U>
-static void lutCreateHelper(const VSMap *in, VSMap *out, VSFuncRef *func, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
+static void lutCreateHelper(const VSMap *in, VSMap *out, VSFuncRef *func, ExprLutData *expr, std::unique_ptr<LutData> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = 1 << d->vi->format->bitsPerSample;
     int maxval = 1 << d->vi_out.format->bitsPerSample;
 
     d->lut = malloc(inrange * sizeof(U));
 
-    if (func) {
+    if (expr) {
+        exprToLut<U>(expr, inrange, 1, maxval, d->lut, 1);
+        exprLutFree(expr);
+    } else if (func) {
         std::string errstr;
         funcToLut<U>(inrange, maxval, d->lut, func, vsapi, errstr);
         vsapi->freeFunc(func);
@@ -216,17 +272,18 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     VSFuncRef *func = vsapi->propGetFunc(in, "function", 0, &err);
     int lut_elem = vsapi->propNumElements(in, "lut");
     int lutf_elem = vsapi->propNumElements(in, "lutf");
+    int expr_elem = vsapi->propNumElements(in, "expr");
 
-    int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+    int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + (expr_elem >= 0) + !!func;
 
     if (!num_set) {
         vsapi->freeFunc(func);
-        RETERROR("Lut: none of lut, lutf and function are set");
+        RETERROR("Lut: none of lut, lutf, expr and function are set");
     }
 
     if (num_set > 1) {
         vsapi->freeFunc(func);
-        RETERROR("Lut: more than one of lut, lutf and function are set");
+        RETERROR("Lut: more than one of lut, lutf, expr and function are set");
     }
 
     if (lut_elem >= 0 && floatout) {
@@ -248,20 +305,28 @@ static void VS_CC lutCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         RETERROR(("Lut: bad lut length. Expected " + std::to_string(n) + " elements, got " + std::to_string(lut_length) + " instead").c_str());
     }
 
+    // parsed last so nothing but func has to be freed on the error paths above
+    std::string errstr;
+    ExprLutData *expr = getExprArg(in, "Lut", 1, errstr, vsapi);
+    if (!errstr.empty()) {
+        vsapi->freeFunc(func);
+        RETERROR(errstr.c_str());
+    }
+
     d->vi_out.format = vsapi->registerFormat(d->vi->format->colorFamily, floatout ? stFloat : stInteger, bitsout, d->vi->format->subSamplingW, d->vi->format->subSamplingH, core);
 
     if (d->vi->format->bytesPerSample == 1 && bitsout == 8)
-        lutCreateHelper<uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
     else if (d->vi->format->bytesPerSample == 1 && bitsout > 8 && bitsout <= 16)
-        lutCreateHelper<uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
     else if (d->vi->format->bytesPerSample == 1 && floatout)
-        lutCreateHelper<uint8_t, float>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint8_t, float>(in, out, func, expr, d, core, vsapi);
     else if (d->vi->format->bytesPerSample == 2 && bitsout == 8)
-        lutCreateHelper<uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
     else if (d->vi->format->bytesPerSample == 2 && bitsout > 8 && bitsout <= 16)
-        lutCreateHelper<uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
     else if (d->vi->format->bytesPerSample == 2 && floatout)
-        lutCreateHelper<uint16_t, float>(in, out, func, d, core, vsapi);
+        lutCreateHelper<uint16_t, float>(in, out, func, expr, d, core, vsapi);
 }
 
 //////////////////////////////////////////
@@ -394,13 +459,16 @@ bool funcToLut2(int nxin, int nyin, int nout, void *vlut, VSFuncRef *func, const
 }
 
 template<typename T, typename U, typename V>
-static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFuncRef *func, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
+static void lut2CreateHelper(const VSMap *in, VSMap *out, VSFuncRef *func, ExprLutData *expr, std::unique_ptr<Lut2Data> &d, VSCore *core, const VSAPI *vsapi) {
     int inrange = (1 << d->vi[0]->format->bitsPerSample) * (1 << d->vi[1]->format->bitsPerSample);
     int maxval = 1 << d->vi_out.format->bitsPerSample;
 
     d->lut = malloc(inrange * sizeof(V));
 
-    if (func) {
+    if (expr) {
+        exprToLut<V>(expr, 1 << d->vi[0]->format->bitsPerSample, 1 << d->vi[1]->format->bitsPerSample, maxval, d->lut, vsapi->getCoreInfo(core)->numThreads);
+        exprLutFree(expr);
+    } else if (func) {
         std::string errstr;
         funcToLut2<V>(1 << d->vi[0]->format->bitsPerSample, 1 << d->vi[1]->format->bitsPerSample, maxval, d->lut, func, vsapi, errstr);
         vsapi->freeFunc(func);
@@ -460,18 +528,19 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
     VSFuncRef *func = vsapi->propGetFunc(in, "function", 0, &err);
     int lut_elem = vsapi->propNumElements(in, "lut");
     int lutf_elem = vsapi->propNumElements(in, "lutf");
+    int expr_elem = vsapi->propNumElements(in, "expr");
     bool floatout = !!vsapi->propGetInt(in, "floatout", 0, &err);
 
-    int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + !!func;
+    int num_set = (lut_elem >= 0) + (lutf_elem >= 0) + (expr_elem >= 0) + !!func;
 
     if (!num_set) {
         vsapi->freeFunc(func);
-        RETERROR("Lut2: none of lut, lutf and function are set");
+        RETERROR("Lut2: none of lut, lutf, expr and function are set");
     }
 
     if (num_set > 1) {
         vsapi->freeFunc(func);
-        RETERROR("Lut2: more than one of lut, lutf and function are set");
+        RETERROR("Lut2: more than one of lut, lutf, expr and function are set");
     }
 
     if (lut_elem >= 0 && floatout) {
@@ -501,6 +570,13 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
         RETERROR("Lut2: only 8-16 bit integer and 32 bit float output supported");
     }
 
+    std::string errstr;
+    ExprLutData *expr = getExprArg(in, "Lut2", 2, errstr, vsapi);
+    if (!errstr.empty()) {
+        vsapi->freeFunc(func);
+        RETERROR(errstr.c_str());
+    }
+
     d->vi_out = *d->vi[0];
     d->vi_out.format = vsapi->registerFormat(d->vi[0]->format->colorFamily, floatout ? stFloat : stInteger, bitsout, d->vi[0]->format->subSamplingW, d->vi[0]->format->subSamplingH, core);
 
@@ -508,34 +584,34 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
     if (d->vi[0]->format->bytesPerSample == 1) {
         if (d->vi[1]->format->bytesPerSample == 1) {
             if (d->vi_out.format->bytesPerSample == 1 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bytesPerSample == 2 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bitsPerSample == 32 && d->vi_out.format->sampleType == stFloat)
-                lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
         } else if (d->vi[1]->format->bytesPerSample == 2) {
             if (d->vi_out.format->bytesPerSample == 1 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bytesPerSample == 2 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bitsPerSample == 32 && d->vi_out.format->sampleType == stFloat)
-                lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint8_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
         }
     } else if (d->vi[0]->format->bytesPerSample == 2) {
         if (d->vi[1]->format->bytesPerSample == 1) {
             if (d->vi_out.format->bytesPerSample == 1 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint8_t, uint8_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bytesPerSample == 2 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint8_t, uint16_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bitsPerSample == 32 && d->vi_out.format->sampleType == stFloat)
-                lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint8_t, float>(in, out, func, expr, d, core, vsapi);
         } else if (d->vi[1]->format->bytesPerSample == 2) {
             if (d->vi_out.format->bytesPerSample == 1 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint16_t, uint8_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bytesPerSample == 2 && d->vi_out.format->sampleType == stInteger)
-                lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint16_t, uint16_t>(in, out, func, expr, d, core, vsapi);
             else if (d->vi_out.format->bitsPerSample == 32 && d->vi_out.format->sampleType == stFloat)
-                lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, d, core, vsapi);
+                lut2CreateHelper<uint16_t, uint16_t, float>(in, out, func, expr, d, core, vsapi);
         }
     }
 }
@@ -545,6 +621,6 @@ static void VS_CC lut2Create(const VSMap *in, VSMap *out, void *userData, VSCore
 
 void VS_CC lutInitialize(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
     //configFunc("com.vapoursynth.std", "std", "VapourSynth Core Functions", VAPOURSYNTH_API_VERSION, 1, plugin);
-    registerFunc("Lut", "clip:clip;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", lutCreate, 0, plugin);
-    registerFunc("Lut2", "clipa:clip;clipb:clip;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;bits:int:opt;floatout:int:opt;", lut2Create, 0, plugin);
+    registerFunc("Lut", "clip:clip;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;expr:data:opt;bits:int:opt;floatout:int:opt;", lutCreate, 0, plugin);
+    registerFunc("Lut2", "clipa:clip;clipb:clip;planes:int[]:opt;lut:int[]:opt;lutf:float[]:opt;function:func:opt;expr:data:opt;bits:int:opt;floatout:int:opt;", lut2Create, 0, plugin);
 }
@@ -0,0 +1,248 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "plugincache.h"
+#include "version.h"
+#include "VapourSynth.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef VS_TARGET_OS_WINDOWS
+#    define WIN32_LEAN_AND_MEAN
+#    ifndef NOMINMAX
+#        define NOMINMAX
+#    endif
+#    include <windows.h>
+#    include <direct.h>
+#    include <locale>
+#    include <codecvt>
+#else
+#    include <unistd.h>
+#endif
+
+// The format is one tab separated record per line. A P line describes a plugin
+// and is followed by one F line per function it registered.
+//  P <path> <mtime> <size> <filename> <id> <namespace> <name> <api major> <api minor>
+//  F <function name> <argument string>
+static const char *cacheHeader = "VapourSynthPluginCache";
+static const int cacheFormatVersion = 1;
+
+#ifdef VS_TARGET_OS_WINDOWS
+static std::wstring toWide(const std::string &s) {
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    return conversion.from_bytes(s);
+}
+#endif
+
+static FILE *openCacheFile(const std::string &filename, const char *mode) {
+#ifdef VS_TARGET_OS_WINDOWS
+    return _wfopen(toWide(filename).c_str(), toWide(mode).c_str());
+#else
+    return fopen(filename.c_str(), mode);
+#endif
+}
+
+static void createParentDirs(const std::string &filename) {
+    for (size_t pos = filename.find_first_of("/\\", 1); pos != std::string::npos; pos = filename.find_first_of("/\\", pos + 1)) {
+        std::string dir = filename.substr(0, pos);
+#ifdef VS_TARGET_OS_WINDOWS
+        _wmkdir(toWide(dir).c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+}
+
+static std::vector<std::string> splitFields(const std::string &line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t pos = line.find('\t', start);
+        fields.push_back(line.substr(start, pos - start));
+        if (pos == std::string::npos)
+            break;
+        start = pos + 1;
+    }
+    return fields;
+}
+
+static bool isStorable(const std::string &s) {
+    return s.find_first_of("\t\r\n") == std::string::npos;
+}
+
+bool getPluginFileInfo(const std::string &filename, int64_t &mtime, int64_t &size) {
+    // use the full timestamp resolution so replacing a file right after it was cached is still noticed
+#ifdef VS_TARGET_OS_WINDOWS
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(toWide(filename).c_str(), GetFileExInfoStandard, &data))
+        return false;
+    mtime = static_cast<int64_t>((static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime);
+    size = static_cast<int64_t>((static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow);
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st))
+        return false;
+#ifdef VS_TARGET_OS_DARWIN
+    mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    size = static_cast<int64_t>(st.st_size);
+#endif
+    return true;
+}
+
+PluginCache::PluginCache(const std::string &path) : path(path), dirty(false) {
+    load();
+}
+
+void PluginCache::load() {
+    FILE *f = openCacheFile(path, "rb");
+    if (!f)
+        return;
+
+    std::string data;
+    char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, read);
+    fclose(f);
+
+    std::vector<std::string> lines;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = data.find('\n', start)) != std::string::npos) {
+        lines.push_back(data.substr(start, pos - start));
+        start = pos + 1;
+    }
+
+    // anything unexpected invalidates the whole cache, it's rewritten at the end anyway
+    dirty = true;
+    if (lines.empty())
+        return;
+
+    std::vector<std::string> header = splitFields(lines[0]);
+    if (header.size() != 4 || header[0] != cacheHeader || header[1] != std::to_string(cacheFormatVersion)
+        || header[2] != std::to_string(VAPOURSYNTH_CORE_VERSION) || header[3] != std::to_string(VAPOURSYNTH_API_VERSION))
+        return;
+
+    std::map<std::string, PluginCacheEntry> newEntries;
+    PluginCacheEntry *current = nullptr;
+
+    try {
+        for (size_t i = 1; i < lines.size(); i++) {
+            std::vector<std::string> fields = splitFields(lines[i]);
+            if (fields[0] == "P" && fields.size() == 10) {
+                PluginCacheEntry &e = newEntries[fields[1]];
+                e.mtime = std::stoll(fields[2]);
+                e.size = std::stoll(fields[3]);
+                e.filename = fields[4];
+                e.id = fields[5];
+                e.fnamespace = fields[6];
+                e.fullname = fields[7];
+                e.apiMajor = std::stoi(fields[8]);
+                e.apiMinor = std::stoi(fields[9]);
+                current = &e;
+            } else if (fields[0] == "F" && fields.size() == 3 && current) {
+                current->functions.push_back(std::make_pair(fields[1], fields[2]));
+            } else {
+                return;
+            }
+        }
+    } catch (std::exception &) {
+        return;
+    }
+
+    entries.swap(newEntries);
+    dirty = false;
+}
+
+const PluginCacheEntry *PluginCache::find(const std::string &filename, int64_t mtime, int64_t size) {
+    auto iter = entries.find(filename);
+    if (iter == entries.end() || iter->second.mtime != mtime || iter->second.size != size)
+        return nullptr;
+    used.insert(filename);
+    return &iter->second;
+}
+
+void PluginCache::update(const std::string &filename, const PluginCacheEntry &entry) {
+    if (!isStorable(filename) || !isStorable(entry.filename) || !isStorable(entry.id) || !isStorable(entry.fnamespace) || !isStorable(entry.fullname))
+        return remove(filename);
+    for (const auto &iter : entry.functions)
+        if (!isStorable(iter.first) || !isStorable(iter.second))
+            return remove(filename);
+    entries[filename] = entry;
+    used.insert(filename);
+    dirty = true;
+}
+
+void PluginCache::remove(const std::string &filename) {
+    if (entries.erase(filename))
+        dirty = true;
+    used.erase(filename);
+}
+
+void PluginCache::save() {
+    if (!dirty && used.size() == entries.size())
+        return;
+
+    std::string data;
+    data.append(cacheHeader).append("\t").append(std::to_string(cacheFormatVersion)).append("\t").append(std::to_string(VAPOURSYNTH_CORE_VERSION)).append("\t").append(std::to_string(VAPOURSYNTH_API_VERSION)).append("\n");
+    for (const auto &iter : entries) {
+        if (!used.count(iter.first))
+            continue;
+        const PluginCacheEntry &e = iter.second;
+        data.append("P\t").append(iter.first).append("\t").append(std::to_string(e.mtime)).append("\t").append(std::to_string(e.size)).append("\t");
+        data.append(e.filename).append("\t").append(e.id).append("\t").append(e.fnamespace).append("\t").append(e.fullname).append("\t");
+        data.append(std::to_string(e.apiMajor)).append("\t").append(std::to_string(e.apiMinor)).append("\n");
+        for (const auto &func : e.functions)
+            data.append("F\t").append(func.first).append("\t").append(func.second).append("\n");
+    }
+
+    // write to a temporary file and move it into place so other processes never see a partial cache
+    // several cores may be created at the same time in one process so the process id alone isn't unique
+    static std::atomic<int> tmpCounter(0);
+#ifdef VS_TARGET_OS_WINDOWS
+    std::string tmpPath = path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(++tmpCounter) + ".tmp";
+#else
+    std::string tmpPath = path + "." + std::to_string(getpid()) + "." + std::to_string(++tmpCounter) + ".tmp";
+#endif
+    FILE *f = openCacheFile(tmpPath, "wb");
+    if (!f) {
+        createParentDirs(path);
+        f = openCacheFile(tmpPath, "wb");
+    }
+    if (!f)
+        return;
+
+    bool ok = (fwrite(data.data(), 1, data.size(), f) == data.size());
+    ok = !fclose(f) && ok;
+
+#ifdef VS_TARGET_OS_WINDOWS
+    if (!ok || !MoveFileExW(toWide(tmpPath).c_str(), toWide(path).c_str(), MOVEFILE_REPLACE_EXISTING))
+        _wremove(toWide(tmpPath).c_str());
+#else
+    if (!ok || rename(tmpPath.c_str(), path.c_str()))
+        ::remove(tmpPath.c_str());
+#endif
+    dirty = false;
+}
@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef PLUGINCACHE_H
+#define PLUGINCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Everything needed to expose an autoloaded plugin and its functions without
+// loading the library. Entries are only valid as long as the file's
+// modification time and size match.
+struct PluginCacheEntry {
+    int64_t mtime;
+    int64_t size;
+    std::string filename;
+    std::string id;
+    std::string fnamespace;
+    std::string fullname;
+    int apiMajor;
+    int apiMinor;
+    std::vector<std::pair<std::string, std::string>> functions;
+
+    PluginCacheEntry() : mtime(0), size(0), apiMajor(0), apiMinor(0) {}
+};
+
+class PluginCache {
+private:
+    std::string path;
+    std::map<std::string, PluginCacheEntry> entries;
+    std::set<std::string> used;
+    bool dirty;
+    void load();
+public:
+    explicit PluginCache(const std::string &path);
+    const PluginCacheEntry *find(const std::string &filename, int64_t mtime, int64_t size);
+    void update(const std::string &filename, const PluginCacheEntry &entry);
+    void remove(const std::string &filename);
+    // writes the cache back if anything changed, entries that weren't looked up are dropped
+    void save();
+};
+
+bool getPluginFileInfo(const std::string &filename, int64_t &mtime, int64_t &size);
+
+#endif
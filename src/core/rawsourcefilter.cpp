@@ -0,0 +1,356 @@
+/*
+* Copyright (c) 2012-2017 Fredrik Mellbin
+*
+* This file is part of VapourSynth.
+*
+* VapourSynth is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* VapourSynth is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with VapourSynth; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "vscore.h"
+#include "filemapping.h"
+#include "internalfilters.h"
+#include "VSHelper.h"
+#include <sstream>
+#include <climits>
+
+namespace {
+
+struct RawSourceData {
+    VSVideoInfo vi;
+    std::shared_ptr<MappedFileView> view;
+    // where the planes of every frame start, raw files and y4m files without frame parameters
+    // have frames at a fixed distance so only the first one and the step are needed then
+    std::vector<int64_t> frameOffsets;
+    int64_t firstFrame;
+    int64_t frameStep;
+    // the frame header is checked when it's only assumed to be there
+    int64_t simpleFrameHeaderSize;
+    int64_t frameSize;
+    int64_t planeOffset[3];
+    int rowSize[3];
+    int fieldBased;
+    int sarNum;
+    int sarDen;
+    int colorRange;
+
+    RawSourceData() : vi(), firstFrame(0), frameStep(0), simpleFrameHeaderSize(0), frameSize(0), planeOffset(), rowSize(), fieldBased(-1), sarNum(0), sarDen(0), colorRange(-1) {}
+
+    int64_t getFrameOffset(int n) const {
+        return frameOffsets.empty() ? firstFrame + n * frameStep : frameOffsets[n];
+    }
+};
+
+} // namespace
+
+static const char y4mMagic[] = "YUV4MPEG2 ";
+static const char y4mFrameMagic[] = "FRAME";
+static const char y4mSimpleFrameHeader[] = "FRAME\n";
+
+static bool parseRatio(const std::string &s, int &num, int &den) {
+    return sscanf(s.c_str(), "%d:%d", &num, &den) == 2;
+}
+
+static const VSFormat *parseY4MColorspace(const std::string &cs, VSCore *core, const VSAPI *vsapi) {
+    int colorFamily = cmYUV;
+    int subSamplingW;
+    int subSamplingH;
+    std::string depth;
+
+    if (!cs.compare(0, 4, "mono")) {
+        colorFamily = cmGray;
+        subSamplingW = 0;
+        subSamplingH = 0;
+        depth = cs.substr(4);
+    } else {
+        std::string ss = cs.substr(0, 3);
+        if (ss == "420") {
+            subSamplingW = 1;
+            subSamplingH = 1;
+        } else if (ss == "422") {
+            subSamplingW = 1;
+            subSamplingH = 0;
+        } else if (ss == "444") {
+            subSamplingW = 0;
+            subSamplingH = 0;
+        } else if (ss == "410") {
+            subSamplingW = 2;
+            subSamplingH = 2;
+        } else if (ss == "411") {
+            subSamplingW = 2;
+            subSamplingH = 0;
+        } else if (ss == "440") {
+            subSamplingW = 0;
+            subSamplingH = 1;
+        } else {
+            return nullptr;
+        }
+        depth = cs.substr(3);
+        // the chroma siting variants of 420 are all stored the same way
+        if (depth == "jpeg" || depth == "paldv" || depth == "mpeg2")
+            depth.clear();
+        else if (!depth.empty() && depth[0] == 'p')
+            depth = depth.substr(1);
+        else if (!depth.empty())
+            return nullptr;
+    }
+
+    int sampleType = stInteger;
+    int bits = 8;
+    if (depth == "h" || depth == "s" || depth == "d") {
+        sampleType = stFloat;
+        bits = (depth == "h") ? 16 : ((depth == "s") ? 32 : 64);
+    } else if (!depth.empty()) {
+        bits = atoi(depth.c_str());
+        if (bits < 8 || bits > 32)
+            return nullptr;
+    }
+
+    return vsapi->registerFormat(colorFamily, sampleType, bits, subSamplingW, subSamplingH, core);
+}
+
+static void parseY4MHeader(RawSourceData *d, VSCore *core, const VSAPI *vsapi) {
+    const char *data = reinterpret_cast<const char *>(d->view->data());
+    size_t size = d->view->size();
+    const void *end = memchr(data, '\n', size);
+    if (!end)
+        throw std::string("y4m header isn't terminated");
+
+    std::istringstream header(std::string(data + sizeof(y4mMagic) - 1, static_cast<const char *>(end)));
+    std::string colorspace = "420";
+    std::string tag;
+    while (header >> tag) {
+        std::string value = tag.substr(1);
+        switch (tag[0]) {
+        case 'W':
+            d->vi.width = atoi(value.c_str());
+            break;
+        case 'H':
+            d->vi.height = atoi(value.c_str());
+            break;
+        case 'F': {
+            int num, den;
+            if (!parseRatio(value, num, den) || num <= 0 || den <= 0)
+                throw std::string("invalid y4m frame rate");
+            d->vi.fpsNum = num;
+            d->vi.fpsDen = den;
+            break;
+        }
+        case 'I':
+            if (value == "p")
+                d->fieldBased = 0;
+            else if (value == "b")
+                d->fieldBased = 1;
+            else if (value == "t")
+                d->fieldBased = 2;
+            break;
+        case 'A':
+            if (!parseRatio(value, d->sarNum, d->sarDen) || d->sarNum <= 0 || d->sarDen <= 0)
+                d->sarNum = d->sarDen = 0;
+            break;
+        case 'C':
+            colorspace = value;
+            break;
+        case 'X':
+            if (value == "COLORRANGE=FULL")
+                d->colorRange = 0;
+            else if (value == "COLORRANGE=LIMITED")
+                d->colorRange = 1;
+            break;
+        }
+    }
+
+    d->vi.format = parseY4MColorspace(colorspace, core, vsapi);
+    if (!d->vi.format)
+        throw std::string("unsupported y4m colorspace ") + colorspace;
+
+    d->firstFrame = static_cast<const char *>(end) - data + 1;
+}
+
+// frame headers normally have no parameters and then every frame is at the same distance from the previous,
+// otherwise all of them have to be found first
+static void findY4MFrames(RawSourceData *d) {
+    const char *data = reinterpret_cast<const char *>(d->view->data());
+    int64_t size = static_cast<int64_t>(d->view->size());
+    const int64_t simpleHeaderSize = sizeof(y4mSimpleFrameHeader) - 1;
+
+    if (d->firstFrame + simpleHeaderSize <= size && !memcmp(data + d->firstFrame, y4mSimpleFrameHeader, simpleHeaderSize)) {
+        d->frameStep = simpleHeaderSize + d->frameSize;
+        d->vi.numFrames = static_cast<int>(std::min<int64_t>((size - d->firstFrame) / d->frameStep, INT_MAX));
+        d->firstFrame += simpleHeaderSize;
+        d->simpleFrameHeaderSize = simpleHeaderSize;
+        return;
+    }
+
+    int64_t pos = d->firstFrame;
+    while (pos + simpleHeaderSize <= size && d->frameOffsets.size() < INT_MAX) {
+        if (memcmp(data + pos, y4mFrameMagic, sizeof(y4mFrameMagic) - 1))
+            throw std::string("y4m frame header not found");
+        const void *end = memchr(data + pos, '\n', static_cast<size_t>(size - pos));
+        if (!end)
+            break;
+        int64_t frameStart = static_cast<const char *>(end) - data + 1;
+        if (frameStart + d->frameSize > size)
+            break;
+        d->frameOffsets.push_back(frameStart);
+        pos = frameStart + d->frameSize;
+    }
+    d->vi.numFrames = static_cast<int>(d->frameOffsets.size());
+}
+
+static void VS_CC rawSourceInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    RawSourceData *d = static_cast<RawSourceData *>(*instanceData);
+    vsapi->setVideoInfo(&d->vi, 1, node);
+}
+
+static const VSFrameRef *VS_CC rawSourceGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    RawSourceData *d = static_cast<RawSourceData *>(*instanceData);
+
+    if (activationReason != arInitial)
+        return nullptr;
+
+    int64_t offset = d->getFrameOffset(n);
+    const VSFormat *fi = d->vi.format;
+
+    if (d->simpleFrameHeaderSize && memcmp(d->view->data() + offset - d->simpleFrameHeaderSize, y4mSimpleFrameHeader, d->simpleFrameHeaderSize)) {
+        vsapi->setFilterError("RawSource: y4m frame header not found, frames with parameters in their headers are only supported when the first frame has them too", frameCtx);
+        return nullptr;
+    }
+
+    // usually the next frame is wanted soon after so get the reading started
+    if (n + 1 < d->vi.numFrames)
+        d->view->willNeed(static_cast<size_t>(d->getFrameOffset(n + 1)), static_cast<size_t>(d->frameSize));
+
+    const uint8_t *planes[3] = {};
+    for (int p = 0; p < fi->numPlanes; p++)
+        planes[p] = d->view->data() + offset + d->planeOffset[p];
+
+    VSFrameRef *dst;
+    // when the rows happen to be aligned like the core's own frames the data can be used directly from the mapping
+    if (VSFrame::canWrapPlanes(fi, d->vi.width, planes, d->rowSize)) {
+        dst = new VSFrameRef(std::make_shared<VSFrame>(fi, d->vi.width, d->vi.height, planes, d->view, nullptr, core));
+    } else {
+        dst = vsapi->newVideoFrame(fi, d->vi.width, d->vi.height, nullptr, core);
+        for (int p = 0; p < fi->numPlanes; p++)
+            vs_bitblt(vsapi->getWritePtr(dst, p), vsapi->getStride(dst, p), planes[p], d->rowSize[p], d->rowSize[p], vsapi->getFrameHeight(dst, p));
+    }
+
+    VSMap *props = vsapi->getFramePropsRW(dst);
+    vsapi->propSetInt(props, "_DurationNum", d->vi.fpsDen, paReplace);
+    vsapi->propSetInt(props, "_DurationDen", d->vi.fpsNum, paReplace);
+    if (d->fieldBased >= 0)
+        vsapi->propSetInt(props, "_FieldBased", d->fieldBased, paReplace);
+    if (d->sarNum > 0) {
+        vsapi->propSetInt(props, "_SARNum", d->sarNum, paReplace);
+        vsapi->propSetInt(props, "_SARDen", d->sarDen, paReplace);
+    }
+    if (d->colorRange >= 0)
+        vsapi->propSetInt(props, "_ColorRange", d->colorRange, paReplace);
+
+    return dst;
+}
+
+static void VS_CC rawSourceFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    delete static_cast<RawSourceData *>(instanceData);
+}
+
+static void VS_CC rawSourceCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    std::unique_ptr<RawSourceData> d(new RawSourceData());
+    int err;
+
+    try {
+        std::string source = vsapi->propGetData(in, "source", 0, nullptr);
+
+        MappedFile file;
+        if (!file.open(source, false))
+            throw std::string("failed to open ") + source;
+        int64_t fileSize = file.getSize();
+        if (fileSize <= 0)
+            throw std::string("the file is empty");
+        d->view = file.map(fileSize);
+        if (!d->view)
+            throw std::string("failed to map the file into memory");
+        d->view->adviseSequential();
+
+        d->vi.fpsNum = 24;
+        d->vi.fpsDen = 1;
+        bool y4m = d->view->size() >= sizeof(y4mMagic) - 1 && !memcmp(d->view->data(), y4mMagic, sizeof(y4mMagic) - 1);
+
+        if (y4m) {
+            parseY4MHeader(d.get(), core, vsapi);
+        } else {
+            d->vi.width = int64ToIntS(vsapi->propGetInt(in, "width", 0, &err));
+            if (err)
+                throw std::string("width must be set for files that aren't y4m");
+            d->vi.height = int64ToIntS(vsapi->propGetInt(in, "height", 0, &err));
+            if (err)
+                throw std::string("height must be set for files that aren't y4m");
+            d->vi.format = vsapi->getFormatPreset(int64ToIntS(vsapi->propGetInt(in, "format", 0, &err)), core);
+            if (!d->vi.format)
+                throw std::string("a valid format must be set for files that aren't y4m");
+
+            int64_t fpsNum = vsapi->propGetInt(in, "fpsnum", 0, &err);
+            if (!err) {
+                int64_t fpsDen = vsapi->propGetInt(in, "fpsden", 0, &err);
+                if (err)
+                    fpsDen = 1;
+                if (fpsNum <= 0 || fpsDen <= 0)
+                    throw std::string("fpsnum and fpsden must be positive");
+                muldivRational(&fpsNum, &fpsDen, 1, 1);
+                d->vi.fpsNum = fpsNum;
+                d->vi.fpsDen = fpsDen;
+            }
+
+            d->firstFrame = vsapi->propGetInt(in, "offset", 0, &err);
+            if (d->firstFrame < 0 || d->firstFrame >= fileSize)
+                throw std::string("offset must be inside the file");
+        }
+
+        const VSFormat *fi = d->vi.format;
+        if (fi->id == pfCompatBGR32 || fi->id == pfCompatYUY2)
+            throw std::string("compat formats not supported");
+        if (d->vi.width <= 0 || d->vi.height <= 0)
+            throw std::string("invalid dimensions");
+        if (d->vi.width % (1 << fi->subSamplingW) || d->vi.height % (1 << fi->subSamplingH))
+            throw std::string("dimensions must be divisible by the subsampling");
+
+        // rgb planes are stored in the same gbr order vspipe writes them in
+        const int rgbRemap[] = { 1, 2, 0 };
+        for (int rp = 0; rp < fi->numPlanes; rp++) {
+            int p = (fi->colorFamily == cmRGB) ? rgbRemap[rp] : rp;
+            d->rowSize[p] = (d->vi.width >> (p ? fi->subSamplingW : 0)) * fi->bytesPerSample;
+            d->planeOffset[p] = d->frameSize;
+            d->frameSize += static_cast<int64_t>(d->rowSize[p]) * (d->vi.height >> (p ? fi->subSamplingH : 0));
+        }
+
+        if (y4m) {
+            findY4MFrames(d.get());
+        } else {
+            d->frameStep = d->frameSize;
+            d->vi.numFrames = static_cast<int>(std::min<int64_t>((fileSize - d->firstFrame) / d->frameSize, INT_MAX));
+        }
+
+        if (d->vi.numFrames <= 0)
+            throw std::string("the file doesn't contain a single complete frame");
+    } catch (std::string &error) {
+        vsapi->setError(out, ("RawSource: " + error).c_str());
+        return;
+    }
+
+    vsapi->createFilter(in, out, "RawSource", rawSourceInit, rawSourceGetFrame, rawSourceFree, fmParallel, 0, d.release(), core);
+}
+
+void VS_CC rawSourceInitialize(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
+    registerFunc("RawSource", "source:data;width:int:opt;height:int:opt;format:int:opt;fpsnum:int:opt;fpsden:int:opt;offset:int:opt;", rawSourceCreate, nullptr, plugin);
+}
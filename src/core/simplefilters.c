@@ -2007,10 +2007,10 @@ typedef struct {
     VSNodeRef *node1;
     VSNodeRef *node2;
     const VSVideoInfo *vi;
-    char *propAverage;
-    char *propMin;
-    char *propMax;
-    char *propDiff;
+    const VSMapKey *propAverage;
+    const VSMapKey *propMin;
+    const VSMapKey *propMax;
+    const VSMapKey *propDiff;
     int plane;
 } PlaneStatsData;
 
@@ -2374,11 +2374,11 @@ static const VSFrameRef *VS_CC planeStatsGetFrame(int n, int activationReason, v
         VSMap *dstProps = vsapi->getFramePropsRW(dst);
 
         if (fi->sampleType == stInteger) {
-            vsapi->propSetInt(dstProps, d->propMin, imin, paReplace);
-            vsapi->propSetInt(dstProps, d->propMax, imax, paReplace);
+            vsapi->propSetIntByKey(dstProps, d->propMin, imin, paReplace);
+            vsapi->propSetIntByKey(dstProps, d->propMax, imax, paReplace);
         } else {
-            vsapi->propSetFloat(dstProps, d->propMin, fmin, paReplace);
-            vsapi->propSetFloat(dstProps, d->propMax, fmax, paReplace);
+            vsapi->propSetFloatByKey(dstProps, d->propMin, fmin, paReplace);
+            vsapi->propSetFloatByKey(dstProps, d->propMax, fmax, paReplace);
         }
 
         double avg = 0.0;
@@ -2393,9 +2393,9 @@ static const VSFrameRef *VS_CC planeStatsGetFrame(int n, int activationReason, v
                 diff = fdiffacc / (double)((int64_t)width * height);
         }
         
-        vsapi->propSetFloat(dstProps, d->propAverage, avg, paReplace);
+        vsapi->propSetFloatByKey(dstProps, d->propAverage, avg, paReplace);
         if (d->node2)
-            vsapi->propSetFloat(dstProps, d->propDiff, diff, paReplace);
+            vsapi->propSetFloatByKey(dstProps, d->propDiff, diff, paReplace);
 
         vsapi->freeFrame(src1);
         vsapi->freeFrame(src2);
@@ -2408,10 +2408,6 @@ static void VS_CC planeStatsFree(void *instanceData, VSCore *core, const VSAPI *
     PlaneStatsData *d = (PlaneStatsData *)instanceData;
     vsapi->freeNode(d->node1);
     vsapi->freeNode(d->node2);
-    free(d->propAverage);
-    free(d->propMin);
-    free(d->propMax);
-    free(d->propDiff);
     free(d);
 }
 
@@ -2448,18 +2444,23 @@ static void VS_CC planeStatsCreate(const VSMap *in, VSMap *out, void *userData,
     if (err)
         tempprop = "PlaneStats";
     size_t l = strlen(tempprop);
-    d.propMin = malloc(l + 3 + 1);
-    d.propMax = malloc(l + 3 + 1);
-    d.propAverage = malloc(l + 7 + 1);
-    d.propDiff = malloc(l + 4 + 1);
-    strcpy(d.propMin, tempprop);
-    strcpy(d.propMax, tempprop);
-    strcpy(d.propAverage, tempprop);
-    strcpy(d.propDiff, tempprop);
-    strcpy(d.propMin + l, "Min");
-    strcpy(d.propMax + l, "Max");
-    strcpy(d.propAverage + l, "Average");
-    strcpy(d.propDiff + l, "Diff");
+    char *propName = malloc(l + 7 + 1);
+    strcpy(propName, tempprop);
+    strcpy(propName + l, "Min");
+    d.propMin = vsapi->getMapKey(propName);
+    strcpy(propName + l, "Max");
+    d.propMax = vsapi->getMapKey(propName);
+    strcpy(propName + l, "Average");
+    d.propAverage = vsapi->getMapKey(propName);
+    strcpy(propName + l, "Diff");
+    d.propDiff = vsapi->getMapKey(propName);
+    free(propName);
+
+    if (!d.propMin || !d.propMax || !d.propAverage || !d.propDiff) {
+        vsapi->freeNode(d.node1);
+        vsapi->freeNode(d.node2);
+        RETERROR("PlaneStats: invalid property name specified");
+    }
 
     data = malloc(sizeof(d));
     *data = d;
@@ -85,10 +85,11 @@ static void VS_CC getFrameAsync(int n, VSNodeRef *clip, VSFrameDoneCallback fdc,
 struct GetFrameWaiter {
     std::mutex b;
     std::condition_variable a;
+    std::atomic<bool> done;
     const VSFrameRef *r;
     char *errorMsg;
     int bufSize;
-    GetFrameWaiter(char *errorMsg, int bufSize) : errorMsg(errorMsg), bufSize(bufSize) {}
+    GetFrameWaiter(char *errorMsg, int bufSize) : done(false), r(nullptr), errorMsg(errorMsg), bufSize(bufSize) {}
 };
 
 static void VS_CC frameWaiterCallback(void *userData, const VSFrameRef *frame, int n, VSNodeRef *node, const char *errorMsg) VS_NOEXCEPT {
@@ -102,21 +103,25 @@ static void VS_CC frameWaiterCallback(void *userData, const VSFrameRef *frame, i
             g->errorMsg[g->bufSize - 1] = 0;
         }
     }
+    g->done = true;
     g->a.notify_one();
 }
 
 static const VSFrameRef *VS_CC getFrame(int n, VSNodeRef *clip, char *errorMsg, int bufSize) VS_NOEXCEPT {
     assert(clip);
     GetFrameWaiter g(errorMsg, bufSize);
-    std::unique_lock<std::mutex> l(g.b);
     VSNode *node = clip->clip.get();
-    bool isWorker = node->isWorkerThread();
-    if (isWorker)
-        node->releaseThread();
-    node->getFrame(std::make_shared<FrameContext>(n, clip->index, clip, &frameWaiterCallback, &g, false));
-    g.a.wait(l);
-    if (isWorker)
-        node->reserveThread();
+    PFrameContext ctx = std::make_shared<FrameContext>(n, clip->index, clip, &frameWaiterCallback, &g, false);
+    if (node->isWorkerThread()) {
+        // filters requesting frames synchronously keep their thread busy with the work the frame depends on
+        node->getFrameAndWait(ctx, g.done);
+        // the callback may still be running on another thread
+        std::lock_guard<std::mutex> l(g.b);
+    } else {
+        std::unique_lock<std::mutex> l(g.b);
+        node->getFrame(ctx);
+        g.a.wait(l, [&g] { return g.done.load(); });
+    }
     return g.r;
 }
 
@@ -247,7 +252,7 @@ static const char *VS_CC propGetKey(const VSMap *map, int index) VS_NOEXCEPT {
     return map->key(index);
 }
 
-static int propNumElementsInternal(const VSMap *map, const std::string &key) VS_NOEXCEPT {
+static int propNumElementsInternal(const VSMap *map, const char *key) VS_NOEXCEPT {
     VSVariant *val = map->find(key);
     return val ? val->size() : -1;
 }
@@ -265,12 +270,12 @@ static char VS_CC propGetType(const VSMap *map, const char *key) VS_NOEXCEPT {
     return val ? a[val->getType()] : 'u';
 }
 
-#define PROP_GET_SHARED(vt, retexpr) \
+#define PROP_GET_SHARED_KEY(lookupkey, vt, retexpr) \
     assert(map && key); \
     if (map->hasError()) \
         vsFatal("Attempted to read key '%s' from a map with error set: %s", key, map->getErrorMessage().c_str()); \
     int err = 0; \
-    VSVariant *l = map->find(key); \
+    VSVariant *l = map->find(lookupkey); \
     if (l && l->getType() == (vt)) { \
         if (index >= 0 && static_cast<size_t>(index) < l->size()) { \
             if (error) \
@@ -289,6 +294,8 @@ static char VS_CC propGetType(const VSMap *map, const char *key) VS_NOEXCEPT {
     *error = err; \
     return 0;
 
+#define PROP_GET_SHARED(vt, retexpr) PROP_GET_SHARED_KEY(key, vt, retexpr)
+
 static int64_t VS_CC propGetInt(const VSMap *map, const char *key, int index, int *error) VS_NOEXCEPT {
     PROP_GET_SHARED(VSVariant::vInt, l->getValue<int64_t>(index))
 }
@@ -326,40 +333,40 @@ static inline bool isAlphaNumUnderscore(char c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
 }
 
-static bool isValidVSMapKey(const std::string &s) {
-    size_t len = s.length();
-    if (!len)
+static bool isValidVSMapKey(const char *s) {
+    if (!*s)
         return false;
 
     if (!isAlphaUnderscore(s[0]))
         return false;
-    for (size_t i = 1; i < len; i++)
+    for (size_t i = 1; s[i]; i++)
         if (!isAlphaNumUnderscore(s[i]))
             return false;
     return true;
 }
 
-#define PROP_SET_SHARED(vv, appendexpr) \
-    assert(map && key); \
+#define PROP_SET_SHARED_KEY(vv, appendexpr) \
     if (append != paReplace && append != paAppend && append != paTouch) \
-        vsFatal("Invalid prop append mode given when setting key '%s'", key); \
-    std::string skey = key; \
-    if (!isValidVSMapKey(skey)) \
-        return 1; \
-    if (append != paReplace && map->contains(skey)) { \
-        VSVariant &l = map->at(skey); \
-        if (l.getType() != (vv)) \
+        vsFatal("Invalid prop append mode given when setting key '%s'", vsMapKeyName(key)); \
+    VSVariant *e = (append != paReplace) ? map->findForWrite(key) : nullptr; \
+    if (e) { \
+        if (e->getType() != (vv)) \
             return 1; \
         else if (append == paAppend) \
-            l.append(appendexpr); \
+            e->append(appendexpr); \
     } else { \
         VSVariant l((vv)); \
         if (append != paTouch) \
             l.append(appendexpr); \
-        map->insert(skey, std::move(l)); \
+        map->insert(key, std::move(l)); \
     } \
     return 0;
 
+#define PROP_SET_SHARED(vv, appendexpr) \
+    assert(map && key); \
+    if (!isValidVSMapKey(key)) \
+        return 1; \
+    PROP_SET_SHARED_KEY(vv, appendexpr)
 
 static int VS_CC propSetInt(VSMap *map, const char *key, int64_t i, int append) VS_NOEXCEPT {
     PROP_SET_SHARED(VSVariant::vInt, i)
@@ -515,12 +522,11 @@ static int VS_CC propSetIntArray(VSMap *map, const char *key, const int64_t *i,
     assert(map && key && size >= 0);
     if (size < 0)
         return 1;
-    std::string skey = key;
-    if (!isValidVSMapKey(skey))
+    if (!isValidVSMapKey(key))
         return 1;
     VSVariant l(VSVariant::vInt);
     l.setArray(i, size);
-    map->insert(skey, std::move(l));
+    map->insert(key, std::move(l));
     return 0;
 }
 
@@ -528,12 +534,11 @@ static int VS_CC propSetFloatArray(VSMap *map, const char *key, const double *d,
     assert(map && key && size >= 0);
     if (size < 0)
         return 1;
-    std::string skey = key;
-    if (!isValidVSMapKey(skey))
+    if (!isValidVSMapKey(key))
         return 1;
     VSVariant l(VSVariant::vFloat);
     l.setArray(d, size);
-    map->insert(skey, std::move(l));
+    map->insert(key, std::move(l));
     return 0;
 }
 
@@ -541,6 +546,35 @@ static void VS_CC logMessage(int msgType, const char *msg) VS_NOEXCEPT {
     vsLog(__FILE__, __LINE__, static_cast<VSMessageType>(msgType), "%s", msg);
 }
 
+static const VSMapKey *VS_CC getMapKey(const char *key) VS_NOEXCEPT {
+    assert(key);
+    if (!isValidVSMapKey(key))
+        return nullptr;
+    return reinterpret_cast<const VSMapKey *>(vsInternMapKey(key));
+}
+
+static int64_t VS_CC propGetIntByKey(const VSMap *map, const VSMapKey *mkey, int index, int *error) VS_NOEXCEPT {
+    assert(mkey);
+    const char *key = vsMapKeyName(mkey);
+    PROP_GET_SHARED_KEY(mkey, VSVariant::vInt, l->getValue<int64_t>(index))
+}
+
+static double VS_CC propGetFloatByKey(const VSMap *map, const VSMapKey *mkey, int index, int *error) VS_NOEXCEPT {
+    assert(mkey);
+    const char *key = vsMapKeyName(mkey);
+    PROP_GET_SHARED_KEY(mkey, VSVariant::vFloat, l->getValue<double>(index))
+}
+
+static int VS_CC propSetIntByKey(VSMap *map, const VSMapKey *key, int64_t i, int append) VS_NOEXCEPT {
+    assert(map && key);
+    PROP_SET_SHARED_KEY(VSVariant::vInt, i)
+}
+
+static int VS_CC propSetFloatByKey(VSMap *map, const VSMapKey *key, double d, int append) VS_NOEXCEPT {
+    assert(map && key);
+    PROP_SET_SHARED_KEY(VSVariant::vFloat, d)
+}
+
 const VSAPI vs_internal_vsapi = {
     &createCore,
     &freeCore,
@@ -628,7 +662,13 @@ const VSAPI vs_internal_vsapi = {
     &propSetIntArray,
     &propSetFloatArray,
 
-    &logMessage
+    &logMessage,
+
+    &getMapKey,
+    &propGetIntByKey,
+    &propGetFloatByKey,
+    &propSetIntByKey,
+    &propSetFloatByKey
 };
 
 ///////////////////////////////
@@ -30,6 +30,7 @@
 #endif
 #include <cassert>
 #include <queue>
+#include <unordered_set>
 
 #ifdef VS_TARGET_CPU_X86
 #include "x86utils.h"
@@ -122,10 +123,11 @@ void ExtFunction::call(const VSMap *in, VSMap *out) {
 ///////////////
 
 VSVariant::VSVariant(VSVType vtype) : vtype(vtype), internalSize(0), storage(nullptr) {
+    scalar.i = 0;
 }
 
-VSVariant::VSVariant(const VSVariant &v) : vtype(v.vtype), internalSize(v.internalSize), storage(nullptr) {
-    if (internalSize) {
+VSVariant::VSVariant(const VSVariant &v) : vtype(v.vtype), internalSize(v.internalSize), storage(nullptr), scalar(v.scalar) {
+    if (v.storage) {
         switch (vtype) {
         case VSVariant::vInt:
             storage = new IntList(*reinterpret_cast<IntList *>(v.storage)); break;
@@ -144,13 +146,31 @@ VSVariant::VSVariant(const VSVariant &v) : vtype(v.vtype), internalSize(v.intern
     }
 }
 
-VSVariant::VSVariant(VSVariant &&v) : vtype(v.vtype), internalSize(v.internalSize), storage(v.storage) {
+VSVariant::VSVariant(VSVariant &&v) : vtype(v.vtype), internalSize(v.internalSize), storage(v.storage), scalar(v.scalar) {
     v.vtype = vUnset;
     v.storage = nullptr;
     v.internalSize = 0;
 }
 
 VSVariant::~VSVariant() {
+    freeStorage();
+}
+
+VSVariant &VSVariant::operator=(VSVariant &&v) {
+    if (this != &v) {
+        freeStorage();
+        vtype = v.vtype;
+        internalSize = v.internalSize;
+        storage = v.storage;
+        scalar = v.scalar;
+        v.vtype = vUnset;
+        v.storage = nullptr;
+        v.internalSize = 0;
+    }
+    return *this;
+}
+
+void VSVariant::freeStorage() {
     if (storage) {
         switch (vtype) {
         case VSVariant::vInt:
@@ -167,6 +187,7 @@ VSVariant::~VSVariant() {
             delete reinterpret_cast<FuncList *>(storage); break;
         default:;
         }
+        storage = nullptr;
     }
 }
 
@@ -179,14 +200,26 @@ VSVariant::VSVType VSVariant::getType() const {
 }
 
 void VSVariant::append(int64_t val) {
-    initStorage(vInt);
-    reinterpret_cast<IntList *>(storage)->push_back(val);
+    if (!storage && !internalSize) {
+        assert(vtype == vUnset || vtype == vInt);
+        vtype = vInt;
+        scalar.i = val;
+    } else {
+        initStorage(vInt);
+        reinterpret_cast<IntList *>(storage)->push_back(val);
+    }
     internalSize++;
 }
 
 void VSVariant::append(double val) {
-    initStorage(vFloat);
-    reinterpret_cast<FloatList *>(storage)->push_back(val);
+    if (!storage && !internalSize) {
+        assert(vtype == vUnset || vtype == vFloat);
+        vtype = vFloat;
+        scalar.f = val;
+    } else {
+        initStorage(vFloat);
+        reinterpret_cast<FloatList *>(storage)->push_back(val);
+    }
     internalSize++;
 }
 
@@ -219,10 +252,11 @@ void VSVariant::initStorage(VSVType t) {
     vtype = t;
     if (!storage) {
         switch (t) {
+        // promote an inline scalar to a list
         case VSVariant::vInt:
-            storage = new IntList(); break;
+            storage = new IntList(internalSize, scalar.i); break;
         case VSVariant::vFloat:
-            storage = new FloatList(); break;
+            storage = new FloatList(internalSize, scalar.f); break;
         case VSVariant::vData:
             storage = new DataList(); break;
         case VSVariant::vNode:
@@ -238,6 +272,15 @@ void VSVariant::initStorage(VSVType t) {
 
 ///////////////
 
+const char *vsInternMapKey(const char *key) {
+    static std::mutex lock;
+    static std::unordered_set<std::string> keys;
+    std::lock_guard<std::mutex> l(lock);
+    return keys.insert(key).first->c_str();
+}
+
+///////////////
+
 void MemoryUse::add(size_t bytes) {
     used.fetch_add(bytes);
 }
@@ -340,6 +383,10 @@ VSPlaneData::VSPlaneData(size_t dataSize, MemoryUse &mem) : refCount(1), mem(mem
 #endif
 }
 
+VSPlaneData::VSPlaneData(uint8_t *externalData, size_t dataSize, const std::shared_ptr<void> &owner, MemoryUse &mem) : refCount(1), mem(mem), owner(owner), data(externalData), size(dataSize) {
+    assert(owner && VSFrame::guardSpace == 0);
+}
+
 VSPlaneData::VSPlaneData(const VSPlaneData &d) : refCount(1), mem(d.mem), size(d.size) {
 #ifdef VS_FRAME_POOL
     data = mem.allocBuffer(size);
@@ -354,6 +401,8 @@ VSPlaneData::VSPlaneData(const VSPlaneData &d) : refCount(1), mem(d.mem), size(d
 }
 
 VSPlaneData::~VSPlaneData() {
+    if (owner)
+        return;
 #ifdef VS_FRAME_POOL
     mem.freeBuffer(data);
 #else
@@ -363,7 +412,8 @@ VSPlaneData::~VSPlaneData() {
 }
 
 bool VSPlaneData::unique() {
-    return (refCount == 1);
+    // external data is always copied before writing
+    return (refCount == 1 && !owner);
 }
 
 void VSPlaneData::addRef() {
@@ -445,6 +495,40 @@ VSFrame::VSFrame(const VSFormat *f, int width, int height, const VSFrame * const
     }
 }
 
+VSFrame::VSFrame(const VSFormat *f, int width, int height, const uint8_t * const *planes, const std::shared_ptr<void> &owner, const VSFrame *propSrc, VSCore *core) : format(f), data(), width(width), height(height) {
+    if (!f)
+        vsFatal("Error in frame creation: null format");
+
+    if (width <= 0 || height <= 0)
+        vsFatal("Error in frame creation: dimensions are negative (%dx%d)", width, height);
+
+    if (propSrc)
+        properties = propSrc->properties;
+
+    for (int i = 0; i < 3; i++)
+        stride[i] = (i < f->numPlanes) ? getAlignedStride(f, width, i) : 0;
+
+    if (!canWrapPlanes(f, width, planes, stride))
+        vsFatal("Error in frame creation: external planes aren't aligned");
+
+    for (int i = 0; i < f->numPlanes; i++)
+        data[i] = new VSPlaneData(const_cast<uint8_t *>(planes[i]), stride[i] * getHeight(i), owner, *core->memory);
+}
+
+int VSFrame::getAlignedStride(const VSFormat *f, int width, int plane) {
+    return ((width >> (plane ? f->subSamplingW : 0)) * f->bytesPerSample + (alignment - 1)) & ~(alignment - 1);
+}
+
+bool VSFrame::canWrapPlanes(const VSFormat *f, int width, const uint8_t * const *planes, const int *strides) {
+    // the guard pattern can't be added around memory the core doesn't own
+    if (guardSpace)
+        return false;
+    for (int i = 0; i < f->numPlanes; i++)
+        if (!planes[i] || reinterpret_cast<uintptr_t>(planes[i]) % alignment || strides[i] != getAlignedStride(f, width, i))
+            return false;
+    return true;
+}
+
 VSFrame::VSFrame(const VSFrame &f) {
     data[0] = f.data[0];
     data[1] = f.data[1];
@@ -615,8 +699,73 @@ VSFunction::VSFunction(const std::string &argString, VSPublicFunction func, void
     }
 }
 
+// The plugin function being invoked on this thread, it's part of the graph hash since
+// different plugins may well pass the same name to createFilter()
+static thread_local const std::string *invokedFunction = nullptr;
+
+// FNV-1a, it only has to tell filter graphs apart
+static void hashBytes(uint64_t &hash, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(1099511628211);
+    }
+}
+
+static bool hashMap(uint64_t &hash, const VSMap &map) {
+    for (const auto &iter : map.getStorage()) {
+        const VSVariant &v = iter.second;
+        int type = v.getType();
+        uint64_t count = v.size();
+        hashBytes(hash, iter.first, strlen(iter.first) + 1);
+        hashBytes(hash, &type, sizeof(type));
+        hashBytes(hash, &count, sizeof(count));
+
+        for (size_t i = 0; i < v.size(); i++) {
+            switch (v.getType()) {
+            case VSVariant::vInt:
+                hashBytes(hash, &v.getValue<int64_t>(i), sizeof(int64_t));
+                break;
+            case VSVariant::vFloat:
+                hashBytes(hash, &v.getValue<double>(i), sizeof(double));
+                break;
+            case VSVariant::vData: {
+                const std::string &d = *v.getValue<VSMapData>(i);
+                uint64_t size = d.size();
+                hashBytes(hash, &size, sizeof(size));
+                hashBytes(hash, d.data(), d.size());
+                break;
+            }
+            case VSVariant::vNode: {
+                const VSNodeRef &ref = v.getValue<VSNodeRef>(i);
+                uint64_t nodeHash;
+                if (!ref.clip->getGraphHash(ref.index, nodeHash))
+                    return false;
+                hashBytes(hash, &nodeHash, sizeof(nodeHash));
+                break;
+            }
+            case VSVariant::vFrame: {
+                const VSFrame *f = v.getValue<PVideoFrame>(i).get();
+                const VSFormat *fi = f->getFormat();
+                int header[3] = { fi->id, f->getWidth(0), f->getHeight(0) };
+                hashBytes(hash, header, sizeof(header));
+                for (int p = 0; p < fi->numPlanes; p++) {
+                    const uint8_t *ptr = f->getReadPtr(p);
+                    for (int y = 0; y < f->getHeight(p); y++)
+                        hashBytes(hash, ptr + y * f->getStride(p), f->getWidth(p) * fi->bytesPerSample);
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 VSNode::VSNode(const VSMap *in, VSMap *out, const std::string &name, VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, int flags, void *instanceData, int apiMajor, VSCore *core) :
-instanceData(instanceData), name(name), init(init), filterGetFrame(getFrame), free(free), filterMode(filterMode), apiMajor(apiMajor), core(core), flags(flags), hasVi(false), serialFrame(-1) {
+instanceData(instanceData), name(name), init(init), filterGetFrame(getFrame), free(free), filterMode(filterMode), apiMajor(apiMajor), core(core), flags(flags), hasVi(false), serialFrame(-1), graphHash(UINT64_C(14695981039346656037)), hasGraphHash(false) {
 
     if (flags & ~(nfNoCache | nfIsCache | nfMakeLinear))
         throw VSException("Filter " + name  + " specified unknown flags");
@@ -624,6 +773,17 @@ instanceData(instanceData), name(name), init(init), filterGetFrame(getFrame), fr
     if ((flags & nfIsCache) && !(flags & nfNoCache))
         throw VSException("Filter " + name + " specified an illegal combination of flags (nfNoCache must always be set with nfIsCache)");
 
+    // caches don't change the output so they simply pass on the identity of their input
+    if ((flags & nfIsCache) && in->contains("clip") && (*in)["clip"].getType() == VSVariant::vNode) {
+        const VSNodeRef &ref = (*in)["clip"].getValue<VSNodeRef>(0);
+        hasGraphHash = ref.clip->getGraphHash(ref.index, graphHash);
+    } else {
+        if (invokedFunction)
+            hashBytes(graphHash, invokedFunction->c_str(), invokedFunction->size() + 1);
+        hashBytes(graphHash, name.c_str(), name.size() + 1);
+        hasGraphHash = hashMap(graphHash, *in);
+    }
+
     core->filterInstanceCreated();
     VSMap inval(*in);
     init(&inval, out, &this->instanceData, this, core, getVSAPIInternal(apiMajor));
@@ -650,6 +810,16 @@ VSNode::~VSNode() {
     core->destroyFilterInstance(this);
 }
 
+bool VSNode::getGraphHash(int index, uint64_t &hash) const {
+    if (!hasGraphHash)
+        return false;
+    hash = graphHash;
+    // the cache case already has the output index of the node it sits on mixed in
+    if (!(flags & nfIsCache))
+        hashBytes(hash, &index, sizeof(index));
+    return true;
+}
+
 void VSNode::getFrame(const PFrameContext &ct) {
     core->threadPool->start(ct);
 }
@@ -719,12 +889,8 @@ PVideoFrame VSNode::getFrameInternal(int n, int activationReason, VSFrameContext
     return p;
 }
 
-void VSNode::reserveThread() {
-    core->threadPool->reserveThread();
-}
-
-void VSNode::releaseThread() {
-    core->threadPool->releaseThread();
+void VSNode::getFrameAndWait(const PFrameContext &ct, const std::atomic<bool> &done) {
+    core->threadPool->startAndWait(ct, done);
 }
 
 bool VSNode::isWorkerThread() {
@@ -953,9 +1119,9 @@ void VSCore::registerFormats() {
 
 
 #ifdef VS_TARGET_OS_WINDOWS
-bool VSCore::loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter) {
+bool VSCore::loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter, PluginCache *cache) {
 #else
-bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &filter) {
+bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &filter, PluginCache *cache) {
 #endif
     if (path.empty())
         return false;
@@ -969,7 +1135,7 @@ bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &fi
         return false;
     do {
         try {
-            loadPlugin(conversion.to_bytes(path + L"\\" + findData.cFileName));
+            autoloadPlugin(conversion.to_bytes(path + L"\\" + findData.cFileName), cache);
         } catch (VSException &) {
             // Ignore any errors
         }
@@ -1001,7 +1167,7 @@ bool VSCore::loadAllPluginsInPath(const std::string &path, const std::string &fi
             try {
                 std::string fullname;
                 fullname.append(path).append("/").append(name);
-                loadPlugin(fullname);
+                autoloadPlugin(fullname, cache);
             } catch (VSException &) {
                 // Ignore any errors
             }
@@ -1092,12 +1258,14 @@ VSCore::VSCore(int threads) : coreFreed(false), numFilterInstances(1), numFuncti
     ::vs_internal_configPlugin("com.vapoursynth.std", "std", "VapourSynth Core Functions", VAPOURSYNTH_API_VERSION, 0, p);
     loadPluginInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     cacheInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
+    diskCacheInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     exprInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     genericInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     lutInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     boxBlurInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     mergeInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     reorderInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
+    rawSourceInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     stdlibInitialize(::vs_internal_configPlugin, ::vs_internal_registerFunction, p);
     p->enableCompat();
     p->lock();
@@ -1136,46 +1304,59 @@ VSCore::VSCore(int threads) : coreFreed(false), numFilterInstances(1), numFuncti
     if (portableFile)
         fclose(portableFile);
 
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    std::vector<wchar_t> appDataBuffer(MAX_PATH + 1);
+    SHGetFolderPath(nullptr, CSIDL_APPDATA, nullptr, SHGFP_TYPE_CURRENT, appDataBuffer.data());
+
+    // Remembers the functions of autoloaded plugins so they don't have to be loaded until used
+    std::wstring pluginCachePath;
+    if (isPortable)
+        pluginCachePath = dllPath + L"vapoursynth" + bits + L"\\plugincache";
+    else
+        pluginCachePath = std::wstring(appDataBuffer.data()) + L"\\VapourSynth\\plugincache" + bits;
+    PluginCache pluginCache(conversion.to_bytes(pluginCachePath));
+
     if (isPortable) {
         // Use alternative search strategy relative to dll path
 
         // Autoload bundled plugins
         std::wstring corePluginPath = dllPath + L"vapoursynth" + bits + L"\\coreplugins";
-        if (!loadAllPluginsInPath(corePluginPath, filter))
+        if (!loadAllPluginsInPath(corePluginPath, filter, &pluginCache))
             vsCritical("Core plugin autoloading failed. Installation is broken?");
 
         // Autoload global plugins last, this is so the bundled plugins cannot be overridden easily
         // and accidentally block updated bundled versions
         std::wstring globalPluginPath = dllPath + L"vapoursynth" + bits + L"\\plugins";
-        loadAllPluginsInPath(globalPluginPath, filter);
+        loadAllPluginsInPath(globalPluginPath, filter, &pluginCache);
     } else {
         // Autoload user specific plugins first so a user can always override
-        std::vector<wchar_t> appDataBuffer(MAX_PATH + 1);
-        SHGetFolderPath(nullptr, CSIDL_APPDATA, nullptr, SHGFP_TYPE_CURRENT, appDataBuffer.data());
-
         std::wstring appDataPath = std::wstring(appDataBuffer.data()) + L"\\VapourSynth\\plugins" + bits;
 
         // Autoload per user plugins
-        loadAllPluginsInPath(appDataPath, filter);
+        loadAllPluginsInPath(appDataPath, filter, &pluginCache);
 
         // Autoload bundled plugins
         std::wstring corePluginPath = readRegistryValue(L"Software\\VapourSynth", L"CorePlugins");
-        if (!loadAllPluginsInPath(corePluginPath, filter))
+        if (!loadAllPluginsInPath(corePluginPath, filter, &pluginCache))
             vsCritical("Core plugin autoloading failed. Installation is broken?");
 
         // Autoload global plugins last, this is so the bundled plugins cannot be overridden easily
         // and accidentally block updated bundled versions
         std::wstring globalPluginPath = readRegistryValue(L"Software\\VapourSynth", L"Plugins");
-        loadAllPluginsInPath(globalPluginPath, filter);
+        loadAllPluginsInPath(globalPluginPath, filter, &pluginCache);
     }
 
+    pluginCache.save();
+
 #else
     std::string configFile;
+    std::string pluginCacheFile;
     const char *home = getenv("HOME");
 #ifdef VS_TARGET_OS_DARWIN
     std::string filter = ".dylib";
     if (home) {
         configFile.append(home).append("/Library/Application Support/VapourSynth/vapoursynth.conf");
+        pluginCacheFile.append(home).append("/Library/Caches/VapourSynth/plugincache");
     }
 #else
     std::string filter = ".so";
@@ -1185,6 +1366,13 @@ VSCore::VSCore(int threads) : coreFreed(false), numFilterInstances(1), numFuncti
     } else if (home) {
         configFile.append(home).append("/.config/vapoursynth/vapoursynth.conf");
     } // If neither exists, an empty string will do.
+
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    if (xdg_cache_home) {
+        pluginCacheFile.append(xdg_cache_home).append("/vapoursynth/plugincache");
+    } else if (home) {
+        pluginCacheFile.append(home).append("/.cache/vapoursynth/plugincache");
+    } // If neither exists the cache isn't used
 #endif
 
     VSMap *settings = readSettings(configFile);
@@ -1207,17 +1395,28 @@ VSCore::VSCore(int threads) : coreFreed(false), numFilterInstances(1), numFuncti
         tmp = vs_internal_vsapi.propGetData(settings, "AutoloadSystemPluginDir", 0, &err);
         bool autoloadSystemPluginDir = tmp ? std::string(tmp) == "true" : true;
 
+        tmp = vs_internal_vsapi.propGetData(settings, "PluginCache", 0, &err);
+        bool usePluginCache = tmp ? std::string(tmp) == "true" : true;
+
+        // Remembers the functions of autoloaded plugins so they don't have to be loaded until used
+        std::unique_ptr<PluginCache> pluginCache;
+        if (usePluginCache && !pluginCacheFile.empty())
+            pluginCache.reset(new PluginCache(pluginCacheFile));
+
         if (autoloadUserPluginDir && !userPluginDir.empty()) {
-            if (!loadAllPluginsInPath(userPluginDir, filter)) {
+            if (!loadAllPluginsInPath(userPluginDir, filter, pluginCache.get())) {
                 vsWarning("Autoloading the user plugin dir '%s' failed. Directory doesn't exist?", userPluginDir.c_str());
             }
         }
 
         if (autoloadSystemPluginDir) {
-            if (!loadAllPluginsInPath(systemPluginDir, filter)) {
+            if (!loadAllPluginsInPath(systemPluginDir, filter, pluginCache.get())) {
                 vsCritical("Autoloading the system plugin dir '%s' failed. Directory doesn't exist?", systemPluginDir.c_str());
             }
         }
+
+        if (pluginCache)
+            pluginCache->save();
     }
 
     vs_internal_vsapi.freeMap(settings);
@@ -1279,8 +1478,44 @@ VSPlugin *VSCore::getPluginByNs(const std::string &ns) {
 }
 
 void VSCore::loadPlugin(const std::string &filename, const std::string &forcedNamespace, const std::string &forcedId) {
-    VSPlugin *p = new VSPlugin(filename, forcedNamespace, forcedId, this);
+    addPlugin(new VSPlugin(filename, forcedNamespace, forcedId, this), filename);
+}
+
+void VSCore::autoloadPlugin(const std::string &filename, PluginCache *cache) {
+    int64_t mtime, size;
+    if (!cache || !getPluginFileInfo(filename, mtime, size)) {
+        loadPlugin(filename);
+        return;
+    }
+
+    // plugins found in the cache are only loaded when one of their functions is invoked
+    const PluginCacheEntry *entry = cache->find(filename, mtime, size);
+    if (entry && entry->apiMajor == VAPOURSYNTH_API_MAJOR && entry->apiMinor <= VAPOURSYNTH_API_MINOR) {
+        addPlugin(new VSPlugin(*entry, this), filename);
+        return;
+    }
+
+    VSPlugin *p;
+    try {
+        p = new VSPlugin(filename, std::string(), std::string(), this);
+    } catch (VSException &) {
+        cache->remove(filename);
+        throw;
+    }
+
+    if (p->isCacheable()) {
+        PluginCacheEntry newEntry = p->getCacheEntry();
+        newEntry.mtime = mtime;
+        newEntry.size = size;
+        cache->update(filename, newEntry);
+    } else {
+        cache->remove(filename);
+    }
 
+    addPlugin(p, filename);
+}
+
+void VSCore::addPlugin(VSPlugin *p, const std::string &filename) {
     std::lock_guard<std::recursive_mutex> lock(pluginLock);
     if (getPluginById(p->id)) {
         std::string error = "Plugin " + filename + " already loaded (" + p->id + ")";
@@ -1316,11 +1551,22 @@ void VSCore::createFilter(const VSMap *in, VSMap *out, const std::string &name,
 }
 
 VSPlugin::VSPlugin(VSCore *core)
-    : apiMajor(0), apiMinor(0), hasConfig(false), readOnly(false), compat(false), libHandle(0), core(core) {
+    : apiMajor(0), apiMinor(0), hasConfig(false), readOnly(false), readOnlySet(false), compat(false), libHandle(0), core(core), deferred(false), loadingDeferred(false) {
 }
 
 VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedNamespace, const std::string &forcedId, VSCore *core)
-    : apiMajor(0), apiMinor(0), hasConfig(false), readOnly(false), compat(false), libHandle(0), core(core), fnamespace(forcedNamespace), id(forcedId) {
+    : apiMajor(0), apiMinor(0), hasConfig(false), readOnly(false), readOnlySet(false), compat(false), libHandle(0), core(core), deferred(false), loadingDeferred(false), fnamespace(forcedNamespace), id(forcedId) {
+    initPlugin(loadLibrary(relFilename), relFilename);
+}
+
+VSPlugin::VSPlugin(const PluginCacheEntry &entry, VSCore *core)
+    : apiMajor(entry.apiMajor), apiMinor(entry.apiMinor), hasConfig(true), readOnly(true), readOnlySet(true), compat(false), libHandle(0), core(core), deferred(true), loadingDeferred(false),
+    filename(entry.filename), fullname(entry.fullname), fnamespace(entry.fnamespace), id(entry.id) {
+    for (const auto &iter : entry.functions)
+        funcs.insert(std::make_pair(iter.first, VSFunction(iter.second, nullptr, nullptr)));
+}
+
+VSInitPlugin VSPlugin::loadLibrary(const std::string &relFilename) {
 #ifdef VS_TARGET_OS_WINDOWS
     std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
     std::wstring wPath = conversion.from_bytes(relFilename);
@@ -1355,6 +1601,7 @@ VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedName
 
     if (!pluginInit) {
         FreeLibrary(libHandle);
+        libHandle = 0;
         throw VSException("No entry point found in " + relFilename);
     }
 #else
@@ -1378,11 +1625,14 @@ VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedName
 
     if (!pluginInit) {
         dlclose(libHandle);
+        libHandle = 0;
         throw VSException("No entry point found in " + relFilename);
     }
-
-
 #endif
+    return pluginInit;
+}
+
+void VSPlugin::initPlugin(VSInitPlugin pluginInit, const std::string &relFilename) {
     pluginInit(::vs_internal_configPlugin, ::vs_internal_registerFunction, this);
 
 #ifdef VS_TARGET_CPU_X86
@@ -1405,10 +1655,52 @@ VSPlugin::VSPlugin(const std::string &relFilename, const std::string &forcedName
 #else
         dlclose(libHandle);
 #endif
+        libHandle = 0;
         throw VSException("Core only supports API R" + std::to_string(VAPOURSYNTH_API_MAJOR) + "." + std::to_string(VAPOURSYNTH_API_MINOR) + " but the loaded plugin requires API R" + std::to_string(apiMajor) + "." + std::to_string(apiMinor) + "; Filename: " + relFilename + "; Name: " + fullname);
     }
 }
 
+void VSPlugin::loadDeferred() {
+    std::lock_guard<std::mutex> lock(deferredLock);
+    if (!deferred)
+        return;
+
+    // the cached functions get their function pointers filled in when the plugin registers them again
+    VSInitPlugin pluginInit = loadLibrary(filename);
+    readOnly = false;
+    hasConfig = false;
+    loadingDeferred = true;
+    try {
+        initPlugin(pluginInit, filename);
+    } catch (VSException &) {
+        loadingDeferred = false;
+        readOnly = true;
+        hasConfig = true;
+        throw;
+    }
+    loadingDeferred = false;
+    deferred = false;
+}
+
+bool VSPlugin::isCacheable() const {
+    // plugins that can add functions later on always have to be loaded
+    return readOnly && !compat && !deferred && libHandle;
+}
+
+PluginCacheEntry VSPlugin::getCacheEntry() {
+    PluginCacheEntry entry;
+    entry.filename = filename;
+    entry.id = id;
+    entry.fnamespace = fnamespace;
+    entry.fullname = fullname;
+    entry.apiMajor = apiMajor;
+    entry.apiMinor = apiMinor;
+    std::lock_guard<std::mutex> lock(registerFunctionLock);
+    for (const auto &iter : funcs)
+        entry.functions.push_back(std::make_pair(iter.first, iter.second.argString));
+    return entry;
+}
+
 VSPlugin::~VSPlugin() {
 #ifdef VS_TARGET_OS_WINDOWS
     if (libHandle)
@@ -1429,7 +1721,9 @@ void VSPlugin::configPlugin(const std::string &identifier, const std::string &de
     if (fnamespace.empty())
         fnamespace = defaultNamespace;
 
-    this->fullname = fullname;
+    // only assign when changed since a plugin loaded from the cache may be in use
+    if (this->fullname != fullname)
+        this->fullname = fullname;
 
     apiMajor = apiVersion;
     if (apiMajor >= 0x10000) {
@@ -1450,7 +1744,14 @@ void VSPlugin::registerFunction(const std::string &name, const std::string &args
 
     std::lock_guard<std::mutex> lock(registerFunctionLock);
 
-    if (funcs.count(name)) {
+    auto iter = funcs.find(name);
+    if (iter != funcs.end() && loadingDeferred && !iter->second.func) {
+        iter->second.func = argsFunc;
+        iter->second.functionData = functionData;
+        return;
+    }
+
+    if (iter != funcs.end()) {
         vsWarning("Plugin %s tried to register '%s' more than once. Second registration ignored.", filename.c_str(), name.c_str());
         return;
     }
@@ -1492,10 +1793,17 @@ static bool hasForeignNodes(const VSMap &m, const VSCore *core) {
 VSMap VSPlugin::invoke(const std::string &funcName, const VSMap &args) {
     const char lookup[] = { 'i', 'f', 's', 'c', 'v', 'm' };
     VSMap v;
+    // functions may invoke other functions to create their filters
+    const std::string *outerFunction = invokedFunction;
 
     try {
+        if (deferred)
+            loadDeferred();
+
         if (funcs.count(funcName)) {
             const VSFunction &f = funcs[funcName];
+            if (!f.func)
+                throw VSException(funcName + ": function no longer registered by the plugin, the plugin cache is out of date");
             if (!compat && hasCompatNodes(args))
                 throw VSException(funcName + ": only special filters may accept compat input");
             if (hasForeignNodes(args, core))
@@ -1534,7 +1842,10 @@ VSMap VSPlugin::invoke(const std::string &funcName, const VSMap &args) {
                 throw VSException(funcName + ": no argument(s) named " + s);
             }
 
+            const std::string function = id + "." + funcName;
+            invokedFunction = &function;
             f.func(&args, &v, f.functionData, core, getVSAPIInternal(apiMajor));
+            invokedFunction = outerFunction;
 
             if (!compat && hasCompatNodes(v))
                 vsFatal("%s: illegal filter node returning a compat format detected, DO NOT USE THE COMPAT FORMATS IN NEW FILTERS", funcName.c_str());
@@ -1542,6 +1853,7 @@ VSMap VSPlugin::invoke(const std::string &funcName, const VSMap &args) {
             return v;
         }
     } catch (VSException &e) {
+        invokedFunction = outerFunction;
         vs_internal_vsapi.setError(&v, e.what());
         return v;
     }
@@ -1552,6 +1864,7 @@ VSMap VSPlugin::invoke(const std::string &funcName, const VSMap &args) {
 
 VSMap VSPlugin::getFunctions() {
     VSMap m;
+    std::lock_guard<std::mutex> lock(registerFunctionLock);
     for (const auto & f : funcs) {
         std::string b = f.first + ";" + f.second.argString;
         vs_internal_vsapi.propSetData(&m, f.first.c_str(), b.c_str(), static_cast<int>(b.size()), paReplace);
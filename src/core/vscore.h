@@ -23,6 +23,7 @@
 
 #include "VapourSynth.h"
 #include "vslog.h"
+#include "plugincache.h"
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
@@ -125,6 +126,8 @@ public:
     VSVariant(VSVariant &&v);
     ~VSVariant();
 
+    VSVariant &operator=(VSVariant &&v);
+
     size_t size() const;
     VSVType getType() const;
 
@@ -135,19 +138,34 @@ public:
     void append(const PVideoFrame &val);
     void append(const PExtFunction &val);
 
+    // a single int or float is stored inline in scalar and storage is left unallocated,
+    // any other type only has no storage when it's empty
     template<typename T>
     const T &getValue(size_t index) const {
+        if (!storage) {
+            if (index >= internalSize)
+                throw std::out_of_range("VSVariant index out of range");
+            return *getScalar(static_cast<const T *>(nullptr));
+        }
         return reinterpret_cast<std::vector<T>*>(storage)->at(index);
     }
 
     template<typename T>
     const T *getArray() const {
+        if (!storage)
+            return getScalar(static_cast<const T *>(nullptr));
         return reinterpret_cast<std::vector<T>*>(storage)->data();
     }
 
     template<typename T>
     void setArray(const T *val, size_t size) {
-        assert(val && !storage);
+        assert(val && !storage && !internalSize);
+        if (size <= 1 && (vtype == vInt || vtype == vFloat)) {
+            if (size)
+                memcpy(&scalar, val, sizeof(T));
+            internalSize = size;
+            return;
+        }
         std::vector<T> *vect = new std::vector<T>(size);
         if (size)
             memcpy(vect->data(), val, size * sizeof(T));
@@ -159,15 +177,51 @@ private:
     VSVType vtype;
     size_t internalSize;
     void *storage;
+    union {
+        int64_t i;
+        double f;
+    } scalar;
+
+    // the overload is picked by the pointer type so scalar is only ever read through the member
+    // of the matching type, other types are never stored inline
+    const int64_t *getScalar(const int64_t *) const {
+        return &scalar.i;
+    }
+
+    const double *getScalar(const double *) const {
+        return &scalar.f;
+    }
+
+    template<typename T>
+    const T *getScalar(const T *) const {
+        return nullptr;
+    }
 
     void initStorage(VSVType t);
+    void freeStorage();
 };
 
+// Map keys are interned so every distinct key name exists exactly once for the
+// lifetime of the process. All keys stored in a map are interned pointers so
+// lookups through a VSMapKey handle are a binary search where the key itself is
+// recognized by its pointer. The public VSMapKey handle is simply the interned
+// string.
+const char *vsInternMapKey(const char *key);
+
+static inline const char *vsMapKeyName(const VSMapKey *key) {
+    return reinterpret_cast<const char *>(key);
+}
+
+static inline const char *vsMapKeyName(const char *key) {
+    return key;
+}
+
 class VSMapStorage {
 private:
     std::atomic<int> refCount;
 public:
-    std::map<std::string, VSVariant> data;
+    // sorted by key name to keep the iteration order stable
+    std::vector<std::pair<const char *, VSVariant>> data;
     bool error;
 
     VSMapStorage() : refCount(1), error(false) {}
@@ -190,6 +244,8 @@ public:
 
 struct VSMap {
 private:
+    typedef std::vector<std::pair<const char *, VSVariant>> StorageType;
+
     VSMapStorage *data;
 
     void detach() {
@@ -199,6 +255,35 @@ private:
             old->release();
         }
     }
+
+    StorageType::iterator lowerBound(const char *key) const {
+        return std::lower_bound(data->data.begin(), data->data.end(), key, [](const StorageType::value_type &v, const char *k) { return strcmp(v.first, k) < 0; });
+    }
+
+    StorageType::iterator findIter(const char *key) const {
+        auto it = lowerBound(key);
+        return (it != data->data.end() && !strcmp(it->first, key)) ? it : data->data.end();
+    }
+
+    // stored keys are interned so the matching key is the same pointer and never needs a string comparison
+    StorageType::iterator findIter(const VSMapKey *key) const {
+        const char *k = vsMapKeyName(key);
+        auto it = std::lower_bound(data->data.begin(), data->data.end(), k, [](const StorageType::value_type &v, const char *k) { return v.first != k && strcmp(v.first, k) < 0; });
+        return (it != data->data.end() && it->first == k) ? it : data->data.end();
+    }
+
+    template<typename K>
+    bool insertImpl(K key, const char *name, VSVariant &&v) {
+        detach();
+        auto it = findIter(key);
+        if (it != data->data.end()) {
+            it->second = std::move(v);
+        } else {
+            name = vsInternMapKey(name);
+            data->data.emplace(lowerBound(name), name, std::move(v));
+        }
+        return true;
+    }
 public:
     VSMap() : data(new VSMapStorage()) {}
 
@@ -221,36 +306,77 @@ public:
         return *this;
     }
 
+    bool contains(const char *key) const {
+        return findIter(key) != data->data.end();
+    }
+
     bool contains(const std::string &key) const {
-        return !!data->data.count(key);
+        return contains(key.c_str());
+    }
+
+    VSVariant &at(const char *key) const {
+        auto it = findIter(key);
+        if (it == data->data.end())
+            throw std::out_of_range("VSMap key not found");
+        return it->second;
     }
 
     VSVariant &at(const std::string &key) const {
-        return data->data.at(key);
+        return at(key.c_str());
     }
 
     VSVariant &operator[](const std::string &key) const {
         // implicit creation is unwanted so make sure it doesn't happen by wrapping at() instead
-        return data->data.at(key);
+        return at(key.c_str());
+    }
+
+    VSVariant *find(const char *key) const {
+        auto it = findIter(key);
+        return it == data->data.end() ? nullptr : &it->second;
     }
 
     VSVariant *find(const std::string &key) const {
-        auto it = data->data.find(key);
+        return find(key.c_str());
+    }
+
+    VSVariant *find(const VSMapKey *key) const {
+        auto it = findIter(key);
         return it == data->data.end() ? nullptr : &it->second;
     }
 
-    bool erase(const std::string &key) {
+    // like find() but makes sure the returned value isn't shared with other maps so it can be modified
+    template<typename K>
+    VSVariant *findForWrite(K key) {
+        if (find(key) == nullptr)
+            return nullptr;
         detach();
-        return data->data.erase(key) > 0;
+        return find(key);
     }
 
-    bool insert(const std::string &key, VSVariant &&v) {
+    bool erase(const char *key) {
+        if (!contains(key))
+            return false;
         detach();
-        data->data.erase(key);
-        data->data.insert(std::make_pair(key, v));
+        data->data.erase(findIter(key));
         return true;
     }
 
+    bool erase(const std::string &key) {
+        return erase(key.c_str());
+    }
+
+    bool insert(const char *key, VSVariant &&v) {
+        return insertImpl(key, key, std::move(v));
+    }
+
+    bool insert(const std::string &key, VSVariant &&v) {
+        return insert(key.c_str(), std::move(v));
+    }
+
+    bool insert(const VSMapKey *key, VSVariant &&v) {
+        return insertImpl(key, vsMapKeyName(key), std::move(v));
+    }
+
     size_t size() const {
         return data->data.size();
     }
@@ -261,14 +387,12 @@ public:
     }
 
     const char *key(int n) const {
-        if (n >= static_cast<int>(size()))
+        if (n < 0 || n >= static_cast<int>(size()))
             return nullptr;
-        auto iter = data->data.cbegin();
-        std::advance(iter, n);
-        return iter->first.c_str();
+        return data->data[n].first;
     }
 
-    const std::map<std::string, VSVariant> &getStorage() const {
+    const StorageType &getStorage() const {
         return data->data;
     }
 
@@ -358,10 +482,13 @@ class VSPlaneData {
 private:
     std::atomic<int> refCount;
     MemoryUse &mem;
+    // keeps memory that isn't owned by the core alive, such data is never written to
+    std::shared_ptr<void> owner;
 public:
     uint8_t *data;
     const size_t size;
     VSPlaneData(size_t dataSize, MemoryUse &mem);
+    VSPlaneData(uint8_t *externalData, size_t dataSize, const std::shared_ptr<void> &owner, MemoryUse &mem);
     VSPlaneData(const VSPlaneData &d);
     ~VSPlaneData();
     bool unique();
@@ -388,9 +515,15 @@ public:
 
     VSFrame(const VSFormat *f, int width, int height, const VSFrame *propSrc, VSCore *core);
     VSFrame(const VSFormat *f, int width, int height, const VSFrame * const *planeSrc, const int *plane, const VSFrame *propSrc, VSCore *core);
+    // wraps planes in memory owned by someone else without copying, they have to be laid out exactly like
+    // the planes of a newly allocated frame which can be checked with canWrapPlanes() first
+    VSFrame(const VSFormat *f, int width, int height, const uint8_t * const *planes, const std::shared_ptr<void> &owner, const VSFrame *propSrc, VSCore *core);
     VSFrame(const VSFrame &f);
     ~VSFrame();
 
+    static int getAlignedStride(const VSFormat *f, int width, int plane);
+    static bool canWrapPlanes(const VSFormat *f, int width, const uint8_t * const *planes, const int *strides);
+
     VSMap &getProperties() {
         return properties;
     }
@@ -479,6 +612,11 @@ private:
     std::mutex concurrentFramesMutex;
     std::set<int> concurrentFrames;
 
+    // identifies the filter graph up to this node by filter names and arguments, functions can't be
+    // compared so graphs with them don't get one
+    uint64_t graphHash;
+    bool hasGraphHash;
+
     PVideoFrame getFrameInternal(int n, int activationReason, VSFrameContext &frameCtx);
 public:
     VSNode(const VSMap *in, VSMap *out, const std::string &name, VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, VSFilterMode filterMode, int flags, void *instanceData, int apiMajor, VSCore *core);
@@ -503,9 +641,10 @@ public:
         return name;
     }
 
+    bool getGraphHash(int index, uint64_t &hash) const;
+
     // to get around encapsulation a bit, more elegant than making everything friends in this case
-    void reserveThread();
-    void releaseThread();
+    void getFrameAndWait(const PFrameContext &ct, const std::atomic<bool> &done);
     bool isWorkerThread();
 
     void notifyCache(bool needMemory);
@@ -528,8 +667,10 @@ private:
     std::map<NodeOutputKey, PFrameContext> allContexts;
     std::condition_variable newWork;
     std::condition_variable allIdle;
+    std::condition_variable helperWork;
     std::atomic<unsigned> activeThreads;
     std::atomic<unsigned> idleThreads;
+    unsigned waitingThreads;
     std::atomic<uintptr_t> reqCounter;
     unsigned maxThreads;
     std::atomic<bool> stopThreads;
@@ -538,8 +679,10 @@ private:
     void notifyCaches(bool needMemory);
     void startInternal(const PFrameContext &context);
     void spawnThread();
+    bool runTask(std::unique_lock<std::mutex> &lock, const FrameContext *root);
     static void runTasks(VSThreadPool *owner, std::atomic<bool> &stop);
     static bool taskCmp(const PFrameContext &a, const PFrameContext &b);
+    static bool isRequestedBy(const FrameContext *context, const FrameContext *root);
 public:
     VSThreadPool(VSCore *core, int threads);
     ~VSThreadPool();
@@ -549,8 +692,8 @@ public:
     int threadCount() const;
     void setThreadCount(int threads);
     void start(const PFrameContext &context);
-    void releaseThread();
-    void reserveThread();
+    // starts the request from a worker thread and keeps the thread busy with it until done is set
+    void startAndWait(const PFrameContext &context, const std::atomic<bool> &done);
     bool isWorkerThread();
     void waitForDone();
 };
@@ -582,6 +725,13 @@ private:
     std::map<std::string, VSFunction> funcs;
     std::mutex registerFunctionLock;
     VSCore *core;
+    // set for plugins created from the plugin cache until the library has been loaded
+    std::atomic<bool> deferred;
+    bool loadingDeferred;
+    std::mutex deferredLock;
+    VSInitPlugin loadLibrary(const std::string &relFilename);
+    void initPlugin(VSInitPlugin pluginInit, const std::string &relFilename);
+    void loadDeferred();
 public:
     std::string filename;
     std::string fullname;
@@ -589,7 +739,10 @@ public:
     std::string id;
     VSPlugin(VSCore *core);
     VSPlugin(const std::string &relFilename, const std::string &forcedNamespace, const std::string &forcedId, VSCore *core);
+    VSPlugin(const PluginCacheEntry &entry, VSCore *core);
     ~VSPlugin();
+    bool isCacheable() const;
+    PluginCacheEntry getCacheEntry();
     void lock() {
         readOnly = true;
     };
@@ -626,10 +779,12 @@ private:
 
     void registerFormats();
 #ifdef VS_TARGET_OS_WINDOWS
-    bool loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter);
+    bool loadAllPluginsInPath(const std::wstring &path, const std::wstring &filter, PluginCache *cache);
 #else
-    bool loadAllPluginsInPath(const std::string &path, const std::string &filter);
+    bool loadAllPluginsInPath(const std::string &path, const std::string &filter, PluginCache *cache);
 #endif
+    void autoloadPlugin(const std::string &filename, PluginCache *cache);
+    void addPlugin(VSPlugin *p, const std::string &filename);
 public:
     VSThreadPool *threadPool;
     MemoryUse *memory;
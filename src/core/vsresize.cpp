@@ -196,12 +196,56 @@ T propGetScalarDef(const VSMap *map, const char *key, T def, const VSAPI *vsapi)
         return def;
 }
 
+// Frame properties are read and written once per frame, so their keys are only resolved once.
+struct frame_prop_keys {
+    const VSMapKey *chroma_location;
+    const VSMapKey *color_range;
+    const VSMapKey *matrix;
+    const VSMapKey *transfer;
+    const VSMapKey *primaries;
+    const VSMapKey *field;
+    const VSMapKey *field_based;
+    const VSMapKey *sar_num;
+    const VSMapKey *sar_den;
+
+    explicit frame_prop_keys(const VSAPI *vsapi) :
+        chroma_location{ vsapi->getMapKey("_ChromaLocation") },
+        color_range{ vsapi->getMapKey("_ColorRange") },
+        matrix{ vsapi->getMapKey("_Matrix") },
+        transfer{ vsapi->getMapKey("_Transfer") },
+        primaries{ vsapi->getMapKey("_Primaries") },
+        field{ vsapi->getMapKey("_Field") },
+        field_based{ vsapi->getMapKey("_FieldBased") },
+        sar_num{ vsapi->getMapKey("_SARNum") },
+        sar_den{ vsapi->getMapKey("_SARDen") }
+    {}
+};
+
+const frame_prop_keys &get_frame_prop_keys(const VSAPI *vsapi) {
+    static const frame_prop_keys keys{ vsapi };
+    return keys;
+}
+
+bool propGetIntByKeyIfSet(const VSMap *map, const VSMapKey *key, const char *name, int64_t *out, const VSAPI *vsapi) {
+    int err;
+    int64_t x = vsapi->propGetIntByKey(map, key, 0, &err);
+
+    if (err == peType)
+        throw std::runtime_error{ std::string{ "bad " } + name + " type" };
+    if (err)
+        return false;
+
+    *out = x;
+    return true;
+}
+
 template <class T, class U, class Pred>
-void propGetIfValid(const VSMap *map, const char *key, U *out, Pred pred, const VSAPI *vsapi) {
-    if (vsapi->propNumElements(map, key) > 0) {
-        T x = propGetScalar<T>(map, key, vsapi);
-        if (pred(x))
-            *out = static_cast<U>(x);
+void propGetIfValid(const VSMap *map, const VSMapKey *key, const char *name, U *out, Pred pred, const VSAPI *vsapi) {
+    int64_t x;
+    if (propGetIntByKeyIfSet(map, key, name, &x, vsapi)) {
+        T y = range_check_integer<T>(x, name);
+        if (pred(y))
+            *out = static_cast<U>(y);
     }
 }
 
@@ -269,11 +313,12 @@ void translate_vsformat(const VSFormat *vsformat, zimg_image_format *format) {
 
 
 bool import_frame_props(const VSMap *props, zimg_image_format *format, const VSAPI *vsapi) {
-    propGetIfValid<int>(props, "_ChromaLocation", &format->chroma_location, [](int x) { return x >= 0; }, vsapi);
+    const frame_prop_keys &keys = get_frame_prop_keys(vsapi);
+    int64_t x;
 
-    if (vsapi->propNumElements(props, "_ColorRange") > 0) {
-        int64_t x = vsapi->propGetInt(props, "_ColorRange", 0, nullptr);
+    propGetIfValid<int>(props, keys.chroma_location, "_ChromaLocation", &format->chroma_location, [](int x) { return x >= 0; }, vsapi);
 
+    if (propGetIntByKeyIfSet(props, keys.color_range, "_ColorRange", &x, vsapi)) {
         if (x == 0)
             format->pixel_range = ZIMG_RANGE_FULL;
         else if (x == 1)
@@ -283,23 +328,19 @@ bool import_frame_props(const VSMap *props, zimg_image_format *format, const VSA
     }
 
     // Ignore UNSPECIFIED values from properties, since the user can specify them.
-    propGetIfValid<int>(props, "_Matrix", &format->matrix_coefficients, [](int x) { return x != ZIMG_MATRIX_UNSPECIFIED; }, vsapi);
-    propGetIfValid<int>(props, "_Transfer", &format->transfer_characteristics, [](int x) { return x != ZIMG_TRANSFER_UNSPECIFIED; }, vsapi);
-    propGetIfValid<int>(props, "_Primaries", &format->color_primaries, [](int x) { return x != ZIMG_PRIMARIES_UNSPECIFIED; }, vsapi);
+    propGetIfValid<int>(props, keys.matrix, "_Matrix", &format->matrix_coefficients, [](int x) { return x != ZIMG_MATRIX_UNSPECIFIED; }, vsapi);
+    propGetIfValid<int>(props, keys.transfer, "_Transfer", &format->transfer_characteristics, [](int x) { return x != ZIMG_TRANSFER_UNSPECIFIED; }, vsapi);
+    propGetIfValid<int>(props, keys.primaries, "_Primaries", &format->color_primaries, [](int x) { return x != ZIMG_PRIMARIES_UNSPECIFIED; }, vsapi);
 
     bool is_interlaced = false;
-    if (vsapi->propNumElements(props, "_Field") > 0) {
-        int64_t x = vsapi->propGetInt(props, "_Field", 0, nullptr);
-
+    if (propGetIntByKeyIfSet(props, keys.field, "_Field", &x, vsapi)) {
         if (x == 0)
             format->field_parity = ZIMG_FIELD_BOTTOM;
         else if (x == 1)
             format->field_parity = ZIMG_FIELD_TOP;
         else
             throw std::runtime_error{ std::string{ "bad _Field value: " } + std::to_string(x) };
-    } else if (vsapi->propNumElements(props, "_FieldBased") > 0) {
-        int64_t x = vsapi->propGetInt(props, "_FieldBased", 0, nullptr);
-
+    } else if (propGetIntByKeyIfSet(props, keys.field_based, "_FieldBased", &x, vsapi)) {
         if (x != 0 && x != 1 && x != 2)
             throw std::runtime_error{ std::string{ "bad _FieldBased value: " } + std::to_string(x) };
 
@@ -315,35 +356,36 @@ bool import_frame_props(const VSMap *props, zimg_image_format *format, const VSA
 }
 
 void export_frame_props(const zimg_image_format &format, VSMap *props, const VSAPI *vsapi) {
-    auto set_int_if_positive = [&](const char *key, int x) {
+    const frame_prop_keys &keys = get_frame_prop_keys(vsapi);
+
+    auto set_int_if_positive = [&](const VSMapKey *key, const char *name, int x) {
         if (x >= 0)
-            vsapi->propSetInt(props, key, x, paReplace);
+            vsapi->propSetIntByKey(props, key, x, paReplace);
         else
-            vsapi->propDeleteKey(props, key);
+            vsapi->propDeleteKey(props, name);
     };
 
-    set_int_if_positive("_ChromaLocation", format.chroma_location);
+    set_int_if_positive(keys.chroma_location, "_ChromaLocation", format.chroma_location);
 
     if (format.pixel_range == ZIMG_RANGE_FULL)
-        vsapi->propSetInt(props, "_ColorRange", 0, paReplace);
+        vsapi->propSetIntByKey(props, keys.color_range, 0, paReplace);
     else if (format.pixel_range == ZIMG_RANGE_LIMITED)
-        vsapi->propSetInt(props, "_ColorRange", 1, paReplace);
+        vsapi->propSetIntByKey(props, keys.color_range, 1, paReplace);
     else
         vsapi->propDeleteKey(props, "_ColorRange");
 
-    set_int_if_positive("_Matrix", format.matrix_coefficients);
-    set_int_if_positive("_Transfer", format.transfer_characteristics);
-    set_int_if_positive("_Primaries", format.color_primaries);
+    set_int_if_positive(keys.matrix, "_Matrix", format.matrix_coefficients);
+    set_int_if_positive(keys.transfer, "_Transfer", format.transfer_characteristics);
+    set_int_if_positive(keys.primaries, "_Primaries", format.color_primaries);
 }
 
 void propagate_sar(const VSMap *src_props, VSMap *dst_props, const zimg_image_format &src_format, const zimg_image_format &dst_format, const VSAPI *vsapi) {
+    const frame_prop_keys &keys = get_frame_prop_keys(vsapi);
     int64_t sar_num = 0;
     int64_t sar_den = 0;
 
-    if (vsapi->propNumElements(src_props, "_SARNum") > 0)
-        sar_num = vsapi->propGetInt(src_props, "_SARNum", 0, nullptr);
-    if (vsapi->propNumElements(dst_props, "_SARDen") > 0)
-        sar_den = vsapi->propGetInt(dst_props, "_SARDen", 0, nullptr);
+    propGetIntByKeyIfSet(src_props, keys.sar_num, "_SARNum", &sar_num, vsapi);
+    propGetIntByKeyIfSet(dst_props, keys.sar_den, "_SARDen", &sar_den, vsapi);
 
     if (sar_num <= 0 || sar_den <= 0) {
         vsapi->propDeleteKey(dst_props, "_SARNum");
@@ -352,8 +394,8 @@ void propagate_sar(const VSMap *src_props, VSMap *dst_props, const zimg_image_fo
         muldivRational(&sar_num, &sar_den, src_format.width, dst_format.width);
         muldivRational(&sar_num, &sar_den, dst_format.height, src_format.height);
 
-        vsapi->propSetInt(dst_props, "_SARNum", sar_num, paReplace);
-        vsapi->propSetInt(dst_props, "_SARDen", sar_den, paReplace);
+        vsapi->propSetIntByKey(dst_props, keys.sar_num, sar_num, paReplace);
+        vsapi->propSetIntByKey(dst_props, keys.sar_den, sar_den, paReplace);
     }
 }
 
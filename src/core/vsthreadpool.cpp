@@ -24,257 +24,284 @@
 #include "x86utils.h"
 #endif
 
+#ifdef VS_TARGET_OS_DARWIN
+#define thread_local __thread
+#endif
+
+// How many getFrame() calls may be nested on one worker's stack before it simply waits
+static const int maxHelpDepth = 8;
+
 bool VSThreadPool::taskCmp(const PFrameContext &a, const PFrameContext &b) {
     return (a->reqOrder < b->reqOrder) || (a->reqOrder == b->reqOrder && a->n < b->n);
 }
 
-void VSThreadPool::runTasks(VSThreadPool *owner, std::atomic<bool> &stop) {
-#ifdef VS_TARGET_CPU_X86
-    if (!vs_isMMXStateOk())
-        vsFatal("Bad MMX state detected after creating new thread");
-#endif
-#ifdef VS_TARGET_OS_WINDOWS
-    if (!vs_isFPUStateOk())
-        vsWarning("Bad FPU state detected after creating new thread");
-    if (!vs_isSSEStateOk())
-        vsFatal("Bad SSE state detected after creating new thread");
-#endif
-
-    std::unique_lock<std::mutex> lock(owner->lock);
+bool VSThreadPool::isRequestedBy(const FrameContext *context, const FrameContext *root) {
+    for (; context; context = context->upstreamContext.get())
+        if (context == root)
+            return true;
+    return false;
+}
 
-    while (true) {
-        bool ranTask = false;
+// Runs at most one task, if root is set only tasks that are part of producing the frame requested by root are considered
+bool VSThreadPool::runTask(std::unique_lock<std::mutex> &lock, const FrameContext *root) {
+    bool ranTask = false;
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Go through all tasks from the top (oldest) and process the first one possible
-        owner->tasks.sort(taskCmp);
+    tasks.sort(taskCmp);
 
-        // fixme, test if this matters at all!
-        std::set<VSNode *> seenNodes;
+    // fixme, test if this matters at all!
+    std::set<VSNode *> seenNodes;
 
-        for (auto iter = owner->tasks.begin(); iter != owner->tasks.end(); ++iter) {
-            FrameContext *mainContext = iter->get();
-            FrameContext *leafContext = nullptr;
+    for (auto iter = tasks.begin(); iter != tasks.end(); ++iter) {
+        FrameContext *mainContext = iter->get();
+        FrameContext *leafContext = nullptr;
+
+        if (root && !isRequestedBy(mainContext, root))
+            continue;
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Handle the output tasks
-            if (mainContext->frameDone && mainContext->returnedFrame) {
-                PFrameContext mainContextRef(*iter);
-                owner->tasks.erase(iter);
-                owner->returnFrame(mainContextRef, mainContext->returnedFrame);
-                ranTask = true;
-                break;
-            }
+        if (mainContext->frameDone && mainContext->returnedFrame) {
+            PFrameContext mainContextRef(*iter);
+            tasks.erase(iter);
+            returnFrame(mainContextRef, mainContext->returnedFrame);
+            ranTask = true;
+            break;
+        }
 
-            if (mainContext->frameDone && mainContext->hasError()) {
-                PFrameContext mainContextRef(*iter);
-                owner->tasks.erase(iter);
-                owner->returnFrame(mainContextRef, mainContext->getErrorMessage());
-                ranTask = true;
-                break;
-            }
+        if (mainContext->frameDone && mainContext->hasError()) {
+            PFrameContext mainContextRef(*iter);
+            tasks.erase(iter);
+            returnFrame(mainContextRef, mainContext->getErrorMessage());
+            ranTask = true;
+            break;
+        }
 
-            if (seenNodes.count(mainContext->clip))
-                continue;
-            seenNodes.insert(mainContext->clip);
+        bool hasLeafContext = mainContext->returnedFrame || mainContext->hasError();
+        if (hasLeafContext) {
+            leafContext = mainContext;
+            mainContext = mainContext->upstreamContext.get();
+        }
 
-            bool hasLeafContext = mainContext->returnedFrame || mainContext->hasError();
-            if (hasLeafContext) {
-                leafContext = mainContext;
-                mainContext = mainContext->upstreamContext.get();
-            }
+        VSNode *clip = mainContext->clip;
+        int filterMode = clip->filterMode;
 
-            VSNode *clip = mainContext->clip;
-            int filterMode = clip->filterMode;
+        // Tasks carrying a finished frame run the filter that requested it, so that's the node
+        // to skip, otherwise one of them waiting for a busy filter holds back every other task
+        // of the node that produced the frame
+        if (seenNodes.count(clip))
+            continue;
+        seenNodes.insert(clip);
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // This part handles the locking for the different filter modes
 
-            bool parallelRequestsNeedsUnlock = false;
-            if (filterMode == fmUnordered || filterMode == fmUnorderedLinear) {
-                // already busy?
-                if (!clip->serialMutex.try_lock())
-                    continue;
-            } else if (filterMode == fmSerial) {
-                // already busy?
-                if (!clip->serialMutex.try_lock())
-                    continue;
-                // no frame in progress?
-                if (clip->serialFrame == -1) {
-                    clip->serialFrame = mainContext->n;
-                // another frame already in progress?
-                } else if (clip->serialFrame != mainContext->n) {
-                    clip->serialMutex.unlock();
-                    continue;
-                }
-                // continue processing the already started frame
-            } else if (filterMode == fmParallel) {
-                std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
-                // is the filter already processing another call for this frame? if so move along
-                if (clip->concurrentFrames.count(mainContext->n)) {
-                    continue;
-                } else {
+        bool parallelRequestsNeedsUnlock = false;
+        if (filterMode == fmUnordered || filterMode == fmUnorderedLinear) {
+            // already busy?
+            if (!clip->serialMutex.try_lock())
+                continue;
+        } else if (filterMode == fmSerial) {
+            // already busy?
+            if (!clip->serialMutex.try_lock())
+                continue;
+            // no frame in progress?
+            if (clip->serialFrame == -1) {
+                clip->serialFrame = mainContext->n;
+            // another frame already in progress?
+            } else if (clip->serialFrame != mainContext->n) {
+                clip->serialMutex.unlock();
+                continue;
+            }
+            // continue processing the already started frame
+        } else if (filterMode == fmParallel) {
+            std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
+            // is the filter already processing another call for this frame? if so move along
+            if (clip->concurrentFrames.count(mainContext->n)) {
+                continue;
+            } else {
+                clip->concurrentFrames.insert(mainContext->n);
+            }
+        } else if (filterMode == fmParallelRequests) {
+            std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
+            // is the filter already processing another call for this frame? if so move along
+            if (clip->concurrentFrames.count(mainContext->n)) {
+                continue;
+            } else {
+                // do we need the serial lock since all frames will be ready this time?
+                // check if we're in the arAllFramesReady state so we need additional locking
+                if (mainContext->numFrameRequests == 1) {
+                    if (!clip->serialMutex.try_lock())
+                        continue;
+                    parallelRequestsNeedsUnlock = true;
                     clip->concurrentFrames.insert(mainContext->n);
                 }
-            } else if (filterMode == fmParallelRequests) {
-                std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
-                // is the filter already processing another call for this frame? if so move along
-                if (clip->concurrentFrames.count(mainContext->n)) {
-                    continue;
-                } else {
-                    // do we need the serial lock since all frames will be ready this time?
-                    // check if we're in the arAllFramesReady state so we need additional locking
-                    if (mainContext->numFrameRequests == 1) {
-                        if (!clip->serialMutex.try_lock())
-                            continue;
-                        parallelRequestsNeedsUnlock = true;
-                        clip->concurrentFrames.insert(mainContext->n);
-                    }
-                }
             }
+        }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Remove the context from the task list
 
-            PFrameContext mainContextRef;
-            PFrameContext leafContextRef;
-            if (hasLeafContext) {
-                leafContextRef = *iter;
-                mainContextRef = leafContextRef->upstreamContext;
-            } else {
-                mainContextRef = *iter;
-            }
+        PFrameContext mainContextRef;
+        PFrameContext leafContextRef;
+        if (hasLeafContext) {
+            leafContextRef = *iter;
+            mainContextRef = leafContextRef->upstreamContext;
+        } else {
+            mainContextRef = *iter;
+        }
 
-            owner->tasks.erase(iter);
+        tasks.erase(iter);
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Figure out the activation reason
 
-            VSActivationReason ar = arInitial;
-            bool skipCall = false; // Used to avoid multiple error calls for the same frame request going into a filter
-            if ((hasLeafContext && leafContext->hasError()) || mainContext->hasError()) {
-                ar = arError;
-                skipCall = mainContext->setError(leafContext->getErrorMessage());
-                --mainContext->numFrameRequests;
-            } else if (hasLeafContext && leafContext->returnedFrame) {
-                if (--mainContext->numFrameRequests > 0)
-                    ar = arFrameReady;
-                else
-                    ar = arAllFramesReady;
-
-                mainContext->availableFrames.insert(std::make_pair(NodeOutputKey(leafContext->clip, leafContext->n, leafContext->index), leafContext->returnedFrame));
-                mainContext->lastCompletedN = leafContext->n;
-                mainContext->lastCompletedNode = leafContext->node;
-            }
+        VSActivationReason ar = arInitial;
+        bool skipCall = false; // Used to avoid multiple error calls for the same frame request going into a filter
+        if ((hasLeafContext && leafContext->hasError()) || mainContext->hasError()) {
+            ar = arError;
+            skipCall = mainContext->setError(leafContext->getErrorMessage());
+            --mainContext->numFrameRequests;
+        } else if (hasLeafContext && leafContext->returnedFrame) {
+            if (--mainContext->numFrameRequests > 0)
+                ar = arFrameReady;
+            else
+                ar = arAllFramesReady;
+
+            mainContext->availableFrames.insert(std::make_pair(NodeOutputKey(leafContext->clip, leafContext->n, leafContext->index), leafContext->returnedFrame));
+            mainContext->lastCompletedN = leafContext->n;
+            mainContext->lastCompletedNode = leafContext->node;
+        }
 
-            bool hasExistingRequests = !!mainContext->numFrameRequests;
-            bool isLinear = (filterMode == fmUnorderedLinear);
+        bool hasExistingRequests = !!mainContext->numFrameRequests;
+        bool isLinear = (filterMode == fmUnorderedLinear);
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Do the actual processing
 
-            if (!isLinear)
-                lock.unlock();
+        if (!isLinear)
+            lock.unlock();
 
-            VSFrameContext externalFrameCtx(mainContextRef);
-            assert(ar == arError || !mainContext->hasError());
+        VSFrameContext externalFrameCtx(mainContextRef);
+        assert(ar == arError || !mainContext->hasError());
 #ifdef VS_FRAME_REQ_DEBUG
-            vsWarning("Entering: %s Frame: %d Index: %d AR: %d Req: %d", mainContext->clip->name.c_str(), mainContext->n, mainContext->index, (int)ar, (int)mainContext->reqOrder);
+        vsWarning("Entering: %s Frame: %d Index: %d AR: %d Req: %d", mainContext->clip->name.c_str(), mainContext->n, mainContext->index, (int)ar, (int)mainContext->reqOrder);
 #endif
-            PVideoFrame f;
-            if (!skipCall)
-                f = clip->getFrameInternal(mainContext->n, ar, externalFrameCtx);
-            ranTask = true;
+        PVideoFrame f;
+        if (!skipCall)
+            f = clip->getFrameInternal(mainContext->n, ar, externalFrameCtx);
+        ranTask = true;
 #ifdef VS_FRAME_REQ_DEBUG
-            vsWarning("Exiting: %s Frame: %d Index: %d AR: %d Req: %d", mainContext->clip->name.c_str(), mainContext->n, mainContext->index, (int)ar, (int)mainContext->reqOrder);
+        vsWarning("Exiting: %s Frame: %d Index: %d AR: %d Req: %d", mainContext->clip->name.c_str(), mainContext->n, mainContext->index, (int)ar, (int)mainContext->reqOrder);
 #endif
-            bool frameProcessingDone = f || mainContext->hasError();
-            if (mainContext->hasError() && f)
-                vsFatal("A frame was returned by %s but an error was also set, this is not allowed", clip->name.c_str());
-                
+        bool frameProcessingDone = f || mainContext->hasError();
+        if (mainContext->hasError() && f)
+            vsFatal("A frame was returned by %s but an error was also set, this is not allowed", clip->name.c_str());
+            
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Unlock so the next job can run on the context
-            if (filterMode == fmUnordered || filterMode == fmUnorderedLinear) {
-                clip->serialMutex.unlock();
-            } else if (filterMode == fmSerial) {
-                if (frameProcessingDone)
-                    clip->serialFrame = -1;
+        if (filterMode == fmUnordered || filterMode == fmUnorderedLinear) {
+            clip->serialMutex.unlock();
+        } else if (filterMode == fmSerial) {
+            if (frameProcessingDone)
+                clip->serialFrame = -1;
+            clip->serialMutex.unlock();
+        } else if (filterMode == fmParallel) {
+            std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
+            clip->concurrentFrames.erase(mainContext->n);
+        } else if (filterMode == fmParallelRequests) {
+            std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
+            clip->concurrentFrames.erase(mainContext->n);
+            if (parallelRequestsNeedsUnlock)
                 clip->serialMutex.unlock();
-            } else if (filterMode == fmParallel) {
-                std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
-                clip->concurrentFrames.erase(mainContext->n);
-            } else if (filterMode == fmParallelRequests) {
-                std::lock_guard<std::mutex> lock(clip->concurrentFramesMutex);
-                clip->concurrentFrames.erase(mainContext->n);
-                if (parallelRequestsNeedsUnlock)
-                    clip->serialMutex.unlock();
-            }
+        }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Handle frames that were requested
-            bool requestedFrames = !externalFrameCtx.reqList.empty() && !frameProcessingDone;
+        bool requestedFrames = !externalFrameCtx.reqList.empty() && !frameProcessingDone;
 
-            if (!isLinear)
-                lock.lock();
+        if (!isLinear)
+            lock.lock();
 
-            if (requestedFrames) {
-                for (auto &reqIter : externalFrameCtx.reqList)
-                    owner->startInternal(reqIter);
-                externalFrameCtx.reqList.clear();
-            }
+        if (requestedFrames) {
+            for (auto &reqIter : externalFrameCtx.reqList)
+                startInternal(reqIter);
+            externalFrameCtx.reqList.clear();
+        }
 
-            if (frameProcessingDone)
-                owner->allContexts.erase(NodeOutputKey(mainContext->clip, mainContext->n, mainContext->index));
+        if (frameProcessingDone)
+            allContexts.erase(NodeOutputKey(mainContext->clip, mainContext->n, mainContext->index));
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Propagate status to other linked contexts
 // CHANGES mainContextRef!!!
 
-            if (mainContext->hasError() && !hasExistingRequests && !requestedFrames) {
-                PFrameContext n;
-                do {
-                    n = mainContextRef->notificationChain;
-
-                    if (n) {
-                        mainContextRef->notificationChain.reset();
-                        n->setError(mainContextRef->getErrorMessage());
-                    }
-
-                    if (mainContextRef->upstreamContext) {
-                        owner->startInternal(mainContextRef);
-                    }
-
-                    if (mainContextRef->frameDone) {
-                        owner->returnFrame(mainContextRef, mainContextRef->getErrorMessage());
-                    }
-                } while ((mainContextRef = n));
-            } else if (f) {
-                if (hasExistingRequests || requestedFrames)
-                    vsFatal("A frame was returned at the end of processing by %s but there are still outstanding requests", clip->name.c_str());
-                PFrameContext n;
-
-                do {
-                    n = mainContextRef->notificationChain;
-
-                    if (n)
-                        mainContextRef->notificationChain.reset();
-
-                    if (mainContextRef->upstreamContext) {
-                        mainContextRef->returnedFrame = f;
-                        owner->startInternal(mainContextRef);
-                    }
-
-                    if (mainContextRef->frameDone)
-                        owner->returnFrame(mainContextRef, f);
-                } while ((mainContextRef = n));
-            } else if (hasExistingRequests || requestedFrames) {
-                // already scheduled, do nothing
-            } else {
-                vsFatal("No frame returned at the end of processing by %s", clip->name.c_str());
-            }
-            break;
+        if (mainContext->hasError() && !hasExistingRequests && !requestedFrames) {
+            PFrameContext n;
+            do {
+                n = mainContextRef->notificationChain;
+
+                if (n) {
+                    mainContextRef->notificationChain.reset();
+                    n->setError(mainContextRef->getErrorMessage());
+                }
+
+                if (mainContextRef->upstreamContext) {
+                    startInternal(mainContextRef);
+                }
+
+                if (mainContextRef->frameDone) {
+                    returnFrame(mainContextRef, mainContextRef->getErrorMessage());
+                }
+            } while ((mainContextRef = n));
+        } else if (f) {
+            if (hasExistingRequests || requestedFrames)
+                vsFatal("A frame was returned at the end of processing by %s but there are still outstanding requests", clip->name.c_str());
+            PFrameContext n;
+
+            do {
+                n = mainContextRef->notificationChain;
+
+                if (n)
+                    mainContextRef->notificationChain.reset();
+
+                if (mainContextRef->upstreamContext) {
+                    mainContextRef->returnedFrame = f;
+                    startInternal(mainContextRef);
+                }
+
+                if (mainContextRef->frameDone)
+                    returnFrame(mainContextRef, f);
+            } while ((mainContextRef = n));
+        } else if (hasExistingRequests || requestedFrames) {
+            // already scheduled, do nothing
+        } else {
+            vsFatal("No frame returned at the end of processing by %s", clip->name.c_str());
         }
+        break;
+    }
+
 
+    return ranTask;
+}
+
+void VSThreadPool::runTasks(VSThreadPool *owner, std::atomic<bool> &stop) {
+#ifdef VS_TARGET_CPU_X86
+    if (!vs_isMMXStateOk())
+        vsFatal("Bad MMX state detected after creating new thread");
+#endif
+#ifdef VS_TARGET_OS_WINDOWS
+    if (!vs_isFPUStateOk())
+        vsWarning("Bad FPU state detected after creating new thread");
+    if (!vs_isSSEStateOk())
+        vsFatal("Bad SSE state detected after creating new thread");
+#endif
+
+    std::unique_lock<std::mutex> lock(owner->lock);
+
+    while (true) {
+        bool ranTask = owner->runTask(lock, nullptr);
 
         if (!ranTask || owner->activeThreadCount() > owner->threadCount()) {
             --owner->activeThreads;
@@ -293,7 +320,7 @@ void VSThreadPool::runTasks(VSThreadPool *owner, std::atomic<bool> &stop) {
     }
 }
 
-VSThreadPool::VSThreadPool(VSCore *core, int threads) : core(core), activeThreads(0), idleThreads(0), reqCounter(0), stopThreads(false), ticks(0) {
+VSThreadPool::VSThreadPool(VSCore *core, int threads) : core(core), activeThreads(0), idleThreads(0), waitingThreads(0), reqCounter(0), stopThreads(false), ticks(0) {
     setThreadCount(threads);
 }
 
@@ -321,21 +348,15 @@ void VSThreadPool::setThreadCount(int threads) {
 
 void VSThreadPool::wakeThread() {
     if (activeThreads < maxThreads) {
-        if (idleThreads == 0) // newly spawned threads are active so no need to notify an additional thread
-            spawnThread();
-        else
+        if (idleThreads > 0)
             newWork.notify_one();
+        // Workers waiting in startAndWait() still exist and aren't replaced, an additional thread is only
+        // started when all of them are waiting since nothing would run the remaining tasks otherwise
+        else if (allThreads.size() < maxThreads || activeThreads == 0)
+            spawnThread(); // newly spawned threads are active so no need to notify an additional thread
     }
 }
 
-void VSThreadPool::releaseThread() {
-    --activeThreads;
-}
-
-void VSThreadPool::reserveThread() {
-    ++activeThreads;
-}
-
 void VSThreadPool::notifyCaches(bool needMemory) {
     std::lock_guard<std::mutex> lock(core->cacheLock);
     for (auto &cache : core->caches)
@@ -362,6 +383,8 @@ void VSThreadPool::returnFrame(const PFrameContext &rCtx, const PVideoFrame &f)
     if (outputLock)
         callbackLock.unlock();
     lock.lock();
+    if (waitingThreads)
+        helperWork.notify_all();
 }
 
 void VSThreadPool::returnFrame(const PFrameContext &rCtx, const std::string &errMsg) {
@@ -376,6 +399,8 @@ void VSThreadPool::returnFrame(const PFrameContext &rCtx, const std::string &err
     if (outputLock)
         callbackLock.unlock();
     lock.lock();
+    if (waitingThreads)
+        helperWork.notify_all();
 }
 
 void VSThreadPool::startInternal(const PFrameContext &context) {
@@ -427,6 +452,37 @@ void VSThreadPool::startInternal(const PFrameContext &context) {
         }
     }
     wakeThread();
+    if (waitingThreads)
+        helperWork.notify_all();
+}
+
+void VSThreadPool::startAndWait(const PFrameContext &context, const std::atomic<bool> &done) {
+    static thread_local int helpDepth = 0;
+    bool help = (++helpDepth <= maxHelpDepth);
+
+    std::unique_lock<std::mutex> l(lock);
+    context->reqOrder = ++reqCounter;
+    startInternal(context);
+
+    // Instead of blocking the worker and waking another thread to take its place the
+    // worker itself processes what the requested frame depends on. Only those tasks are
+    // eligible since anything else could end up waiting for the filter that's further
+    // up on this thread's stack.
+    while (!done) {
+        if (help && runTask(l, context.get()))
+            continue;
+
+        // Nothing to do until another thread finishes something, let an idle one use this thread's share meanwhile
+        --activeThreads;
+        if (!tasks.empty())
+            wakeThread();
+        ++waitingThreads;
+        helperWork.wait(l);
+        --waitingThreads;
+        ++activeThreads;
+    }
+
+    --helpDepth;
 }
 
 bool VSThreadPool::isWorkerThread() {
@@ -23,7 +23,13 @@ from cython cimport view
 from libc.stdint cimport intptr_t, uint16_t, uint32_t
 from cpython.buffer cimport (PyBUF_WRITABLE, PyBUF_FORMAT, PyBUF_STRIDES,
                              PyBUF_F_CONTIGUOUS)
-from cpython.ref cimport Py_INCREF, Py_DECREF
+from cpython.ref cimport Py_INCREF, Py_DECREF, PyObject
+from cpython.exc cimport PyErr_CheckSignals
+from cpython.pythread cimport (PyThread_type_lock, PyThread_allocate_lock, PyThread_free_lock,
+                               PyThread_acquire_lock, PyThread_release_lock, WAIT_LOCK)
+from libc.stdio cimport FILE, fwrite, fflush, fclose, snprintf
+from libc.stdlib cimport malloc, calloc, free
+import io
 import os
 import ctypes
 import threading
@@ -32,6 +38,7 @@ import gc
 import sys
 import inspect
 from types import MappingProxyType
+from collections import OrderedDict
 from collections.abc import Iterable, Mapping
 from fractions import Fraction
 
@@ -297,6 +304,8 @@ cdef class CallbackData(object):
     cdef int requested
     cdef int completed
     cdef int total
+    cdef int prefetch
+    cdef int backlog
     cdef int num_planes
     cdef bint y4m
     cdef dict reorder
@@ -310,6 +319,8 @@ cdef class CallbackData(object):
         self.requested = requested
         self.completed = 0
         self.total = total
+        self.prefetch = requested
+        self.backlog = total
         self.num_planes = num_planes
         self.y4m = y4m
         self.condition = threading.Condition()
@@ -405,6 +416,147 @@ cdef void __stdcall frameDoneCallbackOutput(void *data, const VSFrameRef *f, int
     d.condition.release()
 
 
+# Used by VideoNode.frames(), completed frames are only stored and reordering is done by the consumer.
+# New requests are issued as long as fewer than prefetch frames are in flight and fewer than backlog
+# frames are waiting to be consumed so a slow consumer doesn't make the number of stored frames grow.
+cdef void __stdcall frameDoneCallbackFrames(void *data, const VSFrameRef *f, int n, VSNodeRef *node, const char *errormsg) with gil:
+    cdef CallbackData d = <CallbackData>data
+    d.completed += 1
+
+    if f == NULL:
+        d.total = d.requested
+        if errormsg == NULL:
+            d.error = 'Failed to retrieve frame ' + str(n)
+        else:
+            d.error = 'Failed to retrieve frame ' + str(n) + ' with error: ' + errormsg.decode('utf-8')
+    else:
+        d.reorder[n] = createConstVideoFrame(f, d.funcs, d.node.core)
+
+    while d.requested < d.total and d.requested - d.completed < d.prefetch and d.requested - d.output < d.backlog:
+        d.node.funcs.getFrameAsync(d.requested, d.node.node, frameDoneCallbackFrames, data)
+        d.requested += 1
+
+    d.condition.acquire()
+    d.condition.notify()
+    d.condition.release()
+
+cdef extern from "stdio.h" nogil:
+    FILE *fdopen(int fd, const char *mode)
+
+cdef extern from "pythread.h" nogil:
+    ctypedef long long PY_TIMEOUT_T
+    enum:
+        PY_LOCK_ACQUIRED
+    int PyThread_acquire_lock_timed(PyThread_type_lock lock, PY_TIMEOUT_T microseconds, int intr_flag)
+
+# Used by VideoNode.output() when the file object is backed by a real file descriptor. Frames are
+# reordered and written to a FILE duplicated from it without ever taking the gil, apart from when
+# the progress_update function is called. The frame done callbacks of async requests are already
+# serialized by the core so the lock only protects the counters shared with the waiting thread.
+cdef struct NativeOutputData:
+    const VSAPI *funcs
+    VSNodeRef *node
+    FILE *f
+    PyThread_type_lock lock
+    PyThread_type_lock done
+    const VSFrameRef **reorder
+    int capacity
+    int prefetch
+    int output
+    int requested
+    int completed
+    int total
+    bint y4m
+    bint progress
+    bint signaled
+    bint failed
+    char error[1024]
+    PyObject *cbdata
+
+cdef int writeFrameNative(FILE *f, const VSAPI *funcs, const VSFrameRef *frame, bint y4m) nogil:
+    cdef const VSFormat *fi = funcs.getFrameFormat(frame)
+    cdef const uint8_t *readPtr
+    cdef int stride, rowSize, height, p, y
+
+    if y4m and fwrite(b'FRAME\n', 1, 6, f) != 6:
+        return 1
+
+    for p in range(fi.numPlanes):
+        stride = funcs.getStride(frame, p)
+        readPtr = funcs.getReadPtr(frame, p)
+        rowSize = funcs.getFrameWidth(frame, p) * fi.bytesPerSample
+        height = funcs.getFrameHeight(frame, p)
+
+        if stride == rowSize:
+            if fwrite(readPtr, 1, <size_t>rowSize * height, f) != <size_t>rowSize * height:
+                return 1
+        else:
+            for y in range(height):
+                if fwrite(readPtr + <intptr_t>stride * y, 1, rowSize, f) != <size_t>rowSize:
+                    return 1
+
+    return 0
+
+cdef void __stdcall frameDoneCallbackOutputNative(void *data, const VSFrameRef *f, int n, VSNodeRef *node, const char *errormsg) nogil:
+    cdef NativeOutputData *d = <NativeOutputData *>data
+    cdef const VSFrameRef *frame
+    cdef bint finished
+
+    PyThread_acquire_lock(d.lock, WAIT_LOCK)
+    d.completed += 1
+    PyThread_release_lock(d.lock)
+
+    if f == NULL:
+        PyThread_acquire_lock(d.lock, WAIT_LOCK)
+        d.total = d.requested
+        PyThread_release_lock(d.lock)
+        if not d.failed:
+            d.failed = True
+            if errormsg == NULL:
+                snprintf(d.error, sizeof(d.error), "Failed to retrieve frame %d", n)
+            else:
+                snprintf(d.error, sizeof(d.error), "Failed to retrieve frame %d with error: %s", n, errormsg)
+    else:
+        d.reorder[n % d.capacity] = f
+
+        while d.reorder[d.output % d.capacity] != NULL:
+            frame = d.reorder[d.output % d.capacity]
+            d.reorder[d.output % d.capacity] = NULL
+            if not d.failed and writeFrameNative(d.f, d.funcs, frame, d.y4m):
+                d.failed = True
+                snprintf(d.error, sizeof(d.error), "File write call returned an error")
+                PyThread_acquire_lock(d.lock, WAIT_LOCK)
+                d.total = d.requested
+                PyThread_release_lock(d.lock)
+            d.funcs.freeFrame(frame)
+            d.output += 1
+
+        if d.progress and not d.failed:
+            with gil:
+                try:
+                    (<CallbackData>d.cbdata).progress_update(d.completed, d.total)
+                except BaseException as e:
+                    (<CallbackData>d.cbdata).error = 'Progress update caused an exception: ' + str(e)
+                    d.failed = True
+                    PyThread_acquire_lock(d.lock, WAIT_LOCK)
+                    d.total = d.requested
+                    PyThread_release_lock(d.lock)
+
+    PyThread_acquire_lock(d.lock, WAIT_LOCK)
+    # keep at most capacity frames between the oldest unwritten frame and the newest request
+    while d.requested < d.total and d.requested - d.completed < d.prefetch and d.requested - d.output < d.capacity:
+        d.funcs.getFrameAsync(d.requested, d.node, frameDoneCallbackOutputNative, data)
+        d.requested += 1
+    finished = d.completed == d.total and not d.signaled
+    if finished:
+        d.signaled = True
+    PyThread_release_lock(d.lock)
+
+    # d may be freed as soon as done is released
+    if finished:
+        PyThread_release_lock(d.done)
+
+
 cdef object mapToDict(const VSMap *map, bint flatten, bint add_cache, Core core, const VSAPI *funcs):
     cdef int numKeys = funcs.propNumKeys(map)
     retdict = {}
@@ -1193,6 +1345,18 @@ cdef class VideoNode(object):
         cdef str header = 'YUV4MPEG2 ' + y4mformat + 'W' + str(self.width) + ' H' + str(self.height) + ' F' + str(self.fps_num) + ':' + str(self.fps_den) + ' Ip A0:0\n'
         if y4m:
             fileobj.write(header.encode('utf-8'))
+
+        cdef int fd = -1
+        try:
+            fd = fileobj.fileno()
+        except (AttributeError, io.UnsupportedOperation, OSError):
+            pass
+
+        if fd >= 0:
+            fileobj.flush()
+            self._output_native(fd, d, prefetch)
+            return
+
         d.condition.acquire()
 
         for n in range(min(prefetch, d.total)):
@@ -1212,6 +1376,97 @@ cdef class VideoNode(object):
 
         if d.error:
             raise Error(d.error)
+
+    cdef _output_native(self, int fd, CallbackData cbdata, int prefetch):
+        cdef NativeOutputData *d = <NativeOutputData *>calloc(1, sizeof(NativeOutputData))
+        cdef int n, initial
+        cdef bint acquired, finished
+        if d == NULL:
+            raise MemoryError()
+
+        d.funcs = self.funcs
+        d.node = self.node
+        d.prefetch = min(prefetch, cbdata.total)
+        d.capacity = max(d.prefetch * 2, 1)
+        d.total = cbdata.total
+        d.y4m = cbdata.y4m
+        d.progress = cbdata.progress_update is not None
+        d.cbdata = <PyObject *>cbdata
+        d.reorder = <const VSFrameRef **>calloc(d.capacity, sizeof(VSFrameRef *))
+        d.lock = PyThread_allocate_lock()
+        d.done = PyThread_allocate_lock()
+        dupfd = os.dup(fd)
+        d.f = fdopen(dupfd, b'wb')
+
+        if d.f == NULL:
+            os.close(dupfd)
+        if d.reorder == NULL or d.lock == NULL or d.done == NULL or d.f == NULL:
+            if d.f != NULL:
+                fclose(d.f)
+            if d.lock != NULL:
+                PyThread_free_lock(d.lock)
+            if d.done != NULL:
+                PyThread_free_lock(d.done)
+            free(d.reorder)
+            free(d)
+            raise Error('Failed to set up native output')
+
+        stored_exception = None
+
+        try:
+            # done is released by the callback that completes the last frame
+            PyThread_acquire_lock(d.done, WAIT_LOCK)
+
+            with nogil:
+                PyThread_acquire_lock(d.lock, WAIT_LOCK)
+                initial = d.prefetch
+                d.requested = initial
+                for n in range(initial):
+                    d.funcs.getFrameAsync(n, d.node, frameDoneCallbackOutputNative, <void *>d)
+                PyThread_release_lock(d.lock)
+
+            if initial > 0:
+                while True:
+                    with nogil:
+                        acquired = PyThread_acquire_lock_timed(d.done, 100000, 0) == PY_LOCK_ACQUIRED
+                    if acquired:
+                        break
+                    try:
+                        PyErr_CheckSignals()
+                    except BaseException, e:
+                        stored_exception = e
+                        with nogil:
+                            PyThread_acquire_lock(d.lock, WAIT_LOCK)
+                            d.total = d.requested
+                            # no callback will signal completion if all requested frames already finished
+                            finished = d.completed == d.total and not d.signaled
+                            if finished:
+                                d.signaled = True
+                            PyThread_release_lock(d.lock)
+                        if finished:
+                            break
+
+            with nogil:
+                if fflush(d.f) != 0 and not d.failed:
+                    d.failed = True
+                    snprintf(d.error, sizeof(d.error), "File write call returned an error")
+
+            if stored_exception is not None:
+                raise stored_exception
+
+            if cbdata.error:
+                raise Error(cbdata.error)
+
+            if d.failed:
+                raise Error(d.error.decode('utf-8'))
+        finally:
+            for n in range(d.capacity):
+                self.funcs.freeFrame(d.reorder[n])
+            fclose(d.f)
+            PyThread_free_lock(d.lock)
+            PyThread_free_lock(d.done)
+            free(d.reorder)
+            free(d)
             
     def __add__(x, y):
         if not isinstance(x, VideoNode) or not isinstance(y, VideoNode):
@@ -1280,9 +1535,47 @@ cdef class VideoNode(object):
         else:
             raise TypeError("index must be int or slice")
 
-    def frames(self):
-        for frameno in range(len(self)):
-            yield self.get_frame(frameno)
+    def frames(self, int prefetch = 0, int backlog = -1):
+        if prefetch < 1:
+            prefetch = self.core.num_threads
+        if backlog < 0:
+            backlog = prefetch * 3
+        elif backlog < prefetch:
+            backlog = prefetch
+
+        cdef CallbackData d = CallbackData(None, 0, self.num_frames, 0, False, self, None)
+        d.prefetch = prefetch
+        d.backlog = backlog
+
+        try:
+            while d.output < d.total:
+                d.condition.acquire()
+                try:
+                    while d.requested < d.total and d.requested - d.completed < d.prefetch and d.requested - d.output < d.backlog:
+                        self.funcs.getFrameAsync(d.requested, self.node, frameDoneCallbackFrames, <void *>d)
+                        d.requested += 1
+
+                    # waiting on the condition releases the gil so the callbacks can run
+                    while d.output not in d.reorder and not d.error:
+                        d.condition.wait()
+
+                    if d.error:
+                        raise Error(d.error)
+
+                    frame = d.reorder.pop(d.output)
+                    d.output += 1
+                finally:
+                    d.condition.release()
+
+                yield frame
+        finally:
+            # all outstanding requests have to finish before d can go away
+            d.condition.acquire()
+            d.total = d.requested
+            while d.completed != d.requested:
+                d.condition.wait()
+            d.condition.release()
+            d.reorder.clear()
             
     def __dir__(self):
         plugins = [plugin["namespace"] for plugin in self.core.get_plugins().values()]
@@ -1482,12 +1775,14 @@ cdef class Core(object):
         s += '\tAccept Lowercase: ' + str(self.accept_lowercase) + '\n'
         return s
 
-cdef Core createCore():
+cdef Core createCore(VSCore *core = NULL):
     cdef Core instance = Core.__new__(Core)
     instance.funcs = getVapourSynthAPI(VAPOURSYNTH_API_VERSION)
     if instance.funcs == NULL:
         raise Error('Failed to obtain VapourSynth API pointer. System does not support SSE2 or is the Python module and loaded core library mismatched?')
-    instance.core = instance.funcs.createCore(0)
+    if core == NULL:
+        core = instance.funcs.createCore(0)
+    instance.core = core
     instance.add_cache = True
     instance.accept_lowercase = False
     return instance
@@ -1791,6 +2086,22 @@ cdef public api int vpy_createScript(VPYScriptExport *se) nogil:
             _environment_id = _environment_id_stack.pop()
         return 0         
     
+# the compiled code is kept for the most recently evaluated scripts so evaluating the same script again only has to run it
+_compiled_scripts = OrderedDict()
+_max_compiled_scripts = 32
+
+cdef object compileScript(bytes script, str fn):
+    key = (fn, script)
+    comp = _compiled_scripts.get(key)
+    if comp is None:
+        comp = compile(script.decode('utf-8-sig'), fn, 'exec')
+        _compiled_scripts[key] = comp
+        if len(_compiled_scripts) > _max_compiled_scripts:
+            _compiled_scripts.popitem(last=False)
+    else:
+        _compiled_scripts.move_to_end(key)
+    return comp
+
 cdef public api int vpy_evaluateScript(VPYScriptExport *se, const char *script, const char *scriptFilename, int flags) nogil:
     with gil:
         global _environment_id
@@ -1826,7 +2137,7 @@ cdef public api int vpy_evaluateScript(VPYScriptExport *se, const char *script,
                 Py_DECREF(errstr)
                 errstr = None
 
-            comp = compile(script.decode('utf-8-sig'), fn, 'exec')
+            comp = compileScript(script, fn)
             exec(comp) in evaldict
 
         except BaseException, e:
@@ -1873,6 +2184,17 @@ cdef public api int vpy_evaluateFile(VPYScriptExport *se, const char *scriptFile
             se.errstr = <void *>errstr
             return 1
 
+cdef public api int vpy_setCore(VPYScriptExport *se, VSCore *core) nogil:
+    with gil:
+        global _cores
+        if se.id in _cores:
+            return 1
+        try:
+            _cores[se.id] = createCore(core)
+        except:
+            return 1
+        return 0
+
 cdef public api void vpy_freeScript(VPYScriptExport *se) nogil:
     with gil:
         vpy_clearEnvironment(se)
@@ -25,6 +25,7 @@
 
 #define _POSIX_C_SOURCE 200112L
 #include <float.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,8 @@ typedef struct {
     int planes;
     float alpha, beta, gamma,  vthresh0, vthresh1, vthresh2;
     int field, nrad, mdis, vcheck;
+    int isInt;
+    float peak, scale;
 } eedi3Data;
 
 
@@ -54,92 +57,220 @@ static void VS_CC eedi3Init(VSMap *in, VSMap *out, void **instanceData, VSNode *
 }
 
 
-static void interpLineFP(const uint8_t *srcp, const int width, const int pitch,
-                         const float alpha, const float beta, const float gamma, const int nrad,
-                         const int mdis, float *temp, uint8_t *dstp, int *dmap, const int ucubic,
-                         const int cost3)
+// All processing is done in float. Integer formats round exactly like the original
+// 8 bit code did so the results stay identical for 8 bit input.
+
+static inline float roundedMean(const float sum, const float bias, const float norm, const int isInt)
 {
-    const uint8_t *src3p = srcp - 3 * pitch;
-    const uint8_t *src1p = srcp - 1 * pitch;
-    const uint8_t *src1n = srcp + 1 * pitch;
-    const uint8_t *src3n = srcp + 3 * pitch;
-    const int tpitch = mdis * 2 + 1;
-    float *ccosts = temp;
-    float *pcosts = ccosts + width * tpitch;
-    int *pbackt = (int *)(pcosts + width * tpitch);
-    int *fpath = pbackt + width * tpitch;
-
-    int k, u, v, x;
-
-    // calculate all connection costs
-    if(!cost3) {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax; u <= umax; ++u) {
-                int s = 0;
-
-                for(k = -nrad; k <= nrad; ++k)
-                    s +=
-                        abs(src3p[x + u + k] - src1p[x - u + k]) +
-                        abs(src1p[x + u + k] - src1n[x - u + k]) +
-                        abs(src1n[x + u + k] - src3n[x - u + k]);
-
-                const int ip = (src1p[x + u] + src1n[x - u] + 1) >> 1; // should use cubic if ucubic=true
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
-                ccosts[x * tpitch + mdis + u] = alpha * s + beta * abs(u) + (1.0f - alpha - beta) * v;
-            }
-        }
+    return isInt ? (float)(int)((sum + bias) * norm) : sum * norm;
+}
+
+
+static inline float cubicMean(const float inner, const float outer, const float bias, const float norm, const eedi3Data *d)
+{
+    const float val = 36.0f * inner - 4.0f * outer;
+
+    if(!d->isInt)
+        return val * norm;
+
+    return VSMIN((float)(int)VSMAX((val + bias) * norm, 0.0f), d->peak);
+}
+
+
+// Reads past the 12 pixel padding of the source repeat its outermost pixel
+static void loadRow(const uint8_t *srcp, const int width, const int margin, const int bytesPerSample, float *dst)
+{
+    int x;
+
+    if(bytesPerSample == 1) {
+        for(x = -margin; x < width + margin; ++x)
+            dst[x] = srcp[VSMIN(VSMAX(x, -12), width + 11)];
+    } else if(bytesPerSample == 2) {
+        const uint16_t *srcp16 = (const uint16_t *)srcp;
+
+        for(x = -margin; x < width + margin; ++x)
+            dst[x] = srcp16[VSMIN(VSMAX(x, -12), width + 11)];
     } else {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax; u <= umax; ++u) {
-                int s0 = 0, s1 = -1, s2 = -1;
-
-                for(k = -nrad; k <= nrad; ++k)
-                    s0 +=
-                        abs(src3p[x + u + k] - src1p[x - u + k]) +
-                        abs(src1p[x + u + k] - src1n[x - u + k]) +
-                        abs(src1n[x + u + k] - src3n[x - u + k]);
-
-                if((u >= 0 && x >= u * 2) || (u <= 0 && x < width + u * 2)) {
-                    s1 = 0;
-
-                    for(k = -nrad; k <= nrad; ++k)
-                        s1 +=
-                            abs(src3p[x + k] - src1p[x - u * 2 + k]) +
-                            abs(src1p[x + k] - src1n[x - u * 2 + k]) +
-                            abs(src1n[x + k] - src3n[x - u * 2 + k]);
-                }
+        const float *srcpf = (const float *)srcp;
 
-                if((u <= 0 && x >= u * 2) || (u >= 0 && x < width + u * 2)) {
-                    s2 = 0;
+        for(x = -margin; x < width + margin; ++x)
+            dst[x] = srcpf[VSMIN(VSMAX(x, -12), width + 11)];
+    }
+}
 
-                    for(k = -nrad; k <= nrad; ++k)
-                        s2 +=
-                            abs(src3p[x + u * 2 + k] - src1p[x + k]) +
-                            abs(src1p[x + u * 2 + k] - src1n[x + k]) +
-                            abs(src1n[x + u * 2 + k] - src3n[x + k]);
-                }
 
-                s1 = s1 >= 0 ? s1 : (s2 >= 0 ? s2 : s0);
-                s2 = s2 >= 0 ? s2 : (s1 >= 0 ? s1 : s0);
-                const int ip = (src1p[x + u] + src1n[x - u] + 1) >> 1; // should use cubic if ucubic=true
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
-                ccosts[x * tpitch + mdis + u] = alpha * (s0 + s1 + s2) * 0.333333f + beta * abs(u) + (1.0f - alpha - beta) * v;
+static void storeRow(const float *src, const int width, const int bytesPerSample, uint8_t *dstp)
+{
+    int x;
+
+    if(bytesPerSample == 1) {
+        for(x = 0; x < width; ++x)
+            dstp[x] = (uint8_t)src[x];
+    } else if(bytesPerSample == 2) {
+        uint16_t *dstp16 = (uint16_t *)dstp;
+
+        for(x = 0; x < width; ++x)
+            dstp16[x] = (uint16_t)src[x];
+    } else {
+        memcpy(dstp, src, width * sizeof(float));
+    }
+}
+
+
+static void calcHalfPelRow(const float *src, float *dst, const int width, const int margin, const eedi3Data *d)
+{
+    int x;
+
+    for(x = -margin; x < width + margin - 1; ++x) {
+        if(!d->ucubic || x <= 0 || x >= width - 2)
+            dst[x] = roundedMean(src[x] + src[x + 1], 1.0f, 0.5f, d->isInt);
+        else
+            dst[x] = cubicMean(src[x] + src[x + 1], src[x - 1] + src[x + 2], 32.0f, 1.0f / 64.0f, d);
+    }
+
+    dst[width + margin - 1] = dst[width + margin - 2];
+}
+
+
+// sums[x] is the sum of absolute differences between the rows when connecting x in the upper
+// rows to x - delta in the lower ones, taken over a 2 * nrad + 1 wide window centered on x
+static void calcDiffSums(const float *r3p, const float *r1p, const float *r1n, const float *r3n,
+                         const int delta, const int start, const int end, const int nrad,
+                         float *diff, float *sums)
+{
+    int k, x;
+
+    for(x = start - nrad; x < end + nrad; ++x)
+        diff[x] = fabsf(r3p[x] - r1p[x - delta]) + fabsf(r1p[x] - r1n[x - delta]) + fabsf(r1n[x] - r3n[x - delta]);
+
+    for(x = start; x < end; ++x)
+        sums[x] = diff[x - nrad];
+
+    for(k = -nrad + 1; k <= nrad; ++k)
+        for(x = start; x < end; ++x)
+            sums[x] += diff[x + k];
+}
+
+
+typedef struct {
+    float *r3p, *r1p, *r1n, *r3n;
+    float *h3p, *h1p, *h1n, *h3n;
+    float *diff, *sums, *sumshp;
+    float *ccosts, *pcosts;
+    int *pbackt, *fpath;
+    float *dline;
+} eedi3Lines;
+
+
+// The rows are padded on both sides so every direction can be evaluated without bounds checks
+static int rowMargin(const int mdis)
+{
+    return mdis * 4 + 8;
+}
+
+
+static size_t workspaceSize(const int width, const int mdis)
+{
+    const size_t rowWidth = width + 2 * rowMargin(mdis);
+    return (11 * rowWidth + 3 * (size_t)(mdis * 4 + 1) * width + 2 * width) * sizeof(float);
+}
+
+
+static void setupLines(eedi3Lines *l, float *temp, const int width, const int mdis, const int tpitch)
+{
+    const int margin = rowMargin(mdis);
+    const int rowWidth = width + 2 * margin;
+    float **rows[] = { &l->r3p, &l->r1p, &l->r1n, &l->r3n, &l->h3p, &l->h1p, &l->h1n, &l->h3n, &l->diff, &l->sums, &l->sumshp };
+    int i;
+
+    for(i = 0; i < 11; ++i)
+        *rows[i] = temp + i * rowWidth + margin;
+
+    temp += 11 * rowWidth;
+    l->ccosts = temp;
+    l->pcosts = l->ccosts + width * tpitch;
+    l->pbackt = (int *)(l->pcosts + width * tpitch);
+    l->fpath = l->pbackt + width * tpitch;
+    l->dline = (float *)(l->fpath + width);
+}
+
+
+static void loadLines(eedi3Lines *l, const uint8_t *srcp, const int width, const int pitch, const eedi3Data *d)
+{
+    const int margin = rowMargin(d->mdis);
+    const int bps = d->vi.format->bytesPerSample;
+
+    loadRow(srcp - 3 * pitch, width, margin, bps, l->r3p);
+    loadRow(srcp - 1 * pitch, width, margin, bps, l->r1p);
+    loadRow(srcp + 1 * pitch, width, margin, bps, l->r1n);
+    loadRow(srcp + 3 * pitch, width, margin, bps, l->r3n);
+}
+
+
+static void interpLineFP(const uint8_t *srcp, const int width, const int pitch, const eedi3Data *d,
+                         float *temp, uint8_t *dstp, int *dmap)
+{
+    const int mdis = d->mdis;
+    const int nrad = d->nrad;
+    const int isInt = d->isInt;
+    const int tpitch = mdis * 2 + 1;
+    // the weights are tuned for 8 bit sample differences
+    const float alpha = d->alpha * d->scale;
+    const float beta = d->beta;
+    const float vweight = (1.0f - d->alpha - d->beta) * d->scale;
+    eedi3Lines l;
+
+    int u, v, x;
+
+    setupLines(&l, temp, width, mdis, tpitch);
+    loadLines(&l, srcp, width, pitch, d);
+
+    // calculate all connection costs, one direction at a time so the loops over x vectorize
+    for(u = -mdis; u <= mdis; ++u) {
+        const int au = abs(u);
+        const int xstart = au;
+        const int xend = width - au;
+
+        if(xstart >= xend)
+            continue;
+
+        float *cc = l.ccosts + (mdis + u) * width;
+        const float *s0p = l.sums + u;
+        const float *ipp = l.r1p + u;
+        const float *ipn = l.r1n - u;
+
+        if(!d->cost3) {
+            calcDiffSums(l.r3p, l.r1p, l.r1n, l.r3n, u * 2, xstart + u, xend + u, nrad, l.diff, l.sums);
+
+            for(x = xstart; x < xend; ++x) {
+                const float ip = roundedMean(ipp[x] + ipn[x], 1.0f, 0.5f, isInt); // should use cubic if ucubic=true
+                const float vc = fabsf(l.r1p[x] - ip) + fabsf(l.r1n[x] - ip);
+                cc[x] = alpha * s0p[x] + beta * au + vweight * vc;
+            }
+        } else {
+            // s1 and s2 are the same sums centered on the two pixels the direction connects
+            calcDiffSums(l.r3p, l.r1p, l.r1n, l.r3n, u * 2, xstart + VSMIN(u * 2, 0), xend + VSMAX(u * 2, 0), nrad, l.diff, l.sums);
+
+            for(x = xstart; x < xend; ++x) {
+                const int v1 = x - u * 2 >= 0 && x - u * 2 < width;
+                const int v2 = x + u * 2 >= 0 && x + u * 2 < width;
+                const float s0 = s0p[x];
+                const float s1 = v1 ? l.sums[x] : (v2 ? l.sums[x + u * 2] : s0);
+                const float s2 = v2 ? l.sums[x + u * 2] : (v1 ? l.sums[x] : s0);
+                const float ip = roundedMean(ipp[x] + ipn[x], 1.0f, 0.5f, isInt); // should use cubic if ucubic=true
+                const float vc = fabsf(l.r1p[x] - ip) + fabsf(l.r1n[x] - ip);
+                cc[x] = alpha * (s0 + s1 + s2) * 0.333333f + beta * au + vweight * vc;
             }
         }
     }
 
     // calculate path costs
-    pcosts[mdis] = ccosts[mdis];
+    l.pcosts[mdis] = l.ccosts[mdis * width];
 
     for(x = 1; x < width; ++x) {
-        float *tT = ccosts + x * tpitch;
-        float *ppT = pcosts + (x - 1) * tpitch;
-        float *pT = pcosts + x * tpitch;
-        int *piT = pbackt + (x - 1) * tpitch;
+        float *ppT = l.pcosts + (x - 1) * tpitch;
+        float *pT = l.pcosts + x * tpitch;
+        int *piT = l.pbackt + (x - 1) * tpitch;
         const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
 
         for(u = -umax; u <= umax; ++u) {
@@ -148,7 +279,7 @@ static void interpLineFP(const uint8_t *srcp, const int width, const int pitch,
             const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis);
 
             for(v = VSMAX(-umax2, u - 1); v <= VSMIN(umax2, u + 1); ++v) {
-                const double y = ppT[mdis + v] + gamma * abs(u - v);
+                const double y = ppT[mdis + v] + d->gamma * abs(u - v);
                 const float ccost = (float)VSMIN(y, FLT_MAX * 0.9);
 
                 if(ccost < bval) {
@@ -157,7 +288,7 @@ static void interpLineFP(const uint8_t *srcp, const int width, const int pitch,
                 }
             }
 
-            const double y = bval + tT[mdis + u];
+            const double y = bval + l.ccosts[(mdis + u) * width + x];
 
             pT[mdis + u] = (float)VSMIN(y, FLT_MAX * 0.9);
 
@@ -166,156 +297,110 @@ static void interpLineFP(const uint8_t *srcp, const int width, const int pitch,
     }
 
     // backtrack
-    fpath[width - 1] = 0;
+    l.fpath[width - 1] = 0;
 
     for(x = width - 2; x >= 0; --x)
-        fpath[x] = pbackt[x * tpitch + mdis + fpath[x + 1]];
+        l.fpath[x] = l.pbackt[x * tpitch + mdis + l.fpath[x + 1]];
 
     // interpolate
     for(x = 0; x < width; ++x) {
-        const int dir = fpath[x];
+        const int dir = l.fpath[x];
         dmap[x] = dir;
         const int ad = abs(dir);
 
-        if(ucubic && x >= ad * 3 && x <= width - 1 - ad * 3)
-            dstp[x] = VSMIN(VSMAX((36 * (src1p[x + dir] + src1n[x - dir]) -
-                               4 * (src3p[x + dir * 3] + src3n[x - dir * 3]) + 32) >> 6, 0), 255);
+        if(d->ucubic && x >= ad * 3 && x <= width - 1 - ad * 3)
+            l.dline[x] = cubicMean(l.r1p[x + dir] + l.r1n[x - dir], l.r3p[x + dir * 3] + l.r3n[x - dir * 3], 32.0f, 1.0f / 64.0f, d);
         else
-            dstp[x] = (src1p[x + dir] + src1n[x - dir] + 1) >> 1;
+            l.dline[x] = roundedMean(l.r1p[x + dir] + l.r1n[x - dir], 1.0f, 0.5f, isInt);
     }
+
+    storeRow(l.dline, width, d->vi.format->bytesPerSample, dstp);
 }
 
 
-static void interpLineHP(const uint8_t *srcp, const int width, const int pitch,
-                         const float alpha, const float beta, const float gamma, const int nrad,
-                         const int mdis, float *temp, uint8_t *dstp, int *dmap, const int ucubic,
-                         const int cost3)
+static void interpLineHP(const uint8_t *srcp, const int width, const int pitch, const eedi3Data *d,
+                         float *temp, uint8_t *dstp, int *dmap)
 {
-    const uint8_t *src3p = srcp - 3 * pitch;
-    const uint8_t *src1p = srcp - 1 * pitch;
-    const uint8_t *src1n = srcp + 1 * pitch;
-    const uint8_t *src3n = srcp + 3 * pitch;
+    const int mdis = d->mdis;
+    const int nrad = d->nrad;
+    const int isInt = d->isInt;
+    const int margin = rowMargin(mdis);
     const int tpitch = mdis * 4 + 1;
-    float *ccosts = temp;
-    float *pcosts = ccosts + width * tpitch;
-    int *pbackt = (int *)(pcosts + width * tpitch);
-    int *fpath = pbackt + width * tpitch;
-    // calculate half pel values
-    uint8_t *hp3p = (uint8_t *)fpath;
-    uint8_t *hp1p = hp3p + width;
-    uint8_t *hp1n = hp1p + width;
-    uint8_t *hp3n = hp1n + width;
-
-    int k, u, v, x;
-
-    for(x = 0; x < width - 1; ++x) {
-        if(!ucubic || (x == 0 || x == width - 2)) {
-            hp3p[x] = (src3p[x] + src3p[x + 1] + 1) >> 1;
-            hp1p[x] = (src1p[x] + src1p[x + 1] + 1) >> 1;
-            hp1n[x] = (src1n[x] + src1n[x + 1] + 1) >> 1;
-            hp3n[x] = (src3n[x] + src3n[x + 1] + 1) >> 1;
-        } else {
-            hp3p[x] = VSMIN(VSMAX((36 * (src3p[x] + src3p[x + 1]) - 4 * (src3p[x - 1] + src3p[x + 2]) + 32) >> 6, 0), 255);
-            hp1p[x] = VSMIN(VSMAX((36 * (src1p[x] + src1p[x + 1]) - 4 * (src1p[x - 1] + src1p[x + 2]) + 32) >> 6, 0), 255);
-            hp1n[x] = VSMIN(VSMAX((36 * (src1n[x] + src1n[x + 1]) - 4 * (src1n[x - 1] + src1n[x + 2]) + 32) >> 6, 0), 255);
-            hp3n[x] = VSMIN(VSMAX((36 * (src3n[x] + src3n[x + 1]) - 4 * (src3n[x - 1] + src3n[x + 2]) + 32) >> 6, 0), 255);
-        }
-    }
+    // the weights are tuned for 8 bit sample differences
+    const float alpha = d->alpha * d->scale;
+    const float beta = d->beta;
+    const float vweight = (1.0f - d->alpha - d->beta) * d->scale;
+    eedi3Lines l;
 
-    // calculate all connection costs
-    if(!cost3) {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax * 2; u <= umax * 2; ++u) {
-                int s = 0, ip;
-                const int u2 = u >> 1;
-
-                if(!(u & 1)) {
-                    for(k = -nrad; k <= nrad; ++k)
-                        s +=
-                            abs(src3p[x + u2 + k] - src1p[x - u2 + k]) +
-                            abs(src1p[x + u2 + k] - src1n[x - u2 + k]) +
-                            abs(src1n[x + u2 + k] - src3n[x - u2 + k]);
-
-                    ip = (src1p[x + u2] + src1n[x - u2] + 1) >> 1; // should use cubic if ucubic=true
-                } else {
-                    for(k = -nrad; k <= nrad; ++k)
-                        s +=
-                            abs(hp3p[x + u2 + k] - hp1p[x - u2 - 1 + k]) +
-                            abs(hp1p[x + u2 + k] - hp1n[x - u2 - 1 + k]) +
-                            abs(hp1n[x + u2 + k] - hp3n[x - u2 - 1 + k]);
-
-                    ip = (hp1p[x + u2] + hp1n[x - u2 - 1] + 1) >> 1; // should use cubic if ucubic=true
-                }
+    int u, v, x;
 
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
+    setupLines(&l, temp, width, mdis, tpitch);
+    loadLines(&l, srcp, width, pitch, d);
 
-                ccosts[x * tpitch + mdis * 2 + u] = alpha * s + beta * abs(u) * 0.5f + (1.0f - alpha - beta) * v;
-            }
+    // calculate half pel values
+    calcHalfPelRow(l.r3p, l.h3p, width, margin - 2, d);
+    calcHalfPelRow(l.r1p, l.h1p, width, margin - 2, d);
+    calcHalfPelRow(l.r1n, l.h1n, width, margin - 2, d);
+    calcHalfPelRow(l.r3n, l.h3n, width, margin - 2, d);
+
+    // calculate all connection costs, one direction at a time so the loops over x vectorize
+    for(u = -mdis * 2; u <= mdis * 2; ++u) {
+        const int au = abs(u);
+        const int u2 = u >> 1;
+        const int xstart = (au + 1) >> 1;
+        const int xend = width - xstart;
+
+        if(xstart >= xend)
+            continue;
+
+        float *cc = l.ccosts + (mdis * 2 + u) * width;
+        const float *s0p, *ipp, *ipn;
+
+        // odd directions connect half pel positions
+        if(!(u & 1)) {
+            s0p = l.sums + u2;
+            ipp = l.r1p + u2;
+            ipn = l.r1n - u2;
+        } else {
+            calcDiffSums(l.h3p, l.h1p, l.h1n, l.h3n, u, xstart + u2, xend + u2, nrad, l.diff, l.sumshp);
+            s0p = l.sumshp + u2;
+            ipp = l.h1p + u2;
+            ipn = l.h1n - u2 - 1;
         }
-    } else {
-        for(x = 0; x < width; ++x) {
-            const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
-
-            for(u = -umax * 2; u <= umax * 2; ++u) {
-                int s0 = 0, s1 = -1, s2 = -1, ip;
-                const int u2 = u >> 1;
-
-                if(!(u & 1)) {
-                    for(k = -nrad; k <= nrad; ++k)
-                        s0 +=
-                            abs(src3p[x + u2 + k] - src1p[x - u2 + k]) +
-                            abs(src1p[x + u2 + k] - src1n[x - u2 + k]) +
-                            abs(src1n[x + u2 + k] - src3n[x - u2 + k]);
-
-                    ip = (src1p[x + u2] + src1n[x - u2] + 1) >> 1; // should use cubic if ucubic=true
-                } else {
-                    for(k = -nrad; k <= nrad; ++k)
-                        s0 +=
-                            abs(hp3p[x + u2 + k] - hp1p[x - u2 - 1 + k]) +
-                            abs(hp1p[x + u2 + k] - hp1n[x - u2 - 1 + k]) +
-                            abs(hp1n[x + u2 + k] - hp3n[x - u2 - 1 + k]);
-
-                    ip = (hp1p[x + u2] + hp1n[x - u2 - 1] + 1) >> 1; // should use cubic if ucubic=true
-                }
 
-                if((u >= 0 && x >= u) || (u <= 0 && x < width + u)) {
-                    s1 = 0;
+        if(!d->cost3) {
+            if(!(u & 1))
+                calcDiffSums(l.r3p, l.r1p, l.r1n, l.r3n, u, xstart + u2, xend + u2, nrad, l.diff, l.sums);
 
-                    for(k = -nrad; k <= nrad; ++k)
-                        s1 +=
-                            abs(src3p[x + k] - src1p[x - u + k]) +
-                            abs(src1p[x + k] - src1n[x - u + k]) +
-                            abs(src1n[x + k] - src3n[x - u + k]);
-                }
-
-                if((u <= 0 && x >= u) || (u >= 0 && x < width + u)) {
-                    s2 = 0;
-
-                    for(k = -nrad; k <= nrad; ++k)
-                        s2 +=
-                            abs(src3p[x + u + k] - src1p[x + k]) +
-                            abs(src1p[x + u + k] - src1n[x + k]) +
-                            abs(src1n[x + u + k] - src3n[x + k]);
-                }
-
-                s1 = s1 >= 0 ? s1 : (s2 >= 0 ? s2 : s0);
-                s2 = s2 >= 0 ? s2 : (s1 >= 0 ? s1 : s0);
-                const int v = abs(src1p[x] - ip) + abs(src1n[x] - ip);
-                ccosts[x * tpitch + mdis * 2 + u] = alpha * (s0 + s1 + s2) * 0.333333f + beta * abs(u) * 0.5f + (1.0f - alpha - beta) * v;
+            for(x = xstart; x < xend; ++x) {
+                const float ip = roundedMean(ipp[x] + ipn[x], 1.0f, 0.5f, isInt); // should use cubic if ucubic=true
+                const float vc = fabsf(l.r1p[x] - ip) + fabsf(l.r1n[x] - ip);
+                cc[x] = alpha * s0p[x] + beta * au * 0.5f + vweight * vc;
+            }
+        } else {
+            // s1 and s2 are the full pel sums centered on the two pixels the direction connects
+            calcDiffSums(l.r3p, l.r1p, l.r1n, l.r3n, u, xstart + VSMIN(u, 0), xend + VSMAX(u, 0), nrad, l.diff, l.sums);
+
+            for(x = xstart; x < xend; ++x) {
+                const int v1 = x - u >= 0 && x - u < width;
+                const int v2 = x + u >= 0 && x + u < width;
+                const float s0 = s0p[x];
+                const float s1 = v1 ? l.sums[x] : (v2 ? l.sums[x + u] : s0);
+                const float s2 = v2 ? l.sums[x + u] : (v1 ? l.sums[x] : s0);
+                const float ip = roundedMean(ipp[x] + ipn[x], 1.0f, 0.5f, isInt); // should use cubic if ucubic=true
+                const float vc = fabsf(l.r1p[x] - ip) + fabsf(l.r1n[x] - ip);
+                cc[x] = alpha * (s0 + s1 + s2) * 0.333333f + beta * au * 0.5f + vweight * vc;
             }
         }
     }
 
     // calculate path costs
-    pcosts[mdis * 2] = ccosts[mdis * 2];
+    l.pcosts[mdis * 2] = l.ccosts[mdis * 2 * width];
 
     for(x = 1; x < width; ++x) {
-        float *tT = ccosts + x * tpitch;
-        float *ppT = pcosts + (x - 1) * tpitch;
-        float *pT = pcosts + x * tpitch;
-        int *piT = pbackt + (x - 1) * tpitch;
+        float *ppT = l.pcosts + (x - 1) * tpitch;
+        float *pT = l.pcosts + x * tpitch;
+        int *piT = l.pbackt + (x - 1) * tpitch;
         const int umax = VSMIN(VSMIN(x, width - 1 - x), mdis);
 
         for(u = -umax * 2; u <= umax * 2; ++u) {
@@ -324,7 +409,7 @@ static void interpLineHP(const uint8_t *srcp, const int width, const int pitch,
             const int umax2 = VSMIN(VSMIN(x - 1, width - x), mdis);
 
             for(v = VSMAX(-umax2 * 2, u - 2); v <= VSMIN(umax2 * 2, u + 2); ++v) {
-                const double y = ppT[mdis * 2 + v] + gamma * abs(u - v) * 0.5f;
+                const double y = ppT[mdis * 2 + v] + d->gamma * abs(u - v) * 0.5f;
                 const float ccost = (float)VSMIN(y, FLT_MAX * 0.9);
 
                 if(ccost < bval) {
@@ -333,7 +418,7 @@ static void interpLineHP(const uint8_t *srcp, const int width, const int pitch,
                 }
             }
 
-            const double y = bval + tT[mdis * 2 + u];
+            const double y = bval + l.ccosts[(mdis * 2 + u) * width + x];
 
             pT[mdis * 2 + u] = (float)VSMIN(y, FLT_MAX * 0.9);
 
@@ -342,25 +427,24 @@ static void interpLineHP(const uint8_t *srcp, const int width, const int pitch,
     }
 
     // backtrack
-    fpath[width - 1] = 0;
+    l.fpath[width - 1] = 0;
 
     for(x = width - 2; x >= 0; --x)
-        fpath[x] = pbackt[x * tpitch + mdis * 2 + fpath[x + 1]];
+        l.fpath[x] = l.pbackt[x * tpitch + mdis * 2 + l.fpath[x + 1]];
 
     // interpolate
     for(x = 0; x < width; ++x) {
-        const int dir = fpath[x];
+        const int dir = l.fpath[x];
         dmap[x] = dir;
 
         if(!(dir & 1)) {
             const int d2 = dir >> 1;
             const int ad = abs(d2);
 
-            if(ucubic && x >= ad * 3 && x <= width - 1 - ad * 3)
-                dstp[x] = VSMIN(VSMAX((36 * (src1p[x + d2] + src1n[x - d2]) -
-                                   4 * (src3p[x + d2 * 3] + src3n[x - d2 * 3]) + 32) >> 6, 0), 255);
+            if(d->ucubic && x >= ad * 3 && x <= width - 1 - ad * 3)
+                l.dline[x] = cubicMean(l.r1p[x + d2] + l.r1n[x - d2], l.r3p[x + d2 * 3] + l.r3n[x - d2 * 3], 32.0f, 1.0f / 64.0f, d);
             else
-                dstp[x] = (src1p[x + d2] + src1n[x - d2] + 1) >> 1;
+                l.dline[x] = roundedMean(l.r1p[x + d2] + l.r1n[x - d2], 1.0f, 0.5f, isInt);
         } else {
             const int d20 = dir >> 1;
             const int d21 = (dir + 1) >> 1;
@@ -368,16 +452,18 @@ static void interpLineHP(const uint8_t *srcp, const int width, const int pitch,
             const int d31 = (dir * 3 + 1) >> 1;
             const int ad = VSMAX(abs(d30), abs(d31));
 
-            if(ucubic && x >= ad && x <= width - 1 - ad) {
-                const int c0 = src3p[x + d30] + src3p[x + d31];
-                const int c1 = src1p[x + d20] + src1p[x + d21]; // should use cubic if ucubic=true
-                const int c2 = src1n[x - d20] + src1n[x - d21]; // should use cubic if ucubic=true
-                const int c3 = src3n[x - d30] + src3n[x - d31];
-                dstp[x] = VSMIN(VSMAX((36 * (c1 + c2) - 4 * (c0 + c3) + 64) >> 7, 0), 255);
+            if(d->ucubic && x >= ad && x <= width - 1 - ad) {
+                const float c0 = l.r3p[x + d30] + l.r3p[x + d31];
+                const float c1 = l.r1p[x + d20] + l.r1p[x + d21]; // should use cubic if ucubic=true
+                const float c2 = l.r1n[x - d20] + l.r1n[x - d21]; // should use cubic if ucubic=true
+                const float c3 = l.r3n[x - d30] + l.r3n[x - d31];
+                l.dline[x] = cubicMean(c1 + c2, c0 + c3, 64.0f, 1.0f / 128.0f, d);
             } else
-                dstp[x] = (src1p[x + d20] + src1p[x + d21] + src1n[x - d20] + src1n[x - d21] + 2) >> 2;
+                l.dline[x] = roundedMean(l.r1p[x + d20] + l.r1p[x + d21] + l.r1n[x - d20] + l.r1n[x - d21], 2.0f, 0.25f, isInt);
         }
     }
+
+    storeRow(l.dline, width, d->vi.format->bytesPerSample, dstp);
 }
 
 
@@ -386,25 +472,26 @@ static VSFrameRef *copyPad(const VSFrameRef *src, int fn, VSFrameContext *frameC
     eedi3Data *d = (eedi3Data *) * instanceData;
 
     const int off = 1 - fn;
+    const int bps = d->vi.format->bytesPerSample;
     VSFrameRef *srcPF = vsapi->newVideoFrame(d->vi.format, d->vi.width + 24 * (1 << d->vi.format->subSamplingW), d->vi.height + 8 * (1 << d->vi.format->subSamplingH), NULL, core);
 
     int b, x, y;
 
     if(!d->dh) {
         for(b = 0; b < d->vi.format->numPlanes; ++b)
-            vs_bitblt(vsapi->getWritePtr(srcPF, b) + vsapi->getStride(srcPF, b) * (4 + off) + 12,
+            vs_bitblt(vsapi->getWritePtr(srcPF, b) + vsapi->getStride(srcPF, b) * (4 + off) + 12 * bps,
                       vsapi->getStride(srcPF, b) * 2,
                       vsapi->getReadPtr(src, b) + vsapi->getStride(src, b)*off,
                       vsapi->getStride(src, b) * 2,
-                      vsapi->getFrameWidth(src, b) * d->vi.format->bytesPerSample,
+                      vsapi->getFrameWidth(src, b) * bps,
                       vsapi->getFrameHeight(src, b) >> 1);
     } else {
         for(b = 0; b < d->vi.format->numPlanes; ++b)
-            vs_bitblt(vsapi->getWritePtr(srcPF, b) + vsapi->getStride(srcPF, b) * (4 + off) + 12,
+            vs_bitblt(vsapi->getWritePtr(srcPF, b) + vsapi->getStride(srcPF, b) * (4 + off) + 12 * bps,
                       vsapi->getStride(srcPF, b) * 2,
                       vsapi->getReadPtr(src, b),
                       vsapi->getStride(src, b),
-                      vsapi->getFrameWidth(src, b) * d->vi.format->bytesPerSample,
+                      vsapi->getFrameWidth(src, b) * bps,
                       vsapi->getFrameHeight(src, b));
     }
 
@@ -418,12 +505,12 @@ static VSFrameRef *copyPad(const VSFrameRef *src, int fn, VSFrameContext *frameC
 
         for(y = 4 + off; y < height - 4; y += 2) {
             for(x = 0; x < 12; ++x)
-                dstp[x] = dstp[24 - x];
+                memcpy(dstp + x * bps, dstp + (24 - x) * bps, bps);
 
             int c = 2;
 
             for(x = width - 12; x < width; ++x, c += 2)
-                dstp[x] = dstp[x - c];
+                memcpy(dstp + x * bps, dstp + (x - c) * bps, bps);
 
             dstp += dst_pitch * 2;
         }
@@ -432,13 +519,13 @@ static VSFrameRef *copyPad(const VSFrameRef *src, int fn, VSFrameContext *frameC
 
         for(y = off; y < 4; y += 2)
             vs_bitblt(dstp + y * dst_pitch, dst_pitch,
-                      dstp + (8 - y) * dst_pitch, dst_pitch, width, 1);
+                      dstp + (8 - y) * dst_pitch, dst_pitch, width * bps, 1);
 
         int c = 2 + 2 * off;
 
         for(y = height - 4 + off; y < height; y += 2, c += 4)
             vs_bitblt(dstp + y * dst_pitch, dst_pitch,
-                      dstp + (y - c) * dst_pitch, dst_pitch, width, 1);
+                      dstp + (y - c) * dst_pitch, dst_pitch, width * bps, 1);
     }
 
     return srcPF;
@@ -495,7 +582,7 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
         vsapi->freeFrame(src);
 
         float *workspace = NULL;
-        VS_ALIGNED_MALLOC((void **)&workspace, d->vi.width * VSMAX(d->mdis * 4 + 1, 16) * 4 * sizeof(float), 16);
+        VS_ALIGNED_MALLOC((void **)&workspace, workspaceSize(d->vi.width, d->mdis), 16);
         if (!workspace){
             vsapi->setFilterError("EEDI3: Memory allocation failed", frameCtx);
             vsapi->freeFrame(scpPF);
@@ -505,7 +592,7 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
         }
 
         int *dmapa = NULL;
-        VS_ALIGNED_MALLOC((void **)&dmapa, vsapi->getStride(dst, 0)*vsapi->getFrameHeight(dst, 0)*sizeof(int), 16);
+        VS_ALIGNED_MALLOC((void **)&dmapa, d->vi.width * d->vi.height * sizeof(int), 16);
         if (!dmapa) {
             VS_ALIGNED_FREE(workspace);
             vsapi->setFilterError("EEDI3: Memory allocation failed", frameCtx);
@@ -515,6 +602,8 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
             return 0;
         }
 
+        const int bps = d->vi.format->bytesPerSample;
+        const int isInt = d->isInt;
         int b, x, y;
 
         for(b = 0; b < d->vi.format->numPlanes; ++b) {
@@ -527,9 +616,11 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
             const int height = vsapi->getFrameHeight(dst, b) + 8;
             uint8_t *dstp = vsapi->getWritePtr(dst, b);
             const int dpitch = vsapi->getStride(dst, b);
+            // the direction map has one row per interpolated line
+            const int dmpitch = width - 24;
             vs_bitblt(dstp + (1 - field_n)*dpitch, dpitch * 2,
-                      srcp + (4 + 1 - field_n)*spitch + 12, spitch * 2,
-                      width - 24,
+                      srcp + (4 + 1 - field_n)*spitch + 12 * bps, spitch * 2,
+                      (width - 24) * bps,
                       (height - 8) >> 1);
             srcp += (4 + field_n) * spitch;
             dstp += field_n * dpitch;
@@ -539,13 +630,11 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
                 const int off = (y - 4 - field_n) >> 1;
 
                 if(d->hp)
-                    interpLineHP(srcp + 12 + off * 2 * spitch, width - 24, spitch, d->alpha, d->beta,
-                                 d->gamma, d->nrad, d->mdis, workspace, dstp + off * 2 * dpitch,
-                                 dmapa + off * dpitch, d->ucubic, d->cost3);
+                    interpLineHP(srcp + 12 * bps + off * 2 * spitch, width - 24, spitch, d,
+                                 workspace, dstp + off * 2 * dpitch, dmapa + off * dmpitch);
                 else
-                    interpLineFP(srcp + 12 + off * 2 * spitch, width - 24, spitch, d->alpha, d->beta,
-                                 d->gamma, d->nrad, d->mdis, workspace, dstp + off * 2 * dpitch,
-                                 dmapa + off * dpitch, d->ucubic, d->cost3);
+                    interpLineFP(srcp + 12 * bps + off * 2 * spitch, width - 24, spitch, d,
+                                 workspace, dstp + off * 2 * dpitch, dmapa + off * dmpitch);
             }
 
             if(d->vcheck > 0) {
@@ -553,6 +642,17 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
                 const uint8_t *scpp = NULL;
                 int scpitch = 0;
 
+                // the workspace is free again at this point, each row is converted to float before use
+                float *dst3p = workspace;
+                float *dst2p = dst3p + dmpitch;
+                float *dst1p = dst2p + dmpitch;
+                float *dst0 = dst1p + dmpitch;
+                float *dst1n = dst0 + dmpitch;
+                float *dst2n = dst1n + dmpitch;
+                float *dst3n = dst2n + dmpitch;
+                float *scline = dst3n + dmpitch;
+                float *tline = scline + dmpitch;
+
                 if(d->sclip) {
                     scpitch = vsapi->getStride(scpPF, b);
                     scpp = vsapi->getReadPtr(scpPF, b) + field_n * scpitch;
@@ -560,84 +660,88 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
 
                 for(y = 4 + field_n; y < height - 4; y += 2) {
                     if(y >= 6 && y < height - 6) {
-                        const uint8_t *dst3p = srcp - 3 * spitch + 12;
-                        const uint8_t *dst2p = dstp - 2 * dpitch;
-                        const uint8_t *dst1p = dstp - 1 * dpitch;
-                        const uint8_t *dst1n = dstp + 1 * dpitch;
-                        const uint8_t *dst2n = dstp + 2 * dpitch;
-                        const uint8_t *dst3n = srcp + 3 * spitch + 12;
-                        uint8_t *tline = (uint8_t *)workspace;
+                        loadRow(srcp - 3 * spitch + 12 * bps, dmpitch, 0, bps, dst3p);
+                        loadRow(dstp - 2 * dpitch, dmpitch, 0, bps, dst2p);
+                        loadRow(dstp - 1 * dpitch, dmpitch, 0, bps, dst1p);
+                        loadRow(dstp, dmpitch, 0, bps, dst0);
+                        loadRow(dstp + 1 * dpitch, dmpitch, 0, bps, dst1n);
+                        loadRow(dstp + 2 * dpitch, dmpitch, 0, bps, dst2n);
+                        loadRow(srcp + 3 * spitch + 12 * bps, dmpitch, 0, bps, dst3n);
+
+                        if(scpp)
+                            loadRow(scpp, dmpitch, 0, bps, scline);
 
                         for(x = 0; x < width - 24; ++x) {
                             const int dirc = dstpd[x];
-                            const int cint = scpp ? scpp[x] :
-                                             VSMIN(VSMAX((36 * (dst1p[x] + dst1n[x]) - 4 * (dst3p[x] + dst3n[x]) + 32) >> 6, 0), 255);
+                            const float cint = scpp ? scline[x] :
+                                               cubicMean(dst1p[x] + dst1n[x], dst3p[x] + dst3n[x], 32.0f, 1.0f / 64.0f, d);
 
                             if(dirc == 0) {
                                 tline[x] = cint;
                                 continue;
                             }
 
-                            const int dirt = dstpd[x - dpitch];
+                            const int dirt = dstpd[x - dmpitch];
 
-                            const int dirb = dstpd[x + dpitch];
+                            const int dirb = dstpd[x + dmpitch];
 
                             if(VSMAX(dirc * dirt, dirc * dirb) < 0 || (dirt == dirb && dirt == 0)) {
                                 tline[x] = cint;
                                 continue;
                             }
 
-                            int it, ib, vt, vb, vc;
-                            vc = abs(dstp[x] - dst1p[x]) + abs(dstp[x] - dst1n[x]);
+                            float it, ib, vt, vb;
+                            const float vc = fabsf(dst0[x] - dst1p[x]) + fabsf(dst0[x] - dst1n[x]);
 
                             if(d->hp) {
                                 if(!(dirc & 1)) {
                                     const int d2 = dirc >> 1;
-                                    it = (dst2p[x + d2] + dstp[x - d2] + 1) >> 1;
-                                    vt = abs(dst2p[x + d2] - dst1p[x + d2]) + abs(dstp[x + d2] - dst1p[x + d2]);
-                                    ib = (dstp[x + d2] + dst2n[x - d2] + 1) >> 1;
-                                    vb = abs(dst2n[x - d2] - dst1n[x - d2]) + abs(dstp[x - d2] - dst1n[x - d2]);
+                                    it = roundedMean(dst2p[x + d2] + dst0[x - d2], 1.0f, 0.5f, isInt);
+                                    vt = fabsf(dst2p[x + d2] - dst1p[x + d2]) + fabsf(dst0[x + d2] - dst1p[x + d2]);
+                                    ib = roundedMean(dst0[x + d2] + dst2n[x - d2], 1.0f, 0.5f, isInt);
+                                    vb = fabsf(dst2n[x - d2] - dst1n[x - d2]) + fabsf(dst0[x - d2] - dst1n[x - d2]);
                                 } else {
                                     const int d20 = dirc >> 1;
                                     const int d21 = (dirc + 1) >> 1;
-                                    const int pa2p = dst2p[x + d20] + dst2p[x + d21] + 1;
-                                    const int pa1p = dst1p[x + d20] + dst1p[x + d21] + 1;
-                                    const int ps0 = dstp[x - d20] + dstp[x - d21] + 1;
-                                    const int pa0 = dstp[x + d20] + dstp[x + d21] + 1;
-                                    const int ps1n = dst1n[x - d20] + dst1n[x - d21] + 1;
-                                    const int ps2n = dst2n[x - d20] + dst2n[x - d21] + 1;
-                                    it = (pa2p + ps0) >> 2;
-                                    vt = (abs(pa2p - pa1p) + abs(pa0 - pa1p)) >> 1;
-                                    ib = (pa0 + ps2n) >> 2;
-                                    vb = (abs(ps2n - ps1n) + abs(ps0 - ps1n)) >> 1;
+                                    const float pa2p = dst2p[x + d20] + dst2p[x + d21];
+                                    const float pa1p = dst1p[x + d20] + dst1p[x + d21];
+                                    const float ps0 = dst0[x - d20] + dst0[x - d21];
+                                    const float pa0 = dst0[x + d20] + dst0[x + d21];
+                                    const float ps1n = dst1n[x - d20] + dst1n[x - d21];
+                                    const float ps2n = dst2n[x - d20] + dst2n[x - d21];
+                                    it = roundedMean(pa2p + ps0, 2.0f, 0.25f, isInt);
+                                    vt = roundedMean(fabsf(pa2p - pa1p) + fabsf(pa0 - pa1p), 0.0f, 0.5f, isInt);
+                                    ib = roundedMean(pa0 + ps2n, 2.0f, 0.25f, isInt);
+                                    vb = roundedMean(fabsf(ps2n - ps1n) + fabsf(ps0 - ps1n), 0.0f, 0.5f, isInt);
                                 }
                             } else {
-                                it = (dst2p[x + dirc] + dstp[x - dirc] + 1) >> 1;
-                                vt = abs(dst2p[x + dirc] - dst1p[x + dirc]) + abs(dstp[x + dirc] - dst1p[x + dirc]);
-                                ib = (dstp[x + dirc] + dst2n[x - dirc] + 1) >> 1;
-                                vb = abs(dst2n[x - dirc] - dst1n[x - dirc]) + abs(dstp[x - dirc] - dst1n[x - dirc]);
+                                it = roundedMean(dst2p[x + dirc] + dst0[x - dirc], 1.0f, 0.5f, isInt);
+                                vt = fabsf(dst2p[x + dirc] - dst1p[x + dirc]) + fabsf(dst0[x + dirc] - dst1p[x + dirc]);
+                                ib = roundedMean(dst0[x + dirc] + dst2n[x - dirc], 1.0f, 0.5f, isInt);
+                                vb = fabsf(dst2n[x - dirc] - dst1n[x - dirc]) + fabsf(dst0[x - dirc] - dst1n[x - dirc]);
                             }
 
-                            const int d0 = abs(it - dst1p[x]);
-                            const int d1 = abs(ib - dst1n[x]);
-                            const int d2 = abs(vt - vc);
-                            const int d3 = abs(vb - vc);
+                            const float d0 = fabsf(it - dst1p[x]);
+                            const float d1 = fabsf(ib - dst1n[x]);
+                            const float d2 = fabsf(vt - vc);
+                            const float d3 = fabsf(vb - vc);
 
-                            const int mdiff0 = d->vcheck == 1 ? VSMIN(d0, d1) : d->vcheck == 2 ? ((d0 + d1 + 1) >> 1) : VSMAX(d0, d1);
-                            const int mdiff1 = d->vcheck == 1 ? VSMIN(d2, d3) : d->vcheck == 2 ? ((d2 + d3 + 1) >> 1) : VSMAX(d2, d3);
+                            const float mdiff0 = d->vcheck == 1 ? VSMIN(d0, d1) : d->vcheck == 2 ? roundedMean(d0 + d1, 1.0f, 0.5f, isInt) : VSMAX(d0, d1);
+                            const float mdiff1 = d->vcheck == 1 ? VSMIN(d2, d3) : d->vcheck == 2 ? roundedMean(d2 + d3, 1.0f, 0.5f, isInt) : VSMAX(d2, d3);
 
-                            const float a0 = mdiff0 / d->vthresh0;
-                            const float a1 = mdiff1 / d->vthresh1;
+                            const float a0 = mdiff0 * d->scale / d->vthresh0;
+                            const float a1 = mdiff1 * d->scale / d->vthresh1;
 
                             const int dircv = d->hp ? (abs(dirc) >> 1) : abs(dirc);
 
                             const float a2 = VSMAX((d->vthresh2 - dircv) / d->vthresh2, 0.0f);
                             const float a = VSMIN(VSMAX(VSMAX(a0, a1), a2), 1.0f);
 
-                            tline[x] = (int)((1.0 - a) * dstp[x] + a * cint);
+                            const double val = (1.0 - a) * dst0[x] + a * cint;
+                            tline[x] = isInt ? (float)(int)val : (float)val;
                         }
 
-                        memcpy(dstp, tline, width - 24);
+                        storeRow(tline, width - 24, bps, dstp);
                     }
 
                     srcp += 2 * spitch;
@@ -646,7 +750,7 @@ static const VSFrameRef *VS_CC eedi3GetFrame(int n, int activationReason, void *
                     if(scpp)
                         scpp += 2 * scpitch;
 
-                    dstpd += dpitch;
+                    dstpd += dmpitch;
                 }
             }
         }
@@ -773,8 +877,10 @@ static void VS_CC eedi3Create(const VSMap *in, VSMap *out, void *userData, VSCor
     // goto or macro... macro or goto...
     char msg[80];
 
-    if(d.vi.format->bytesPerSample != 1) {
-        snprintf(msg, sizeof(msg), "eedi3: only 8 bits per sample input supported");
+    if(!isConstantFormat(&d.vi) ||
+            (d.vi.format->sampleType == stInteger && d.vi.format->bitsPerSample > 16) ||
+            (d.vi.format->sampleType == stFloat && d.vi.format->bitsPerSample != 32)) {
+        snprintf(msg, sizeof(msg), "eedi3: only constant format 8-16 bit integer and 32 bit float input supported");
         goto error;
     }
 
@@ -838,6 +944,11 @@ static void VS_CC eedi3Create(const VSMap *in, VSMap *out, void *userData, VSCor
         goto error;
     }
 
+    d.isInt = d.vi.format->sampleType == stInteger;
+    d.peak = d.isInt ? (float)((1 << d.vi.format->bitsPerSample) - 1) : 1.0f;
+    // differences are scaled to 8 bits since that's what the thresholds and weights assume
+    d.scale = d.isInt ? 1.0f / (1 << (d.vi.format->bitsPerSample - 8)) : 255.0f;
+
     if(d.field > 1) {
         d.vi.numFrames *= 2;
         muldivRational(&d.vi.fpsNum, &d.vi.fpsDen, 2, 1);
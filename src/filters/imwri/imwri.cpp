@@ -27,11 +27,19 @@
 #include <Magick++.h>
 #include <VapourSynth.h>
 #include <VSHelper.h>
+#include <cstdio>
 #include <cstring>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -45,6 +53,10 @@
 #include <unistd.h>
 #endif
 
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
+
 // Handle both with and without hdri
 #if MAGICKCORE_HDRI_ENABLE
 #define IMWRI_NAMESPACE "imwrif"
@@ -157,6 +169,17 @@ static void getWorkingDir(std::string &path) {
 #endif
 }
 
+static FILE *openFile(const std::string &filename, const char *mode) {
+#ifdef _WIN32
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    std::wstring wPath = conversion.from_bytes(filename);
+    std::wstring wMode = conversion.from_bytes(mode);
+    return _wfopen(wPath.c_str(), wMode.c_str());
+#else
+    return fopen(filename.c_str(), mode);
+#endif
+}
+
 //////////////////////////////////////////
 // Write
 
@@ -172,7 +195,16 @@ struct WriteData {
     MagickCore::CompressionType compressType;
     bool dither;
 
-    WriteData() : videoNode(nullptr), alphaNode(nullptr), vi(nullptr), quality(0), compressType(MagickCore::UndefinedCompression), dither(true) {}
+    // The encoded images are written to disk by a background thread
+    std::thread writer;
+    std::mutex queueLock;
+    std::condition_variable queueCond;
+    std::deque<std::pair<std::string, Magick::Blob>> queue;
+    size_t maxQueued;
+    bool stopWriter;
+    std::string writeError;
+
+    WriteData() : videoNode(nullptr), alphaNode(nullptr), vi(nullptr), quality(0), compressType(MagickCore::UndefinedCompression), dither(true), maxQueued(1), stopWriter(false) {}
 };
 
 static void VS_CC writeInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -180,68 +212,148 @@ static void VS_CC writeInit(VSMap *in, VSMap *out, void **instanceData, VSNode *
     vsapi->setVideoInfo(d->vi, 1, node);
 }
 
+static void writeThread(WriteData *d) {
+    std::unique_lock<std::mutex> lock(d->queueLock);
+
+    while (true) {
+        d->queueCond.wait(lock, [d] { return !d->queue.empty() || d->stopWriter; });
+        if (d->queue.empty())
+            return;
+
+        std::pair<std::string, Magick::Blob> item = d->queue.front();
+        d->queue.pop_front();
+        d->queueCond.notify_all();
+        lock.unlock();
+
+        bool success = false;
+        FILE *f = openFile(item.first, "wb");
+        if (f) {
+            success = fwrite(item.second.data(), 1, item.second.length(), f) == item.second.length();
+            success = !fclose(f) && success;
+        }
+
+        lock.lock();
+        if (!success && d->writeError.empty())
+            d->writeError = "Write: Failed to write " + item.first;
+    }
+}
+
+template<typename T>
+static inline Quantum sampleToQuantum(T v, unsigned scaleFactor, unsigned shiftFactor) {
+    return static_cast<Quantum>(v * scaleFactor + (v >> shiftFactor));
+}
+
+template<>
+inline Quantum sampleToQuantum<float>(float v, unsigned scaleFactor, unsigned shiftFactor) {
+    return static_cast<Quantum>(v * static_cast<float>(QuantumRange));
+}
+
+template<typename T>
+static void interleaveRow(const T * const *src, Quantum *dst, const ssize_t *offsets, size_t channels, int width, unsigned scaleFactor, unsigned shiftFactor) {
+    int x = 0;
+
+#if defined(VS_TARGET_CPU_X86) && !MAGICKCORE_HDRI_ENABLE && MAGICKCORE_QUANTUM_DEPTH == 16
+    // The usual RGBA pixel layout, 8 pixels at a time. The scaled values always fit in 16 bits.
+    if (channels == 4 && offsets[0] == 0 && offsets[1] == 1 && offsets[2] == 2 && offsets[3] == 3 && sizeof(T) <= 2) {
+        const __m128i scale = _mm_set1_epi16(static_cast<short>(scaleFactor));
+        const __m128i shift = _mm_cvtsi32_si128(shiftFactor);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i opaque = _mm_set1_epi16(static_cast<short>(QuantumRange));
+
+        for (; x + 8 <= width; x += 8) {
+            __m128i v[4];
+
+            for (int c = 0; c < 4; c++) {
+                if (!src[c]) {
+                    v[c] = opaque;
+                    continue;
+                }
+
+                if (sizeof(T) == 1)
+                    v[c] = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src[c] + x)), zero);
+                else
+                    v[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[c] + x));
+
+                v[c] = _mm_add_epi16(_mm_mullo_epi16(v[c], scale), _mm_srl_epi16(v[c], shift));
+            }
+
+            __m128i rg0 = _mm_unpacklo_epi16(v[0], v[1]);
+            __m128i rg1 = _mm_unpackhi_epi16(v[0], v[1]);
+            __m128i ba0 = _mm_unpacklo_epi16(v[2], v[3]);
+            __m128i ba1 = _mm_unpackhi_epi16(v[2], v[3]);
+
+            __m128i *d = reinterpret_cast<__m128i *>(dst + x * 4);
+            _mm_storeu_si128(d + 0, _mm_unpacklo_epi32(rg0, ba0));
+            _mm_storeu_si128(d + 1, _mm_unpackhi_epi32(rg0, ba0));
+            _mm_storeu_si128(d + 2, _mm_unpacklo_epi32(rg1, ba1));
+            _mm_storeu_si128(d + 3, _mm_unpackhi_epi32(rg1, ba1));
+        }
+    }
+#endif
+
+    for (; x < width; x++) {
+        Quantum *pixel = dst + x * channels;
+        pixel[offsets[0]] = sampleToQuantum<T>(src[0][x], scaleFactor, shiftFactor);
+        pixel[offsets[1]] = sampleToQuantum<T>(src[1][x], scaleFactor, shiftFactor);
+        pixel[offsets[2]] = sampleToQuantum<T>(src[2][x], scaleFactor, shiftFactor);
+        pixel[offsets[3]] = src[3] ? sampleToQuantum<T>(src[3][x], scaleFactor, shiftFactor) : QuantumRange;
+    }
+}
+
+// Fills the pixel cache in blocks of rows
 template<typename T>
 static void writeImageHelper(const VSFrameRef *frame, const VSFrameRef *alphaFrame, bool isGray, Magick::Image &image, int width, int height, int bitsPerSample, const VSAPI *vsapi) {
-    unsigned prepeat = (MAGICKCORE_QUANTUM_DEPTH - 1) / bitsPerSample;
-    unsigned pleftover = MAGICKCORE_QUANTUM_DEPTH - (bitsPerSample * prepeat);
-    unsigned shiftFactor = bitsPerSample - pleftover;
     unsigned scaleFactor = 0;
-    for (unsigned i = 0; i < prepeat; i++) {
-        scaleFactor <<= bitsPerSample;
-        scaleFactor += 1;
+    unsigned shiftFactor = 0;
+
+    if (std::is_integral<T>::value) {
+        unsigned prepeat = (MAGICKCORE_QUANTUM_DEPTH - 1) / bitsPerSample;
+        unsigned pleftover = MAGICKCORE_QUANTUM_DEPTH - (bitsPerSample * prepeat);
+        shiftFactor = bitsPerSample - pleftover;
+        for (unsigned i = 0; i < prepeat; i++) {
+            scaleFactor <<= bitsPerSample;
+            scaleFactor += 1;
+        }
+        scaleFactor <<= pleftover;
     }
-    scaleFactor <<= pleftover;
 
     Magick::Pixels pixelCache(image);
 
-    const T * VS_RESTRICT r = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, 0));
-    const T * VS_RESTRICT g = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-    const T * VS_RESTRICT b = reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-    int strideR = vsapi->getStride(frame, 0);
-    int strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-    int strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-    ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-    ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-    ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
+    const T *src[4] = {
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, 0)),
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 1)),
+        reinterpret_cast<const T *>(vsapi->getReadPtr(frame, isGray ? 0 : 2)),
+        alphaFrame ? reinterpret_cast<const T *>(vsapi->getReadPtr(alphaFrame, 0)) : nullptr
+    };
+    int strides[4] = {
+        vsapi->getStride(frame, 0),
+        vsapi->getStride(frame, isGray ? 0 : 1),
+        vsapi->getStride(frame, isGray ? 0 : 2),
+        alphaFrame ? vsapi->getStride(alphaFrame, 0) : 0
+    };
+    ssize_t offsets[4] = {
+        pixelCache.offset(MagickCore::RedPixelChannel),
+        pixelCache.offset(MagickCore::GreenPixelChannel),
+        pixelCache.offset(MagickCore::BluePixelChannel),
+        pixelCache.offset(MagickCore::AlphaPixelChannel)
+    };
     size_t channels = image.channels();
 
-    if (alphaFrame) {
-        int strideA = vsapi->getStride(alphaFrame, 0);
-        const T * VS_RESTRICT a = reinterpret_cast<const T *>(vsapi->getReadPtr(alphaFrame, 0));
-
-        for (int y = 0; y < height; y++) {
-            MagickCore::Quantum *pixels = pixelCache.get(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                pixels[x * channels + rOff] = r[x] * scaleFactor + (r[x] >> shiftFactor);
-                pixels[x * channels + gOff] = g[x] * scaleFactor + (g[x] >> shiftFactor);
-                pixels[x * channels + bOff] = b[x] * scaleFactor + (b[x] >> shiftFactor);
-                pixels[x * channels + aOff] = a[x] * scaleFactor + (a[x] >> shiftFactor);
-            }
+    const int blockRows = 32;
 
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
-            a += strideA / sizeof(T);
+    for (int y = 0; y < height; y += blockRows) {
+        int rows = std::min(blockRows, height - y);
+        MagickCore::Quantum *pixels = pixelCache.get(0, y, width, rows);
 
-            pixelCache.sync();
-        }
-    } else {
-        for (int y = 0; y < height; y++) {
-            MagickCore::Quantum *pixels = pixelCache.get(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                pixels[x * channels + rOff] = r[x] * scaleFactor + (r[x] >> shiftFactor);
-                pixels[x * channels + gOff] = g[x] * scaleFactor + (g[x] >> shiftFactor);
-                pixels[x * channels + bOff] = b[x] * scaleFactor + (b[x] >> shiftFactor);
-                pixels[x * channels + aOff] = QuantumRange;
-            }
+        for (int i = 0; i < rows; i++) {
+            interleaveRow<T>(src, pixels + static_cast<size_t>(i) * width * channels, offsets, channels, width, scaleFactor, shiftFactor);
 
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
-
-            pixelCache.sync();
+            for (int c = 0; c < 4; c++)
+                if (src[c])
+                    src[c] += strides[c] / sizeof(T);
         }
+
+        pixelCache.sync();
     }
 }
 
@@ -294,64 +406,7 @@ static const VSFrameRef *VS_CC writeGetFrame(int n, int activationReason, void *
                 image.depth(fi->bitsPerSample);
 
             if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
-                Magick::Pixels pixelCache(image);
-                const float scaleFactor = QuantumRange;
-
-                const float * VS_RESTRICT r = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, 0));
-                const float * VS_RESTRICT g = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-                const float * VS_RESTRICT b = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-               
-                int strideR = vsapi->getStride(frame, 0);
-                int strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-                int strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-                    
-                ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-                ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-                ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-                ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-                size_t channels = image.channels();
-
-                if (alphaFrame) {
-                    const float * VS_RESTRICT a = reinterpret_cast<const float *>(vsapi->getReadPtr(alphaFrame, 0));
-                    int strideA = vsapi->getStride(alphaFrame, 0);
-            
-                    for (int y = 0; y < height; y++) {
-                        MagickCore::Quantum* pixels = pixelCache.get(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            pixels[x * channels + rOff] = r[x] * scaleFactor;
-                            pixels[x * channels + gOff] = g[x] * scaleFactor;
-                            pixels[x * channels + bOff] = b[x] * scaleFactor;
-                            pixels[x * channels + aOff] = a[x] * scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-                        a += strideA / sizeof(float);
-
-                        pixelCache.sync();
-                    }
-                } else {
-                    const float *r = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, 0));
-                    const float *g = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 1));
-                    const float *b = reinterpret_cast<const float *>(vsapi->getReadPtr(frame, isGray ? 0 : 2));
-
-                    for (int y = 0; y < height; y++) {
-                        MagickCore::Quantum* pixels = pixelCache.get(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            pixels[x * channels + rOff] = r[x] * scaleFactor;
-                            pixels[x * channels + gOff] = g[x] * scaleFactor;
-                            pixels[x * channels + bOff] = b[x] * scaleFactor;
-                            pixels[x * channels + aOff] = 1    * scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-
-                        pixelCache.sync();
-                    }
-                }
+                writeImageHelper<float>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
             } else if (fi->bytesPerSample == 4) {
                 writeImageHelper<uint32_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
             } else if (fi->bytesPerSample == 2) {
@@ -364,9 +419,24 @@ static const VSFrameRef *VS_CC writeGetFrame(int n, int activationReason, void *
             if (!isAbsolute(filename))
                 filename = d->workingDir + filename;
 
-            image.write(filename);
+            // Encoding happens here in parallel, only the file writing is left to the background thread
+            Magick::Blob blob;
+            image.write(&blob);
 
             vsapi->freeFrame(alphaFrame);
+            alphaFrame = nullptr;
+
+            std::unique_lock<std::mutex> lock(d->queueLock);
+            if (!d->writeError.empty()) {
+                vsapi->setFilterError(d->writeError.c_str(), frameCtx);
+                vsapi->freeFrame(frame);
+                return nullptr;
+            }
+
+            d->queueCond.wait(lock, [d] { return d->queue.size() < d->maxQueued; });
+            d->queue.emplace_back(filename, blob);
+            d->queueCond.notify_all();
+
             return frame;
         } catch (Magick::Exception &e) {
             vsapi->setFilterError((std::string("Write: ImageMagick error: ") + e.what()).c_str(), frameCtx);
@@ -381,6 +451,20 @@ static const VSFrameRef *VS_CC writeGetFrame(int n, int activationReason, void *
 
 static void VS_CC writeFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     WriteData *d = static_cast<WriteData *>(instanceData);
+
+    if (d->writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(d->queueLock);
+            d->stopWriter = true;
+        }
+        d->queueCond.notify_all();
+        d->writer.join();
+    }
+
+    // There are no more frames to report it with
+    if (!d->writeError.empty())
+        vsapi->logMessage(mtCritical, d->writeError.c_str());
+
     vsapi->freeNode(d->videoNode);
     vsapi->freeNode(d->alphaNode);
     delete d;
@@ -511,7 +595,10 @@ static void VS_CC writeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
 
     getWorkingDir(d->workingDir);
 
-    vsapi->createFilter(in, out, "Write", writeInit, writeGetFrame, writeFree, fmParallelRequests, 0, d.release(), core);
+    d->maxQueued = vsapi->getCoreInfo(core)->numThreads;
+    d->writer = std::thread(writeThread, d.get());
+
+    vsapi->createFilter(in, out, "Write", writeInit, writeGetFrame, writeFree, fmParallel, 0, d.release(), core);
 }
 
 //////////////////////////////////////////
@@ -522,14 +609,19 @@ struct ReadData {
     std::vector<std::string> filenames;
     std::string workingDir;
     int firstNum;
+    int readahead;
     bool alpha;
     bool mismatch;
     bool fileListMode;
+
+    std::mutex lock;
     int cachedFrameNum;
     bool cachedAlpha;
     const VSFrameRef *cachedFrame;
+    int lastFrameNum;
+    std::map<int, std::shared_future<std::string>> prefetched;
 
-    ReadData() : fileListMode(true), cachedFrameNum(-1), cachedAlpha(false), cachedFrame(nullptr) {};
+    ReadData() : readahead(0), fileListMode(true), cachedFrameNum(-1), cachedAlpha(false), cachedFrame(nullptr), lastFrameNum(-1) {};
 };
 
 static void VS_CC readInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -537,61 +629,167 @@ static void VS_CC readInit(VSMap *in, VSMap *out, void **instanceData, VSNode *n
     vsapi->setVideoInfo(d->vi, d->alpha ? 2 : 1, node);
 }
 
+static std::string readFilename(const ReadData *d, int n) {
+    std::string filename = d->fileListMode ? d->filenames[n] : specialPrintf(d->filenames[0], n + d->firstNum);
+    if (!isAbsolute(filename))
+        filename = d->workingDir + filename;
+    return filename;
+}
+
+// An empty string means the file couldn't be read here, in which case ImageMagick gets to open it itself
+static std::string readFileContents(const std::string &filename) {
+    std::string contents;
+    FILE *f = openFile(filename, "rb");
+    if (!f)
+        return contents;
+
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        contents.append(buffer, size);
+
+    if (ferror(f))
+        contents.clear();
+
+    fclose(f);
+    return contents;
+}
+
+// Starts reading the next files in the background when the frames are requested in order
+static std::shared_future<std::string> readPrefetch(ReadData *d, int n) {
+    std::lock_guard<std::mutex> lock(d->lock);
+
+    std::shared_future<std::string> result;
+    auto iter = d->prefetched.find(n);
+    if (iter != d->prefetched.end()) {
+        result = iter->second;
+        d->prefetched.erase(iter);
+    }
+
+    bool sequential = n > d->lastFrameNum - d->readahead && n <= d->lastFrameNum + d->readahead + 1;
+    d->lastFrameNum = n;
+
+    for (auto i = d->prefetched.begin(); i != d->prefetched.end();) {
+        if (!sequential || i->first < n - d->readahead || i->first > n + d->readahead)
+            i = d->prefetched.erase(i);
+        else
+            ++i;
+    }
+
+    if (sequential) {
+        for (int i = n + 1; i <= n + d->readahead && i < d->vi[0].numFrames; i++) {
+            if (!d->prefetched.count(i))
+                d->prefetched[i] = std::async(std::launch::async, readFileContents, readFilename(d, i)).share();
+        }
+    }
+
+    return result;
+}
+
 template<typename T>
-static void readImageHelper(VSFrameRef *frame, VSFrameRef *alphaFrame, bool isGray, Magick::Image &image, int width, int height, int bitsPerSample, const VSAPI *vsapi) {
-    unsigned shiftR = MAGICKCORE_QUANTUM_DEPTH - bitsPerSample;
-    size_t channels = image.channels();
-    Magick::Pixels pixelCache(image);
+static inline T quantumToSample(Quantum q, unsigned shift) {
+    return static_cast<T>(static_cast<unsigned>(q) >> shift);
+}
 
-    T *r = reinterpret_cast<T *>(vsapi->getWritePtr(frame, 0));
-    T *g = reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 1));
-    T *b = reinterpret_cast<T *>(vsapi->getWritePtr(frame, isGray ? 0 : 2));
-
-    int strideR = vsapi->getStride(frame, 0);
-    int strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-    int strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-
-    ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-    ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-    ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-
-    if (alphaFrame) {
-        T *a = reinterpret_cast<T *>(vsapi->getWritePtr(alphaFrame, 0));
-        int strideA = vsapi->getStride(alphaFrame, 0);;            
-
-        if (aOff >= 0) {
-            for (int y = 0; y < height; y++) {
-                const Magick::Quantum *pixels = pixelCache.getConst(0, y, width, 1);
-                for (int x = 0; x < width; x++) {
-                    r[x] = (unsigned)pixels[x * channels + rOff] >> shiftR;
-                    g[x] = (unsigned)pixels[x * channels + gOff] >> shiftR;
-                    b[x] = (unsigned)pixels[x * channels + bOff] >> shiftR;
-                    a[x] = (unsigned)pixels[x * channels + aOff] >> shiftR;
-                }
+template<>
+inline float quantumToSample<float>(Quantum q, unsigned shift) {
+    return q / static_cast<float>(QuantumRange);
+}
 
-                r += strideR / sizeof(T);
-                g += strideG / sizeof(T);
-                b += strideB / sizeof(T);
-                a += strideA / sizeof(T);
+template<typename T>
+static void deinterleaveRow(const Quantum *src, T * const *dst, int channels, int width, unsigned shift) {
+    int x = 0;
+
+#if defined(VS_TARGET_CPU_X86) && !MAGICKCORE_HDRI_ENABLE && MAGICKCORE_QUANTUM_DEPTH == 16
+    // RGBA and RGB+padding rows, 8 pixels at a time
+    if (channels == 4 && sizeof(T) <= 2) {
+        const __m128i shiftv = _mm_cvtsi32_si128(shift);
+
+        for (; x + 8 <= width; x += 8) {
+            __m128i p01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+            __m128i p23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 8));
+            __m128i p45 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 16));
+            __m128i p67 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 24));
+
+            __m128i t0 = _mm_unpacklo_epi16(p01, p23);
+            __m128i t1 = _mm_unpackhi_epi16(p01, p23);
+            __m128i t2 = _mm_unpacklo_epi16(p45, p67);
+            __m128i t3 = _mm_unpackhi_epi16(p45, p67);
+
+            __m128i rg0 = _mm_unpacklo_epi16(t0, t1);
+            __m128i ba0 = _mm_unpackhi_epi16(t0, t1);
+            __m128i rg1 = _mm_unpacklo_epi16(t2, t3);
+            __m128i ba1 = _mm_unpackhi_epi16(t2, t3);
+
+            __m128i planes[4] = {
+                _mm_srl_epi16(_mm_unpacklo_epi64(rg0, rg1), shiftv),
+                _mm_srl_epi16(_mm_unpackhi_epi64(rg0, rg1), shiftv),
+                _mm_srl_epi16(_mm_unpacklo_epi64(ba0, ba1), shiftv),
+                _mm_srl_epi16(_mm_unpackhi_epi64(ba0, ba1), shiftv)
+            };
+
+            for (int c = 0; c < 4; c++) {
+                if (!dst[c])
+                    continue;
+                if (sizeof(T) == 1)
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst[c] + x), _mm_packus_epi16(planes[c], planes[c]));
+                else
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[c] + x), planes[c]);
             }
-        } else {
-            memset(a, 0, strideA  * height);
         }
-    } else {
+    }
+#endif
+
+    for (int c = 0; c < channels; c++) {
+        if (!dst[c])
+            continue;
+        for (int i = x; i < width; i++)
+            dst[c][i] = quantumToSample<T>(src[i * channels + c], shift);
+    }
+}
+
+// Exports the pixels in blocks of rows and splits them into the planes
+template<typename T>
+static void readImageHelper(VSFrameRef *frame, VSFrameRef *alphaFrame, bool isGray, Magick::Image &image, int width, int height, int bitsPerSample, const VSAPI *vsapi) {
+    unsigned shift = MAGICKCORE_QUANTUM_DEPTH - bitsPerSample;
+    bool hasAlpha = alphaFrame && image.alpha();
+
+    // Padding RGB to four channels lets it use the same fast path as RGBA
+    std::string map = isGray ? "R" : "RGB";
+    if (hasAlpha)
+        map += "A";
+    else if (!isGray)
+        map += "P";
+    int channels = static_cast<int>(map.length());
+
+    T *dst[4] = {};
+    int strides[4] = {};
+    int numPlanes = isGray ? 1 : 3;
+    for (int p = 0; p < numPlanes; p++) {
+        dst[p] = reinterpret_cast<T *>(vsapi->getWritePtr(frame, p));
+        strides[p] = vsapi->getStride(frame, p);
+    }
+
+    if (hasAlpha) {
+        dst[channels - 1] = reinterpret_cast<T *>(vsapi->getWritePtr(alphaFrame, 0));
+        strides[channels - 1] = vsapi->getStride(alphaFrame, 0);
+    } else if (alphaFrame) {
+        memset(vsapi->getWritePtr(alphaFrame, 0), 0, vsapi->getStride(alphaFrame, 0) * height);
+    }
 
+    const int blockRows = 32;
+    std::vector<Quantum> buffer(static_cast<size_t>(width) * channels * blockRows);
 
-        for (int y = 0; y < height; y++) {
-            const Magick::Quantum *pixels = pixelCache.getConst(0, y, width, 1);
-            for (int x = 0; x < width; x++) {
-                r[x] = (unsigned)pixels[x * channels + rOff] >> shiftR;
-                g[x] = (unsigned)pixels[x * channels + gOff] >> shiftR;
-                b[x] = (unsigned)pixels[x * channels + bOff] >> shiftR;
-            }
+    for (int y = 0; y < height; y += blockRows) {
+        int rows = std::min(blockRows, height - y);
+        image.write(0, y, width, rows, map, MagickCore::QuantumPixel, buffer.data());
 
-            r += strideR / sizeof(T);
-            g += strideG / sizeof(T);
-            b += strideB / sizeof(T);
+        for (int i = 0; i < rows; i++) {
+            deinterleaveRow<T>(buffer.data() + static_cast<size_t>(i) * width * channels, dst, channels, width, shift);
+
+            for (int c = 0; c < channels; c++)
+                if (dst[c])
+                    dst[c] += strides[c] / sizeof(T);
         }
     }
 }
@@ -601,8 +799,9 @@ static const VSFrameRef *VS_CC readGetFrame(int n, int activationReason, void **
 
     if (activationReason == arInitial) {
         int index = vsapi->getOutputIndex(frameCtx);
-        if (d->alpha && d->cachedFrameNum == n) {
-            if ((index == 0 && !d->cachedAlpha) || (index == 1 && d->cachedAlpha)) {
+        if (d->alpha) {
+            std::lock_guard<std::mutex> lock(d->lock);
+            if (d->cachedFrameNum == n && ((index == 0 && !d->cachedAlpha) || (index == 1 && d->cachedAlpha))) {
                 const VSFrameRef *frame = d->cachedFrame;
                 d->cachedFrame = nullptr;
                 d->cachedFrameNum = -1;
@@ -610,22 +809,29 @@ static const VSFrameRef *VS_CC readGetFrame(int n, int activationReason, void **
             }
         }
 
+        std::shared_future<std::string> contents = readPrefetch(d, n);
+
         VSFrameRef *frame = nullptr;
         VSFrameRef *alphaFrame = nullptr;
         
         try {
-            std::string filename = d->fileListMode ? d->filenames[n] : specialPrintf(d->filenames[0], n + d->firstNum);
-            if (!isAbsolute(filename))
-                filename = d->workingDir + filename;
+            std::string filename = readFilename(d, n);
+
+            Magick::Image image;
+            if (contents.valid() && !contents.get().empty()) {
+                // The name is still needed to detect formats by their extension
+                image.fileName(filename);
+                image.read(Magick::Blob(contents.get().data(), contents.get().size()));
+            } else {
+                image.read(filename);
+            }
 
-            Magick::Image image(filename);
             VSColorFamily cf = cmRGB;
             if (image.colorSpace() == Magick::GRAYColorspace)
                 cf = cmGray;
 
             int width = static_cast<int>(image.columns());
             int height = static_cast<int>(image.rows());
-            size_t channels = image.channels();
 
 #if MAGICKCORE_HDRI_ENABLE
             VSSampleType st = stFloat;
@@ -655,66 +861,14 @@ static const VSFrameRef *VS_CC readGetFrame(int n, int activationReason, void **
  
             bool isGray = fi->colorFamily == cmGray;                
      
-            if (fi->bytesPerSample == 4 && fi->sampleType == stFloat) {
-                const float scaleFactor = QuantumRange;
-                Magick::Pixels pixelCache(image);
-
-                float *r = reinterpret_cast<float *>(vsapi->getWritePtr(frame, 0));
-                float *g = reinterpret_cast<float *>(vsapi->getWritePtr(frame, isGray ? 0 : 1));
-                float *b = reinterpret_cast<float *>(vsapi->getWritePtr(frame, isGray ? 0 : 2));
-
-                int strideR = vsapi->getStride(frame, 0);
-                int strideG = vsapi->getStride(frame, isGray ? 0 : 1);
-                int strideB = vsapi->getStride(frame, isGray ? 0 : 2);
-
-                ssize_t rOff = pixelCache.offset(MagickCore::RedPixelChannel);
-                ssize_t gOff = pixelCache.offset(MagickCore::GreenPixelChannel);
-                ssize_t bOff = pixelCache.offset(MagickCore::BluePixelChannel);
-
-                if (alphaFrame) {
-                    float *a = reinterpret_cast<float *>(vsapi->getWritePtr(alphaFrame, 0));
-                    int strideA = vsapi->getStride(alphaFrame, 0);
-                    ssize_t aOff = pixelCache.offset(MagickCore::AlphaPixelChannel);
-
-                    if (aOff >= 0) {
-                        for (int y = 0; y < height; y++) {
-                            const MagickCore::Quantum* pixels = pixelCache.getConst(0, y, width, 1);
-                            for (int x = 0; x < width; x++) {
-                                r[x] = pixels[x * channels + rOff] / scaleFactor;
-                                g[x] = pixels[x * channels + gOff] / scaleFactor;
-                                b[x] = pixels[x * channels + bOff] / scaleFactor;
-                                a[x] = pixels[x * channels + aOff] / scaleFactor;
-                            }
-
-                            r += strideR / sizeof(float);
-                            g += strideG / sizeof(float);
-                            b += strideB / sizeof(float);
-                            a += strideA / sizeof(float);
-                        }
-                    } else {
-                        memset(a, 0, strideA  * height);
-                    }
-                } else {
-                    for (int y = 0; y < height; y++) {
-                        const MagickCore::Quantum* pixels = pixelCache.getConst(0, y, width, 1);
-                        for (int x = 0; x < width; x++) {
-                            r[x] = pixels[x * channels + rOff] / scaleFactor;
-                            g[x] = pixels[x * channels + gOff] / scaleFactor;
-                            b[x] = pixels[x * channels + bOff] / scaleFactor;
-                        }
-
-                        r += strideR / sizeof(float);
-                        g += strideG / sizeof(float);
-                        b += strideB / sizeof(float);
-                    }
-                }
-            } else if (fi->bytesPerSample == 4) {
+            if (fi->bytesPerSample == 4 && fi->sampleType == stFloat)
+                readImageHelper<float>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
+            else if (fi->bytesPerSample == 4)
                 readImageHelper<uint32_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            } else if (fi->bytesPerSample == 2) {
+            else if (fi->bytesPerSample == 2)
                 readImageHelper<uint16_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            } else if (fi->bytesPerSample == 1) {
+            else if (fi->bytesPerSample == 1)
                 readImageHelper<uint8_t>(frame, alphaFrame, isGray, image, width, height, fi->bitsPerSample, vsapi);
-            }
         } catch (Magick::Exception &e) {
             vsapi->setFilterError((std::string("Read: ImageMagick error: ") + e.what()).c_str(), frameCtx);
             vsapi->freeFrame(frame);
@@ -723,6 +877,7 @@ static const VSFrameRef *VS_CC readGetFrame(int n, int activationReason, void **
         }
 
         if (d->alpha) {
+            std::lock_guard<std::mutex> lock(d->lock);
             d->cachedFrameNum = n;
             vsapi->freeFrame(d->cachedFrame);
             if (index == 0) {
@@ -744,6 +899,7 @@ static const VSFrameRef *VS_CC readGetFrame(int n, int activationReason, void **
 
 static void VS_CC readFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     ReadData *d = static_cast<ReadData *>(instanceData);
+    vsapi->freeFrame(d->cachedFrame);
     delete d;
 }
 
@@ -762,6 +918,14 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     d->alpha = !!vsapi->propGetInt(in, "alpha", 0, &err);
     d->mismatch = !!vsapi->propGetInt(in, "mismatch", 0, &err);
 
+    d->readahead = int64ToIntS(vsapi->propGetInt(in, "readahead", 0, &err));
+    if (err)
+        d->readahead = vsapi->getCoreInfo(core)->numThreads;
+    if (d->readahead < 0) {
+        vsapi->setError(out, "Read: Readahead can't be negative");
+        return;
+    }
+
     int numElem = vsapi->propNumElements(in, "filename");
     d->filenames.resize(numElem);
     for (int i = 0; i < numElem; i++)
@@ -773,14 +937,7 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         d->fileListMode = false;
 
         for (int i = d->firstNum; i < INT_MAX; i++) {
-#ifdef _WIN32
-            std::string printedStr(specialPrintf(d->filenames[0], i));
-            std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
-            std::wstring wPath = conversion.from_bytes(printedStr);
-            FILE * f = _wfopen(wPath.c_str(), L"rb");
-#else
-            FILE * f = fopen(specialPrintf(d->filenames[0], i).c_str(), "rb");
-#endif
+            FILE * f = openFile(specialPrintf(d->filenames[0], i), "rb");
             if (f) {
                 fclose(f);
             } else {
@@ -826,7 +983,7 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 
     getWorkingDir(d->workingDir);
 
-    vsapi->createFilter(in, out, "Read", readInit, readGetFrame, readFree, fmUnordered, 0, d.release(), core);
+    vsapi->createFilter(in, out, "Read", readInit, readGetFrame, readFree, fmParallel, 0, d.release(), core);
 }
 
 
@@ -836,5 +993,5 @@ static void VS_CC readCreate(const VSMap *in, VSMap *out, void *userData, VSCore
 VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
     configFunc(IMWRI_ID, IMWRI_NAMESPACE, IMWRI_PLUGIN_NAME, VAPOURSYNTH_API_VERSION, 1, plugin);
     registerFunc("Write", "clip:clip;imgformat:data;filename:data;firstnum:int:opt;quality:int:opt;dither:int:opt;compression_type:data:opt;alpha:clip:opt;", writeCreate, nullptr, plugin);
-    registerFunc("Read", "filename:data[];firstnum:int:opt;mismatch:int:opt;alpha:int:opt;", readCreate, nullptr, plugin);
+    registerFunc("Read", "filename:data[];firstnum:int:opt;mismatch:int:opt;alpha:int:opt;readahead:int:opt;", readCreate, nullptr, plugin);
 }
@@ -36,6 +36,9 @@ typedef struct {
     VSNodeRef *node;
     VSNodeRef *diffnode;
     double threshold;
+    const VSMapKey *propDiff;
+    const VSMapKey *propSceneChangePrev;
+    const VSMapKey *propSceneChangeNext;
 } SCDetectData;
 
 static const VSFrameRef *VS_CC scDetectGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -50,13 +53,13 @@ static const VSFrameRef *VS_CC scDetectGetFrame(int n, int activationReason, voi
         const VSFrameRef *prevframe = vsapi->getFrameFilter(std::max(n - 1, 0), d->diffnode, frameCtx);
         const VSFrameRef *nextframe = vsapi->getFrameFilter(n, d->diffnode, frameCtx);
 
-        double prevdiff = vsapi->propGetFloat(vsapi->getFramePropsRO(prevframe), "SCPlaneStatsDiff", 0, nullptr);
-        double nextdiff = vsapi->propGetFloat(vsapi->getFramePropsRO(nextframe), "SCPlaneStatsDiff", 0, nullptr);
+        double prevdiff = vsapi->propGetFloatByKey(vsapi->getFramePropsRO(prevframe), d->propDiff, 0, nullptr);
+        double nextdiff = vsapi->propGetFloatByKey(vsapi->getFramePropsRO(nextframe), d->propDiff, 0, nullptr);
 
         VSFrameRef *dst = vsapi->copyFrame(src, core);
         VSMap *rwprops = vsapi->getFramePropsRW(dst);
-        vsapi->propSetInt(rwprops, "_SceneChangePrev", prevdiff > d->threshold, paReplace);
-        vsapi->propSetInt(rwprops, "_SceneChangeNext", nextdiff > d->threshold, paReplace);
+        vsapi->propSetIntByKey(rwprops, d->propSceneChangePrev, prevdiff > d->threshold, paReplace);
+        vsapi->propSetIntByKey(rwprops, d->propSceneChangeNext, nextdiff > d->threshold, paReplace);
         vsapi->freeFrame(src);
         vsapi->freeFrame(prevframe);
         vsapi->freeFrame(nextframe);
@@ -80,6 +83,9 @@ static void VS_CC scDetectCreate(const VSMap *in, VSMap *out, void *userData, VS
     d->threshold = vsapi->propGetFloat(in, "threshold", 0, &err);
     if (err)
         d->threshold = 0.1;
+    d->propDiff = vsapi->getMapKey("SCPlaneStatsDiff");
+    d->propSceneChangePrev = vsapi->getMapKey("_SceneChangePrev");
+    d->propSceneChangeNext = vsapi->getMapKey("_SceneChangeNext");
     d->node = vsapi->propGetNode(in, "clip", 0, nullptr);
     const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
 
@@ -128,6 +134,8 @@ typedef struct {
     float fscale;
     bool useSceneChange;
     bool process[3];
+    const VSMapKey *propSceneChangePrev;
+    const VSMapKey *propSceneChangeNext;
 } AverageFrameData;
 
 template<typename T>
@@ -239,7 +247,7 @@ static const VSFrameRef *VS_CC averageFramesGetFrame(int n, int activationReason
             for (int i = weights.size() / 2; i > 0; i--) {
                 const VSMap *props = vsapi->getFramePropsRO(frames[i]);
                 int err;
-                if (vsapi->propGetInt(props, "_SceneChangePrev", 0, &err)) {
+                if (vsapi->propGetIntByKey(props, d->propSceneChangePrev, 0, &err)) {
                     fromFrame = i;
                     break;
                 }
@@ -248,7 +256,7 @@ static const VSFrameRef *VS_CC averageFramesGetFrame(int n, int activationReason
             for (int i = weights.size() / 2; i < static_cast<int>(weights.size()) - 1; i++) {
                 const VSMap *props = vsapi->getFramePropsRO(frames[i]);
                 int err;
-                if (vsapi->propGetInt(props, "_SceneChangeNext", 0, &err)) {
+                if (vsapi->propGetIntByKey(props, d->propSceneChangeNext, 0, &err)) {
                     toFrame = i;
                     break;
                 }
@@ -331,6 +339,8 @@ static void VS_CC averageFramesCreate(const VSMap *in, VSMap *out, void *userDat
         d->useSceneChange = !!vsapi->propGetInt(in, "scenechange", 0, &err);
         if (numNodes != 1 && d->useSceneChange)
             throw std::string("Scenechange can only be used in single clip mode");
+        d->propSceneChangePrev = vsapi->getMapKey("_SceneChangePrev");
+        d->propSceneChangeNext = vsapi->getMapKey("_SceneChangeNext");
 
         for (int i = 0; i < numNodes; i++)
             d->nodes.push_back(vsapi->propGetNode(in, "clips", i, 0));
@@ -22,8 +22,8 @@
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
-#include "morpho.h"
 #include "morpho_selems.h"
+#include "morpho.h"
 #include "morpho_filters.h"
 
 static void VS_CC MorphoCreate(const VSMap *in, VSMap *out, void *userData,
@@ -90,12 +90,15 @@ error:
 static void VS_CC MorphoInit(VSMap *in, VSMap *out, void **instanceData,
                              VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
-    int pads;
+    int pads, hsize, i;
 
     MorphoData *d = (MorphoData *) * instanceData;
     vsapi->setVideoInfo(&d->vi, 1, node);
 
+    d->runs = NULL;
+
     pads = d->size + (d->size % 2 == 0);
+    hsize = d->size / 2;
 
     d->selem = calloc(1, sizeof(uint8_t) * pads * pads);
     if (!d->selem) {
@@ -104,6 +107,25 @@ static void VS_CC MorphoInit(VSMap *in, VSMap *out, void **instanceData,
     }
 
     SElemFuncs[d->shape](d->selem, d->size);
+
+    d->runs = malloc(sizeof(SElemRun) * (hsize * 2 + 1) * (hsize + 1));
+    if (!d->runs) {
+        vsapi->setError(out, "Failed to allocate structuring element");
+        return;
+    }
+
+    d->numruns = SElemRuns(d->selem, d->size, d->runs);
+
+    /* One run per row on consecutive rows, all with the same extent, can be
+     * filtered as two separable passes */
+    d->rect = d->numruns > 0;
+
+    for (i = 1; i < d->numruns; i++) {
+        if (d->runs[i].y != d->runs[0].y + i ||
+            d->runs[i].x != d->runs[0].x ||
+            d->runs[i].length != d->runs[0].length)
+            d->rect = 0;
+    }
 }
 
 static const VSFrameRef *VS_CC MorphoGetFrame(int n, int activationReason,
@@ -149,6 +171,7 @@ static void VS_CC MorphoFree(void *instanceData, VSCore *core,
 
     vsapi->freeNode(d->node);
     free(d->selem);
+    free(d->runs);
     free(d);
 }
 
@@ -24,6 +24,10 @@ typedef struct MorphoData {
     int shape;
     int size;
 
+    SElemRun *runs;
+    int numruns;
+    int rect;
+
     int filter;
 } MorphoData;
 
@@ -18,10 +18,17 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
 
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
+#include "morpho_selems.h"
 #include "morpho.h"
 #include "morpho_filters.h"
 
@@ -46,49 +53,276 @@ const MorphoFilter FilterFuncs[] = {
 };
 
 static inline int Border(int v, int max) {
-    if (v < 0)
-        v = -v;
-    else if (v > max)
-        v = max - (v - max);
+    if (max == 0)
+        return 0;
+
+    while (v < 0 || v > max) {
+        if (v < 0)
+            v = -v;
+        else
+            v = max - (v - max);
+    }
 
     return v;
 }
 
-#define MORPHO(T,V,OP)                                                         \
-    int x, y;                                                                  \
-    int hsize = d->size / 2;                                                   \
-                                                                               \
-    for (y = 0; y < height; y++) {                                             \
-        for (x = 0; x < width; x++) {                                          \
-            int i, j;                                                          \
-            T v = (V);                                                         \
-                                                                               \
-            for (j = -hsize; j <= hsize; j++) {                                \
-                for (i = -hsize; i <= hsize; i++) {                            \
-                    uint8_t mv = d->selem[i + hsize + ((j + hsize) * d->size)];\
-                                                                               \
-                    if (mv) {                                                  \
-                        int sx = Border(x + i, width - 1);                     \
-                        int sy = Border(y + j, height - 1);                    \
-                        T sv = ((const T *)&src[sy * stride])[sx];             \
-                        v = OP(v, sv);                                         \
-                    }                                                          \
-                }                                                              \
-            }                                                                  \
+/* Row operations take the element count n. dst may be the same as a as long
+ * as b does not point before it, the doubling passes rely on this. */
+typedef void (*RowOp)(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n);
+
+#ifdef VS_TARGET_CPU_X86
+#define ROWOP(NAME, T, SIMD, OP)                                               \
+    static void NAME(uint8_t *dstp, const uint8_t *ap, const uint8_t *bp,      \
+                     int n)                                                    \
+    {                                                                          \
+        T *dst = (T *)dstp;                                                    \
+        const T *a = (const T *)ap;                                            \
+        const T *b = (const T *)bp;                                            \
+        int x = 0;                                                             \
                                                                                \
-            ((T *)dst)[x] = v;                                                 \
+        for (; x + (int)(16 / sizeof(T)) <= n; x += 16 / sizeof(T)) {          \
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + x));            \
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));            \
+            _mm_storeu_si128((__m128i *)(dst + x), SIMD);                      \
         }                                                                      \
                                                                                \
-        dst += stride;                                                         \
+        for (; x < n; x++)                                                     \
+            dst[x] = OP(a[x], b[x]);                                           \
+    }
+#else
+#define ROWOP(NAME, T, SIMD, OP)                                               \
+    static void NAME(uint8_t *dstp, const uint8_t *ap, const uint8_t *bp,      \
+                     int n)                                                    \
+    {                                                                          \
+        T *dst = (T *)dstp;                                                    \
+        const T *a = (const T *)ap;                                            \
+        const T *b = (const T *)bp;                                            \
+        int x;                                                                 \
+                                                                               \
+        for (x = 0; x < n; x++)                                                \
+            dst[x] = OP(a[x], b[x]);                                           \
+    }
+#endif
+
+/* SSE2 has no unsigned 16 bit min/max, saturating arithmetic does the job */
+ROWOP(MaxRow8, uint8_t, _mm_max_epu8(va, vb), VSMAX)
+ROWOP(MinRow8, uint8_t, _mm_min_epu8(va, vb), VSMIN)
+ROWOP(MaxRow16, uint16_t, _mm_adds_epu16(vb, _mm_subs_epu16(va, vb)), VSMAX)
+ROWOP(MinRow16, uint16_t, _mm_subs_epu16(va, _mm_subs_epu16(va, vb)), VSMIN)
+
+/* Mirrors the row of width samples starting at hsize into the hsize samples
+ * on either side of it */
+static void PadRow(uint8_t *buf, int width, int hsize, int bps)
+{
+    int x;
+
+    if (bps == 1) {
+        uint8_t *p = buf + hsize;
+
+        for (x = 1; x <= hsize; x++) {
+            p[-x] = p[Border(-x, width - 1)];
+            p[width - 1 + x] = p[Border(width - 1 + x, width - 1)];
+        }
+    } else {
+        uint16_t *p = (uint16_t *)buf + hsize;
+
+        for (x = 1; x <= hsize; x++) {
+            p[-x] = p[Border(-x, width - 1)];
+            p[width - 1 + x] = p[Border(width - 1 + x, width - 1)];
+        }
+    }
+}
+
+/* Applies a horizontal window of len samples to width + len - 1 padded
+ * samples. The window is grown by doubling in place, so the cost is
+ * logarithmic in len and every pass is a plain SIMD min/max. */
+static void HorizontalPass(uint8_t *dst, uint8_t *buf, int width, int len,
+                           int bps, RowOp op)
+{
+    int w = 1;
+    int n = width + len - 1;
+
+    while (w * 2 <= len) {
+        op(buf, buf, buf + w * bps, n - w);
+        n -= w;
+        w *= 2;
+    }
+
+    if (w == len)
+        memcpy(dst, buf, width * bps);
+    else
+        op(dst, buf, buf + (len - w) * bps, width);
+}
+
+/* Rectangular structuring elements are separable. The vertical pass uses the
+ * van Herk/Gil-Werman algorithm: the rows are split into blocks as tall as
+ * the window, and every window is the combination of a suffix of one block
+ * and a prefix of the next, for about three operations per sample no matter
+ * how tall the window is. */
+static void MorphoRect(const uint8_t **rows, uint8_t *dst, int width,
+                       int height, int stride, int bps, int hsize,
+                       const MorphoData *d, RowOp op)
+{
+    int r = d->numruns;
+    int x0 = d->runs[0].x;
+    int len = d->runs[0].length;
+    size_t rowsize = width * bps;
+    uint8_t *buf = malloc(rowsize * r + (width + 2 * hsize) * bps);
+    uint8_t *g = buf;
+    uint8_t *suf = buf + rowsize;
+    uint8_t *hbuf = suf + rowsize * (r - 1);
+    uint8_t *center = hbuf + hsize * bps;
+    const uint8_t *gp = NULL;
+    int b, i, k;
+
+    rows += d->runs[0].y;
+
+    for (b = 0; b < height; b += r) {
+        for (i = 0; i < r && b + i < height; i++) {
+            if (i == 0) {
+                const uint8_t *next = rows[b + r - 1];
+
+                for (k = r - 2; k >= 0; k--) {
+                    op(suf + k * rowsize, rows[b + k], next, width);
+                    next = suf + k * rowsize;
+                }
+
+                memcpy(center, next, rowsize);
+            } else {
+                if (i == 1) {
+                    gp = rows[b + r];
+                } else {
+                    op(g, gp, rows[b + r + i - 1], width);
+                    gp = g;
+                }
+
+                op(center, i == r - 1 ? rows[b + r - 1] : suf + i * rowsize,
+                   gp, width);
+            }
+
+            PadRow(hbuf, width, hsize, bps);
+            HorizontalPass(dst + (b + i) * stride, hbuf + x0 * bps, width, len,
+                           bps, op);
+        }
     }
 
+    free(buf);
+}
+
+/* Arbitrary structuring elements are split into horizontal runs. Every padded
+ * source row is kept with its min/max over power of two windows, so each run
+ * costs two SIMD operations per output row no matter how long it is. */
+static void MorphoRuns(const uint8_t **rows, uint8_t *dst, int width,
+                       int height, int stride, int bps, int hsize,
+                       const MorphoData *d, RowOp op)
+{
+    int span = hsize * 2 + 1;
+    int n = width + 2 * hsize;
+    size_t levelsize = n * bps;
+    int levels = 1;
+    int maxlen = 0;
+    int i, k, t;
+    uint8_t *ring;
+    int *runlevel = malloc(sizeof(int) * d->numruns);
+
+    for (i = 0; i < d->numruns; i++) {
+        for (k = 0; (2 << k) <= d->runs[i].length; k++);
+        runlevel[i] = k;
+        maxlen = VSMAX(maxlen, d->runs[i].length);
+    }
+
+    while ((1 << levels) <= maxlen)
+        levels++;
+
+    ring = malloc(levelsize * levels * span);
+
+    for (t = 0; t < height + 2 * hsize; t++) {
+        uint8_t *slot = ring + levelsize * levels * (t % span);
+        int y = t - 2 * hsize;
+
+        memcpy(slot + hsize * bps, rows[t], width * bps);
+        PadRow(slot, width, hsize, bps);
+
+        for (k = 1; k < levels; k++) {
+            uint8_t *prev = slot + levelsize * (k - 1);
+            op(prev + levelsize, prev, prev + (1 << (k - 1)) * bps,
+               n - (1 << k) + 1);
+        }
+
+        if (y < 0)
+            continue;
+
+        for (i = 0; i < d->numruns; i++) {
+            const SElemRun *run = &d->runs[i];
+            const uint8_t *level = ring +
+                                   levelsize * levels * ((y + run->y) % span) +
+                                   levelsize * runlevel[i];
+            const uint8_t *a = level + run->x * bps;
+            const uint8_t *b = level +
+                               (run->x + run->length - (1 << runlevel[i])) * bps;
+
+            if (i == 0) {
+                op(dst, a, b, width);
+            } else {
+                op(dst, dst, a, width);
+                if (b != a)
+                    op(dst, dst, b, width);
+            }
+        }
+
+        dst += stride;
+    }
+
+    free(ring);
+    free(runlevel);
+}
+
+static void MorphoPlane(const uint8_t *src, uint8_t *dst, int width,
+                        int height, int stride, MorphoData *d, RowOp op,
+                        int init)
+{
+    int bps = d->vi.format->bytesPerSample;
+    int hsize = d->size / 2;
+    const uint8_t **rows;
+    int x, y;
+
+    if (!d->numruns) {
+        for (y = 0; y < height; y++) {
+            if (bps == 1) {
+                memset(dst, init, width);
+            } else {
+                for (x = 0; x < width; x++)
+                    ((uint16_t *)dst)[x] = init;
+            }
+
+            dst += stride;
+        }
+
+        return;
+    }
+
+    /* Mirrored rows above and below the plane, so the passes never check
+     * vertical borders */
+    rows = malloc(sizeof(const uint8_t *) * (height + 2 * hsize));
+
+    for (y = 0; y < height + 2 * hsize; y++)
+        rows[y] = src + Border(y - hsize, height - 1) * stride;
+
+    if (d->rect)
+        MorphoRect(rows, dst, width, height, stride, bps, hsize, d, op);
+    else
+        MorphoRuns(rows, dst, width, height, stride, bps, hsize, d, op);
+
+    free(rows);
+}
+
 void MorphoDilate(const uint8_t *src, uint8_t *dst,
                   int width, int height, int stride, MorphoData *d)
 {
     if (d->vi.format->bytesPerSample == 1) {
-        MORPHO(uint8_t, 0, VSMAX);
+        MorphoPlane(src, dst, width, height, stride, d, MaxRow8, 0);
     } else {
-        MORPHO(uint16_t, 0, VSMAX);
+        MorphoPlane(src, dst, width, height, stride, d, MaxRow16, 0);
     }
 }
 
@@ -98,9 +332,9 @@ void MorphoErode(const uint8_t *src, uint8_t *dst,
     int sval = (1 << d->vi.format->bitsPerSample) - 1;
 
     if (d->vi.format->bytesPerSample == 1) {
-        MORPHO(uint8_t, sval, VSMIN);
+        MorphoPlane(src, dst, width, height, stride, d, MinRow8, sval);
     } else {
-        MORPHO(uint16_t, sval, VSMIN);
+        MorphoPlane(src, dst, width, height, stride, d, MinRow16, sval);
     }
 }
 
@@ -84,3 +84,30 @@ void CircleSElem(uint8_t *selem, int size) {
         selem[y + (r * size)] = 9;
     }
 }
+
+/* Splits the structuring element into horizontal runs of set taps. The
+ * element is read the way the filters always have: size / 2 taps on each
+ * side of the center with a row stride of size. At most
+ * (size / 2 * 2 + 1) * (size / 2 + 1) runs are written. */
+int SElemRuns(const uint8_t *selem, int size, SElemRun *runs) {
+    int span = size / 2 * 2 + 1;
+    int x, y, n = 0;
+
+    for (y = 0; y < span; y++) {
+        for (x = 0; x < span; x++) {
+            if (!selem[x + y * size])
+                continue;
+
+            if (x == 0 || !selem[x - 1 + y * size]) {
+                runs[n].y = y;
+                runs[n].x = x;
+                runs[n].length = 0;
+                n++;
+            }
+
+            runs[n - 1].length++;
+        }
+    }
+
+    return n;
+}
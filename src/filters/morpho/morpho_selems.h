@@ -18,8 +18,16 @@
 
 typedef void (*SElemFunc)(uint8_t*, int);
 
+typedef struct SElemRun {
+    int y;
+    int x;
+    int length;
+} SElemRun;
+
 void SquareSElem(uint8_t *selem, int size);
 void DiamondSElem(uint8_t *selem, int size);
 void CircleSElem(uint8_t *selem, int size);
 
+int SElemRuns(const uint8_t *selem, int size, SElemRun *runs);
+
 extern const SElemFunc SElemFuncs[];
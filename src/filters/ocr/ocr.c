@@ -19,13 +19,31 @@
 #include <ctype.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #include <tesseract/capi.h>
 
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
+typedef struct OCRInstance {
+    TessBaseAPI *api;
+
+    /* The last recognized region and its result, for skipidentical */
+    uint8_t *image;
+    int width;
+    int height;
+
+    char *text;
+    int textlength;
+    int *confs;
+} OCRInstance;
+
 typedef struct OCRData {
     VSNodeRef *node;
     VSVideoInfo vi;
@@ -33,8 +51,176 @@ typedef struct OCRData {
     VSMap *options;
     char *datapath;
     char *language;
+
+    int left;
+    int top;
+    int width;
+    int height;
+    int skipidentical;
+
+    int numInstances;
+    OCRInstance *instances;
+    volatile long *instanceInUse;
 } OCRData;
 
+#ifdef _WIN32
+static int tryLockInstance(volatile long *inUse) {
+    return !InterlockedCompareExchange(inUse, 1, 0);
+}
+
+static void unlockInstance(volatile long *inUse) {
+    InterlockedExchange(inUse, 0);
+}
+#else
+static int tryLockInstance(volatile long *inUse) {
+    return __sync_bool_compare_and_swap(inUse, 0, 1);
+}
+
+static void unlockInstance(volatile long *inUse) {
+    __sync_lock_release(inUse);
+}
+#endif
+
+static void OCRFreeInstance(OCRInstance *inst)
+{
+    if (inst->api) {
+        TessBaseAPIEnd(inst->api);
+        TessBaseAPIDelete(inst->api);
+    }
+
+    free(inst->image);
+    free(inst->text);
+    free(inst->confs);
+    memset(inst, 0, sizeof(OCRInstance));
+}
+
+/* Claims an idle instance. If all of them are busy the empty temporary
+   instance is returned, and it is destroyed again on release. */
+static OCRInstance *OCRAcquireInstance(OCRData *d, OCRInstance *temp)
+{
+    int i;
+
+    for (i = 0; i < d->numInstances; i++) {
+        if (tryLockInstance(&d->instanceInUse[i]))
+            return &d->instances[i];
+    }
+
+    memset(temp, 0, sizeof(OCRInstance));
+
+    return temp;
+}
+
+static void OCRReleaseInstance(OCRData *d, OCRInstance *inst,
+                               OCRInstance *temp)
+{
+    if (inst == temp)
+        OCRFreeInstance(temp);
+    else
+        unlockInstance(&d->instanceInUse[inst - d->instances]);
+}
+
+/* Loading the traineddata is by far the most expensive part of using
+   Tesseract, so every instance is only initialized once */
+static TessBaseAPI *OCRCreateAPI(const OCRData *d, const VSAPI *vsapi,
+                                 char *msg, size_t msgsize)
+{
+    TessBaseAPI *api = TessBaseAPICreate();
+
+    if (TessBaseAPIInit3(api, d->datapath, d->language) == -1) {
+        snprintf(msg, msgsize, "Failed to initialize Tesseract");
+        TessBaseAPIDelete(api);
+
+        return NULL;
+    }
+
+    if (d->options) {
+        int i, err;
+        int nopts = vsapi->propNumElements(d->options, "options");
+
+        for (i = 0; i < nopts; i += 2) {
+            const char *key = vsapi->propGetData(d->options, "options",
+                                                 i, &err);
+            const char *value = vsapi->propGetData(d->options, "options",
+                                                   i + 1, &err);
+
+            if (!TessBaseAPISetVariable(api, key, value)) {
+                snprintf(msg, msgsize,
+                         "Failed to set Tesseract option '%s'", key);
+
+                TessBaseAPIEnd(api);
+                TessBaseAPIDelete(api);
+
+                return NULL;
+            }
+        }
+    }
+
+    return api;
+}
+
+static int OCRSameImage(const OCRInstance *inst, const uint8_t *srcp,
+                        int stride, int width, int height)
+{
+    int y;
+
+    if (!inst->image || inst->width != width || inst->height != height)
+        return 0;
+
+    for (y = 0; y < height; y++) {
+        if (memcmp(inst->image + y * width, srcp + y * stride, width))
+            return 0;
+    }
+
+    return 1;
+}
+
+static void OCRRecognize(OCRInstance *inst, const uint8_t *srcp, int stride,
+                         int left, int top, int width, int height,
+                         int keepimage)
+{
+    char *result;
+    int length;
+
+    /* Tesseract adapts to what it has already seen. Start every frame from
+       the same state so the result doesn't depend on which instance or
+       which earlier frames were used. */
+    TessBaseAPIClearAdaptiveClassifier(inst->api);
+
+    result = TessBaseAPIRect(inst->api, srcp, 1, stride,
+                             left, top, width, height);
+
+    free(inst->text);
+    free(inst->confs);
+
+    length = strlen(result);
+    for (; length > 0 && isspace(result[length - 1]); length--);
+
+    inst->text = result;
+    inst->textlength = length;
+    inst->confs = TessBaseAPIAllWordConfidences(inst->api);
+
+    if (keepimage) {
+        const uint8_t *roi = srcp + top * stride + left;
+        int y;
+
+        if (inst->width * inst->height != width * height) {
+            free(inst->image);
+            inst->image = malloc(width * height);
+        }
+
+        inst->width = width;
+        inst->height = height;
+
+        for (y = 0; y < height; y++)
+            memcpy(inst->image + y * width, roi + y * stride, width);
+    } else {
+        free(inst->image);
+        inst->image = NULL;
+        inst->width = 0;
+        inst->height = 0;
+    }
+}
+
 static void VS_CC OCRInit(VSMap *in, VSMap *out, void **instanceData,
                              VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
@@ -46,6 +232,13 @@ static void VS_CC OCRFree(void *instanceData, VSCore *core,
                              const VSAPI *vsapi)
 {
     OCRData *d = (OCRData *)instanceData;
+    int i;
+
+    for (i = 0; i < d->numInstances; i++)
+        OCRFreeInstance(&d->instances[i]);
+
+    free(d->instances);
+    free((void *)d->instanceInUse);
 
     vsapi->freeNode(d->node);
     vsapi->freeMap(d->options);
@@ -67,74 +260,64 @@ static const VSFrameRef *VS_CC OCRGetFrame(int n, int activationReason,
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrameRef *src = vsapi->getFrameFilter(n, d->node, frameCtx);
-        VSFrameRef *dst = vsapi->copyFrame(src, core);
-        VSMap *m = vsapi->getFramePropsRW(dst);
+        VSFrameRef *dst;
+        VSMap *m;
 
         const uint8_t *srcp = vsapi->getReadPtr(src, 0);
         int width = vsapi->getFrameWidth(src, 0);
         int height = vsapi->getFrameHeight(src, 0);
         int stride = vsapi->getStride(src, 0);
 
-        TessBaseAPI *api = TessBaseAPICreate();
-        if (TessBaseAPIInit3(api, d->datapath, d->language) == -1) {
-            vsapi->setFilterError("Failed to initialize Tesseract", frameCtx);
+        int roiw = d->width ? d->width : width - d->left;
+        int roih = d->height ? d->height : height - d->top;
+
+        OCRInstance temp, *inst;
+        int i;
 
-            TessBaseAPIDelete(api);
+        if (d->left + roiw > width || d->top + roih > height ||
+            roiw <= 0 || roih <= 0) {
+            vsapi->setFilterError("The region to recognize lies outside the frame",
+                                  frameCtx);
             vsapi->freeFrame(src);
-            vsapi->freeFrame(dst);
 
             return 0;
         }
 
-        if (d->options) {
-            int i, err;
-            int nopts = vsapi->propNumElements(d->options, "options");
-
-            for (i = 0; i < nopts; i += 2) {
-                const char *key = vsapi->propGetData(d->options, "options",
-                                                     i, &err);
-                const char *value = vsapi->propGetData(d->options, "options",
-                                                       i + 1, &err);
+        inst = OCRAcquireInstance(d, &temp);
 
-                if (!TessBaseAPISetVariable(api, key, value)) {
-                    char msg[200];
+        if (!inst->api) {
+            char msg[200];
 
-                    snprintf(msg, 200,
-                             "Failed to set Tesseract option '%s'", key);
+            inst->api = OCRCreateAPI(d, vsapi, msg, sizeof(msg));
 
-                    vsapi->setFilterError(msg, frameCtx);
+            if (!inst->api) {
+                vsapi->setFilterError(msg, frameCtx);
 
-                    TessBaseAPIEnd(api);
-                    TessBaseAPIDelete(api);
-                    vsapi->freeFrame(src);
-                    vsapi->freeFrame(dst);
+                OCRReleaseInstance(d, inst, &temp);
+                vsapi->freeFrame(src);
 
-                    return 0;
-                }
+                return 0;
             }
         }
 
-        {
-            unsigned i;
+        if (!d->skipidentical ||
+            !OCRSameImage(inst, srcp + d->top * stride + d->left, stride,
+                          roiw, roih)) {
+            OCRRecognize(inst, srcp, stride, d->left, d->top, roiw, roih,
+                         d->skipidentical);
+        }
 
-            char *result = TessBaseAPIRect(api, srcp, 1,
-                                           stride, 0, 0, width, height);
-            int *confs = TessBaseAPIAllWordConfidences(api);
-            int length = strlen(result);
+        dst = vsapi->copyFrame(src, core);
+        m = vsapi->getFramePropsRW(dst);
 
-            for (; length > 0 && isspace(result[length - 1]); length--);
-            vsapi->propSetData(m, "OCRString", result, length, paReplace);
+        vsapi->propSetData(m, "OCRString", inst->text, inst->textlength,
+                           paReplace);
 
-            for (i = 0; confs[i] != -1; i++) {
-                vsapi->propSetInt(m, "OCRConfidence", confs[i], paAppend);
-            }
-
-            free(confs);
-            free(result);
+        for (i = 0; inst->confs[i] != -1; i++) {
+            vsapi->propSetInt(m, "OCRConfidence", inst->confs[i], paAppend);
         }
 
-        TessBaseAPIEnd(api);
-        TessBaseAPIDelete(api);
+        OCRReleaseInstance(d, inst, &temp);
         vsapi->freeFrame(src);
 
         return dst;
@@ -176,6 +359,8 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
     d.options = NULL;
     d.datapath = NULL;
     d.language = NULL;
+    d.instances = NULL;
+    d.instanceInUse = NULL;
 
     if (!d.vi.format) {
         msg = "Only constant format input supported";
@@ -190,6 +375,27 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
         goto error;
     }
 
+    d.left = int64ToIntS(vsapi->propGetInt(in, "left", 0, &err));
+    d.top = int64ToIntS(vsapi->propGetInt(in, "top", 0, &err));
+    d.width = int64ToIntS(vsapi->propGetInt(in, "width", 0, &err));
+    d.height = int64ToIntS(vsapi->propGetInt(in, "height", 0, &err));
+
+    if (d.left < 0 || d.top < 0 || d.width < 0 || d.height < 0) {
+        msg = "left, top, width and height must not be negative";
+        goto error;
+    }
+
+    if ((d.vi.width && d.left + (d.width ? d.width : 1) > d.vi.width) ||
+        (d.vi.height && d.top + (d.height ? d.height : 1) > d.vi.height)) {
+        msg = "The region to recognize lies outside the frame";
+        goto error;
+    }
+
+    d.skipidentical = !!vsapi->propGetInt(in, "skipidentical", 0, &err);
+
+    if (err)
+        d.skipidentical = 1;
+
     if ((nopts = vsapi->propNumElements(in, "options")) > 0) {
         if (nopts % 2) {
             msg = "Options must be key,value pairs";
@@ -244,6 +450,10 @@ static void VS_CC OCRCreate(const VSMap *in, VSMap *out, void *userData,
         d.language = szterm(opt, size);
     }
 
+    d.numInstances = vsapi->getCoreInfo(core)->numThreads;
+    d.instances = calloc(d.numInstances, sizeof(OCRInstance));
+    d.instanceInUse = calloc(d.numInstances, sizeof(long));
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -272,6 +482,8 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc,
                VAPOURSYNTH_API_VERSION, 1, plugin);
 
     registerFunc("Recognize",
-                 "clip:clip;datapath:data:opt;language:data:opt;options:data[]:opt",
+                 "clip:clip;datapath:data:opt;language:data:opt;options:data[]:opt;"
+                 "left:int:opt;top:int:opt;width:int:opt;height:int:opt;"
+                 "skipidentical:int:opt",
                  OCRCreate, 0, plugin);
 }
@@ -28,7 +28,6 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "shared.h"
 
 #define CLENSE_RETERROR(x) do { vsapi->setError(out, (x)); vsapi->freeNode(d.cnode); vsapi->freeNode(d.pnode); vsapi->freeNode(d.nnode); return; } while (0)
-#define CLAMP(value, lower, upper) do { if (value < lower) value = lower; else if (value > upper) value = upper; } while(0)
 
 typedef struct {
     VSNodeRef *cnode;
@@ -49,8 +48,18 @@ struct PlaneProc {
     template<typename T>
     static void clenseProcessPlane(T* VS_RESTRICT pDst, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, int stride, int width, int height) {
         for (int y = 0; y < height; ++y) {
+#ifdef VS_TARGET_CPU_X86
+            typedef PixelVec<T> P;
+            // The rows are padded to at least the vector size
+            for (int x = 0; x < width; x += P::size) {
+                const typename P::V ref1 = P::load(pRef1 + x);
+                const typename P::V ref2 = P::load(pRef2 + x);
+                P::store(pDst + x, P::min(P::max(P::load(pSrc + x), P::min(ref1, ref2)), P::max(ref1, ref2)));
+            }
+#else
             for (int x = 0; x < width; ++x)
                 pDst[x] = std::min(std::max(pSrc[x], std::min(pRef1[x], pRef2[x])), std::max(pRef1[x], pRef2[x]));
+#endif
             pDst += stride;
             pSrc += stride;
             pRef1 += stride;
@@ -59,20 +68,34 @@ struct PlaneProc {
     }
 };
 
+// The reference range can extend past the valid pixel values but clamping the
+// source to it gives the same result as clamping the range first
 struct PlaneProcFB {
     template<typename T>
     static void clenseProcessPlane(T* VS_RESTRICT pDst, const T* VS_RESTRICT pSrc, const T* VS_RESTRICT pRef1, const T* VS_RESTRICT pRef2, int stride, int width, int height) {
         for (int y = 0; y < height; ++y) {
+#ifdef VS_TARGET_CPU_X86
+            typedef PixelVec<T> P;
+            for (int x = 0; x < width; x += P::size) {
+                const typename P::V ref1 = P::load(pRef1 + x);
+                const typename P::V ref2 = P::load(pRef2 + x);
+                const typename P::V minref = P::min(ref1, ref2);
+                const typename P::V maxref = P::max(ref1, ref2);
+                // minref * 2 - ref2 and maxref * 2 - ref2 without overflowing
+                const typename P::V lowref = P::subs(minref, P::subs(ref2, minref));
+                const typename P::V upref = P::adds(maxref, P::subs(maxref, ref2));
+                P::store(pDst + x, P::min(P::max(P::load(pSrc + x), lowref), upref));
+            }
+#else
+            typedef typename CalcType<T>::Type Calc;
             for (int x = 0; x < width; ++x) {
-                T minref = std::min(pRef1[x], pRef2[x]);
-                T maxref = std::max(pRef1[x], pRef2[x]);
-                int lowref = minref * 2 - pRef2[x];
-                int upref = maxref * 2 - pRef2[x];
-                T src = pSrc[x];
-                CLAMP(src, std::max<int>(lowref, std::numeric_limits<T>::min()), std::min<int>(upref, std::numeric_limits<T>::max()));
-                pDst[x] = src;
+                const Calc minref = std::min(pRef1[x], pRef2[x]);
+                const Calc maxref = std::max(pRef1[x], pRef2[x]);
+                const Calc lowref = minref * 2 - pRef2[x];
+                const Calc upref = maxref * 2 - pRef2[x];
+                pDst[x] = static_cast<T>(limit<Calc>(pSrc[x], lowref, upref));
             }
-
+#endif
             pDst += stride;
             pSrc += stride;
             pRef1 += stride;
@@ -214,23 +237,21 @@ void VS_CC clenseCreate(const VSMap *in, VSMap *out, void *userData, VSCore *cor
     }
 
     VSFilterGetFrame getFrameFunc = nullptr;
-    if (d.vi->format->sampleType == stInteger) {
-        if (d.mode == cmNormal) {
-            switch (d.vi->format->bitsPerSample) {
-            case 8: getFrameFunc = clenseGetFrame<uint8_t, PlaneProc>; break;
-            case 16: getFrameFunc = clenseGetFrame<uint16_t, PlaneProc>; break;
-            }
-        } else {
-            switch (d.vi->format->bitsPerSample) {
-            case 8: getFrameFunc = clenseGetFrame<uint8_t, PlaneProcFB>; break;
-            case 16: getFrameFunc = clenseGetFrame<uint16_t, PlaneProcFB>; break;
-            }
-        }
+    if (d.vi->format->sampleType == stInteger && d.vi->format->bitsPerSample <= 16) {
+        if (d.mode == cmNormal)
+            getFrameFunc = (d.vi->format->bytesPerSample == 1) ? clenseGetFrame<uint8_t, PlaneProc> : clenseGetFrame<uint16_t, PlaneProc>;
+        else
+            getFrameFunc = (d.vi->format->bytesPerSample == 1) ? clenseGetFrame<uint8_t, PlaneProcFB> : clenseGetFrame<uint16_t, PlaneProcFB>;
+    } else if (d.vi->format->sampleType == stFloat && d.vi->format->bitsPerSample == 32) {
+        if (d.mode == cmNormal)
+            getFrameFunc = clenseGetFrame<float, PlaneProc>;
+        else
+            getFrameFunc = clenseGetFrame<float, PlaneProcFB>;
     }
 
     if (!getFrameFunc)
-        CLENSE_RETERROR("Clense: only 8 and 16 bit integer input supported");
-    
+        CLENSE_RETERROR("Clense: only 8-16 bit integer and 32 bit float input supported");
+
     data = new ClenseData(d);
 
     vsapi->createFilter(in, out, "Clense", clenseInit, getFrameFunc, clenseFree, fmParallel, 0, data, core);
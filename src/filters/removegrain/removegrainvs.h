@@ -0,0 +1,1555 @@
+/*****************************************************************************
+
+        AvsFilterRemoveGrain/Repair16
+        Author: Laurent de Soras, 2012
+        Modified for VapourSynth by Fredrik Mellbin 2013
+
+--- Legal stuff ---
+
+This program is free software. It comes without any warranty, to
+the extent permitted by applicable law. You can redistribute it
+and/or modify it under the terms of the Do What The Fuck You Want
+To Public License, Version 2, as published by Sam Hocevar. See
+http://sam.zoy.org/wtfpl/COPYING for more details.
+
+*Tab=3***********************************************************************/
+
+#ifndef REMOVEGRAINVS_H
+#define REMOVEGRAINVS_H
+
+#include "shared.h"
+
+// Everything is internal to each translation unit since the AVX2 versions are compiled
+// from the same code with different compiler flags
+namespace {
+
+#ifdef VS_TARGET_CPU_X86
+class ConvSigned
+{
+public:
+    template<typename V>
+    static __forceinline V cv (V a, V m)
+    {
+        return (xor_si (a, m));
+    }
+};
+
+
+class ConvUnsigned
+{
+public:
+    template<typename V>
+    static __forceinline V cv (V a, V m)
+    {
+        return (a);
+    }
+};
+
+#define AvsFilterRemoveGrain16_READ_PIX    \
+   const int      om = stride_src - 1;     \
+   const int      o0 = stride_src    ;     \
+   const int      op = stride_src + 1;     \
+   V                    a1 = ConvSign::cv (load_pix<V> (src_ptr - op), mask_sign); \
+   V                    a2 = ConvSign::cv (load_pix<V> (src_ptr - o0), mask_sign); \
+   V                    a3 = ConvSign::cv (load_pix<V> (src_ptr - om), mask_sign); \
+   V                    a4 = ConvSign::cv (load_pix<V> (src_ptr - 1 ), mask_sign); \
+   V                    c  = ConvSign::cv (load_pix<V> (src_ptr + 0 ), mask_sign); \
+   V                    a5 = ConvSign::cv (load_pix<V> (src_ptr + 1 ), mask_sign); \
+   V                    a6 = ConvSign::cv (load_pix<V> (src_ptr + om), mask_sign); \
+   V                    a7 = ConvSign::cv (load_pix<V> (src_ptr + o0), mask_sign); \
+   V                    a8 = ConvSign::cv (load_pix<V> (src_ptr + op), mask_sign);
+
+#define AvsFilterRemoveGrain16_SORT_AXIS_SIMD   \
+    const V        ma1 = max_epi16(a1, a8); \
+    const V        mi1 = min_epi16(a1, a8); \
+    const V        ma2 = max_epi16(a2, a7); \
+    const V        mi2 = min_epi16(a2, a7); \
+    const V        ma3 = max_epi16(a3, a6); \
+    const V        mi3 = min_epi16(a3, a6); \
+    const V        ma4 = max_epi16(a4, a5); \
+    const V        mi4 = min_epi16(a4, a5);
+
+#else
+
+class ConvSigned
+{
+};
+
+
+class ConvUnsigned
+{
+};
+#endif
+
+#define AvsFilterRemoveGrain16_SORT_AXIS_CPP \
+    const T          ma1 = std::max(a1, a8);   \
+    const T          mi1 = std::min(a1, a8);   \
+    const T          ma2 = std::max(a2, a7);   \
+    const T          mi2 = std::min(a2, a7);   \
+    const T          ma3 = std::max(a3, a6);   \
+    const T          mi3 = std::min(a3, a6);   \
+    const T          ma4 = std::max(a4, a5);   \
+    const T          mi4 = std::min(a4, a5);
+
+class OpRG01 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        const T          mi = std::min (
+            std::min (std::min (a1, a2), std::min (a3, a4)),
+            std::min (std::min (a5, a6), std::min (a7, a8))
+        );
+        const T          ma = std::max (
+            std::max (std::max (a1, a2), std::max (a3, a4)),
+            std::max (std::max (a5, a6), std::max (a7, a8))
+        );
+
+        return (limit (c, mi, ma));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        const V          mi = min_epi16 (
+            min_epi16 (min_epi16 (a1, a2), min_epi16 (a3, a4)),
+            min_epi16 (min_epi16 (a5, a6), min_epi16 (a7, a8))
+        );
+        const V          ma = max_epi16 (
+            max_epi16 (max_epi16 (a1, a2), max_epi16 (a3, a4)),
+            max_epi16 (max_epi16 (a5, a6), max_epi16 (a7, a8))
+        );
+
+        return (min_epi16 (max_epi16 (c, mi), ma));
+    }
+#endif
+};
+
+class OpRG02 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        T                  a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [2-1], a [7-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair (a1, a2);
+        sort_pair (a3, a4);
+        sort_pair (a5, a6);
+        sort_pair (a7, a8);
+
+        sort_pair (a1, a3);
+        sort_pair (a2, a4);
+        sort_pair (a5, a7);
+        sort_pair (a6, a8);
+
+        sort_pair (a2, a3);
+        sort_pair (a6, a7);
+
+        a5 = max_epi16 (a1, a5);    // sort_pair (a1, a5);
+        sort_pair (a2, a6);
+        sort_pair (a3, a7);
+        a4 = min_epi16 (a4, a8);    // sort_pair (a4, a8);
+
+        a3 = min_epi16 (a3, a5);    // sort_pair (a3, a5);
+        a6 = max_epi16 (a4, a6);    // sort_pair (a4, a6);
+
+        a2 = min_epi16 (a2, a3);    // sort_pair (a2, a3);
+        a7 = max_epi16 (a6, a7);    // sort_pair (a6, a7);
+
+        return (min_epi16 (max_epi16 (c, a2), a7));
+    }
+#endif
+};
+
+class OpRG03 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        T                  a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [3-1], a [6-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair (a1, a2);
+        sort_pair (a3, a4);
+        sort_pair (a5, a6);
+        sort_pair (a7, a8);
+
+        sort_pair (a1, a3);
+        sort_pair (a2, a4);
+        sort_pair (a5, a7);
+        sort_pair (a6, a8);
+
+        sort_pair (a2, a3);
+        sort_pair (a6, a7);
+
+        a5 = max_epi16 (a1, a5);    // sort_pair (a1, a5);
+        sort_pair (a2, a6);
+        sort_pair (a3, a7);
+        a4 = min_epi16 (a4, a8);    // sort_pair (a4, a8);
+
+        a3 = min_epi16 (a3, a5);    // sort_pair (a3, a5);
+        a6 = max_epi16 (a4, a6);    // sort_pair (a4, a6);
+
+        a3 = max_epi16 (a2, a3);    // sort_pair (a2, a3);
+        a6 = min_epi16 (a6, a7);    // sort_pair (a6, a7);
+
+        return (min_epi16 (max_epi16 (c, a3), a6));
+    }
+#endif
+};
+
+class OpRG04 : public LineProcAll {
+public:
+    typedef    ConvSigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        T                  a [8] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+
+        std::sort (&a [0], (&a [7]) + 1);
+
+        return (limit (c, a [4-1], a [5-1]));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        // http://en.wikipedia.org/wiki/Batcher_odd%E2%80%93even_mergesort
+
+        AvsFilterRemoveGrain16_READ_PIX
+
+        sort_pair (a1, a2);
+        sort_pair (a3, a4);
+        sort_pair (a5, a6);
+        sort_pair (a7, a8);
+
+        sort_pair (a1, a3);
+        sort_pair (a2, a4);
+        sort_pair (a5, a7);
+        sort_pair (a6, a8);
+
+        sort_pair (a2, a3);
+        sort_pair (a6, a7);
+
+        a5 = max_epi16 (a1, a5);    // sort_pair (a1, a5);
+        a6 = max_epi16 (a2, a6);    // sort_pair (a2, a6);
+        a3 = min_epi16 (a3, a7);    // sort_pair (a3, a7);
+        a4 = min_epi16 (a4, a8);    // sort_pair (a4, a8);
+
+        a5 = max_epi16 (a3, a5);    // sort_pair (a3, a5);
+        a4 = min_epi16 (a4, a6);    // sort_pair (a4, a6);
+
+                                                // sort_pair (a2, a3);
+        sort_pair (a4, a5);
+                                                // sort_pair (a6, a7);
+
+        return (min_epi16 (max_epi16 (c, a4), a5));
+    }
+#endif
+};
+
+class OpRG05 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        c1 = std::abs(c - limit(c, mi1, ma1));
+            const T        c2 = std::abs(c - limit(c, mi2, ma2));
+            const T        c3 = std::abs(c - limit(c, mi3, ma3));
+            const T        c4 = std::abs(c - limit(c, mi4, ma4));
+
+            const T        mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (limit(c, mi4, ma4));
+            } else if (mindiff == c2) {
+                return (limit(c, mi2, ma2));
+            } else if (mindiff == c3) {
+                return (limit(c, mi3, ma3));
+            }
+
+            return (limit(c, mi1, ma1));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        cli1 = limit_epi16(c, mi1, ma1);
+            const V        cli2 = limit_epi16(c, mi2, ma2);
+            const V        cli3 = limit_epi16(c, mi3, ma3);
+            const V        cli4 = limit_epi16(c, mi4, ma4);
+
+            const V        cli1u = xor_si(cli1, mask_sign);
+            const V        cli2u = xor_si(cli2, mask_sign);
+            const V        cli3u = xor_si(cli3, mask_sign);
+            const V        cli4u = xor_si(cli4, mask_sign);
+            const V        cu = xor_si(c, mask_sign);
+
+            const V        c1u = abs_dif_epu16(cu, cli1u);
+            const V        c2u = abs_dif_epu16(cu, cli2u);
+            const V        c3u = abs_dif_epu16(cu, cli3u);
+            const V        c4u = abs_dif_epu16(cu, cli4u);
+
+            const V        c1 = xor_si(c1u, mask_sign);
+            const V        c2 = xor_si(c2u, mask_sign);
+            const V        c3 = xor_si(c3u, mask_sign);
+            const V        c4 = xor_si(c4u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(c1, c2),
+                min_epi16(c3, c4)
+                );
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, c3, cli3, res);
+            res = select_16_equ(mindiff, c2, cli2, res);
+            res = select_16_equ(mindiff, c4, cli4, res);
+
+            return (res);
+
+        }
+#endif
+};
+
+
+class OpRG06 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        d1 = ma1 - mi1;
+            const T        d2 = ma2 - mi2;
+            const T        d3 = ma3 - mi3;
+            const T        d4 = ma4 - mi4;
+
+            const T        cli1 = limit(c, mi1, ma1);
+            const T        cli2 = limit(c, mi2, ma2);
+            const T        cli3 = limit(c, mi3, ma3);
+            const T        cli4 = limit(c, mi4, ma4);
+
+            const T        c1 = clamp16(std::abs(c - cli1) * 2 + d1);
+            const T        c2 = clamp16(std::abs(c - cli2) * 2 + d2);
+            const T        c3 = clamp16(std::abs(c - cli3) * 2 + d3);
+            const T        c4 = clamp16(std::abs(c - cli4) * 2 + d4);
+
+            const T        mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        d1u = sub_epi16(ma1, mi1);
+            const V        d2u = sub_epi16(ma2, mi2);
+            const V        d3u = sub_epi16(ma3, mi3);
+            const V        d4u = sub_epi16(ma4, mi4);
+
+            const V        cli1 = limit_epi16(c, mi1, ma1);
+            const V        cli2 = limit_epi16(c, mi2, ma2);
+            const V        cli3 = limit_epi16(c, mi3, ma3);
+            const V        cli4 = limit_epi16(c, mi4, ma4);
+
+            const V        cli1u = xor_si(cli1, mask_sign);
+            const V        cli2u = xor_si(cli2, mask_sign);
+            const V        cli3u = xor_si(cli3, mask_sign);
+            const V        cli4u = xor_si(cli4, mask_sign);
+            const V        cu = xor_si(c, mask_sign);
+
+            const V        ad1u = abs_dif_epu16(cu, cli1u);
+            const V        ad2u = abs_dif_epu16(cu, cli2u);
+            const V        ad3u = abs_dif_epu16(cu, cli3u);
+            const V        ad4u = abs_dif_epu16(cu, cli4u);
+
+            const V        c1u = adds_epu16(adds_epu16(d1u, ad1u), ad1u);
+            const V        c2u = adds_epu16(adds_epu16(d2u, ad2u), ad2u);
+            const V        c3u = adds_epu16(adds_epu16(d3u, ad3u), ad3u);
+            const V        c4u = adds_epu16(adds_epu16(d4u, ad4u), ad4u);
+
+            const V        c1 = xor_si(c1u, mask_sign);
+            const V        c2 = xor_si(c2u, mask_sign);
+            const V        c3 = xor_si(c3u, mask_sign);
+            const V        c4 = xor_si(c4u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(c1, c2),
+                min_epi16(c3, c4)
+                );
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, c3, cli3, res);
+            res = select_16_equ(mindiff, c2, cli2, res);
+            res = select_16_equ(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+
+class OpRG07 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        d1 = ma1 - mi1;
+            const T        d2 = ma2 - mi2;
+            const T        d3 = ma3 - mi3;
+            const T        d4 = ma4 - mi4;
+
+            const T        cli1 = limit(c, mi1, ma1);
+            const T        cli2 = limit(c, mi2, ma2);
+            const T        cli3 = limit(c, mi3, ma3);
+            const T        cli4 = limit(c, mi4, ma4);
+
+            const T        c1 = std::abs(c - cli1) + d1;
+            const T        c2 = std::abs(c - cli2) + d2;
+            const T        c3 = std::abs(c - cli3) + d3;
+            const T        c4 = std::abs(c - cli4) + d4;
+
+            const T        mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        d1u = sub_epi16(ma1, mi1);
+            const V        d2u = sub_epi16(ma2, mi2);
+            const V        d3u = sub_epi16(ma3, mi3);
+            const V        d4u = sub_epi16(ma4, mi4);
+
+            const V        cli1 = limit_epi16(c, mi1, ma1);
+            const V        cli2 = limit_epi16(c, mi2, ma2);
+            const V        cli3 = limit_epi16(c, mi3, ma3);
+            const V        cli4 = limit_epi16(c, mi4, ma4);
+
+            const V        cli1u = xor_si(cli1, mask_sign);
+            const V        cli2u = xor_si(cli2, mask_sign);
+            const V        cli3u = xor_si(cli3, mask_sign);
+            const V        cli4u = xor_si(cli4, mask_sign);
+            const V        cu = xor_si(c, mask_sign);
+
+            const V        ad1u = abs_dif_epu16(cu, cli1u);
+            const V        ad2u = abs_dif_epu16(cu, cli2u);
+            const V        ad3u = abs_dif_epu16(cu, cli3u);
+            const V        ad4u = abs_dif_epu16(cu, cli4u);
+
+            const V        c1u = adds_epu16(d1u, ad1u);
+            const V        c2u = adds_epu16(d2u, ad2u);
+            const V        c3u = adds_epu16(d3u, ad3u);
+            const V        c4u = adds_epu16(d4u, ad4u);
+
+            const V        c1 = xor_si(c1u, mask_sign);
+            const V        c2 = xor_si(c2u, mask_sign);
+            const V        c3 = xor_si(c3u, mask_sign);
+            const V        c4 = xor_si(c4u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(c1, c2),
+                min_epi16(c3, c4)
+                );
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, c3, cli3, res);
+            res = select_16_equ(mindiff, c2, cli2, res);
+            res = select_16_equ(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+
+class OpRG08 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        d1 = ma1 - mi1;
+            const T        d2 = ma2 - mi2;
+            const T        d3 = ma3 - mi3;
+            const T        d4 = ma4 - mi4;
+
+            const T        cli1 = limit(c, mi1, ma1);
+            const T        cli2 = limit(c, mi2, ma2);
+            const T        cli3 = limit(c, mi3, ma3);
+            const T        cli4 = limit(c, mi4, ma4);
+
+            const T        c1 = clamp16(std::abs(c - cli1) + d1 * 2);
+            const T        c2 = clamp16(std::abs(c - cli2) + d2 * 2);
+            const T        c3 = clamp16(std::abs(c - cli3) + d3 * 2);
+            const T        c4 = clamp16(std::abs(c - cli4) + d4 * 2);
+
+            const T        mindiff = std::min(std::min(c1, c2), std::min(c3, c4));
+
+            if (mindiff == c4) {
+                return (cli4);
+            } else if (mindiff == c2) {
+                return (cli2);
+            } else if (mindiff == c3) {
+                return (cli3);
+            }
+
+            return (cli1);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        d1u = sub_epi16(ma1, mi1);
+            const V        d2u = sub_epi16(ma2, mi2);
+            const V        d3u = sub_epi16(ma3, mi3);
+            const V        d4u = sub_epi16(ma4, mi4);
+
+            const V        cli1 = limit_epi16(c, mi1, ma1);
+            const V        cli2 = limit_epi16(c, mi2, ma2);
+            const V        cli3 = limit_epi16(c, mi3, ma3);
+            const V        cli4 = limit_epi16(c, mi4, ma4);
+
+            const V        cli1u = xor_si(cli1, mask_sign);
+            const V        cli2u = xor_si(cli2, mask_sign);
+            const V        cli3u = xor_si(cli3, mask_sign);
+            const V        cli4u = xor_si(cli4, mask_sign);
+            const V        cu = xor_si(c, mask_sign);
+
+            const V        ad1u = abs_dif_epu16(cu, cli1u);
+            const V        ad2u = abs_dif_epu16(cu, cli2u);
+            const V        ad3u = abs_dif_epu16(cu, cli3u);
+            const V        ad4u = abs_dif_epu16(cu, cli4u);
+
+            const V        c1u = adds_epu16(adds_epu16(d1u, d1u), ad1u);
+            const V        c2u = adds_epu16(adds_epu16(d2u, d2u), ad2u);
+            const V        c3u = adds_epu16(adds_epu16(d3u, d3u), ad3u);
+            const V        c4u = adds_epu16(adds_epu16(d4u, d4u), ad4u);
+
+            const V        c1 = xor_si(c1u, mask_sign);
+            const V        c2 = xor_si(c2u, mask_sign);
+            const V        c3 = xor_si(c3u, mask_sign);
+            const V        c4 = xor_si(c4u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(c1, c2),
+                min_epi16(c3, c4)
+                );
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, c3, cli3, res);
+            res = select_16_equ(mindiff, c2, cli2, res);
+            res = select_16_equ(mindiff, c4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG09 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        d1 = ma1 - mi1;
+            const T        d2 = ma2 - mi2;
+            const T        d3 = ma3 - mi3;
+            const T        d4 = ma4 - mi4;
+
+            const T        mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+            if (mindiff == d4) {
+                return (limit(c, mi4, ma4));
+            } else if (mindiff == d2) {
+                return (limit(c, mi2, ma2));
+            } else if (mindiff == d3) {
+                return (limit(c, mi3, ma3));
+            }
+
+            return (limit(c, mi1, ma1));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        cli1 = limit_epi16(c, mi1, ma1);
+            const V        cli2 = limit_epi16(c, mi2, ma2);
+            const V        cli3 = limit_epi16(c, mi3, ma3);
+            const V        cli4 = limit_epi16(c, mi4, ma4);
+
+            const V        d1u = sub_epi16(ma1, mi1);
+            const V        d2u = sub_epi16(ma2, mi2);
+            const V        d3u = sub_epi16(ma3, mi3);
+            const V        d4u = sub_epi16(ma4, mi4);
+
+            const V        d1 = xor_si(d1u, mask_sign);
+            const V        d2 = xor_si(d2u, mask_sign);
+            const V        d3 = xor_si(d3u, mask_sign);
+            const V        d4 = xor_si(d4u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(d1, d2),
+                min_epi16(d3, d4)
+                );
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, d3, cli3, res);
+            res = select_16_equ(mindiff, d2, cli2, res);
+            res = select_16_equ(mindiff, d4, cli4, res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG10 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        d1 = std::abs(c - a1);
+            const T        d2 = std::abs(c - a2);
+            const T        d3 = std::abs(c - a3);
+            const T        d4 = std::abs(c - a4);
+            const T        d5 = std::abs(c - a5);
+            const T        d6 = std::abs(c - a6);
+            const T        d7 = std::abs(c - a7);
+            const T        d8 = std::abs(c - a8);
+
+            const T        mindiff = std::min(
+                std::min(std::min(d1, d2), std::min(d3, d4)),
+                std::min(std::min(d5, d6), std::min(d7, d8))
+                );
+
+            if (mindiff == d7) { return (a7); }
+            if (mindiff == d8) { return (a8); }
+            if (mindiff == d6) { return (a6); }
+            if (mindiff == d2) { return (a2); }
+            if (mindiff == d3) { return (a3); }
+            if (mindiff == d1) { return (a1); }
+            if (mindiff == d5) { return (a5); }
+
+            return (a4);
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        d1u = abs_dif_epu16(c, a1);
+            const V        d2u = abs_dif_epu16(c, a2);
+            const V        d3u = abs_dif_epu16(c, a3);
+            const V        d4u = abs_dif_epu16(c, a4);
+            const V        d5u = abs_dif_epu16(c, a5);
+            const V        d6u = abs_dif_epu16(c, a6);
+            const V        d7u = abs_dif_epu16(c, a7);
+            const V        d8u = abs_dif_epu16(c, a8);
+
+            const V        d1 = xor_si(d1u, mask_sign);
+            const V        d2 = xor_si(d2u, mask_sign);
+            const V        d3 = xor_si(d3u, mask_sign);
+            const V        d4 = xor_si(d4u, mask_sign);
+            const V        d5 = xor_si(d5u, mask_sign);
+            const V        d6 = xor_si(d6u, mask_sign);
+            const V        d7 = xor_si(d7u, mask_sign);
+            const V        d8 = xor_si(d8u, mask_sign);
+
+            const V        mindiff = min_epi16(
+                min_epi16(min_epi16(d1, d2), min_epi16(d3, d4)),
+                min_epi16(min_epi16(d5, d6), min_epi16(d7, d8))
+                );
+
+            V              res = a4;
+            res = select_16_equ(mindiff, d5, a5, res);
+            res = select_16_equ(mindiff, d1, a1, res);
+            res = select_16_equ(mindiff, d3, a3, res);
+            res = select_16_equ(mindiff, d2, a2, res);
+            res = select_16_equ(mindiff, d6, a6, res);
+            res = select_16_equ(mindiff, d8, a8, res);
+            res = select_16_equ(mindiff, d7, a7, res);
+
+            return (res);
+        }
+#endif
+};
+
+
+#ifdef VS_TARGET_CPU_X86
+class OpRG12simd
+{
+public:
+    typedef    ConvUnsigned    ConvSign;
+
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        const V          bias = set1_epi16<V> (1);
+
+        const V          a13  = avg_epu16 (a1, a3);
+        const V          a123 = avg_epu16 (a2, a13);
+
+        const V          a68  = avg_epu16 (a6, a8);
+        const V          a678 = avg_epu16 (a7, a68);
+
+        const V          a45  = avg_epu16 (a4, a5);
+        const V          a4c5 = avg_epu16 (c, a45);
+
+        const V          a123678  = avg_epu16 (a123, a678);
+        const V          a123678b = subs_epu16 (a123678, bias);
+        const V          val      = avg_epu16 (a4c5, a123678b);
+
+        return (val);
+    }
+};
+#endif
+
+class OpRG11 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        const T          sum = 4 * c + 2 * (a2 + a4 + a5 + a7) + a1 + a3 + a6 + a8;
+        const T          val = div_round(sum, 16);
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        return (OpRG12simd::rg (src_ptr, stride_src, mask_sign));
+    }
+#endif
+};
+
+class OpRG12 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        return (OpRG11::rg (c, a1, a2, a3, a4, a5, a6, a7, a8));
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        return (OpRG12simd::rg(src_ptr, stride_src, mask_sign));
+    }
+#endif
+};
+
+class OpRG1314 {
+public:
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        d1 = std::abs(a1 - a8);
+            const T        d2 = std::abs(a2 - a7);
+            const T        d3 = std::abs(a3 - a6);
+
+            const T        mindiff = std::min(std::min(d1, d2), d3);
+
+            if (mindiff == d2) {
+                return avg_round(a2, a7);
+            }
+            if (mindiff == d3) {
+                return avg_round(a3, a6);
+            }
+
+            return avg_round(a1, a8);
+        }
+#ifdef VS_TARGET_CPU_X86
+    typedef ConvUnsigned ConvSign;
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+            (void)c;
+            (void)a4;
+            (void)a5;
+
+                const V        d1 = xor_si(abs_dif_epu16(a1, a8), mask_sign);
+            const V        d2 = xor_si(abs_dif_epu16(a2, a7), mask_sign);
+            const V        d3 = xor_si(abs_dif_epu16(a3, a6), mask_sign);
+
+            const V        mindiff = min_epi16(min_epi16(d1, d2), d3);
+
+            V              res = avg_epu16(a1, a8);
+            res = select_16_equ(mindiff, d3, avg_epu16(a3, a6), res);
+            res = select_16_equ(mindiff, d2, avg_epu16(a2, a7), res);
+
+            return (res);
+        }
+#endif
+};
+class OpRG13 : public OpRG1314, public LineProcEven {};
+class OpRG14 : public OpRG1314, public LineProcOdd {};
+class OpRG1516 {
+public:
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        d1 = std::abs(a1 - a8);
+            const T        d2 = std::abs(a2 - a7);
+            const T        d3 = std::abs(a3 - a6);
+
+            const T        mindiff = std::min(std::min(d1, d2), d3);
+            const T        average = div_round(2 * (a2 + a7) + a1 + a3 + a6 + a8, 8);
+
+            if (mindiff == d2) {
+                return (limit(average, std::min(a2, a7), std::max(a2, a7)));
+            }
+            if (mindiff == d3) {
+                return (limit(average, std::min(a3, a6), std::max(a3, a6)));
+            }
+
+            return (limit(average, std::min(a1, a8), std::max(a1, a8)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    typedef ConvUnsigned ConvSign;
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+            (void)c;
+            (void)a4;
+            (void)a5;
+
+                const V        zero = setzero<V>();
+
+            // The sum needs 19 bits, the bias makes the average fit a signed word
+            V              sum_0 = set1_epi32<V>(4 - 0x8000 * 8);
+            V              sum_1 = sum_0;
+
+            add_x16_s32(sum_0, sum_1, a1, zero);
+            add_x16_s32(sum_0, sum_1, a2, zero);
+            add_x16_s32(sum_0, sum_1, a2, zero);
+            add_x16_s32(sum_0, sum_1, a3, zero);
+            add_x16_s32(sum_0, sum_1, a6, zero);
+            add_x16_s32(sum_0, sum_1, a7, zero);
+            add_x16_s32(sum_0, sum_1, a7, zero);
+            add_x16_s32(sum_0, sum_1, a8, zero);
+
+            const V        average = packs_epi32(srai_epi32(sum_0, 3), srai_epi32(sum_1, 3));
+
+            const V        d1 = xor_si(abs_dif_epu16(a1, a8), mask_sign);
+            const V        d2 = xor_si(abs_dif_epu16(a2, a7), mask_sign);
+            const V        d3 = xor_si(abs_dif_epu16(a3, a6), mask_sign);
+
+            const V        mindiff = min_epi16(min_epi16(d1, d2), d3);
+
+            const V        a1s = xor_si(a1, mask_sign);
+            const V        a2s = xor_si(a2, mask_sign);
+            const V        a3s = xor_si(a3, mask_sign);
+            const V        a6s = xor_si(a6, mask_sign);
+            const V        a7s = xor_si(a7, mask_sign);
+            const V        a8s = xor_si(a8, mask_sign);
+
+            const V        cli1 = limit_epi16(average, min_epi16(a1s, a8s), max_epi16(a1s, a8s));
+            const V        cli2 = limit_epi16(average, min_epi16(a2s, a7s), max_epi16(a2s, a7s));
+            const V        cli3 = limit_epi16(average, min_epi16(a3s, a6s), max_epi16(a3s, a6s));
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, d3, cli3, res);
+            res = select_16_equ(mindiff, d2, cli2, res);
+
+            return (xor_si(res, mask_sign));
+        }
+#endif
+};
+class OpRG15 : public OpRG1516, public LineProcEven {};
+class OpRG16 : public OpRG1516, public LineProcOdd {};
+class OpRG17 : public LineProcAll {
+public:
+    typedef ConvSigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        l = std::max(std::max(mi1, mi2), std::max(mi3, mi4));
+            const T        u = std::min(std::min(ma1, ma2), std::min(ma3, ma4));
+
+            return (limit(c, std::min(l, u), std::max(l, u)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+                AvsFilterRemoveGrain16_SORT_AXIS_SIMD
+
+                const V        l = max_epi16(
+                max_epi16(mi1, mi2),
+                max_epi16(mi3, mi4)
+                );
+            const V        u = min_epi16(
+                min_epi16(ma1, ma2),
+                min_epi16(ma3, ma4)
+                );
+            const V        mi = min_epi16(l, u);
+            const V        ma = max_epi16(l, u);
+
+            return (limit_epi16(c, mi, ma));
+        }
+#endif
+};
+
+class OpRG18 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        d1 = std::max(std::abs(c - a1), std::abs(c - a8));
+            const T        d2 = std::max(std::abs(c - a2), std::abs(c - a7));
+            const T        d3 = std::max(std::abs(c - a3), std::abs(c - a6));
+            const T        d4 = std::max(std::abs(c - a4), std::abs(c - a5));
+
+            const T        mindiff = std::min(std::min(d1, d2), std::min(d3, d4));
+
+            if (mindiff == d4) {
+                return (limit(c, std::min(a4, a5), std::max(a4, a5)));
+            }
+            if (mindiff == d2) {
+                return (limit(c, std::min(a2, a7), std::max(a2, a7)));
+            }
+            if (mindiff == d3) {
+                return (limit(c, std::min(a3, a6), std::max(a3, a6)));
+            }
+
+            return (limit(c, std::min(a1, a8), std::max(a1, a8)));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        absdiff1u = abs_dif_epu16(c, a1);
+            const V        absdiff2u = abs_dif_epu16(c, a2);
+            const V        absdiff3u = abs_dif_epu16(c, a3);
+            const V        absdiff4u = abs_dif_epu16(c, a4);
+            const V        absdiff5u = abs_dif_epu16(c, a5);
+            const V        absdiff6u = abs_dif_epu16(c, a6);
+            const V        absdiff7u = abs_dif_epu16(c, a7);
+            const V        absdiff8u = abs_dif_epu16(c, a8);
+
+            const V        absdiff1 = xor_si(absdiff1u, mask_sign);
+            const V        absdiff2 = xor_si(absdiff2u, mask_sign);
+            const V        absdiff3 = xor_si(absdiff3u, mask_sign);
+            const V        absdiff4 = xor_si(absdiff4u, mask_sign);
+            const V        absdiff5 = xor_si(absdiff5u, mask_sign);
+            const V        absdiff6 = xor_si(absdiff6u, mask_sign);
+            const V        absdiff7 = xor_si(absdiff7u, mask_sign);
+            const V        absdiff8 = xor_si(absdiff8u, mask_sign);
+
+            const V        d1 = max_epi16(absdiff1, absdiff8);
+            const V        d2 = max_epi16(absdiff2, absdiff7);
+            const V        d3 = max_epi16(absdiff3, absdiff6);
+            const V        d4 = max_epi16(absdiff4, absdiff5);
+
+            const V        mindiff = min_epi16(
+                min_epi16(d1, d2),
+                min_epi16(d3, d4)
+                );
+
+            const V        a1s = xor_si(a1, mask_sign);
+            const V        a2s = xor_si(a2, mask_sign);
+            const V        a3s = xor_si(a3, mask_sign);
+            const V        a4s = xor_si(a4, mask_sign);
+            const V        a5s = xor_si(a5, mask_sign);
+            const V        a6s = xor_si(a6, mask_sign);
+            const V        a7s = xor_si(a7, mask_sign);
+            const V        a8s = xor_si(a8, mask_sign);
+            const V        cs = xor_si(c, mask_sign);
+
+            const V        ma1 = max_epi16(a1s, a8s);
+            const V        mi1 = min_epi16(a1s, a8s);
+            const V        ma2 = max_epi16(a2s, a7s);
+            const V        mi2 = min_epi16(a2s, a7s);
+            const V        ma3 = max_epi16(a3s, a6s);
+            const V        mi3 = min_epi16(a3s, a6s);
+            const V        ma4 = max_epi16(a4s, a5s);
+            const V        mi4 = min_epi16(a4s, a5s);
+
+            const V        cli1 = limit_epi16(cs, mi1, ma1);
+            const V        cli2 = limit_epi16(cs, mi2, ma2);
+            const V        cli3 = limit_epi16(cs, mi3, ma3);
+            const V        cli4 = limit_epi16(cs, mi4, ma4);
+
+            V              res = cli1;
+            res = select_16_equ(mindiff, d3, cli3, res);
+            res = select_16_equ(mindiff, d2, cli2, res);
+            res = select_16_equ(mindiff, d4, cli4, res);
+
+            return (xor_si(res, mask_sign));
+        }
+#endif
+};
+
+class OpRG19 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        const T          sum = a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8;
+        const T          val = div_round(sum, 8);
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+        (void)c;
+
+        const V          bias = set1_epi16<V> (1);
+
+        const V          a13    = avg_epu16 (a1, a3);
+        const V          a68    = avg_epu16 (a6, a8);
+        const V          a1368  = avg_epu16 (a13, a68);
+        const V          a1368b = subs_epu16 (a1368, bias);
+        const V          a25    = avg_epu16 (a2, a5);
+        const V          a47    = avg_epu16 (a4, a7);
+        const V          a2457  = avg_epu16 (a25, a47);
+        const V          val    = avg_epu16 (a1368b, a2457);
+
+        return (val);
+    }
+#endif
+};
+
+class OpRG20 : public LineProcAll {
+public:
+    typedef    ConvUnsigned    ConvSign;
+    template <class T>
+    static __forceinline T rg (T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+        const T          sum = a1 + a2 + a3 + a4 + c + a5 + a6 + a7 + a8;
+        const T          val = div_round(sum, 9);
+
+        return (val);
+    }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+        AvsFilterRemoveGrain16_READ_PIX
+
+            const V        zero = setzero<V>();
+
+        V              sum_0 = set1_epi32<V>(-0x8000 * 9 + 4);
+        V              sum_1 = sum_0;
+
+        add_x16_s32(sum_0, sum_1, c, zero);
+        add_x16_s32(sum_0, sum_1, a1, zero);
+        add_x16_s32(sum_0, sum_1, a2, zero);
+        add_x16_s32(sum_0, sum_1, a3, zero);
+        add_x16_s32(sum_0, sum_1, a4, zero);
+        add_x16_s32(sum_0, sum_1, a5, zero);
+        add_x16_s32(sum_0, sum_1, a6, zero);
+        add_x16_s32(sum_0, sum_1, a7, zero);
+        add_x16_s32(sum_0, sum_1, a8, zero);
+
+        const V        fix_0 = srai_epi32(sum_0, 15);
+        const V        fix_1 = srai_epi32(sum_1, 15);
+        sum_0 = sub_epi32(sum_0, fix_0);
+        sum_1 = sub_epi32(sum_1, fix_1);
+
+        const V        mult = set1_epi16<V>(7282); // (1^16 + 4) / 9
+        const V        val = mul_s32_s15_s16(sum_0, sum_1, mult);
+
+        return (xor_si(val, mask_sign));
+    }
+#endif
+};
+
+class OpRG21 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        l1l = avg_floor(a1, a8);
+            const T        l2l = avg_floor(a2, a7);
+            const T        l3l = avg_floor(a3, a6);
+            const T        l4l = avg_floor(a4, a5);
+
+            const T        l1h = avg_round(a1, a8);
+            const T        l2h = avg_round(a2, a7);
+            const T        l3h = avg_round(a3, a6);
+            const T        l4h = avg_round(a4, a5);
+
+            const T        mi = std::min(std::min(l1l, l2l), std::min(l3l, l4l));
+            const T        ma = std::max(std::max(l1h, l2h), std::max(l3h, l4h));
+
+            return (limit(c, mi, ma));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        bit0 = set1_epi16<V>(0x0001);
+
+            const V        odd1 = and_si(xor_si(a1, a8), bit0);
+            const V        odd2 = and_si(xor_si(a2, a7), bit0);
+            const V        odd3 = and_si(xor_si(a3, a6), bit0);
+            const V        odd4 = and_si(xor_si(a4, a5), bit0);
+
+            const V        l1hu = avg_epu16(a1, a8);
+            const V        l2hu = avg_epu16(a2, a7);
+            const V        l3hu = avg_epu16(a3, a6);
+            const V        l4hu = avg_epu16(a4, a5);
+
+            const V        l1h = xor_si(l1hu, mask_sign);
+            const V        l2h = xor_si(l2hu, mask_sign);
+            const V        l3h = xor_si(l3hu, mask_sign);
+            const V        l4h = xor_si(l4hu, mask_sign);
+
+            const V        l1l = subs_epi16(l1h, odd1);
+            const V        l2l = subs_epi16(l2h, odd2);
+            const V        l3l = subs_epi16(l3h, odd3);
+            const V        l4l = subs_epi16(l4h, odd4);
+
+            const V        mi = min_epi16(
+                min_epi16(l1l, l2l),
+                min_epi16(l3l, l4l)
+                );
+            const V        ma = max_epi16(
+                max_epi16(l1h, l2h),
+                max_epi16(l3h, l4h)
+                );
+
+            const V        cs = xor_si(c, mask_sign);
+            const V        res = limit_epi16(cs, mi, ma);
+
+            return (xor_si(res, mask_sign));
+        }
+#endif
+};
+
+
+class OpRG22 : public LineProcAll {
+public:
+    typedef ConvUnsigned ConvSign;
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            const T        l1 = avg_round(a1, a8);
+            const T        l2 = avg_round(a2, a7);
+            const T        l3 = avg_round(a3, a6);
+            const T        l4 = avg_round(a4, a5);
+
+            const T        mi = std::min(std::min(l1, l2), std::min(l3, l4));
+            const T        ma = std::max(std::max(l1, l2), std::max(l3, l4));
+
+            return (limit(c, mi, ma));
+        }
+#ifdef VS_TARGET_CPU_X86
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        l1u = avg_epu16(a1, a8);
+            const V        l2u = avg_epu16(a2, a7);
+            const V        l3u = avg_epu16(a3, a6);
+            const V        l4u = avg_epu16(a4, a5);
+
+            const V        l1 = xor_si(l1u, mask_sign);
+            const V        l2 = xor_si(l2u, mask_sign);
+            const V        l3 = xor_si(l3u, mask_sign);
+            const V        l4 = xor_si(l4u, mask_sign);
+
+            const V        mi = min_epi16(
+                min_epi16(l1, l2),
+                min_epi16(l3, l4)
+                );
+            const V        ma = max_epi16(
+                max_epi16(l1, l2),
+                max_epi16(l3, l4)
+                );
+
+            const V        cs = xor_si(c, mask_sign);
+            const V        res = limit_epi16(cs, mi, ma);
+
+            return (xor_si(res, mask_sign));
+        }
+#endif
+};
+
+class OpRG23 : public LineProcAll {
+public:
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        linediff1 = ma1 - mi1;
+            const T        linediff2 = ma2 - mi2;
+            const T        linediff3 = ma3 - mi3;
+            const T        linediff4 = ma4 - mi4;
+
+            const T        u1 = std::min(c - ma1, linediff1);
+            const T        u2 = std::min(c - ma2, linediff2);
+            const T        u3 = std::min(c - ma3, linediff3);
+            const T        u4 = std::min(c - ma4, linediff4);
+            const T        u = std::max(
+                std::max(std::max(u1, u2), std::max(u3, u4)),
+                T(0)
+                );
+
+            const T        d1 = std::min(mi1 - c, linediff1);
+            const T        d2 = std::min(mi2 - c, linediff2);
+            const T        d3 = std::min(mi3 - c, linediff3);
+            const T        d4 = std::min(mi4 - c, linediff4);
+            const T        d = std::max(
+                std::max(std::max(d1, d2), std::max(d3, d4)),
+                T(0)
+                );
+
+            return (c - u + d);  // This probably will never overflow.
+        }
+#ifdef VS_TARGET_CPU_X86
+    typedef ConvUnsigned ConvSign;
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        ma1 = max_epu16(a1, a8);
+            const V        mi1 = min_epu16(a1, a8);
+            const V        ma2 = max_epu16(a2, a7);
+            const V        mi2 = min_epu16(a2, a7);
+            const V        ma3 = max_epu16(a3, a6);
+            const V        mi3 = min_epu16(a3, a6);
+            const V        ma4 = max_epu16(a4, a5);
+            const V        mi4 = min_epu16(a4, a5);
+
+            const V        linediff1 = sub_epi16(ma1, mi1);
+            const V        linediff2 = sub_epi16(ma2, mi2);
+            const V        linediff3 = sub_epi16(ma3, mi3);
+            const V        linediff4 = sub_epi16(ma4, mi4);
+
+            // Negative differences saturate to 0, which is where the final maximum is clamped anyway
+            const V        u1 = min_epu16(subs_epu16(c, ma1), linediff1);
+            const V        u2 = min_epu16(subs_epu16(c, ma2), linediff2);
+            const V        u3 = min_epu16(subs_epu16(c, ma3), linediff3);
+            const V        u4 = min_epu16(subs_epu16(c, ma4), linediff4);
+            const V        u = max_epu16(max_epu16(u1, u2), max_epu16(u3, u4));
+
+            const V        d1 = min_epu16(subs_epu16(mi1, c), linediff1);
+            const V        d2 = min_epu16(subs_epu16(mi2, c), linediff2);
+            const V        d3 = min_epu16(subs_epu16(mi3, c), linediff3);
+            const V        d4 = min_epu16(subs_epu16(mi4, c), linediff4);
+            const V        d = max_epu16(max_epu16(d1, d2), max_epu16(d3, d4));
+
+            return (add_epi16(sub_epi16(c, u), d));
+        }
+#endif
+};
+class OpRG24 : public LineProcAll {
+public:
+    template <class T>
+    static __forceinline T rg(T c, T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8) {
+            AvsFilterRemoveGrain16_SORT_AXIS_CPP
+
+                const T        linediff1 = ma1 - mi1;
+            const T        linediff2 = ma2 - mi2;
+            const T        linediff3 = ma3 - mi3;
+            const T        linediff4 = ma4 - mi4;
+
+            const T        tu1 = c - ma1;
+            const T        tu2 = c - ma2;
+            const T        tu3 = c - ma3;
+            const T        tu4 = c - ma4;
+
+            const T        u1 = std::min(tu1, linediff1 - tu1);
+            const T        u2 = std::min(tu2, linediff2 - tu2);
+            const T        u3 = std::min(tu3, linediff3 - tu3);
+            const T        u4 = std::min(tu4, linediff4 - tu4);
+            const T        u = std::max(
+                std::max(std::max(u1, u2), std::max(u3, u4)),
+                T(0)
+                );
+
+            const T        td1 = mi1 - c;
+            const T        td2 = mi2 - c;
+            const T        td3 = mi3 - c;
+            const T        td4 = mi4 - c;
+
+            const T        d1 = std::min(td1, linediff1 - td1);
+            const T        d2 = std::min(td2, linediff2 - td2);
+            const T        d3 = std::min(td3, linediff3 - td3);
+            const T        d4 = std::min(td4, linediff4 - td4);
+            const T        d = std::max(
+                std::max(std::max(d1, d2), std::max(d3, d4)),
+                T(0)
+                );
+
+            return (c - u + d);  // This probably will never overflow.
+        }
+#ifdef VS_TARGET_CPU_X86
+    typedef ConvUnsigned ConvSign;
+    template<typename V, typename T>
+    static __forceinline V rg(const T *src_ptr, int stride_src, V mask_sign) {
+            AvsFilterRemoveGrain16_READ_PIX
+
+                const V        ma1 = max_epu16(a1, a8);
+            const V        mi1 = min_epu16(a1, a8);
+            const V        ma2 = max_epu16(a2, a7);
+            const V        mi2 = min_epu16(a2, a7);
+            const V        ma3 = max_epu16(a3, a6);
+            const V        mi3 = min_epu16(a3, a6);
+            const V        ma4 = max_epu16(a4, a5);
+            const V        mi4 = min_epu16(a4, a5);
+
+            const V        linediff1 = sub_epi16(ma1, mi1);
+            const V        linediff2 = sub_epi16(ma2, mi2);
+            const V        linediff3 = sub_epi16(ma3, mi3);
+            const V        linediff4 = sub_epi16(ma4, mi4);
+
+            // Negative differences saturate to 0, which is where the final maximum is clamped anyway
+            const V        tu1 = subs_epu16(c, ma1);
+            const V        tu2 = subs_epu16(c, ma2);
+            const V        tu3 = subs_epu16(c, ma3);
+            const V        tu4 = subs_epu16(c, ma4);
+
+            const V        u1 = min_epu16(tu1, subs_epu16(linediff1, tu1));
+            const V        u2 = min_epu16(tu2, subs_epu16(linediff2, tu2));
+            const V        u3 = min_epu16(tu3, subs_epu16(linediff3, tu3));
+            const V        u4 = min_epu16(tu4, subs_epu16(linediff4, tu4));
+            const V        u = max_epu16(max_epu16(u1, u2), max_epu16(u3, u4));
+
+            const V        td1 = subs_epu16(mi1, c);
+            const V        td2 = subs_epu16(mi2, c);
+            const V        td3 = subs_epu16(mi3, c);
+            const V        td4 = subs_epu16(mi4, c);
+
+            const V        d1 = min_epu16(td1, subs_epu16(linediff1, td1));
+            const V        d2 = min_epu16(td2, subs_epu16(linediff2, td2));
+            const V        d3 = min_epu16(td3, subs_epu16(linediff3, td3));
+            const V        d4 = min_epu16(td4, subs_epu16(linediff4, td4));
+            const V        d = max_epu16(max_epu16(d1, d2), max_epu16(d3, d4));
+
+            return (add_epi16(sub_epi16(c, u), d));
+        }
+#endif
+};
+
+template <class OP, class T>
+class PlaneProc {
+public:
+
+static void process_subplane_cpp (const T *src_ptr, int stride_src, T *dst_ptr, int stride_dst, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride_dst;
+    src_ptr += y_b * stride_src;
+
+    const int        x_e = width - 1;
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+        if (OP::skip_line(y)) {
+            memcpy(dst_ptr, src_ptr, width * sizeof(T));
+        } else {
+
+            dst_ptr[0] = src_ptr[0];
+
+            process_row_cpp(
+                dst_ptr,
+                src_ptr,
+                stride_src,
+                1,
+                x_e
+                );
+
+            dst_ptr[x_e] = src_ptr[x_e];
+        }
+
+        dst_ptr += stride_dst;
+        src_ptr += stride_src;
+    }
+}
+
+static void process_row_cpp (T *dst_ptr, const T *src_ptr, int stride_src, int x_beg, int x_end)
+{
+    const int      om = stride_src - 1;
+    const int      o0 = stride_src    ;
+    const int      op = stride_src + 1;
+
+    typedef typename CalcType<T>::Type Calc;
+
+    src_ptr += x_beg;
+
+    for (int x = x_beg; x < x_end; ++x)
+    {
+        const Calc       a1 = src_ptr [-op];
+        const Calc       a2 = src_ptr [-o0];
+        const Calc       a3 = src_ptr [-om];
+        const Calc       a4 = src_ptr [-1 ];
+        const Calc       c  = src_ptr [ 0 ];
+        const Calc       a5 = src_ptr [ 1 ];
+        const Calc       a6 = src_ptr [ om];
+        const Calc       a7 = src_ptr [ o0];
+        const Calc       a8 = src_ptr [ op];
+
+        const Calc       res = OP::rg (c, a1, a2, a3, a4, a5, a6, a7, a8);
+
+        dst_ptr [x] = res;
+
+        ++ src_ptr;
+    }
+}
+
+#ifdef VS_TARGET_CPU_X86
+template <class V>
+static void process_subplane_simd (const T *src_ptr, int stride_src, T *dst_ptr, int stride_dst, int width, int height)
+{
+    const int        y_b = 1;
+    const int        y_e = height - 1;
+
+    dst_ptr += y_b * stride_dst;
+    src_ptr += y_b * stride_src;
+
+    const V          mask_sign = set1_epi16<V> (-0x8000);
+
+    const __m128i    mask_sign_128 = _mm_set1_epi16 (-0x8000);
+
+    const int        x_e =   width - 1;
+    const int        w8  = ((width - 2) & -8) + 1;
+    // Wider vectors leave at most one 8 pixel vector to do, the rest is done
+    // in C++ exactly like before so all instruction sets give the same output
+    const int        wv  = ((width - 2) & -static_cast<int>(sizeof(V) / 2)) + 1;
+
+    for (int y = y_b; y < y_e; ++y)
+    {
+
+        if (OP::skip_line(y)) {
+            memcpy(dst_ptr, src_ptr, width * sizeof(T));
+        } else {
+            dst_ptr[0] = src_ptr[0];
+
+            for (int x = 1; x < wv; x += sizeof(V) / 2) {
+                V                  res = OP::rg(
+                    src_ptr + x,
+                    stride_src,
+                    mask_sign
+                    );
+
+                res = OP::ConvSign::cv(res, mask_sign);
+                store_pix(dst_ptr + x, res);
+            }
+
+            for (int x = wv; x < w8; x += 8) {
+                __m128i            res = OP::rg(
+                    src_ptr + x,
+                    stride_src,
+                    mask_sign_128
+                    );
+
+                res = OP::ConvSign::cv(res, mask_sign_128);
+                store_pix(dst_ptr + x, res);
+            }
+
+            process_row_cpp(
+                dst_ptr,
+                src_ptr,
+                stride_src,
+                w8,
+                x_e
+                );
+
+            dst_ptr[x_e] = src_ptr[x_e];
+        }
+        dst_ptr += stride_dst;
+        src_ptr += stride_src;
+    }
+}
+
+template <class V, class OP1, class T1>
+static void do_process_plane_simd (const VSFrameRef *src_frame, VSFrameRef *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int        w             = vsapi->getFrameWidth(src_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src_frame, plane_id);
+    T1 *                dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const int        stride        = vsapi->getStride(dst_frame, plane_id);
+
+    const T1*        src_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src_frame, plane_id));
+
+    // First line
+    memcpy (dst_ptr, src_ptr, stride);
+
+    // Main content
+    PlaneProc<OP1, T1>::template process_subplane_simd<V>(src_ptr, stride/sizeof(T1), dst_ptr, stride/sizeof(T1), w, h);
+
+    // Last line
+    const int        lp = (h - 1) * stride/sizeof(T1);
+    memcpy (dst_ptr + lp, src_ptr + lp, stride);
+}
+#endif
+
+template <class OP1, class T1>
+static void do_process_plane_cpp (const VSFrameRef *src_frame, VSFrameRef *dst_frame, int plane_id, const VSAPI *vsapi)
+{
+    const int        w             = vsapi->getFrameWidth(src_frame, plane_id);
+    const int        h             = vsapi->getFrameHeight(src_frame, plane_id);
+    T1 *                dst_ptr       = reinterpret_cast<T1*>(vsapi->getWritePtr(dst_frame, plane_id));
+    const int        stride        = vsapi->getStride(dst_frame, plane_id);
+
+    const T1*        src_ptr       = reinterpret_cast<const T1*>(vsapi->getReadPtr(src_frame, plane_id));
+
+    // First line
+    memcpy(dst_ptr, src_ptr, w * sizeof(T1));
+
+    // Main content
+    PlaneProc<OP1, T1>::process_subplane_cpp(src_ptr, stride/sizeof(T1), dst_ptr, stride/sizeof(T1), w, h);
+
+    // Last line
+    const int        lp = (h - 1) * stride/sizeof(T1);
+    memcpy(dst_ptr + lp, src_ptr + lp, w * sizeof(T1));
+}
+
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,90 @@
+/*****************************************************************************
+
+        AvsFilterRemoveGrain/Repair16
+        Author: Laurent de Soras, 2012
+        Modified for VapourSynth by Fredrik Mellbin 2013
+
+--- Legal stuff ---
+
+This program is free software. It comes without any warranty, to
+the extent permitted by applicable law. You can redistribute it
+and/or modify it under the terms of the Do What The Fuck You Want
+To Public License, Version 2, as published by Sam Hocevar. See
+http://sam.zoy.org/wtfpl/COPYING for more details.
+
+*Tab=3***********************************************************************/
+
+// Compiled with AVX2 enabled, only call when the cpu supports it
+
+#include "removegrainvs.h"
+
+#ifdef VS_TARGET_CPU_X86
+
+#define PROC_ARGS_16_AVX2(op) PlaneProc <op, uint16_t>::do_process_plane_simd<__m256i, op, uint16_t>(src_frame, dst_frame, plane_id, vsapi); return true;
+#define PROC_ARGS_8_AVX2(op) PlaneProc <op, uint8_t>::do_process_plane_simd<__m256i, op, uint8_t>(src_frame, dst_frame, plane_id, vsapi); return true;
+
+bool removeGrainProcessPlaneAVX2(const VSFrameRef *src_frame, VSFrameRef *dst_frame, int plane_id, int mode, const VSAPI *vsapi) {
+    if (vsapi->getFrameFormat(src_frame)->bytesPerSample == 1) {
+        switch (mode)
+        {
+            case  1: PROC_ARGS_8_AVX2(OpRG01)
+            case  2: PROC_ARGS_8_AVX2(OpRG02)
+            case  3: PROC_ARGS_8_AVX2(OpRG03)
+            case  4: PROC_ARGS_8_AVX2(OpRG04)
+            case  5: PROC_ARGS_8_AVX2(OpRG05)
+            case  6: PROC_ARGS_8_AVX2(OpRG06)
+            case  7: PROC_ARGS_8_AVX2(OpRG07)
+            case  8: PROC_ARGS_8_AVX2(OpRG08)
+            case  9: PROC_ARGS_8_AVX2(OpRG09)
+            case 10: PROC_ARGS_8_AVX2(OpRG10)
+            case 11: PROC_ARGS_8_AVX2(OpRG11)
+            case 12: PROC_ARGS_8_AVX2(OpRG12)
+            case 13: PROC_ARGS_8_AVX2(OpRG13)
+            case 14: PROC_ARGS_8_AVX2(OpRG14)
+            case 15: PROC_ARGS_8_AVX2(OpRG15)
+            case 16: PROC_ARGS_8_AVX2(OpRG16)
+            case 17: PROC_ARGS_8_AVX2(OpRG17)
+            case 18: PROC_ARGS_8_AVX2(OpRG18)
+            case 19: PROC_ARGS_8_AVX2(OpRG19)
+            case 20: PROC_ARGS_8_AVX2(OpRG20)
+            case 21: PROC_ARGS_8_AVX2(OpRG21)
+            case 22: PROC_ARGS_8_AVX2(OpRG22)
+            case 23: PROC_ARGS_8_AVX2(OpRG23)
+            case 24: PROC_ARGS_8_AVX2(OpRG24)
+            default: break;
+        }
+    } else {
+        switch (mode)
+        {
+            case  1: PROC_ARGS_16_AVX2(OpRG01)
+            case  2: PROC_ARGS_16_AVX2(OpRG02)
+            case  3: PROC_ARGS_16_AVX2(OpRG03)
+            case  4: PROC_ARGS_16_AVX2(OpRG04)
+            case  5: PROC_ARGS_16_AVX2(OpRG05)
+            case  6: PROC_ARGS_16_AVX2(OpRG06)
+            case  7: PROC_ARGS_16_AVX2(OpRG07)
+            case  8: PROC_ARGS_16_AVX2(OpRG08)
+            case  9: PROC_ARGS_16_AVX2(OpRG09)
+            case 10: PROC_ARGS_16_AVX2(OpRG10)
+            case 11: PROC_ARGS_16_AVX2(OpRG11)
+            case 12: PROC_ARGS_16_AVX2(OpRG12)
+            case 13: PROC_ARGS_16_AVX2(OpRG13)
+            case 14: PROC_ARGS_16_AVX2(OpRG14)
+            case 15: PROC_ARGS_16_AVX2(OpRG15)
+            case 16: PROC_ARGS_16_AVX2(OpRG16)
+            case 17: PROC_ARGS_16_AVX2(OpRG17)
+            case 18: PROC_ARGS_16_AVX2(OpRG18)
+            case 19: PROC_ARGS_16_AVX2(OpRG19)
+            case 20: PROC_ARGS_16_AVX2(OpRG20)
+            case 21: PROC_ARGS_16_AVX2(OpRG21)
+            case 22: PROC_ARGS_16_AVX2(OpRG22)
+            case 23: PROC_ARGS_16_AVX2(OpRG23)
+            case 24: PROC_ARGS_16_AVX2(OpRG24)
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+#endif
@@ -16,6 +16,30 @@ http://sam.zoy.org/wtfpl/COPYING for more details.
 
 #include "shared.h"
 
+#if defined(VS_TARGET_CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef VS_TARGET_CPU_X86
+bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    // The OS also has to save the ymm registers
+    __cpuid(regs, 1);
+    if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
 //////////////////////////////////////////
 // Init
 
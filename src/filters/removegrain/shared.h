@@ -22,8 +22,12 @@ http://sam.zoy.org/wtfpl/COPYING for more details.
 #include <stdint.h>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 #ifdef VS_TARGET_CPU_X86
 #include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #endif
 
 #if defined(_MSC_VER)
@@ -43,55 +47,185 @@ static __forceinline T limit(T x, T mi, T ma)
     return ((x < mi) ? mi : ((x > ma) ? ma : x));
 }
 
+// The scalar operators work on int for integer pixels and on float for float pixels
+template <class T>
+struct CalcType { typedef int Type; };
+template <>
+struct CalcType<float> { typedef float Type; };
+
+// Only integer results can leave the 16 bit range, float values pass through
+static __forceinline int clamp16(int x) { return limit(x, 0, 0xFFFF); }
+static __forceinline float clamp16(float x) { return x; }
+
+// Rounded averages and divisions, floats need no rounding
+static __forceinline int avg_round(int a, int b) { return (a + b + 1) >> 1; }
+static __forceinline float avg_round(float a, float b) { return (a + b) * 0.5f; }
+static __forceinline int avg_floor(int a, int b) { return (a + b) >> 1; }
+static __forceinline float avg_floor(float a, float b) { return (a + b) * 0.5f; }
+static __forceinline int div_round(int x, int d) { return (x + d / 2) / d; }
+static __forceinline float div_round(float x, int d) { return x * (1.0f / d); }
+
 #ifdef VS_TARGET_CPU_X86
-static inline __m128i limit_epi16(const __m128i &x, const __m128i &mi, const __m128i &ma) {
-    return (_mm_max_epi16(_mm_min_epi16(x, ma), mi));
+// The SIMD operators are written once for both __m128i (SSE2) and __m256i (AVX2),
+// these overloads map the 16 bit lane operations to the right intrinsics
+
+static __forceinline __m128i min_epi16(__m128i a, __m128i b) { return _mm_min_epi16(a, b); }
+static __forceinline __m128i max_epi16(__m128i a, __m128i b) { return _mm_max_epi16(a, b); }
+static __forceinline __m128i adds_epu16(__m128i a, __m128i b) { return _mm_adds_epu16(a, b); }
+static __forceinline __m128i subs_epu16(__m128i a, __m128i b) { return _mm_subs_epu16(a, b); }
+static __forceinline __m128i adds_epi16(__m128i a, __m128i b) { return _mm_adds_epi16(a, b); }
+static __forceinline __m128i subs_epi16(__m128i a, __m128i b) { return _mm_subs_epi16(a, b); }
+static __forceinline __m128i add_epi16(__m128i a, __m128i b) { return _mm_add_epi16(a, b); }
+static __forceinline __m128i sub_epi16(__m128i a, __m128i b) { return _mm_sub_epi16(a, b); }
+static __forceinline __m128i avg_epu16(__m128i a, __m128i b) { return _mm_avg_epu16(a, b); }
+static __forceinline __m128i cmpeq_epi16(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+static __forceinline __m128i mullo_epi16(__m128i a, __m128i b) { return _mm_mullo_epi16(a, b); }
+static __forceinline __m128i mulhi_epu16(__m128i a, __m128i b) { return _mm_mulhi_epu16(a, b); }
+static __forceinline __m128i add_epi32(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+static __forceinline __m128i sub_epi32(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+static __forceinline __m128i srai_epi32(__m128i a, int n) { return _mm_srai_epi32(a, n); }
+static __forceinline __m128i slli_epi32(__m128i a, int n) { return _mm_slli_epi32(a, n); }
+static __forceinline __m128i unpacklo_epi16(__m128i a, __m128i b) { return _mm_unpacklo_epi16(a, b); }
+static __forceinline __m128i unpackhi_epi16(__m128i a, __m128i b) { return _mm_unpackhi_epi16(a, b); }
+static __forceinline __m128i packs_epi32(__m128i a, __m128i b) { return _mm_packs_epi32(a, b); }
+static __forceinline __m128i and_si(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+static __forceinline __m128i or_si(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+static __forceinline __m128i xor_si(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+static __forceinline __m128i andnot_si(__m128i a, __m128i b) { return _mm_andnot_si128(a, b); }
+// SSE2 only has signed 16 bit min and max
+static __forceinline __m128i min_epu16(__m128i a, __m128i b) { return _mm_subs_epu16(a, _mm_subs_epu16(a, b)); }
+static __forceinline __m128i max_epu16(__m128i a, __m128i b) { return _mm_adds_epu16(b, _mm_subs_epu16(a, b)); }
+
+template <class V> static V setzero();
+template <class V> static V set1_epi16(int x);
+template <class V> static V set1_epi32(int x);
+template <class V, class T> static V load_pix(const T *p);
+
+template <> __forceinline __m128i setzero<__m128i>() { return _mm_setzero_si128(); }
+template <> __forceinline __m128i set1_epi16<__m128i>(int x) { return _mm_set1_epi16(x); }
+template <> __forceinline __m128i set1_epi32<__m128i>(int x) { return _mm_set1_epi32(x); }
+
+// Pixels are always processed as 16 bit lanes, 8 bit pixels are widened when loaded and packed when stored
+template <> __forceinline __m128i load_pix<__m128i, uint8_t>(const uint8_t *p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128());
+}
+
+template <> __forceinline __m128i load_pix<__m128i, uint16_t>(const uint16_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+static __forceinline void store_pix(uint8_t *p, __m128i v) {
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_packus_epi16(v, v));
+}
+
+static __forceinline void store_pix(uint16_t *p, __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+#ifdef __AVX2__
+static __forceinline __m256i min_epi16(__m256i a, __m256i b) { return _mm256_min_epi16(a, b); }
+static __forceinline __m256i max_epi16(__m256i a, __m256i b) { return _mm256_max_epi16(a, b); }
+static __forceinline __m256i adds_epu16(__m256i a, __m256i b) { return _mm256_adds_epu16(a, b); }
+static __forceinline __m256i subs_epu16(__m256i a, __m256i b) { return _mm256_subs_epu16(a, b); }
+static __forceinline __m256i adds_epi16(__m256i a, __m256i b) { return _mm256_adds_epi16(a, b); }
+static __forceinline __m256i subs_epi16(__m256i a, __m256i b) { return _mm256_subs_epi16(a, b); }
+static __forceinline __m256i add_epi16(__m256i a, __m256i b) { return _mm256_add_epi16(a, b); }
+static __forceinline __m256i sub_epi16(__m256i a, __m256i b) { return _mm256_sub_epi16(a, b); }
+static __forceinline __m256i avg_epu16(__m256i a, __m256i b) { return _mm256_avg_epu16(a, b); }
+static __forceinline __m256i cmpeq_epi16(__m256i a, __m256i b) { return _mm256_cmpeq_epi16(a, b); }
+static __forceinline __m256i mullo_epi16(__m256i a, __m256i b) { return _mm256_mullo_epi16(a, b); }
+static __forceinline __m256i mulhi_epu16(__m256i a, __m256i b) { return _mm256_mulhi_epu16(a, b); }
+static __forceinline __m256i add_epi32(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+static __forceinline __m256i sub_epi32(__m256i a, __m256i b) { return _mm256_sub_epi32(a, b); }
+static __forceinline __m256i srai_epi32(__m256i a, int n) { return _mm256_srai_epi32(a, n); }
+static __forceinline __m256i slli_epi32(__m256i a, int n) { return _mm256_slli_epi32(a, n); }
+// Unpacking and packing work within 128 bit lanes, an unpack followed by a pack restores the order
+static __forceinline __m256i unpacklo_epi16(__m256i a, __m256i b) { return _mm256_unpacklo_epi16(a, b); }
+static __forceinline __m256i unpackhi_epi16(__m256i a, __m256i b) { return _mm256_unpackhi_epi16(a, b); }
+static __forceinline __m256i packs_epi32(__m256i a, __m256i b) { return _mm256_packs_epi32(a, b); }
+static __forceinline __m256i and_si(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+static __forceinline __m256i or_si(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+static __forceinline __m256i xor_si(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+static __forceinline __m256i andnot_si(__m256i a, __m256i b) { return _mm256_andnot_si256(a, b); }
+static __forceinline __m256i min_epu16(__m256i a, __m256i b) { return _mm256_min_epu16(a, b); }
+static __forceinline __m256i max_epu16(__m256i a, __m256i b) { return _mm256_max_epu16(a, b); }
+
+template <> __forceinline __m256i setzero<__m256i>() { return _mm256_setzero_si256(); }
+template <> __forceinline __m256i set1_epi16<__m256i>(int x) { return _mm256_set1_epi16(x); }
+template <> __forceinline __m256i set1_epi32<__m256i>(int x) { return _mm256_set1_epi32(x); }
+
+template <> __forceinline __m256i load_pix<__m256i, uint8_t>(const uint8_t *p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
 }
 
-static inline __m128i abs_dif_epu16(const __m128i &a, const __m128i &b) {
-    const __m128i p = _mm_subs_epu16(a, b);
-    const __m128i n = _mm_subs_epu16(b, a);
+template <> __forceinline __m256i load_pix<__m256i, uint16_t>(const uint16_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+static __forceinline void store_pix(uint8_t *p, __m256i v) {
+    const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_castsi256_si128(packed));
+}
+
+static __forceinline void store_pix(uint16_t *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+#endif
 
-    return (_mm_or_si128(p, n));
+template <class V>
+static __forceinline V limit_epi16(const V &x, const V &mi, const V &ma) {
+    return (max_epi16(min_epi16(x, ma), mi));
 }
 
-static inline __m128i select(const __m128i &cond, const __m128i &v_t, const __m128i &v_f) {
-    const __m128i cond_1 = _mm_and_si128(cond, v_t);
-    const __m128i cond_0 = _mm_andnot_si128(cond, v_f);
-    const __m128i res = _mm_or_si128(cond_0, cond_1);
+template <class V>
+static __forceinline V abs_dif_epu16(const V &a, const V &b) {
+    const V p = subs_epu16(a, b);
+    const V n = subs_epu16(b, a);
+
+    return (or_si(p, n));
+}
+
+template <class V>
+static __forceinline V select(const V &cond, const V &v_t, const V &v_f) {
+    const V cond_1 = and_si(cond, v_t);
+    const V cond_0 = andnot_si(cond, v_f);
+    const V res = or_si(cond_0, cond_1);
 
     return (res);
 }
 
-static inline __m128i select_16_equ(const __m128i &lhs, const __m128i &rhs, const __m128i &v_t, const __m128i &v_f) {
-    const __m128i cond = _mm_cmpeq_epi16(lhs, rhs);
+template <class V>
+static __forceinline V select_16_equ(const V &lhs, const V &rhs, const V &v_t, const V &v_f) {
+    const V cond = cmpeq_epi16(lhs, rhs);
 
     return (select(cond, v_t, v_f));
 }
 
-static inline void add_x16_s32(__m128i &dst0, __m128i &dst1, __m128i src, __m128i msw) {
-    const __m128i res0 = _mm_unpacklo_epi16(src, msw);
-    const __m128i res1 = _mm_unpackhi_epi16(src, msw);
+template <class V>
+static __forceinline void add_x16_s32(V &dst0, V &dst1, V src, V msw) {
+    const V res0 = unpacklo_epi16(src, msw);
+    const V res1 = unpackhi_epi16(src, msw);
 
-    dst0 = _mm_add_epi32(dst0, res0);
-    dst1 = _mm_add_epi32(dst1, res1);
+    dst0 = add_epi32(dst0, res0);
+    dst1 = add_epi32(dst1, res1);
 }
 
-static inline __m128i mul_s32_s15_s16(__m128i src0, __m128i src1, __m128i coef) {
-    const __m128i hi0 = _mm_mulhi_epu16(src0, coef);
-    const __m128i lo0 = _mm_mullo_epi16(src0, coef);
-    const __m128i hi1 = _mm_mulhi_epu16(src1, coef);
-    const __m128i lo1 = _mm_mullo_epi16(src1, coef);
+template <class V>
+static __forceinline V mul_s32_s15_s16(V src0, V src1, V coef) {
+    const V hi0 = mulhi_epu16(src0, coef);
+    const V lo0 = mullo_epi16(src0, coef);
+    const V hi1 = mulhi_epu16(src1, coef);
+    const V lo1 = mullo_epi16(src1, coef);
 
-    const __m128i hi0s = _mm_slli_epi32(hi0, 16);
-    const __m128i hi1s = _mm_slli_epi32(hi1, 16);
+    const V hi0s = slli_epi32(hi0, 16);
+    const V hi1s = slli_epi32(hi1, 16);
 
-    __m128i sum0 = _mm_add_epi32(hi0s, lo0);
-    __m128i sum1 = _mm_add_epi32(hi1s, lo1);
-    sum0 = _mm_srai_epi32(sum0, 16);
-    sum1 = _mm_srai_epi32(sum1, 16);
+    V sum0 = add_epi32(hi0s, lo0);
+    V sum1 = add_epi32(hi1s, lo1);
+    sum0 = srai_epi32(sum0, 16);
+    sum1 = srai_epi32(sum1, 16);
 
-    const __m128i res = _mm_packs_epi32(sum0, sum1);
+    const V res = packs_epi32(sum0, sum1);
 
     return (res);
 }
@@ -111,18 +245,72 @@ public:
 };
 
 #ifdef VS_TARGET_CPU_X86
-static __forceinline void sort_pair(__m128i &a1, __m128i &a2)
+template <class V>
+static __forceinline void sort_pair(V &a1, V &a2)
 {
-    const __m128i tmp = _mm_min_epi16(a1, a2);
-    a2 = _mm_max_epi16(a1, a2);
+    const V tmp = min_epi16(a1, a2);
+    a2 = max_epi16(a1, a2);
     a1 = tmp;
 }
 
-static __forceinline void sort_pair(__m128i &mi, __m128i &ma, __m128i a1, __m128i a2)
+template <class V>
+static __forceinline void sort_pair(V &mi, V &ma, V a1, V a2)
 {
-    mi = _mm_min_epi16(a1, a2);
-    ma = _mm_max_epi16(a1, a2);
+    mi = min_epi16(a1, a2);
+    ma = max_epi16(a1, a2);
 }
+
+// Whole vectors of pixels for the filters that only combine pixels in the same position,
+// 8 bit uses the byte instructions directly. The integer versions saturate instead of
+// wrapping around, clamping to the actual peak value never changes the results.
+template <class T>
+struct PixelVec;
+
+template <>
+struct PixelVec<uint8_t> {
+    typedef __m128i V;
+    static const int size = 16;
+    static __forceinline V load(const uint8_t *p) { return _mm_load_si128(reinterpret_cast<const __m128i *>(p)); }
+    static __forceinline void store(uint8_t *p, V v) { _mm_store_si128(reinterpret_cast<__m128i *>(p), v); }
+    static __forceinline V min(V a, V b) { return _mm_min_epu8(a, b); }
+    static __forceinline V max(V a, V b) { return _mm_max_epu8(a, b); }
+    static __forceinline V adds(V a, V b) { return _mm_adds_epu8(a, b); }
+    static __forceinline V subs(V a, V b) { return _mm_subs_epu8(a, b); }
+    static __forceinline V diff(V a, V b) { return _mm_subs_epu8(a, b); }
+};
+
+template <>
+struct PixelVec<uint16_t> {
+    typedef __m128i V;
+    static const int size = 8;
+    static __forceinline V load(const uint16_t *p) { return _mm_load_si128(reinterpret_cast<const __m128i *>(p)); }
+    static __forceinline void store(uint16_t *p, V v) { _mm_store_si128(reinterpret_cast<__m128i *>(p), v); }
+    static __forceinline V min(V a, V b) { return min_epu16(a, b); }
+    static __forceinline V max(V a, V b) { return max_epu16(a, b); }
+    static __forceinline V adds(V a, V b) { return adds_epu16(a, b); }
+    static __forceinline V subs(V a, V b) { return subs_epu16(a, b); }
+    static __forceinline V diff(V a, V b) { return subs_epu16(a, b); }
+};
+
+template <>
+struct PixelVec<float> {
+    typedef __m128 V;
+    static const int size = 4;
+    static __forceinline V load(const float *p) { return _mm_load_ps(p); }
+    static __forceinline void store(float *p, V v) { _mm_store_ps(p, v); }
+    static __forceinline V min(V a, V b) { return _mm_min_ps(a, b); }
+    static __forceinline V max(V a, V b) { return _mm_max_ps(a, b); }
+    static __forceinline V adds(V a, V b) { return _mm_add_ps(a, b); }
+    static __forceinline V subs(V a, V b) { return _mm_sub_ps(a, b); }
+    static __forceinline V diff(V a, V b) { return _mm_max_ps(_mm_sub_ps(a, b), _mm_setzero_ps()); }
+};
+
+// Only the plugin itself can check the cpu, the core's cpu detection isn't exported
+bool cpuHasAVX2();
+
+// The AVX2 versions return false for modes they don't handle
+bool removeGrainProcessPlaneAVX2(const VSFrameRef *src_frame, VSFrameRef *dst_frame, int plane_id, int mode, const VSAPI *vsapi);
+bool repairProcessPlaneAVX2(const VSFrameRef *src1_frame, const VSFrameRef *src2_frame, VSFrameRef *dst_frame, int plane_id, int mode, const VSAPI *vsapi);
 #endif
 
 enum cleanseMode {
@@ -14,12 +14,22 @@ static void verticalMedian(const T * VS_RESTRICT srcp, T * VS_RESTRICT dstp, con
     dstp += stride;
 
     for (int y = 1; y < height - 1; y++) {
+#ifdef VS_TARGET_CPU_X86
+        typedef PixelVec<T> P;
+        // The rows are padded to at least the vector size
+        for (int x = 0; x < width; x += P::size) {
+            const typename P::V up = P::load(srcp + x - stride);
+            const typename P::V down = P::load(srcp + x + stride);
+            P::store(dstp + x, P::min(P::max(P::min(up, down), P::load(srcp + x)), P::max(up, down)));
+        }
+#else
         for (int x = 0; x < width; x++) {
             const T up = srcp[x - stride];
             const T center = srcp[x];
             const T down = srcp[x + stride];
             dstp[x] = std::min(std::max(std::min(up, down), center), std::max(up, down));
         }
+#endif
 
         srcp += stride;
         dstp += stride;
@@ -28,28 +38,45 @@ static void verticalMedian(const T * VS_RESTRICT srcp, T * VS_RESTRICT dstp, con
     memcpy(dstp, srcp, stride * sizeof(T));
 }
 
+// Clamping the intermediate values to the pixel range is left out since the
+// result is the center pixel limited to a range that always contains p1 and n1
 template<typename T>
-static void relaxedVerticalMedian(const T * VS_RESTRICT srcp, T * VS_RESTRICT dstp, const int width, const int height, const int stride, const int bitsPerSample) {
-    const int peak = (1 << bitsPerSample) - 1;
-
+static void relaxedVerticalMedian(const T * VS_RESTRICT srcp, T * VS_RESTRICT dstp, const int width, const int height, const int stride) {
     memcpy(dstp, srcp, stride * sizeof(T) * 2);
 
     srcp += stride * 2;
     dstp += stride * 2;
 
     for (int y = 2; y < height - 2; y++) {
+#ifdef VS_TARGET_CPU_X86
+        typedef PixelVec<T> P;
+        for (int x = 0; x < width; x += P::size) {
+            const typename P::V p2 = P::load(srcp + x - stride * 2);
+            const typename P::V p1 = P::load(srcp + x - stride);
+            const typename P::V c = P::load(srcp + x);
+            const typename P::V n1 = P::load(srcp + x + stride);
+            const typename P::V n2 = P::load(srcp + x + stride * 2);
+
+            const typename P::V upper = P::max(P::max(P::min(P::adds(P::diff(p1, p2), p1), P::adds(P::diff(n1, n2), n1)), p1), n1);
+            const typename P::V lower = P::min(P::min(p1, n1), P::max(P::subs(p1, P::diff(p2, p1)), P::subs(n1, P::diff(n2, n1))));
+
+            P::store(dstp + x, P::min(P::max(c, lower), upper));
+        }
+#else
+        typedef typename CalcType<T>::Type Calc;
         for (int x = 0; x < width; x++) {
-            const T p2 = srcp[x - stride * 2];
-            const T p1 = srcp[x - stride];
-            const T c = srcp[x];
-            const T n1 = srcp[x + stride];
-            const T n2 = srcp[x + stride * 2];
+            const Calc p2 = srcp[x - stride * 2];
+            const Calc p1 = srcp[x - stride];
+            const Calc c = srcp[x];
+            const Calc n1 = srcp[x + stride];
+            const Calc n2 = srcp[x + stride * 2];
 
-            const T upper = std::max<int>(std::max<int>(std::min<int>(limit(limit(p1 - p2, 0, peak) + p1, 0, peak), limit(limit(n1 - n2, 0, peak) + n1, 0, peak)), p1), n1);
-            const T lower = std::min<int>(std::min<int>(p1, n1), std::max<int>(limit(p1 - limit(p2 - p1, 0, peak), 0, peak), limit(n1 - limit(n2 - n1, 0, peak), 0, peak)));
+            const Calc upper = std::max(std::max(std::min(std::max<Calc>(p1 - p2, 0) + p1, std::max<Calc>(n1 - n2, 0) + n1), p1), n1);
+            const Calc lower = std::min(std::min(p1, n1), std::max(p1 - std::max<Calc>(p2 - p1, 0), n1 - std::max<Calc>(n2 - n1, 0)));
 
-            dstp[x] = limit(c, lower, upper);
+            dstp[x] = static_cast<T>(limit(c, lower, upper));
         }
+#endif
 
         srcp += stride;
         dstp += stride;
@@ -82,15 +109,19 @@ static const VSFrameRef *VS_CC verticalCleanerGetFrame(int n, int activationReas
             uint8_t * dstp = vsapi->getWritePtr(dst, plane);
 
             if (d->mode[plane] == 1) {
-                if (d->vi->format->bytesPerSample == 1)
+                if (d->vi->format->sampleType == stFloat)
+                    verticalMedian<float>(reinterpret_cast<const float *>(srcp), reinterpret_cast<float *>(dstp), width, height, stride / 4);
+                else if (d->vi->format->bytesPerSample == 1)
                     verticalMedian<uint8_t>(srcp, dstp, width, height, stride);
                 else
                     verticalMedian<uint16_t>(reinterpret_cast<const uint16_t *>(srcp), reinterpret_cast<uint16_t *>(dstp), width, height, stride / 2);
             } else if (d->mode[plane] == 2) {
-                if (d->vi->format->bytesPerSample == 1)
-                    relaxedVerticalMedian<uint8_t>(srcp, dstp, width, height, stride, d->vi->format->bitsPerSample);
+                if (d->vi->format->sampleType == stFloat)
+                    relaxedVerticalMedian<float>(reinterpret_cast<const float *>(srcp), reinterpret_cast<float *>(dstp), width, height, stride / 4);
+                else if (d->vi->format->bytesPerSample == 1)
+                    relaxedVerticalMedian<uint8_t>(srcp, dstp, width, height, stride);
                 else
-                    relaxedVerticalMedian<uint16_t>(reinterpret_cast<const uint16_t *>(srcp), reinterpret_cast<uint16_t *>(dstp), width, height, stride / 2, d->vi->format->bitsPerSample);
+                    relaxedVerticalMedian<uint16_t>(reinterpret_cast<const uint16_t *>(srcp), reinterpret_cast<uint16_t *>(dstp), width, height, stride / 2);
             }
         }
 
@@ -113,8 +144,9 @@ void VS_CC verticalCleanerCreate(const VSMap *in, VSMap *out, void *userData, VS
     d.node = vsapi->propGetNode(in, "clip", 0, nullptr);
     d.vi = vsapi->getVideoInfo(d.node);
 
-    if (!isConstantFormat(d.vi) || d.vi->format->sampleType != stInteger || d.vi->format->bytesPerSample > 2) {
-        vsapi->setError(out, "VerticalCleaner: only constant format 8-16 bits integer input supported");
+    if (!isConstantFormat(d.vi) || (d.vi->format->sampleType == stInteger && d.vi->format->bitsPerSample > 16) ||
+        (d.vi->format->sampleType == stFloat && d.vi->format->bitsPerSample != 32)) {
+        vsapi->setError(out, "VerticalCleaner: only constant format 8-16 bits integer and 32 bits float input supported");
         vsapi->freeNode(d.node);
         return;
     }
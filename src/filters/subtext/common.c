@@ -1,16 +1,248 @@
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
 
+typedef struct BlendRectData {
+    VSNodeRef *clip;
+    VSNodeRef *subs;
+    VSNodeRef *alpha;
+    VSNodeRef *alpha23;
+    VSNodeRef *rects;
+    const VSVideoInfo *vi;
+    int rects_width;
+    int rects_height;
+    int pad;
+    char range_error[256];
+} BlendRectData;
+
+
+static void VS_CC blendRectInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    BlendRectData *d = (BlendRectData *) *instanceData;
+
+    vsapi->setVideoInfo(d->vi, 1, node);
+}
+
+
+static int getLimitedRangeOffset(const VSFrameRef *f, const VSVideoInfo *vi, const VSAPI *vsapi) {
+    int err;
+    int limited = !!vsapi->propGetInt(vsapi->getFramePropsRO(f), "_ColorRange", 0, &err);
+    if (err)
+        limited = (vi->format->colorFamily == cmGray || vi->format->colorFamily == cmYUV || vi->format->colorFamily == cmYCoCg);
+    return (limited ? (16 << (vi->format->bitsPerSample - 8)) : 0);
+}
+
+
+// Returns the area touched by the subtitles as [left, top, right, bottom]
+// in the clip's coordinates. It's widened by the reach of the resizers
+// that scaled and converted the subtitles and the mask.
+static void getBlendRect(const BlendRectData *d, const VSFrameRef *rects, int rect[4], const VSAPI *vsapi) {
+    const VSMap *props = vsapi->getFramePropsRO(rects);
+    int err;
+
+    vsapi->propGetInt(props, "SubtitleRect", 3, &err);
+    if (err) {
+        rect[0] = rect[1] = 0;
+        rect[2] = d->vi->width;
+        rect[3] = d->vi->height;
+        return;
+    }
+
+    int64_t left = vsapi->propGetInt(props, "SubtitleRect", 0, NULL);
+    int64_t top = vsapi->propGetInt(props, "SubtitleRect", 1, NULL);
+    int64_t right = left + vsapi->propGetInt(props, "SubtitleRect", 2, NULL);
+    int64_t bottom = top + vsapi->propGetInt(props, "SubtitleRect", 3, NULL);
+
+    left = left * d->vi->width / d->rects_width - d->pad;
+    top = top * d->vi->height / d->rects_height - d->pad;
+    right = (right * d->vi->width + d->rects_width - 1) / d->rects_width + d->pad;
+    bottom = (bottom * d->vi->height + d->rects_height - 1) / d->rects_height + d->pad;
+
+    rect[0] = (int)VSMAX(left, 0);
+    rect[1] = (int)VSMAX(top, 0);
+    rect[2] = (int)VSMIN(right, d->vi->width);
+    rect[3] = (int)VSMIN(bottom, d->vi->height);
+}
+
+
+// The same premultiplied blend as std.MaskedMerge, limited to the
+// rectangle of one plane.
+static void blendPlane(const VSFrameRef *subs, const VSFrameRef *mask, VSFrameRef *dst, int plane, const int rect[4], int offset, const VSFormat *fi, const VSAPI *vsapi) {
+    int src_stride = vsapi->getStride(subs, plane);
+    int stride = vsapi->getStride(dst, plane);
+    int mask_stride = vsapi->getStride(mask, 0);
+    int bps = fi->bytesPerSample;
+    int x0 = rect[0], y0 = rect[1], w = rect[2] - rect[0], h = rect[3] - rect[1];
+
+    const uint8_t *srcp = vsapi->getReadPtr(subs, plane) + y0 * src_stride + x0 * bps;
+    const uint8_t *maskp = vsapi->getReadPtr(mask, 0) + y0 * mask_stride + x0 * bps;
+    uint8_t *dstp = vsapi->getWritePtr(dst, plane) + y0 * stride + x0 * bps;
+
+    int yuvhandling = (plane > 0) && (fi->colorFamily == cmYUV || fi->colorFamily == cmYCoCg);
+
+    if (fi->sampleType == stFloat) {
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++)
+                ((float *)dstp)[x] = ((const float *)srcp)[x] + (((float *)dstp)[x] * (1.f - ((const float *)maskp)[x]));
+            srcp += src_stride;
+            maskp += mask_stride;
+            dstp += stride;
+        }
+    } else if (bps == 1) {
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                int m = maskp[x];
+                if (yuvhandling)
+                    dstp[x] = VSMIN(VSMAX(srcp[x] + (((256 - (((m >> 1) & 1) + m)) * (dstp[x] - 128)) >> 8), 0), 255);
+                else
+                    dstp[x] = VSMIN(VSMAX(srcp[x] - offset, 0) + (((256 - (((m >> 1) & 1) + m)) * VSMAX(dstp[x] - offset, 0) + 128) >> 8) + offset, 255);
+            }
+            srcp += src_stride;
+            maskp += mask_stride;
+            dstp += stride;
+        }
+    } else {
+        const unsigned shift = fi->bitsPerSample;
+        const int maxplusone = 1 << shift;
+        const int maxvalue = maxplusone - 1;
+        const int round = 1 << (shift - 1);
+        for (int y = 0; y < h; y++) {
+            const uint16_t *s = (const uint16_t *)srcp;
+            uint16_t *dd = (uint16_t *)dstp;
+            for (int x = 0; x < w; x++) {
+                int m = VSMIN(((const uint16_t *)maskp)[x], maxvalue);
+                if (yuvhandling)
+                    dd[x] = VSMIN(VSMAX(s[x] + (((maxplusone - (((m >> 1) & 1) + m)) * (dd[x] - round)) >> shift), 0), maxvalue);
+                else
+                    dd[x] = VSMIN(VSMAX(s[x] - offset, 0) + (((maxplusone - (((m >> 1) & 1) + m)) * VSMAX(dd[x] - offset, 0) + round) >> shift) + offset, maxvalue);
+            }
+            srcp += src_stride;
+            maskp += mask_stride;
+            dstp += stride;
+        }
+    }
+}
+
+
+// Frames without any subtitle are passed through untouched and the others
+// are only blended within the bounding box of the subtitles, which the
+// subtitle frames carry in SubtitleRect.
+static const VSFrameRef *VS_CC blendRectGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    BlendRectData *d = (BlendRectData *) *instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->rects, frameCtx);
+    } else if (activationReason == arAllFramesReady && !*frameData) {
+        const VSFrameRef *rects = vsapi->getFrameFilter(n, d->rects, frameCtx);
+
+        int err;
+        int64_t rect_width = vsapi->propGetInt(vsapi->getFramePropsRO(rects), "SubtitleRect", 2, &err);
+
+        vsapi->freeFrame(rects);
+
+        vsapi->requestFrameFilter(n, d->clip, frameCtx);
+
+        if (!err && rect_width == 0) {
+            *frameData = d->clip;
+        } else {
+            vsapi->requestFrameFilter(n, d->subs, frameCtx);
+            vsapi->requestFrameFilter(n, d->alpha, frameCtx);
+            if (d->alpha23)
+                vsapi->requestFrameFilter(n, d->alpha23, frameCtx);
+            *frameData = d->subs;
+        }
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrameRef *src = vsapi->getFrameFilter(n, d->clip, frameCtx);
+
+        if (*frameData == d->clip)
+            return src;
+
+        const VSFrameRef *rects = vsapi->getFrameFilter(n, d->rects, frameCtx);
+        const VSFrameRef *subs = vsapi->getFrameFilter(n, d->subs, frameCtx);
+        const VSFrameRef *alpha = vsapi->getFrameFilter(n, d->alpha, frameCtx);
+        const VSFrameRef *alpha23 = d->alpha23 ? vsapi->getFrameFilter(n, d->alpha23, frameCtx) : NULL;
+
+        const VSFormat *fi = d->vi->format;
+        int offset = 0;
+
+        if (fi->sampleType == stInteger) {
+            offset = getLimitedRangeOffset(src, d->vi, vsapi);
+            if (offset != getLimitedRangeOffset(subs, d->vi, vsapi)) {
+                vsapi->freeFrame(src);
+                vsapi->freeFrame(rects);
+                vsapi->freeFrame(subs);
+                vsapi->freeFrame(alpha);
+                vsapi->freeFrame(alpha23);
+                vsapi->setFilterError(d->range_error, frameCtx);
+                return NULL;
+            }
+        }
+
+        int rect[4];
+        getBlendRect(d, rects, rect, vsapi);
+
+        VSFrameRef *dst = vsapi->copyFrame(src, core);
+
+        if (rect[0] < rect[2] && rect[1] < rect[3]) {
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                int ssw = plane ? fi->subSamplingW : 0;
+                int ssh = plane ? fi->subSamplingH : 0;
+                const int plane_rect[4] = {
+                    rect[0] >> ssw,
+                    rect[1] >> ssh,
+                    (rect[2] + (1 << ssw) - 1) >> ssw,
+                    (rect[3] + (1 << ssh) - 1) >> ssh
+                };
+
+                blendPlane(subs, (plane && alpha23) ? alpha23 : alpha, dst, plane, plane_rect, offset, fi, vsapi);
+            }
+        }
+
+        vsapi->freeFrame(src);
+        vsapi->freeFrame(rects);
+        vsapi->freeFrame(subs);
+        vsapi->freeFrame(alpha);
+        vsapi->freeFrame(alpha23);
+
+        return dst;
+    }
+
+    return NULL;
+}
+
+
+static void VS_CC blendRectFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    BlendRectData *d = (BlendRectData *)instanceData;
+
+    vsapi->freeNode(d->clip);
+    vsapi->freeNode(d->subs);
+    vsapi->freeNode(d->alpha);
+    vsapi->freeNode(d->alpha23);
+    vsapi->freeNode(d->rects);
+    free(d);
+}
+
+
 void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VSMap *in, VSMap *out, const char *filter_name, char *error, size_t error_size, VSCore *core, const VSAPI *vsapi) {
     int err;
 
     VSPlugin *std_plugin = vsapi->getPluginById("com.vapoursynth.std", core);
     VSPlugin *resize_plugin = vsapi->getPluginById("com.vapoursynth.resize", core);
 
+    const VSFormat *clip_format = vsapi->getVideoInfo(clip)->format;
+    if (clip_format->colorFamily == cmCompat ||
+        (clip_format->sampleType == stInteger && clip_format->bytesPerSample > 2) ||
+        (clip_format->sampleType == stFloat && clip_format->bytesPerSample != 4)) {
+        snprintf(error, error_size, "%s: only 8-16 bit integer and 32 bit float clips are supported when blending.", filter_name);
+        vsapi->setError(out, error);
+        return;
+    }
+
+    VSNodeRef *rects = vsapi->cloneNodeRef(subs);
+
     subs = vsapi->cloneNodeRef(subs);
     alpha = vsapi->cloneNodeRef(alpha);
 
@@ -28,6 +260,7 @@ void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VS
         vsapi->setError(out, error);
         vsapi->freeMap(ret);
         vsapi->freeNode(alpha);
+        vsapi->freeNode(rects);
         return;
     }
 
@@ -90,6 +323,7 @@ void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VS
             vsapi->setError(out, error);
             vsapi->freeMap(ret);
             vsapi->freeNode(alpha);
+            vsapi->freeNode(rects);
             return;
         }
 
@@ -131,6 +365,7 @@ void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VS
                 vsapi->setError(out, error);
                 vsapi->freeNode(subs);
                 vsapi->freeMap(args);
+                vsapi->freeNode(rects);
                 return;
             }
 
@@ -149,6 +384,7 @@ void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VS
             vsapi->setError(out, error);
             vsapi->freeMap(ret);
             vsapi->freeNode(subs);
+            vsapi->freeNode(rects);
             return;
         }
 
@@ -156,25 +392,54 @@ void blendSubtitles(VSNodeRef *clip, VSNodeRef *subs, VSNodeRef *alpha, const VS
         vsapi->freeMap(ret);
     }
 
-    args = vsapi->createMap();
-    vsapi->propSetNode(args, "clipa", clip, paReplace);
-    vsapi->propSetNode(args, "clipb", subs, paReplace);
-    vsapi->freeNode(subs);
-    vsapi->propSetNode(args, "mask", alpha, paReplace);
-    vsapi->freeNode(alpha);
-    vsapi->propSetInt(args, "premultiplied", 1, paReplace);
+    // The chroma planes of subsampled clips get a scaled down mask, the way
+    // std.MaskedMerge does it
+    VSNodeRef *alpha23 = NULL;
 
-    ret = vsapi->invoke(std_plugin, "MaskedMerge", args);
-    vsapi->freeMap(args);
-    if (vsapi->getError(ret)) {
-        snprintf(error, error_size, "%s: %s", filter_name, vsapi->getError(ret));
-        vsapi->setError(out, error);
+    if (clip_vi->format->numPlanes > 1 && (clip_vi->format->subSamplingW || clip_vi->format->subSamplingH)) {
+        args = vsapi->createMap();
+        vsapi->propSetNode(args, "clip", alpha, paReplace);
+        vsapi->propSetInt(args, "width", clip_vi->width >> clip_vi->format->subSamplingW, paReplace);
+        vsapi->propSetInt(args, "height", clip_vi->height >> clip_vi->format->subSamplingH, paReplace);
+
+        ret = vsapi->invoke(resize_plugin, "Bilinear", args);
+        vsapi->freeMap(args);
+        if (vsapi->getError(ret)) {
+            snprintf(error, error_size, "%s: %s", filter_name, vsapi->getError(ret));
+            vsapi->setError(out, error);
+            vsapi->freeMap(ret);
+            vsapi->freeNode(subs);
+            vsapi->freeNode(alpha);
+            vsapi->freeNode(rects);
+            return;
+        }
+
+        alpha23 = vsapi->propGetNode(ret, "clip", 0, NULL);
         vsapi->freeMap(ret);
-        return;
     }
 
-    clip = vsapi->propGetNode(ret, "clip", 0, NULL);
-    vsapi->freeMap(ret);
-    vsapi->propSetNode(out, "clip", clip, paReplace);
-    vsapi->freeNode(clip);
+    const VSVideoInfo *rects_vi = vsapi->getVideoInfo(rects);
+
+    BlendRectData *data = malloc(sizeof(BlendRectData));
+    data->clip = vsapi->cloneNodeRef(clip);
+    data->subs = subs;
+    data->alpha = alpha;
+    data->alpha23 = alpha23;
+    data->rects = rects;
+    data->vi = clip_vi;
+    data->rects_width = rects_vi->width;
+    data->rects_height = rects_vi->height;
+
+    // How far the resizers can spread the subtitles and the mask outside
+    // of their bounding box, in the clip's pixels
+    data->pad = 0;
+    if (unsuitable_dimensions)
+        data->pad += 2 * VSMAX((clip_vi->width + rects_vi->width - 1) / rects_vi->width, (clip_vi->height + rects_vi->height - 1) / rects_vi->height) + 2;
+    if (alpha23)
+        data->pad += 4 << VSMAX(clip_vi->format->subSamplingW, clip_vi->format->subSamplingH);
+
+    snprintf(data->range_error, sizeof(data->range_error), "%s: the clip and the subtitles must have the same range", filter_name);
+
+    vsapi->propDeleteKey(out, "clip");
+    vsapi->createFilter(in, out, filter_name, blendRectInit, blendRectGetFrame, blendRectFree, fmParallel, nfNoCache, data, core);
 }
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <list>
+#include <set>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +21,9 @@ extern "C" {
 
 static const int64_t unused_colour = (int64_t)1 << 42;
 
+// Rendered subtitles kept around. Each one is a full size RGB frame plus alpha.
+static const size_t max_cached_subtitles = 8;
+
 
 typedef struct Subtitle {
     std::vector<AVPacket> packets;
@@ -26,6 +32,20 @@ typedef struct Subtitle {
 } Subtitle;
 
 
+// A range of frames that shows one subtitle. The spans are sorted and don't overlap.
+typedef struct SubtitleSpan {
+    int start_frame;
+    int end_frame;
+    int index;
+} SubtitleSpan;
+
+
+typedef struct CachedSubtitle {
+    int index;
+    const VSFrameRef *frame;
+} CachedSubtitle;
+
+
 typedef struct ImageFileData {
     std::string filter_name;
 
@@ -33,14 +53,20 @@ typedef struct ImageFileData {
 
     VSVideoInfo vi;
 
+    // Returned for every frame without a subtitle. It has the blank alpha frame attached.
     VSFrameRef *blank_rgb;
     VSFrameRef *blank_alpha;
 
-    const VSFrameRef *last_frame;
-    int last_subtitle;
+    // Most recently used first.
+    std::list<CachedSubtitle> cache;
+
+    // The last subtitle passed to the decoder.
+    int last_decoded;
 
     std::vector<Subtitle> subtitles;
 
+    std::vector<SubtitleSpan> spans;
+
     std::vector<int64_t> palette;
 
     bool gray;
@@ -62,15 +88,90 @@ static void VS_CC imageFileInit(VSMap *in, VSMap *out, void **instanceData, VSNo
 }
 
 
-static int findSubtitleIndex(int frame, const std::vector<Subtitle> &subtitles) {
-    for (size_t i = 0; i < subtitles.size(); i++)
-        if (subtitles[i].start_frame <= frame && frame < subtitles[i].end_frame)
-            return i;
+// Where subtitles overlap the one that comes first in the file is shown.
+static std::vector<SubtitleSpan> buildSubtitleSpans(const std::vector<Subtitle> &subtitles) {
+    // Starts are stored as the subtitle index, ends as -index - 1.
+    std::vector<std::pair<int, int> > events;
+
+    for (size_t i = 0; i < subtitles.size(); i++) {
+        if (subtitles[i].start_frame < subtitles[i].end_frame) {
+            events.push_back(std::make_pair(subtitles[i].start_frame, (int)i));
+            events.push_back(std::make_pair(subtitles[i].end_frame, -(int)i - 1));
+        }
+    }
+
+    std::sort(events.begin(), events.end());
+
+    std::vector<SubtitleSpan> spans;
+    std::set<int> active;
+
+    for (size_t e = 0; e < events.size(); ) {
+        int frame = events[e].first;
+
+        for (; e < events.size() && events[e].first == frame; e++) {
+            if (events[e].second >= 0)
+                active.insert(events[e].second);
+            else
+                active.erase(-events[e].second - 1);
+        }
+
+        if (active.empty() || e == events.size())
+            continue;
+
+        int index = *active.begin();
+        int next_frame = events[e].first;
+
+        if (spans.size() && spans.back().index == index && spans.back().end_frame == frame) {
+            spans.back().end_frame = next_frame;
+        } else {
+            SubtitleSpan span = { frame, next_frame, index };
+            spans.push_back(span);
+        }
+    }
+
+    return spans;
+}
+
+
+static int findSubtitleIndex(int frame, const std::vector<SubtitleSpan> &spans) {
+    auto span = std::upper_bound(spans.begin(), spans.end(), frame,
+                                 [] (int f, const SubtitleSpan &s) { return f < s.start_frame; });
+
+    if (span == spans.begin())
+        return -1;
+
+    --span;
+
+    if (frame < span->end_frame)
+        return span->index;
 
     return -1;
 }
 
 
+static const VSFrameRef *findCachedSubtitle(ImageFileData *d, int index) {
+    for (auto it = d->cache.begin(); it != d->cache.end(); it++) {
+        if (it->index == index) {
+            d->cache.splice(d->cache.begin(), d->cache, it);
+            return it->frame;
+        }
+    }
+
+    return nullptr;
+}
+
+
+static void addCachedSubtitle(ImageFileData *d, int index, const VSFrameRef *frame, const VSAPI *vsapi) {
+    CachedSubtitle cached = { index, vsapi->cloneFrameRef(frame) };
+    d->cache.push_front(cached);
+
+    if (d->cache.size() > max_cached_subtitles) {
+        vsapi->freeFrame(d->cache.back().frame);
+        d->cache.pop_back();
+    }
+}
+
+
 static void makePaletteGray(uint32_t *palette) {
     for (int i = 0; i < AVPALETTE_COUNT; i++) {
         uint32_t a = palette[i] >> 24;
@@ -92,72 +193,56 @@ static const VSFrameRef *VS_CC imageFileGetFrame(int n, int activationReason, vo
 
     if (activationReason == arInitial) {
         int subtitle_index;
-        if (d->flatten) {
+        if (d->flatten)
             subtitle_index = n;
-        } else {
-            subtitle_index = findSubtitleIndex(n, d->subtitles);
-            if (subtitle_index == d->last_subtitle)
-                return vsapi->cloneFrameRef(d->last_frame);
-        }
+        else
+            subtitle_index = findSubtitleIndex(n, d->spans);
+
+        if (subtitle_index < 0)
+            return vsapi->cloneFrameRef(d->blank_rgb);
+
+        const VSFrameRef *cached = findCachedSubtitle(d, subtitle_index);
+        if (cached)
+            return vsapi->cloneFrameRef(cached);
 
         VSFrameRef *rgb = vsapi->copyFrame(d->blank_rgb, core);
         VSFrameRef *alpha = vsapi->copyFrame(d->blank_alpha, core);
 
-        if (subtitle_index > -1) {
-            if (d->avctx->codec_id == AV_CODEC_ID_HDMV_PGS_SUBTITLE &&
-                d->last_subtitle != subtitle_index - 1) {
-                // Random access in PGS doesn't quite work without decoding some previous subtitles.
-                // 5 was not enough. 10 seems to work.
-                for (int s = std::max(0, subtitle_index - 10); s < subtitle_index; s++) {
-                    const Subtitle &sub = d->subtitles[s];
+        if (d->avctx->codec_id == AV_CODEC_ID_HDMV_PGS_SUBTITLE &&
+            d->last_decoded != subtitle_index - 1) {
+            // Random access in PGS doesn't quite work without decoding some previous subtitles.
+            // 5 was not enough. 10 seems to work.
+            for (int s = std::max(0, subtitle_index - 10); s < subtitle_index; s++) {
+                const Subtitle &sub = d->subtitles[s];
 
-                    int got_subtitle = 0;
+                int got_subtitle = 0;
 
-                    AVSubtitle avsub;
+                AVSubtitle avsub;
 
-                    for (size_t i = 0; i < sub.packets.size(); i++) {
-                        AVPacket packet = sub.packets[i];
+                for (size_t i = 0; i < sub.packets.size(); i++) {
+                    AVPacket packet = sub.packets[i];
 
-                        avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, &packet);
+                    avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, &packet);
 
-                        if (got_subtitle)
-                            avsubtitle_free(&avsub);
-                    }
+                    if (got_subtitle)
+                        avsubtitle_free(&avsub);
                 }
             }
+        }
 
-            d->last_subtitle = subtitle_index;
-
-            const Subtitle &sub = d->subtitles[subtitle_index];
-
-            int got_subtitle = 0;
-
-            AVSubtitle avsub;
-
-            for (size_t i = 0; i < sub.packets.size(); i++) {
-                AVPacket packet = sub.packets[i];
-
-                if (avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, &packet) < 0) {
-                    vsapi->setFilterError((d->filter_name + ": Failed to decode subtitle.").c_str(), frameCtx);
-
-                    vsapi->freeFrame(rgb);
-                    vsapi->freeFrame(alpha);
+        d->last_decoded = subtitle_index;
 
-                    return nullptr;
-                }
+        const Subtitle &sub = d->subtitles[subtitle_index];
 
-                if (got_subtitle && i < sub.packets.size() - 1) {
-                    vsapi->setFilterError((d->filter_name + ": Got subtitle sooner than expected.").c_str(), frameCtx);
+        int got_subtitle = 0;
 
-                    vsapi->freeFrame(rgb);
-                    vsapi->freeFrame(alpha);
+        AVSubtitle avsub;
 
-                    return nullptr;
-                }
-            }
+        for (size_t i = 0; i < sub.packets.size(); i++) {
+            AVPacket packet = sub.packets[i];
 
-            if (!got_subtitle) {
-                vsapi->setFilterError((d->filter_name + ": Got no subtitle after decoding all the packets.").c_str(), frameCtx);
+            if (avcodec_decode_subtitle2(d->avctx, &avsub, &got_subtitle, &packet) < 0) {
+                vsapi->setFilterError((d->filter_name + ": Failed to decode subtitle.").c_str(), frameCtx);
 
                 vsapi->freeFrame(rgb);
                 vsapi->freeFrame(alpha);
@@ -165,82 +250,109 @@ static const VSFrameRef *VS_CC imageFileGetFrame(int n, int activationReason, vo
                 return nullptr;
             }
 
-            if (avsub.num_rects == 0) {
-                vsapi->setFilterError((d->filter_name + ": Got subtitle with num_rects=0.").c_str(), frameCtx);
+            if (got_subtitle && i < sub.packets.size() - 1) {
+                vsapi->setFilterError((d->filter_name + ": Got subtitle sooner than expected.").c_str(), frameCtx);
 
                 vsapi->freeFrame(rgb);
                 vsapi->freeFrame(alpha);
 
                 return nullptr;
             }
+        }
+
+        if (!got_subtitle) {
+            vsapi->setFilterError((d->filter_name + ": Got no subtitle after decoding all the packets.").c_str(), frameCtx);
 
-            for (unsigned r = 0; r < avsub.num_rects; r++) {
-                AVSubtitleRect *rect = avsub.rects[r];
+            vsapi->freeFrame(rgb);
+            vsapi->freeFrame(alpha);
 
-                if (rect->w <= 0 || rect->h <= 0 || rect->type != SUBTITLE_BITMAP)
-                    continue;
+            return nullptr;
+        }
+
+        if (avsub.num_rects == 0) {
+            vsapi->setFilterError((d->filter_name + ": Got subtitle with num_rects=0.").c_str(), frameCtx);
+
+            vsapi->freeFrame(rgb);
+            vsapi->freeFrame(alpha);
+
+            return nullptr;
+        }
+
+        int left = INT_MAX, top = INT_MAX, right = 0, bottom = 0;
+
+        for (unsigned r = 0; r < avsub.num_rects; r++) {
+            AVSubtitleRect *rect = avsub.rects[r];
+
+            if (rect->w <= 0 || rect->h <= 0 || rect->type != SUBTITLE_BITMAP)
+                continue;
+
+            left = std::min(left, rect->x);
+            top = std::min(top, rect->y);
+            right = std::max(right, rect->x + rect->w);
+            bottom = std::max(bottom, rect->y + rect->h);
 
 #ifdef VS_HAVE_AVSUBTITLERECT_AVPICTURE
-                uint8_t **rect_data = rect->pict.data;
-                int *rect_linesize = rect->pict.linesize;
+            uint8_t **rect_data = rect->pict.data;
+            int *rect_linesize = rect->pict.linesize;
 #else
-                uint8_t **rect_data = rect->data;
-                int *rect_linesize = rect->linesize;
+            uint8_t **rect_data = rect->data;
+            int *rect_linesize = rect->linesize;
 #endif
 
-                uint32_t palette[AVPALETTE_COUNT];
-                memcpy(palette, rect_data[1], AVPALETTE_SIZE);
-                for (size_t i = 0; i < d->palette.size(); i++)
-                    if (d->palette[i] != unused_colour)
-                        palette[i] = d->palette[i];
-
-                if (d->gray)
-                    makePaletteGray(palette);
-
-                const uint8_t *input = rect_data[0];
-
-                uint8_t *dst_a = vsapi->getWritePtr(alpha, 0);
-                uint8_t *dst_r = vsapi->getWritePtr(rgb, 0);
-                uint8_t *dst_g = vsapi->getWritePtr(rgb, 1);
-                uint8_t *dst_b = vsapi->getWritePtr(rgb, 2);
-                int stride = vsapi->getStride(rgb, 0);
-
-                dst_a += rect->y * stride + rect->x;
-                dst_r += rect->y * stride + rect->x;
-                dst_g += rect->y * stride + rect->x;
-                dst_b += rect->y * stride + rect->x;
-
-                for (int y = 0; y < rect->h; y++) {
-                    for (int x = 0; x < rect->w; x++) {
-                        uint32_t argb = palette[input[x]];
-
-                        dst_a[x] = (argb >> 24) & 0xff;
-                        dst_r[x] = (argb >> 16) & 0xff;
-                        dst_g[x] = (argb >> 8) & 0xff;
-                        dst_b[x] = argb & 0xff;
-                    }
-
-                    input += rect_linesize[0];
-                    dst_a += stride;
-                    dst_r += stride;
-                    dst_g += stride;
-                    dst_b += stride;
+            uint32_t palette[AVPALETTE_COUNT];
+            memcpy(palette, rect_data[1], AVPALETTE_SIZE);
+            for (size_t i = 0; i < d->palette.size(); i++)
+                if (d->palette[i] != unused_colour)
+                    palette[i] = d->palette[i];
+
+            if (d->gray)
+                makePaletteGray(palette);
+
+            const uint8_t *input = rect_data[0];
+
+            uint8_t *dst_a = vsapi->getWritePtr(alpha, 0);
+            uint8_t *dst_r = vsapi->getWritePtr(rgb, 0);
+            uint8_t *dst_g = vsapi->getWritePtr(rgb, 1);
+            uint8_t *dst_b = vsapi->getWritePtr(rgb, 2);
+            int stride = vsapi->getStride(rgb, 0);
+
+            dst_a += rect->y * stride + rect->x;
+            dst_r += rect->y * stride + rect->x;
+            dst_g += rect->y * stride + rect->x;
+            dst_b += rect->y * stride + rect->x;
+
+            for (int y = 0; y < rect->h; y++) {
+                for (int x = 0; x < rect->w; x++) {
+                    uint32_t argb = palette[input[x]];
+
+                    dst_a[x] = (argb >> 24) & 0xff;
+                    dst_r[x] = (argb >> 16) & 0xff;
+                    dst_g[x] = (argb >> 8) & 0xff;
+                    dst_b[x] = argb & 0xff;
                 }
-            }
 
-            avsubtitle_free(&avsub);
+                input += rect_linesize[0];
+                dst_a += stride;
+                dst_r += stride;
+                dst_g += stride;
+                dst_b += stride;
+            }
         }
 
+        avsubtitle_free(&avsub);
+
 
         VSMap *rgb_props = vsapi->getFramePropsRW(rgb);
 
+        if (left < right) {
+            const int64_t rect[4] = { left, top, right - left, bottom - top };
+            vsapi->propSetIntArray(rgb_props, "SubtitleRect", rect, 4);
+        }
+
         vsapi->propSetFrame(rgb_props, "_Alpha", alpha, paReplace);
         vsapi->freeFrame(alpha);
 
-        if (subtitle_index > -1) {
-            vsapi->freeFrame(d->last_frame);
-            d->last_frame = vsapi->cloneFrameRef(rgb);
-        }
+        addCachedSubtitle(d, subtitle_index, rgb, vsapi);
 
         return rgb;
     }
@@ -258,7 +370,9 @@ static void VS_CC imageFileFree(void *instanceData, VSCore *core, const VSAPI *v
 
     vsapi->freeFrame(d->blank_rgb);
     vsapi->freeFrame(d->blank_alpha);
-    vsapi->freeFrame(d->last_frame);
+
+    for (auto cached = d->cache.begin(); cached != d->cache.end(); cached++)
+        vsapi->freeFrame(cached->frame);
 
     for (auto sub = d->subtitles.begin(); sub != d->subtitles.end(); sub++)
         for (auto packet = sub->packets.begin(); packet != sub->packets.end(); packet++)
@@ -583,7 +697,14 @@ extern "C" void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userDat
         }
     }
 
-    d.last_subtitle = INT_MIN;
+    VSMap *blank_props = vsapi->getFramePropsRW(d.blank_rgb);
+    const int64_t blank_rect[4] = { 0, 0, 0, 0 };
+    vsapi->propSetIntArray(blank_props, "SubtitleRect", blank_rect, 4);
+    vsapi->propSetFrame(blank_props, "_Alpha", d.blank_alpha, paReplace);
+
+    d.spans = buildSubtitleSpans(d.subtitles);
+
+    d.last_decoded = INT_MIN;
 
 
     d.flatten = !!vsapi->propGetInt(in, "flatten", 0, &err);
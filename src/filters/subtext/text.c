@@ -17,10 +17,15 @@
  */
 
 #include <string.h>
+#include <limits.h>
 #include <ass/ass.h>
 #include <time.h>
 #include <inttypes.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
@@ -44,14 +49,24 @@ struct AssTime {
 };
 typedef struct AssTime AssTime;
 
+struct AssRenderer {
+    ASS_Library *ass_library;
+    ASS_Renderer *ass_renderer;
+    ASS_Track *ass;
+
+    int lastn;
+    const VSFrameRef *lastframe;
+
+    volatile long inUse;
+    struct AssRenderer *next;
+};
+typedef struct AssRenderer AssRenderer;
+
 struct AssData {
     VSNodeRef *node;
     VSVideoInfo vi[2];
 
-    int lastn;
-    VSFrameRef *lastframe;
-    VSFrameRef *lastalpha;
-
+    const char *filter_name;
     const char *file;
     const char *text;
     const char *style;
@@ -63,9 +78,15 @@ struct AssData {
     int margins[4];
     intptr_t debuglevel;
 
-    ASS_Track *ass;
-    ASS_Library *ass_library;
-    ASS_Renderer *ass_renderer;
+    /* The script (or the file's contents converted to UTF-8) is kept
+       around so every renderer can parse its own track. */
+    char *script;
+    int64_t script_size;
+
+    VSFrameRef *blankframe;
+    VSFrameRef *blankalpha;
+
+    AssRenderer * volatile renderers;
 
     int startframe;
     int endframe;
@@ -114,6 +135,21 @@ static char *strrepl(const char *in, const char *str, const char *repl)
     return res;
 }
 
+static char *strcopy(const char *str)
+{
+    size_t len;
+    char *res;
+
+    if(!str)
+        return NULL;
+
+    len = strlen(str);
+    res = malloc(len + 1);
+    memcpy(res, str, len + 1);
+
+    return res;
+}
+
 static void assDebugCallback(int level, const char *fmt, va_list va, void *data)
 {
     if(level < (intptr_t)data) {
@@ -123,15 +159,205 @@ static void assDebugCallback(int level, const char *fmt, va_list va, void *data)
     }
 }
 
+char *convertToUtf8(const char *file_name, const char *charset, int64_t *file_size, char *error, size_t error_size);
+ASS_Track *convertToASS(const char *file_name, const char *contents, size_t contents_size, ASS_Library *ass_library, const char *user_style, const char *charset, char *error, size_t error_size);
+
+#ifdef _WIN32
+static int tryLockRenderer(volatile long *inUse)
+{
+    return !InterlockedCompareExchange(inUse, 1, 0);
+}
+
+static void unlockRenderer(volatile long *inUse)
+{
+    InterlockedExchange(inUse, 0);
+}
+
+static int addRenderer(AssRenderer * volatile *head, AssRenderer *r)
+{
+    return InterlockedCompareExchangePointer((PVOID volatile *)head, r, r->next) == r->next;
+}
+#else
+static int tryLockRenderer(volatile long *inUse)
+{
+    return __sync_bool_compare_and_swap(inUse, 0, 1);
+}
+
+static void unlockRenderer(volatile long *inUse)
+{
+    __sync_lock_release(inUse);
+}
+
+static int addRenderer(AssRenderer * volatile *head, AssRenderer *r)
+{
+    return __sync_bool_compare_and_swap(head, r->next, r);
+}
+#endif
+
 static void VS_CC assInit(VSMap *in, VSMap *out, void **instanceData,
                           VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
     AssData *d = (AssData *) * instanceData;
-    vsapi->setVideoInfo(d->vi, 2, node);
+    vsapi->setVideoInfo(d->vi, 1, node);
 }
 
+static void assFreeRenderer(AssRenderer *r, const VSAPI *vsapi)
+{
+    vsapi->freeFrame(r->lastframe);
+
+    if(r->ass)
+        ass_free_track(r->ass);
+    if(r->ass_renderer)
+        ass_renderer_done(r->ass_renderer);
+    if(r->ass_library)
+        ass_library_done(r->ass_library);
+
+    r->ass = NULL;
+    r->ass_renderer = NULL;
+    r->ass_library = NULL;
+    r->lastframe = NULL;
+    r->lastn = -1;
+}
+
+/* Every renderer gets its own library and track, because libass objects
+   must not be used from several threads at once. */
+static int assInitRenderer(const AssData *d, AssRenderer *r,
+                           char *error, size_t error_size)
+{
+    r->ass_library = ass_library_init();
+
+    if(!r->ass_library) {
+        snprintf(error, error_size, "%s: failed to initialize ASS library", d->filter_name);
+        return 0;
+    }
+
+    ass_set_message_cb(r->ass_library, assDebugCallback, (void *)d->debuglevel);
+    ass_set_extract_fonts(r->ass_library, 0);
+    ass_set_style_overrides(r->ass_library, 0);
+
+    if(d->fontdir)
+        ass_set_fonts_dir(r->ass_library, d->fontdir);
+
+    r->ass_renderer = ass_renderer_init(r->ass_library);
+
+    if(!r->ass_renderer) {
+        snprintf(error, error_size, "%s: failed to initialize ASS renderer", d->filter_name);
+        return 0;
+    }
+
+    ass_set_font_scale(r->ass_renderer, d->scale);
+    ass_set_frame_size(r->ass_renderer, d->vi[0].width, d->vi[0].height);
+    ass_set_margins(r->ass_renderer,
+                    d->margins[0], d->margins[1], d->margins[2], d->margins[3]);
+    ass_set_use_margins(r->ass_renderer, 1);
+
+    if(d->linespacing)
+        ass_set_line_spacing(r->ass_renderer, d->linespacing);
+
+    if(d->sar) {
+        ass_set_aspect_ratio(r->ass_renderer,
+                             (double)d->vi[0].width /
+                             d->vi[0].height * d->sar, 1);
+    }
+
+    ass_set_fonts(r->ass_renderer, NULL, NULL, 1, NULL, 1);
+
+    if(d->file == NULL) {
+        r->ass = ass_new_track(r->ass_library);
+
+        if(r->ass)
+            ass_process_data(r->ass, d->script, (int)d->script_size);
+    } else {
+        r->ass = ass_read_memory(r->ass_library, d->script, d->script_size, NULL);
+
+        if(!r->ass) {
+            snprintf(error, error_size, "%s: ", d->filter_name);
+            r->ass = convertToASS(d->file, d->script, d->script_size, r->ass_library, d->style, d->charset, error + strlen(error), error_size - strlen(error));
+        }
+    }
+
+    if(!r->ass) {
+        if(d->file == NULL)
+            snprintf(error, error_size, "%s: failed to create ASS track", d->filter_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Claims an idle renderer, preferably the one that rendered frame n last.
+   A new renderer is only added when all of them are busy, so there are
+   never more of them than frames requested at the same time. Renderers
+   are kept until the filter is freed. */
+static AssRenderer *assAcquireRenderer(AssData *d, int n)
+{
+    AssRenderer *r;
+
+    for(r = d->renderers; r; r = r->next) {
+        if(r->lastn == n && tryLockRenderer(&r->inUse))
+            return r;
+    }
+
+    for(r = d->renderers; r; r = r->next) {
+        if(tryLockRenderer(&r->inUse))
+            return r;
+    }
+
+    r = calloc(1, sizeof(AssRenderer));
+    r->lastn = -1;
+    r->inUse = 1;
+
+    do {
+        r->next = d->renderers;
+    } while(!addRenderer(&d->renderers, r));
+
+    return r;
+}
+
+static void assReleaseRenderer(AssRenderer *r)
+{
+    unlockRenderer(&r->inUse);
+}
+
+static void assSetRect(VSFrameRef *frame, const int rect[4], const VSAPI *vsapi)
+{
+    vsapi->propSetIntArray(vsapi->getFramePropsRW(frame), "SubtitleRect",
+                           (const int64_t []){ rect[0], rect[1], rect[2], rect[3] }, 4);
+}
+
+/* Computes the bounding box of all the images. Returns 0 when there is
+   nothing to draw. */
+static int assImageRect(ASS_Image *img, int rect[4])
+{
+    int left = INT_MAX, top = INT_MAX, right = 0, bottom = 0;
+
+    for(; img; img = img->next) {
+        if(img->w == 0 || img->h == 0)
+            continue;
+
+        left = VSMIN(left, img->dst_x);
+        top = VSMIN(top, img->dst_y);
+        right = VSMAX(right, img->dst_x + img->w);
+        bottom = VSMAX(bottom, img->dst_y + img->h);
+    }
+
+    if(left >= right || top >= bottom) {
+        rect[0] = rect[1] = rect[2] = rect[3] = 0;
+        return 0;
+    }
+
+    rect[0] = left;
+    rect[1] = top;
+    rect[2] = right - left;
+    rect[3] = bottom - top;
+
+    return 1;
+}
+
+/* The frames are copies of the blank frames, so only the images
+   themselves need to be drawn. */
 static void assRender(VSFrameRef *dst, VSFrameRef *alpha, const VSAPI *vsapi,
-                      ASS_Image *img)
+                      ASS_Image *img, const int rect[4])
 {
     uint8_t *planes[4];
     int strides[4], p;
@@ -141,7 +367,6 @@ static void assRender(VSFrameRef *dst, VSFrameRef *alpha, const VSAPI *vsapi,
 
         planes[p] = vsapi->getWritePtr(fr, p % 3);
         strides[p] = vsapi->getStride(fr, p % 3);
-        memset(planes[p], 0, strides[p] * vsapi->getFrameHeight(fr, p % 3));
     }
 
     while(img) {
@@ -189,6 +414,9 @@ static void assRender(VSFrameRef *dst, VSFrameRef *alpha, const VSAPI *vsapi,
 
         img = img->next;
     }
+
+    assSetRect(dst, rect, vsapi);
+    assSetRect(alpha, rect, vsapi);
 }
 
 static const VSFrameRef *VS_CC assGetFrame(int n, int activationReason,
@@ -197,52 +425,83 @@ static const VSFrameRef *VS_CC assGetFrame(int n, int activationReason,
         const VSAPI *vsapi)
 {
     AssData *d = (AssData *) * instanceData;
+    AssRenderer *r;
+    const VSFrameRef *ret;
+
+    r = assAcquireRenderer(d, n);
+
+    if(!r->ass_renderer) {
+        char error[512];
 
-    if(n != d->lastn) {
+        if(!assInitRenderer(d, r, error, sizeof(error))) {
+            vsapi->setFilterError(error, frameCtx);
+            assFreeRenderer(r, vsapi);
+            assReleaseRenderer(r);
+            return 0;
+        }
+    }
+
+    /* Each renderer remembers its own last frame, and libass reports
+       changes relative to the previous call on the same renderer. */
+    if(n != r->lastn) {
         ASS_Image *img;
         int64_t ts = 0;
         int changed;
 
         ts = (int64_t)n * 1000 * d->vi[0].fpsDen / d->vi[0].fpsNum;
 
-        img = ass_render_frame(d->ass_renderer, d->ass, ts, &changed);
+        img = ass_render_frame(r->ass_renderer, r->ass, ts, &changed);
+
+        if(changed || !r->lastframe) {
+            const VSFrameRef *dst;
+            int rect[4];
 
-        if (changed) {
-            VSFrameRef *dst = vsapi->newVideoFrame(d->vi[0].format,
-                                                   d->vi[0].width,
-                                                   d->vi[0].height,
-                                                   NULL, core);
+            if(assImageRect(img, rect)) {
+                VSFrameRef *newdst = vsapi->copyFrame(d->blankframe, core);
+                VSFrameRef *newa = vsapi->copyFrame(d->blankalpha, core);
 
-            VSFrameRef *a = vsapi->newVideoFrame(d->vi[1].format,
-                                                 d->vi[1].width,
-                                                 d->vi[1].height,
-                                                 NULL, core);
+                assRender(newdst, newa, vsapi, img, rect);
+                vsapi->propSetFrame(vsapi->getFramePropsRW(newdst), "_Alpha", newa, paReplace);
+                vsapi->freeFrame(newa);
+                dst = newdst;
+            } else {
+                dst = vsapi->cloneFrameRef(d->blankframe);
+            }
 
-            assRender(dst, a, vsapi, img);
-            vsapi->freeFrame(d->lastframe);
-            vsapi->freeFrame(d->lastalpha);
-            d->lastframe = dst;
-            d->lastalpha = a;
+            vsapi->freeFrame(r->lastframe);
+            r->lastframe = dst;
         }
 
-        d->lastn = n;
+        r->lastn = n;
     }
 
-    if(vsapi->getOutputIndex(frameCtx) == 0)
-        return vsapi->cloneFrameRef(d->lastframe);
-    else
-        return vsapi->cloneFrameRef(d->lastalpha);
+    ret = vsapi->cloneFrameRef(r->lastframe);
+
+    assReleaseRenderer(r);
+
+    return ret;
 }
 
 static void VS_CC assFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
 {
     AssData *d = (AssData *)instanceData;
+
+    while(d->renderers) {
+        AssRenderer *r = d->renderers;
+
+        d->renderers = r->next;
+        assFreeRenderer(r, vsapi);
+        free(r);
+    }
+
     vsapi->freeNode(d->node);
-    vsapi->freeFrame(d->lastframe);
-    vsapi->freeFrame(d->lastalpha);
-    ass_renderer_done(d->ass_renderer);
-    ass_library_done(d->ass_library);
-    ass_free_track(d->ass);
+    vsapi->freeFrame(d->blankframe);
+    vsapi->freeFrame(d->blankalpha);
+    free(d->script);
+    free((void *)d->file);
+    free((void *)d->style);
+    free((void *)d->charset);
+    free((void *)d->fontdir);
     free(d);
 }
 
@@ -267,9 +526,6 @@ static int frameToTime(int frame, int64_t fpsNum, int64_t fpsDen, char *str, siz
 }
 
 
-char *convertToUtf8(const char *file_name, const char *charset, int64_t *file_size, char *error, size_t error_size);
-ASS_Track *convertToASS(const char *file_name, const char *contents, size_t contents_size, ASS_Library *ass_library, const char *user_style, const char *charset, char *error, size_t error_size);
-
 
 static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
                                   VSCore *core, const VSAPI *vsapi)
@@ -283,7 +539,7 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
 #define ERROR_SIZE 512
     char error[ERROR_SIZE] = { 0 };
 
-    d.lastn = -1;
+    d.filter_name = filter_name;
     d.node = vsapi->propGetNode(in, "clip", 0, 0);
     d.vi[0] = *vsapi->getVideoInfo(d.node);
 
@@ -294,9 +550,6 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
     d.vi[1] = d.vi[0];
     d.vi[1].format = vsapi->getFormatPreset(pfGray8, core);
 
-    d.lastalpha = NULL;
-    d.lastframe = NULL;
-
     d.file = vsapi->propGetData(in, "file", 0, &err);
 
     if(err) {
@@ -375,49 +628,6 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
         return;
     }
 
-    d.ass_library = ass_library_init();
-
-    if(!d.ass_library) {
-        snprintf(error, ERROR_SIZE, "%s: failed to initialize ASS library", filter_name);
-        vsapi->setError(out, error);
-        vsapi->freeNode(d.node);
-        return;
-    }
-
-    ass_set_message_cb(d.ass_library, assDebugCallback, (void *)d.debuglevel);
-    ass_set_extract_fonts(d.ass_library, 0);
-    ass_set_style_overrides(d.ass_library, 0);
-
-    d.ass_renderer = ass_renderer_init(d.ass_library);
-
-    if(!d.ass_renderer) {
-        snprintf(error, ERROR_SIZE, "%s: failed to initialize ASS renderer", filter_name);
-        vsapi->setError(out, error);
-        vsapi->freeNode(d.node);
-        ass_library_done(d.ass_library);
-        return;
-    }
-
-    ass_set_font_scale(d.ass_renderer, d.scale);
-    ass_set_frame_size(d.ass_renderer, d.vi[0].width, d.vi[0].height);
-    ass_set_margins(d.ass_renderer,
-                    d.margins[0], d.margins[1], d.margins[2], d.margins[3]);
-    ass_set_use_margins(d.ass_renderer, 1);
-
-    if(d.linespacing)
-        ass_set_line_spacing(d.ass_renderer, d.linespacing);
-
-    if(d.sar) {
-        ass_set_aspect_ratio(d.ass_renderer,
-                             (double)d.vi[0].width /
-                             d.vi[0].height * d.sar, 1);
-    }
-
-    if(d.fontdir)
-        ass_set_fonts_dir(d.ass_library, d.fontdir);
-
-    ass_set_fonts(d.ass_renderer, NULL, NULL, 1, NULL, 1);
-
     if(d.file == NULL) {
 #define BUFFER_SIZE 16
         char *str, *text, x[BUFFER_SIZE], y[BUFFER_SIZE], start[BUFFER_SIZE] = { 0 }, end[BUFFER_SIZE] = { 0 };
@@ -441,8 +651,6 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
             snprintf(error, ERROR_SIZE, "%s: Unable to calculate %s time", filter_name, start[0] ? "end" : "start");
             vsapi->setError(out, error);
             vsapi->freeNode(d.node);
-            ass_renderer_done(d.ass_renderer);
-            ass_library_done(d.ass_library);
             return;
         }
 
@@ -456,46 +664,56 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
 
         free(text);
 
-        d.ass = ass_new_track(d.ass_library);
-        ass_process_data(d.ass, str, strlen(str));
-
-        free(str);
+        d.script = str;
+        d.script_size = strlen(str);
     } else {
         snprintf(error, ERROR_SIZE, "%s: ", filter_name);
 
-        int64_t contents_size;
-        char *contents = convertToUtf8(d.file, d.charset, &contents_size, error + strlen(error), ERROR_SIZE - strlen(error));
-
-        if (contents) {
-            d.ass = ass_read_memory(d.ass_library, contents, contents_size, NULL);
-
-            if (!d.ass)
-                d.ass = convertToASS(d.file, contents, contents_size, d.ass_library, d.style, d.charset, error + strlen(error), ERROR_SIZE - strlen(error));
-
-            free(contents);
-        }
+        d.script = convertToUtf8(d.file, d.charset, &d.script_size, error + strlen(error), ERROR_SIZE - strlen(error));
 
-        if (!contents || !d.ass) {
+        if (!d.script) {
             vsapi->setError(out, error);
             vsapi->freeNode(d.node);
-            ass_renderer_done(d.ass_renderer);
-            ass_library_done(d.ass_library);
             return;
         }
     }
 
-    d.lastframe = vsapi->newVideoFrame(d.vi[0].format,
-                                       d.vi[0].width,
-                                       d.vi[0].height,
-                                       NULL, core);
+    // The renderers are set up on demand, after the argument map is gone.
+    d.file = strcopy(d.file);
+    d.style = strcopy(d.style);
+    d.charset = strcopy(d.charset);
+    d.fontdir = strcopy(d.fontdir);
+
+    d.renderers = calloc(1, sizeof(AssRenderer));
+    d.renderers->lastn = -1;
+
+    // The other renderers are added on demand, but the first one is
+    // needed here to report broken scripts and missing libraries.
+    if(!assInitRenderer(&d, d.renderers, error, ERROR_SIZE)) {
+        vsapi->setError(out, error);
+        vsapi->freeNode(d.node);
+        assFreeRenderer(d.renderers, vsapi);
+        free(d.renderers);
+        free(d.script);
+        free((void *)d.file);
+        free((void *)d.style);
+        free((void *)d.charset);
+        free((void *)d.fontdir);
+        return;
+    }
+
+    d.blankframe = vsapi->newVideoFrame(d.vi[0].format,
+                                        d.vi[0].width,
+                                        d.vi[0].height,
+                                        NULL, core);
 
-    d.lastalpha = vsapi->newVideoFrame(d.vi[1].format,
-                                       d.vi[1].width,
-                                       d.vi[1].height,
-                                       NULL, core);
+    d.blankalpha = vsapi->newVideoFrame(d.vi[1].format,
+                                        d.vi[1].width,
+                                        d.vi[1].height,
+                                        NULL, core);
 
     for (int p = 0; p < 4; p++) {
-        VSFrameRef *frame = p == 3 ? d.lastalpha : d.lastframe;
+        VSFrameRef *frame = p == 3 ? d.blankalpha : d.blankframe;
         int plane = p % 3;
 
         memset(vsapi->getWritePtr(frame, plane),
@@ -503,28 +721,52 @@ static void VS_CC assRenderCreate(const VSMap *in, VSMap *out, void *userData,
                vsapi->getStride(frame, plane) * vsapi->getFrameHeight(frame, plane));
     }
 
+    {
+        const int rect[4] = { 0, 0, 0, 0 };
+
+        assSetRect(d.blankframe, rect, vsapi);
+        assSetRect(d.blankalpha, rect, vsapi);
+    }
+
+    vsapi->propSetFrame(vsapi->getFramePropsRW(d.blankframe), "_Alpha", d.blankalpha, paReplace);
+
     data = malloc(sizeof(d));
     *data = d;
 
     vsapi->createFilter(in, out, filter_name, assInit, assGetFrame, assFree,
-                        fmUnordered, 0, data, core);
+                        fmParallel, 0, data, core);
+
+    // The mask is attached to the rendered frames and extracted as a
+    // second clip, so every frame is only rendered once for both.
+    VSNodeRef *subs = vsapi->propGetNode(out, "clip", 0, NULL);
+
+    VSMap *args = vsapi->createMap();
+    vsapi->propSetNode(args, "clip", subs, paReplace);
+
+    VSMap *ret = vsapi->invoke(vsapi->getPluginById("com.vapoursynth.std", core), "PropToClip", args);
+    vsapi->freeMap(args);
+    if (vsapi->getError(ret)) {
+        snprintf(error, ERROR_SIZE, "%s: %s", filter_name, vsapi->getError(ret));
+        vsapi->setError(out, error);
+        vsapi->freeMap(ret);
+        vsapi->freeNode(subs);
+        return;
+    }
+
+    VSNodeRef *alpha = vsapi->propGetNode(ret, "clip", 0, NULL);
+    vsapi->freeMap(ret);
 
     int blend = !!vsapi->propGetInt(in, "blend", 0, &err);
     if (err)
         blend = 1;
 
-    if (blend) {
-        VSNodeRef *subs = vsapi->propGetNode(out, "clip", 0, NULL);
-        VSNodeRef *alpha = vsapi->propGetNode(out, "clip", 1, NULL);
-
+    if (blend)
         blendSubtitles(d.node, subs, alpha, in, out, filter_name, error, ERROR_SIZE, core, vsapi);
+    else
+        vsapi->propSetNode(out, "clip", alpha, paAppend);
 
-        vsapi->freeNode(subs);
-        vsapi->freeNode(alpha);
-
-        if (vsapi->getError(out))
-            return;
-    }
+    vsapi->freeNode(subs);
+    vsapi->freeNode(alpha);
 }
 
 void VS_CC imageFileCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
@@ -21,6 +21,10 @@
 
 #include <math.h>
 
+#ifdef VS_TARGET_CPU_X86
+#include <emmintrin.h>
+#endif
+
 #include "VapourSynth.h"
 #include "VSHelper.h"
 
@@ -28,42 +32,324 @@ struct VinverseData {
     VSNodeRef *node;
     VSVideoInfo vi;
 
-    double sstr;
-    double scl;
+    float sstr;
+    float scl;
     int amnt;
-
-    int *dlut;
+    float amntf;
 };
 typedef struct VinverseData VinverseData;
 
 static void VS_CC VinverseInit(VSMap *in, VSMap *out, void **instanceData,
                                VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
-    int x, y;
     VinverseData *d = (VinverseData *) * instanceData;
     vsapi->setVideoInfo(&d->vi, 1, node);
+}
 
-    d->dlut = malloc(512 * 511 * sizeof(int));
+#ifdef VS_TARGET_CPU_X86
+/* The contra-sharpening limit: the sharpening difference y2 is limited to
+ * d1, and scaled by scl when the two point in opposite directions */
+static inline __m128 VinverseDelta(__m128 d1, __m128 d2,
+                                   __m128 sstr, __m128 scl)
+{
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 y2 = _mm_mul_ps(d2, sstr);
+    __m128 usex = _mm_cmplt_ps(_mm_and_ps(d1, absmask),
+                               _mm_and_ps(y2, absmask));
+    __m128 da = _mm_or_ps(_mm_and_ps(usex, d1), _mm_andnot_ps(usex, y2));
+    __m128 neg = _mm_cmplt_ps(_mm_mul_ps(d1, y2), _mm_setzero_ps());
+
+    return _mm_or_ps(_mm_and_ps(neg, _mm_mul_ps(da, scl)),
+                     _mm_andnot_ps(neg, da));
+}
 
-    if (!d->dlut) {
-        vsapi->setError(out, "malloc failure (dlut)");
-        return;
+static inline __m128i VinverseDelta32(__m128i d1, __m128i d2,
+                                      __m128 sstr, __m128 scl)
+{
+    return _mm_cvttps_epi32(VinverseDelta(_mm_cvtepi32_ps(d1),
+                                          _mm_cvtepi32_ps(d2), sstr, scl));
+}
+
+static inline __m128i VinverseMinEpi32(__m128i a, __m128i b)
+{
+    __m128i m = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+
+static inline __m128i VinverseMaxEpi32(__m128i a, __m128i b)
+{
+    __m128i m = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+/* Four samples of up to 16 bits widened to dwords */
+static inline __m128i VinversePixels(__m128i pp, __m128i p, __m128i c,
+                                     __m128i n, __m128i nn,
+                                     __m128 sstr, __m128 scl,
+                                     __m128i amnt, __m128i peak)
+{
+    __m128i pn = _mm_add_epi32(p, n);
+    __m128i b3p = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(pn,
+                                 _mm_slli_epi32(c, 1)), _mm_set1_epi32(2)), 2);
+    __m128i c6 = _mm_add_epi32(_mm_slli_epi32(c, 2), _mm_slli_epi32(c, 1));
+    __m128i b6p = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(
+                                 _mm_add_epi32(pp, nn), _mm_slli_epi32(pn, 2)),
+                                 _mm_add_epi32(c6, _mm_set1_epi32(8))), 4);
+    __m128i d1 = _mm_sub_epi32(c, b3p);
+    __m128i d2 = _mm_sub_epi32(b3p, b6p);
+
+    __m128i df = _mm_add_epi32(b3p, VinverseDelta32(d1, d2, sstr, scl));
+
+    __m128i minm = VinverseMaxEpi32(_mm_sub_epi32(c, amnt), _mm_setzero_si128());
+    __m128i maxm = VinverseMinEpi32(_mm_add_epi32(c, amnt), peak);
+
+    return VinverseMinEpi32(VinverseMaxEpi32(df, minm), maxm);
+}
+
+/* Eight 8 bit samples widened to words, the blurs fit in 16 bits */
+static inline __m128i VinversePixels8(__m128i pp, __m128i p, __m128i c,
+                                      __m128i n, __m128i nn,
+                                      __m128 sstr, __m128 scl, __m128i amnt)
+{
+    __m128i pn = _mm_add_epi16(p, n);
+    __m128i b3p = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pn,
+                                 _mm_slli_epi16(c, 1)), _mm_set1_epi16(2)), 2);
+    __m128i c6 = _mm_add_epi16(_mm_slli_epi16(c, 2), _mm_slli_epi16(c, 1));
+    __m128i b6p = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(
+                                 _mm_add_epi16(pp, nn), _mm_slli_epi16(pn, 2)),
+                                 _mm_add_epi16(c6, _mm_set1_epi16(8))), 4);
+    __m128i d1 = _mm_sub_epi16(c, b3p);
+    __m128i d2 = _mm_sub_epi16(b3p, b6p);
+
+    /* sign extension to dwords */
+    __m128i lo = VinverseDelta32(_mm_srai_epi32(_mm_unpacklo_epi16(d1, d1), 16),
+                                 _mm_srai_epi32(_mm_unpacklo_epi16(d2, d2), 16),
+                                 sstr, scl);
+    __m128i hi = VinverseDelta32(_mm_srai_epi32(_mm_unpackhi_epi16(d1, d1), 16),
+                                 _mm_srai_epi32(_mm_unpackhi_epi16(d2, d2), 16),
+                                 sstr, scl);
+    __m128i df = _mm_adds_epi16(b3p, _mm_packs_epi32(lo, hi));
+
+    __m128i minm = _mm_max_epi16(_mm_sub_epi16(c, amnt), _mm_setzero_si128());
+    __m128i maxm = _mm_min_epi16(_mm_add_epi16(c, amnt), _mm_set1_epi16(255));
+
+    return _mm_min_epi16(_mm_max_epi16(df, minm), maxm);
+}
+
+static void Vinverse8(const uint8_t *srcpp, const uint8_t *srcp,
+                      const uint8_t *src, const uint8_t *srcn,
+                      const uint8_t *srcnn, uint8_t *dst,
+                      int width, const VinverseData *d)
+{
+    __m128 sstr = _mm_set1_ps(d->sstr);
+    __m128 scl = _mm_set1_ps(d->scl);
+    __m128i amnt = _mm_set1_epi16(d->amnt);
+    __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x < width; x += 16) {
+        __m128i pp = _mm_load_si128((const __m128i *)(srcpp + x));
+        __m128i p = _mm_load_si128((const __m128i *)(srcp + x));
+        __m128i c = _mm_load_si128((const __m128i *)(src + x));
+        __m128i n = _mm_load_si128((const __m128i *)(srcn + x));
+        __m128i nn = _mm_load_si128((const __m128i *)(srcnn + x));
+
+        __m128i lo = VinversePixels8(_mm_unpacklo_epi8(pp, zero),
+                                     _mm_unpacklo_epi8(p, zero),
+                                     _mm_unpacklo_epi8(c, zero),
+                                     _mm_unpacklo_epi8(n, zero),
+                                     _mm_unpacklo_epi8(nn, zero),
+                                     sstr, scl, amnt);
+        __m128i hi = VinversePixels8(_mm_unpackhi_epi8(pp, zero),
+                                     _mm_unpackhi_epi8(p, zero),
+                                     _mm_unpackhi_epi8(c, zero),
+                                     _mm_unpackhi_epi8(n, zero),
+                                     _mm_unpackhi_epi8(nn, zero),
+                                     sstr, scl, amnt);
+
+        _mm_store_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
     }
+}
 
-    for (x = -255; x <= 255; x++) {
-        for (y = -255; y <= 255; y++) {
-            double y2 = y * d->sstr;
-            double da = fabs((double)x) < fabs(y2) ? x : y2;
-            d->dlut[((x + 255) << 9) + (y + 255)] = (double)x * y2 < 0.0 ?
-                                                    (int)(da * d->scl) : (int)da;
-        }
+static void Vinverse16(const uint8_t *srcpp, const uint8_t *srcp,
+                       const uint8_t *src, const uint8_t *srcn,
+                       const uint8_t *srcnn, uint8_t *dst,
+                       int width, const VinverseData *d)
+{
+    __m128 sstr = _mm_set1_ps(d->sstr);
+    __m128 scl = _mm_set1_ps(d->scl);
+    __m128i amnt = _mm_set1_epi32(d->amnt);
+    __m128i peak = _mm_set1_epi32((1 << d->vi.format->bitsPerSample) - 1);
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias32 = _mm_set1_epi32(32768);
+    __m128i bias16 = _mm_set1_epi16(-32768);
+    int x;
+
+    for (x = 0; x < width; x += 8) {
+        __m128i pp = _mm_load_si128((const __m128i *)(srcpp + x * 2));
+        __m128i p = _mm_load_si128((const __m128i *)(srcp + x * 2));
+        __m128i c = _mm_load_si128((const __m128i *)(src + x * 2));
+        __m128i n = _mm_load_si128((const __m128i *)(srcn + x * 2));
+        __m128i nn = _mm_load_si128((const __m128i *)(srcnn + x * 2));
+
+        __m128i lo = VinversePixels(_mm_unpacklo_epi16(pp, zero),
+                                    _mm_unpacklo_epi16(p, zero),
+                                    _mm_unpacklo_epi16(c, zero),
+                                    _mm_unpacklo_epi16(n, zero),
+                                    _mm_unpacklo_epi16(nn, zero),
+                                    sstr, scl, amnt, peak);
+        __m128i hi = VinversePixels(_mm_unpackhi_epi16(pp, zero),
+                                    _mm_unpackhi_epi16(p, zero),
+                                    _mm_unpackhi_epi16(c, zero),
+                                    _mm_unpackhi_epi16(n, zero),
+                                    _mm_unpackhi_epi16(nn, zero),
+                                    sstr, scl, amnt, peak);
+
+        /* SSE2 only packs to signed words */
+        _mm_store_si128((__m128i *)(dst + x * 2),
+                        _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias32),
+                                                      _mm_sub_epi32(hi, bias32)),
+                                      bias16));
+    }
+}
+
+static void VinverseF(const uint8_t *srcpp8, const uint8_t *srcp8,
+                      const uint8_t *src8, const uint8_t *srcn8,
+                      const uint8_t *srcnn8, uint8_t *dst8,
+                      int width, const VinverseData *d)
+{
+    const float *srcpp = (const float *)srcpp8;
+    const float *srcp = (const float *)srcp8;
+    const float *src = (const float *)src8;
+    const float *srcn = (const float *)srcn8;
+    const float *srcnn = (const float *)srcnn8;
+    float *dst = (float *)dst8;
+
+    __m128 sstr = _mm_set1_ps(d->sstr);
+    __m128 scl = _mm_set1_ps(d->scl);
+    __m128 amnt = _mm_set1_ps(d->amntf);
+    int x;
+
+    for (x = 0; x < width; x += 4) {
+        __m128 pp = _mm_load_ps(srcpp + x);
+        __m128 p = _mm_load_ps(srcp + x);
+        __m128 c = _mm_load_ps(src + x);
+        __m128 n = _mm_load_ps(srcn + x);
+        __m128 nn = _mm_load_ps(srcnn + x);
+
+        __m128 pn = _mm_add_ps(p, n);
+        __m128 b3p = _mm_mul_ps(_mm_add_ps(pn, _mm_add_ps(c, c)),
+                                _mm_set1_ps(0.25f));
+        __m128 b6p = _mm_mul_ps(_mm_add_ps(_mm_add_ps(pp, nn),
+                                _mm_add_ps(_mm_mul_ps(pn, _mm_set1_ps(4.0f)),
+                                           _mm_mul_ps(c, _mm_set1_ps(6.0f)))),
+                                _mm_set1_ps(0.0625f));
+        __m128 df = _mm_add_ps(b3p, VinverseDelta(_mm_sub_ps(c, b3p),
+                                                  _mm_sub_ps(b3p, b6p),
+                                                  sstr, scl));
+
+        df = _mm_max_ps(df, _mm_sub_ps(c, amnt));
+        _mm_store_ps(dst + x, _mm_min_ps(df, _mm_add_ps(c, amnt)));
+    }
+}
+#else
+static inline float VinverseDelta(float d1, float d2, float sstr, float scl)
+{
+    float y2 = d2 * sstr;
+    float da = fabsf(d1) < fabsf(y2) ? d1 : y2;
+
+    return d1 * y2 < 0.0f ? da * scl : da;
+}
+
+#define VINVERSE_INT(T, peak)                                                  \
+    const T *srcpp = (const T *)srcpp8;                                        \
+    const T *srcp = (const T *)srcp8;                                          \
+    const T *src = (const T *)src8;                                            \
+    const T *srcn = (const T *)srcn8;                                          \
+    const T *srcnn = (const T *)srcnn8;                                        \
+    T *dst = (T *)dst8;                                                        \
+    int x;                                                                     \
+                                                                               \
+    for (x = 0; x < width; x++) {                                              \
+        int b3p = (srcp[x] + (src[x] << 1) + srcn[x] + 2) >> 2;                \
+        int b6p = (srcpp[x] + ((srcp[x] + srcn[x]) << 2) +                     \
+                   src[x] * 6 + srcnn[x] + 8) >> 4;                            \
+                                                                               \
+        int df = b3p + (int)VinverseDelta((float)(src[x] - b3p),               \
+                                          (float)(b3p - b6p),                  \
+                                          d->sstr, d->scl);                    \
+                                                                               \
+        int minm = VSMAX(src[x] - d->amnt, 0);                                 \
+        int maxm = VSMIN(src[x] + d->amnt, (peak));                            \
+                                                                               \
+        if (df <= minm)                                                        \
+            dst[x] = minm;                                                     \
+        else if (df >= maxm)                                                   \
+            dst[x] = maxm;                                                     \
+        else                                                                   \
+            dst[x] = df;                                                       \
+    }
+
+static void Vinverse8(const uint8_t *srcpp8, const uint8_t *srcp8,
+                      const uint8_t *src8, const uint8_t *srcn8,
+                      const uint8_t *srcnn8, uint8_t *dst8,
+                      int width, const VinverseData *d)
+{
+    VINVERSE_INT(uint8_t, 255)
+}
+
+static void Vinverse16(const uint8_t *srcpp8, const uint8_t *srcp8,
+                       const uint8_t *src8, const uint8_t *srcn8,
+                       const uint8_t *srcnn8, uint8_t *dst8,
+                       int width, const VinverseData *d)
+{
+    VINVERSE_INT(uint16_t, (1 << d->vi.format->bitsPerSample) - 1)
+}
+
+static void VinverseF(const uint8_t *srcpp8, const uint8_t *srcp8,
+                      const uint8_t *src8, const uint8_t *srcn8,
+                      const uint8_t *srcnn8, uint8_t *dst8,
+                      int width, const VinverseData *d)
+{
+    const float *srcpp = (const float *)srcpp8;
+    const float *srcp = (const float *)srcp8;
+    const float *src = (const float *)src8;
+    const float *srcn = (const float *)srcn8;
+    const float *srcnn = (const float *)srcnn8;
+    float *dst = (float *)dst8;
+    int x;
+
+    for (x = 0; x < width; x++) {
+        float b3p = (srcp[x] + srcn[x] + (src[x] + src[x])) * 0.25f;
+        float b6p = ((srcpp[x] + srcnn[x]) + ((srcp[x] + srcn[x]) * 4.0f +
+                     src[x] * 6.0f)) * 0.0625f;
+
+        float df = b3p + VinverseDelta(src[x] - b3p, b3p - b6p,
+                                       d->sstr, d->scl);
+
+        df = VSMAX(df, src[x] - d->amntf);
+        dst[x] = VSMIN(df, src[x] + d->amntf);
     }
 }
+#endif
+
+typedef void (*VinverseRowFunc)(const uint8_t *, const uint8_t *,
+                                const uint8_t *, const uint8_t *,
+                                const uint8_t *, uint8_t *,
+                                int, const VinverseData *);
 
 static void Vinverse(const uint8_t *src, uint8_t *dst,
                      int width, int height, int stride, VinverseData *d)
 {
-    int x, y;
+    VinverseRowFunc func;
+    int y;
+
+    if (d->vi.format->sampleType == stFloat)
+        func = VinverseF;
+    else if (d->vi.format->bytesPerSample == 2)
+        func = Vinverse16;
+    else
+        func = Vinverse8;
 
     for (y = 0; y < height; y++) {
         const uint8_t *srcpp = y <  2 ? src + stride * 2 : src - stride * 2;
@@ -71,25 +357,7 @@ static void Vinverse(const uint8_t *src, uint8_t *dst,
         const uint8_t *srcn  = y == height - 1 ? src - stride     : src + stride;
         const uint8_t *srcnn = y >  height - 3 ? src - stride * 2 : src + stride * 2;
 
-        for (x = 0; x < width; x++) {
-            uint8_t b3p = (srcp[x] + (src[x] << 1) + srcn[x] + 2) >> 2;
-            uint8_t b6p = (srcpp[x] + ((srcp[x] + srcn[x]) << 2) +
-                          src[x] * 6 + srcnn[x] + 8) >> 4;
-
-            int d1 = src[x] - b3p + 255;
-            int d2 = b3p - b6p + 255;
-            int df = b3p + d->dlut[(d1 << 9) + d2];
-
-            int minm = VSMAX(src[x] - d->amnt, 0);
-            int maxm = VSMIN(src[x] + d->amnt, 255);
-
-            if (df <= minm)
-                dst[x] = minm;
-            else if (df >= maxm)
-                dst[x] = maxm;
-            else
-                dst[x] = df;
-        }
+        func(srcpp, srcp, src, srcn, srcnn, dst, width, d);
 
         src += stride;
         dst += stride;
@@ -137,7 +405,6 @@ static void VS_CC VinverseFree(void *instanceData,
 {
     VinverseData *d = (VinverseData *)instanceData;
 
-    free(d->dlut);
     vsapi->freeNode(d->node);
     free(d);
 }
@@ -148,7 +415,6 @@ static void VS_CC VinverseCreate(const VSMap *in, VSMap *out, void *userData,
     VinverseData d, *data;
     int err;
 
-    d.dlut = NULL;
     d.node = vsapi->propGetNode(in, "clip", 0, 0);
     d.vi = *vsapi->getVideoInfo(d.node);
 
@@ -158,15 +424,17 @@ static void VS_CC VinverseCreate(const VSMap *in, VSMap *out, void *userData,
         return;
     }
 
-    if (d.vi.format->sampleType != stInteger ||
-        d.vi.format->bytesPerSample != 1) {
+    if ((d.vi.format->sampleType == stInteger &&
+         d.vi.format->bitsPerSample > 16) ||
+        (d.vi.format->sampleType == stFloat &&
+         d.vi.format->bitsPerSample != 32)) {
 
-        vsapi->setError(out, "Only 8-bit int formats supported");
+        vsapi->setError(out, "Only 8-16 bit int and 32 bit float formats supported");
         vsapi->freeNode(d.node);
         return;
     }
 
-    d.sstr = vsapi->propGetFloat(in, "sstr", 0, &err);
+    d.sstr = (float)vsapi->propGetFloat(in, "sstr", 0, &err);
 
     if (err)
         d.sstr = 2.7;
@@ -182,7 +450,13 @@ static void VS_CC VinverseCreate(const VSMap *in, VSMap *out, void *userData,
         return;
     }
 
-    d.scl = vsapi->propGetFloat(in, "scl", 0, &err);
+    /* amnt is given in 8 bit units */
+    d.amntf = d.amnt / 255.0f;
+
+    if (d.vi.format->sampleType == stInteger)
+        d.amnt = (d.amnt * ((1 << d.vi.format->bitsPerSample) - 1) + 127) / 255;
+
+    d.scl = (float)vsapi->propGetFloat(in, "scl", 0, &err);
 
     if (err)
         d.scl = 0.25;
@@ -40,6 +40,15 @@ static int isPowerOf2(int i) {
 
 // VFM
 
+// Work buffers for one frame, there is one set per worker thread so they're only allocated once
+typedef struct {
+    VSFrameRef *map;
+    VSFrameRef *cmask;
+    uint8_t *tbuffer;
+    int *cArray;
+    uint16_t *lineBuffer;
+} VFMScratch;
+
 typedef struct {
     VSNodeRef *node;
     VSNodeRef *clip2;
@@ -60,8 +69,68 @@ typedef struct {
     int y1;
     int micmatch;
     int micout;
+    int tbufferSize;
+    int cArraySize;
+    int numScratch;
+    VFMScratch *scratch;
+    volatile long *scratchInUse;
 } VFMData;
 
+#ifdef _WIN32
+static int tryLockScratch(volatile long *inUse) {
+    return !InterlockedCompareExchange(inUse, 1, 0);
+}
+
+static void unlockScratch(volatile long *inUse) {
+    InterlockedExchange(inUse, 0);
+}
+#else
+static int tryLockScratch(volatile long *inUse) {
+    return __sync_bool_compare_and_swap(inUse, 0, 1);
+}
+
+static void unlockScratch(volatile long *inUse) {
+    __sync_lock_release(inUse);
+}
+#endif
+
+static void allocScratch(VFMScratch *scratch, const VFMData *vfm, const VSFormat *format, int width, int height, VSCore *core, const VSAPI *vsapi) {
+    scratch->map = vsapi->newVideoFrame(format, width, height, NULL, core);
+    scratch->cmask = vsapi->newVideoFrame(format, width, height, NULL, core);
+    scratch->tbuffer = (uint8_t *)malloc(vfm->tbufferSize*sizeof(uint8_t));
+    scratch->cArray = (int *)malloc(vfm->cArraySize*sizeof(int));
+    scratch->lineBuffer = (uint16_t *)malloc(width*sizeof(uint16_t));
+}
+
+static void freeScratch(VFMScratch *scratch, const VSAPI *vsapi) {
+    vsapi->freeFrame(scratch->map);
+    vsapi->freeFrame(scratch->cmask);
+    free(scratch->tbuffer);
+    free(scratch->cArray);
+    free(scratch->lineBuffer);
+}
+
+// Claims a free set of buffers, if all of them are in use the temporary set is allocated and returned instead
+static VFMScratch *acquireScratch(const VFMData *vfm, VFMScratch *temp, const VSFormat *format, int width, int height, VSCore *core, const VSAPI *vsapi) {
+    int i;
+    for (i = 0; i < vfm->numScratch; i++) {
+        if (tryLockScratch(&vfm->scratchInUse[i])) {
+            if (!vfm->scratch[i].map)
+                allocScratch(&vfm->scratch[i], vfm, format, width, height, core, vsapi);
+            return &vfm->scratch[i];
+        }
+    }
+    allocScratch(temp, vfm, format, width, height, core, vsapi);
+    return temp;
+}
+
+static void releaseScratch(const VFMData *vfm, VFMScratch *scratch, VFMScratch *temp, const VSAPI *vsapi) {
+    if (scratch == temp)
+        freeScratch(temp, vsapi);
+    else
+        unlockScratch(&vfm->scratchInUse[scratch - vfm->scratch]);
+}
+
 
 static void copyField(VSFrameRef *dst, const VSFrameRef *src, int field, const VSAPI *vsapi) {
     const VSFormat *fi = vsapi->getFrameFormat(src);
@@ -89,14 +158,26 @@ static void buildABSDiffMask(const unsigned char *prvp, const unsigned char *nxt
     }
 }
 
+// one line of the combing mask, the edge lines are handled by passing mirrored neighbors
+static void buildCombMaskLine(const unsigned char *srcpp2, const unsigned char *srcpp, const unsigned char *srcp,
+    const unsigned char *srcpn, const unsigned char *srcpn2, unsigned char *cmkp, int width, int cthresh, int cthresh6) {
+    int x;
+    for (x=0; x<width; ++x) {
+        const int sFirst = srcp[x] - srcpp[x];
+        const int sSecond = srcp[x] - srcpn[x];
+        const int combed = ((sFirst > cthresh) & (sSecond > cthresh)) | ((sFirst < -cthresh) & (sSecond < -cthresh));
+        const int strong = abs(srcpp2[x]+(srcp[x]*4)+srcpn2[x]-(3*(srcpp[x]+srcpn[x]))) > cthresh6;
+        cmkp[x] = (unsigned char)-(combed & strong);
+    }
+}
 
 static int calcMI(const VSFrameRef *src, const VSAPI *vsapi,
-    int *blockN, int chroma, int cthresh, VSFrameRef *cmask, int *cArray, int blockx, int blocky)
+    int *blockN, int chroma, int cthresh, VSFrameRef *cmask, int *cArray, uint16_t *lineBuffer, int blockx, int blocky)
 {
     int ret = 0;
     const int cthresh6 = cthresh*6;
     int plane;
-    int x, y, u, v;
+    int x, y;
     for (plane=0; plane < (chroma ? 3 : 1); plane++) {
         const unsigned char *srcp = vsapi->getReadPtr(src, plane);
         const int src_pitch = vsapi->getStride(src, plane);
@@ -108,57 +189,24 @@ static int calcMI(const VSFrameRef *src, const VSAPI *vsapi,
             memset(cmkp,255,Height*cmk_pitch);
             continue;
         }
-        memset(cmkp,0,Height*cmk_pitch);
-        for (x=0; x<Width; ++x) {
-            const int sFirst = srcp[x] - srcp[x + src_pitch];
-            if (sFirst > cthresh || sFirst < -cthresh) {
-                if (abs(srcp[x + 2*src_pitch]+(srcp[x]*4)+srcp[x + 2*src_pitch]-6*srcp[x + src_pitch]) > cthresh6)
-                    cmkp[x] = 0xFF;
-            }
-        }
+        // every line is written so no clearing is needed
+        buildCombMaskLine(srcp + 2*src_pitch, srcp + src_pitch, srcp, srcp + src_pitch, srcp + 2*src_pitch, cmkp, Width, cthresh, cthresh6);
         srcp += src_pitch;
         cmkp += cmk_pitch;
-        for (x=0; x<Width; ++x) {
-            const int sFirst = srcp[x] - srcp[x - src_pitch];
-            const int sSecond = srcp[x] - srcp[x + src_pitch];
-            if ((sFirst > cthresh && sSecond > cthresh) || (sFirst < -cthresh && sSecond < -cthresh)) {
-                if (abs(srcp[x + 2*src_pitch]+(srcp[x]*4)+srcp[x + 2*src_pitch]-(3*(srcp[x - src_pitch]+srcp[x + src_pitch]))) > cthresh6)
-                    cmkp[x] = 0xFF;
-            }
-        }
+        buildCombMaskLine(srcp + 2*src_pitch, srcp - src_pitch, srcp, srcp + src_pitch, srcp + 2*src_pitch, cmkp, Width, cthresh, cthresh6);
         srcp += src_pitch;
         cmkp += cmk_pitch;
 
         for (y=2; y<Height-2; ++y) {
-            for (x=0; x<Width; ++x) {
-                const int sFirst = srcp[x] - srcp[x - src_pitch];
-                const int sSecond = srcp[x] - srcp[x + src_pitch];
-                if ((sFirst > cthresh && sSecond > cthresh) || (sFirst < -cthresh && sSecond < -cthresh)) {
-                    if (abs(srcp[x - 2*src_pitch]+(srcp[x]*4)+srcp[x + 2*src_pitch]-(3*(srcp[x - src_pitch]+srcp[x + src_pitch]))) > cthresh6)
-                        cmkp[x] = 0xFF;
-                }
-            }
+            buildCombMaskLine(srcp - 2*src_pitch, srcp - src_pitch, srcp, srcp + src_pitch, srcp + 2*src_pitch, cmkp, Width, cthresh, cthresh6);
             srcp += src_pitch;
             cmkp += cmk_pitch;
         }
 
-        for (x=0; x<Width; ++x) {
-            const int sFirst = srcp[x] - srcp[x - src_pitch];
-            const int sSecond = srcp[x] - srcp[x + src_pitch];
-            if ((sFirst > cthresh && sSecond > cthresh) || (sFirst < -cthresh && sSecond < -cthresh)) {
-                if (abs(srcp[x - 2*src_pitch]+(srcp[x]*4)+srcp[x - 2*src_pitch]-(3*(srcp[x - src_pitch]+srcp[x + src_pitch]))) > cthresh6)
-                    cmkp[x] = 0xFF;
-            }
-        }
+        buildCombMaskLine(srcp - 2*src_pitch, srcp - src_pitch, srcp, srcp + src_pitch, srcp - 2*src_pitch, cmkp, Width, cthresh, cthresh6);
         srcp += src_pitch;
         cmkp += cmk_pitch;
-        for (x=0; x<Width; ++x) {
-            const int sFirst = srcp[x] - srcp[x - src_pitch];
-            if (sFirst > cthresh || sFirst < -cthresh) {
-                if (abs(2*srcp[x - 2*src_pitch]+(srcp[x]*4)-6*srcp[x - src_pitch]) > cthresh6)
-                    cmkp[x] = 0xFF;
-            }
-        }
+        buildCombMaskLine(srcp - 2*src_pitch, srcp - src_pitch, srcp, srcp - src_pitch, srcp - 2*src_pitch, cmkp, Width, cthresh, cthresh6);
     }
     if (chroma) {
         const VSFormat *src_fmt = vsapi->getFrameFormat(src);
@@ -221,8 +269,9 @@ static int calcMI(const VSFrameRef *src, const VSAPI *vsapi,
         }
     }
     {
-    int xhalf = blockx/2;
-    int yhalf = blocky/2;
+    // the mask is summed in half block cells, each cell belongs to four overlapping blocks
+    const int xhalf = blockx/2;
+    const int yhalf = blocky/2;
     const int cmk_pitch = vsapi->getStride(cmask, 0);
     const unsigned char *cmkp = vsapi->getReadPtr(cmask, 0) + cmk_pitch;
     const unsigned char *cmkpp = cmkp - cmk_pitch;
@@ -233,93 +282,32 @@ static int calcMI(const VSFrameRef *src, const VSAPI *vsapi,
     const int xblocks4 = xblocks<<2;
     const int yblocks = ((Height+yhalf)/blocky) + 1;
     const int arraysize = (xblocks*yblocks)<<2;
-    int Heighta = (Height/(blocky/2))*(blocky/2);
-    const int Widtha = (Width/(blockx/2))*(blockx/2);
-    if (Heighta == Height)
-        Heighta = Height-yhalf;
     memset(&cArray[0],0,arraysize*sizeof(int));
-    for (y=1; y<yhalf; ++y) {
-        const int temp1 = (y/blocky)*xblocks4;
-        const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-        for (x=0; x<Width; ++x) {
-            if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                ++cArray[temp1+box1+0];
-                ++cArray[temp1+box2+1];
-                ++cArray[temp2+box1+2];
-                ++cArray[temp2+box2+3];
-            }
-        }
-        cmkpp += cmk_pitch;
-        cmkp += cmk_pitch;
-        cmkpn += cmk_pitch;
-    }
-    for (y=yhalf; y<Heighta; y+=yhalf) {
-        const int temp1 = (y/blocky)*xblocks4;
-        const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-
-        for (x=0; x<Widtha; x+=xhalf) {
-            const unsigned char *cmkppT = cmkpp;
-            const unsigned char *cmkpT = cmkp;
-            const unsigned char *cmkpnT = cmkpn;
-            int sum = 0;
-            for (u=0; u<yhalf; ++u) {
-                for (v=0; v<xhalf; ++v) {
-                    if (cmkppT[x+v] == 0xFF && cmkpT[x+v] == 0xFF &&
-                        cmkpnT[x+v] == 0xFF) ++sum;
+    memset(lineBuffer,0,Width*sizeof(uint16_t));
+    for (y=1; y<Height-1; ++y) {
+        for (x=0; x<Width; ++x)
+            lineBuffer[x] += cmkpp[x] & cmkp[x] & cmkpn[x] & 1;
+
+        if ((y+1) % yhalf == 0 || y == Height-2) {
+            const int cy = y/yhalf;
+            const int temp1 = (cy/2)*xblocks4;
+            const int temp2 = ((cy+1)/2)*xblocks4;
+            int cx;
+            for (cx=0; cx*xhalf<Width; ++cx) {
+                const int xend = VSMIN((cx+1)*xhalf, Width);
+                int sum = 0;
+                for (x=cx*xhalf; x<xend; ++x)
+                    sum += lineBuffer[x];
+                if (sum) {
+                    const int box1 = (cx/2)*4;
+                    const int box2 = ((cx+1)/2)*4;
+                    cArray[temp1+box1+0] += sum;
+                    cArray[temp1+box2+1] += sum;
+                    cArray[temp2+box1+2] += sum;
+                    cArray[temp2+box2+3] += sum;
                 }
-                cmkppT += cmk_pitch;
-                cmkpT += cmk_pitch;
-                cmkpnT += cmk_pitch;
-            }
-            if (sum) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                cArray[temp1+box1+0] += sum;
-                cArray[temp1+box2+1] += sum;
-                cArray[temp2+box1+2] += sum;
-                cArray[temp2+box2+3] += sum;
-            }
-        }
-
-        for (x=Widtha; x<Width; ++x) {
-            const unsigned char *cmkppT = cmkpp;
-            const unsigned char *cmkpT = cmkp;
-            const unsigned char *cmkpnT = cmkpn;
-            int sum = 0;
-            for (u=0; u<yhalf; ++u) {
-                if (cmkppT[x] == 0xFF && cmkpT[x] == 0xFF &&
-                    cmkpnT[x] == 0xFF) ++sum;
-                cmkppT += cmk_pitch;
-                cmkpT += cmk_pitch;
-                cmkpnT += cmk_pitch;
-            }
-            if (sum) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                cArray[temp1+box1+0] += sum;
-                cArray[temp1+box2+1] += sum;
-                cArray[temp2+box1+2] += sum;
-                cArray[temp2+box2+3] += sum;
-            }
-        }
-        cmkpp += cmk_pitch*yhalf;
-        cmkp += cmk_pitch*yhalf;
-        cmkpn += cmk_pitch*yhalf;
-    }
-    for (y=Heighta; y<Height-1; ++y) {
-        const int temp1 = (y/blocky)*xblocks4;
-        const int temp2 = ((y+yhalf)/blocky)*xblocks4;
-        for (x=0; x<Width; ++x) {
-            if (cmkpp[x] == 0xFF && cmkp[x] == 0xFF && cmkpn[x] == 0xFF) {
-                const int box1 = (x/blockx)*4;
-                const int box2 = ((x+xhalf)/blockx)*4;
-                ++cArray[temp1+box1+0];
-                ++cArray[temp1+box2+1];
-                ++cArray[temp2+box1+2];
-                ++cArray[temp2+box2+3];
             }
+            memset(lineBuffer,0,Width*sizeof(uint16_t));
         }
         cmkpp += cmk_pitch;
         cmkp += cmk_pitch;
@@ -340,7 +328,7 @@ static int calcMI(const VSFrameRef *src, const VSAPI *vsapi,
 // build a map over which pixels differ a lot/a little
 static void buildDiffMap(const unsigned char *prvp, const unsigned char *nxtp,
     unsigned char *dstp,int src_pitch, int dst_pitch, int Height,
-    int Width, int tpitch, unsigned char *tbuffer, const VSAPI *vsapi)
+    int Width, int tpitch, unsigned char *tbuffer, uint16_t *lineBuffer, const VSAPI *vsapi)
 {
     const unsigned char *dp = tbuffer+tpitch;
     int x, y, u, diff, count;
@@ -349,46 +337,42 @@ static void buildDiffMap(const unsigned char *prvp, const unsigned char *nxtp,
         tpitch, tbuffer, Width, Height>>1, vsapi);
 
     for (y=2; y<Height-2; y+=2) {
+        // vertical counts of the small differences, the 3x3 count is then the sum of three neighbors
+        for (x=0; x<Width; ++x)
+            lineBuffer[x] = (dp[x-tpitch] > 3) + (dp[x] > 3) + (dp[x+tpitch] > 3);
+        for (x=1; x<Width-1; ++x)
+            dstp[x] += (dp[x] > 3) & (lineBuffer[x-1] + lineBuffer[x] + lineBuffer[x+1] > 1);
+
         for (x=1; x<Width-1; ++x) {
             diff = dp[x];
-            if (diff > 3) {
-                for (count=0,u=x-1; u<x+2 && count<2; ++u) {
-                    if (dp[u-tpitch] > 3) ++count;
-                    if (dp[u] > 3) ++count;
-                    if (dp[u+tpitch] > 3) ++count;
+            if (diff > 19 && lineBuffer[x-1] + lineBuffer[x] + lineBuffer[x+1] > 1) {
+                int upper = 0, lower = 0;
+                for (count=0, u=x-1; u<x+2 && count<6; ++u) {
+                    if (dp[u-tpitch] > 19) { ++count; upper = 1; }
+                    if (dp[u] > 19) ++count;
+                    if (dp[u+tpitch] > 19) { ++count; lower = 1; }
                 }
-                if (count > 1) {
-                    ++dstp[x];
-                    if (diff > 19) {
-                        int upper = 0, lower = 0;
-                        for (count=0, u=x-1; u<x+2 && count<6; ++u) {
-                            if (dp[u-tpitch] > 19) { ++count; upper = 1; }
-                            if (dp[u] > 19) ++count;
-                            if (dp[u+tpitch] > 19) { ++count; lower = 1; }
-                        }
-                        if (count > 3) {
-                            if (!upper || !lower) {
-                                int upper2 = 0, lower2 = 0;
-                                for (u=VSMAX(x-4,0); u<VSMIN(x+5,Width); ++u)
-                                {
-                                    if (y != 2 && dp[u-2*tpitch] > 19)
-                                        upper2 = 1;
-                                    if (dp[u-tpitch] > 19)
-                                        upper = 1;
-                                    if (dp[u+tpitch] > 19)
-                                        lower = 1;
-                                    if (y != Height-4 && dp[u+2*tpitch] > 19)
-                                        lower2 = 1;
-                                }
-                                if ((upper && (lower || upper2)) ||
-                                    (lower && (upper || lower2)))
-                                    dstp[x] += 2;
-                                else if (count > 5)
-                                    dstp[x] += 4;
-                            }
-                            else dstp[x] += 2;
+                if (count > 3) {
+                    if (!upper || !lower) {
+                        int upper2 = 0, lower2 = 0;
+                        for (u=VSMAX(x-4,0); u<VSMIN(x+5,Width); ++u)
+                        {
+                            if (y != 2 && dp[u-2*tpitch] > 19)
+                                upper2 = 1;
+                            if (dp[u-tpitch] > 19)
+                                upper = 1;
+                            if (dp[u+tpitch] > 19)
+                                lower = 1;
+                            if (y != Height-4 && dp[u+2*tpitch] > 19)
+                                lower2 = 1;
                         }
+                        if ((upper && (lower || upper2)) ||
+                            (lower && (upper || lower2)))
+                            dstp[x] += 2;
+                        else if (count > 5)
+                            dstp[x] += 4;
                     }
+                    else dstp[x] += 2;
                 }
             }
         }
@@ -398,7 +382,7 @@ static void buildDiffMap(const unsigned char *prvp, const unsigned char *nxtp,
 }
 
 static int compareFieldsSlow(const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, VSFrameRef *map, int match1,
-    int match2, int mchroma, int field, int y0, int y1, uint8_t *tbuffer, int tpitchy, int tpitchuv, const VSAPI *vsapi)
+    int match2, int mchroma, int field, int y0, int y1, uint8_t *tbuffer, uint16_t *lineBuffer, int tpitchy, int tpitchuv, const VSAPI *vsapi)
 {
     int plane, ret;
     const unsigned char *prvp = 0, *srcp = 0, *nxtp = 0;
@@ -407,7 +391,7 @@ static int compareFieldsSlow(const VSFrameRef *prv, const VSFrameRef *src, const
     unsigned char *mapp;
     int src_stride, Width, Height;
     int curf_pitch, stopx, map_pitch;
-    int x, y, temp1, temp2, startx, y0a, y1a, tp;
+    int x, y, startx, y0a, y1a, tp;
     int stop = mchroma ? 3 : 1;
     unsigned long accumPc = 0, accumNc = 0, accumPm = 0;
     unsigned long accumNm = 0, accumPml = 0, accumNml = 0;
@@ -475,35 +459,32 @@ static int compareFieldsSlow(const VSFrameRef *prv, const VSFrameRef *src, const
         nxtnf = nxtpf + curf_pitch;
         map_pitch <<= 1;
         if ((match1 >= 3 && field == 1) || (match1 < 3 && field != 1))
-            buildDiffMap(prvpf,nxtpf,mapp,curf_pitch,map_pitch,Height,Width,tp,tbuffer,vsapi);
+            buildDiffMap(prvpf,nxtpf,mapp,curf_pitch,map_pitch,Height,Width,tp,tbuffer,lineBuffer,vsapi);
         else
-            buildDiffMap(prvnf,nxtnf,mapp + map_pitch,curf_pitch,map_pitch,Height,Width,tp,tbuffer,vsapi);
+            buildDiffMap(prvnf,nxtnf,mapp + map_pitch,curf_pitch,map_pitch,Height,Width,tp,tbuffer,lineBuffer,vsapi);
 
         for (y=2; y<Height-2; y+=2) {
             if (y0a == y1a || y < y0a || y > y1a) {
+                // per line sums keep the loop free of branches
+                int linePc = 0, lineNc = 0, linePm = 0;
+                int lineNm = 0, linePml = 0, lineNml = 0;
                 for (x=startx; x<stopx; x++) {
-                    if (mapp[x] > 0 || mapp[x + map_pitch] > 0) {
-                        temp1 = curpf[x]+(curf[x]<<2)+curnf[x];
-                        temp2 = abs(3*(prvpf[x]+prvnf[x])-temp1);
-                        if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_pitch]&1)))
-                            accumPc += temp2;
-                        if (temp2 > 42) {
-                            if ((mapp[x]&2) || (mapp[x + map_pitch]&2))
-                                accumPm += temp2;
-                            if ((mapp[x]&4) || (mapp[x + map_pitch]&4))
-                                accumPml += temp2;
-                        }
-                        temp2 = abs(3*(nxtpf[x]+nxtnf[x])-temp1);
-                        if (temp2 > 23 && ((mapp[x]&1) || (mapp[x + map_pitch]&1)))
-                            accumNc += temp2;
-                        if (temp2 > 42) {
-                            if ((mapp[x]&2) || (mapp[x + map_pitch]&2))
-                                accumNm += temp2;
-                            if ((mapp[x]&4) || (mapp[x + map_pitch]&4))
-                                accumNml += temp2;
-                        }
-                    }
+                    const int m = mapp[x] | mapp[x + map_pitch];
+                    const int tempP = abs(3*(prvpf[x]+prvnf[x])-(curpf[x]+(curf[x]<<2)+curnf[x]));
+                    const int tempN = abs(3*(nxtpf[x]+nxtnf[x])-(curpf[x]+(curf[x]<<2)+curnf[x]));
+                    linePc += (tempP > 23 && (m & 1)) ? tempP : 0;
+                    linePm += (tempP > 42 && (m & 2)) ? tempP : 0;
+                    linePml += (tempP > 42 && (m & 4)) ? tempP : 0;
+                    lineNc += (tempN > 23 && (m & 1)) ? tempN : 0;
+                    lineNm += (tempN > 42 && (m & 2)) ? tempN : 0;
+                    lineNml += (tempN > 42 && (m & 4)) ? tempN : 0;
                 }
+                accumPc += linePc;
+                accumNc += lineNc;
+                accumPm += linePm;
+                accumNm += lineNm;
+                accumPml += linePml;
+                accumNml += lineNml;
             }
             prvpf += curf_pitch;
             prvnf += curf_pitch;
@@ -579,17 +560,21 @@ static const VSFrameRef *createWeaveFrame(const VSFrameRef *prv, const VSFrameRe
 
 
 static int checkmm(int m1, int m2, int *m1mic, int *m2mic, int *blockN, int MI, int field, int chroma, int cthresh, const VSFrameRef **genFrames,
-    const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, VSFrameRef *cmask, int *cArray, int blockx, int blocky, const VSAPI *vsapi, VSCore *core) {
+    const VSFrameRef *prv, const VSFrameRef *src, const VSFrameRef *nxt, VSFrameRef *cmask, int *cArray, uint16_t *lineBuffer, int blockx, int blocky, const VSAPI *vsapi, VSCore *core) {
     if (*m1mic < 0) {
         if (!genFrames[m1])
             genFrames[m1] = createWeaveFrame(prv, src, nxt, vsapi, core, m1, field);
-        *m1mic = calcMI(genFrames[m1], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        *m1mic = calcMI(genFrames[m1], vsapi, blockN, chroma, cthresh, cmask, cArray, lineBuffer, blockx, blocky);
     }
 
+    // m2 can only win by being at least 30 lower so there's no point in calculating it
+    if (*m2mic < 0 && *m1mic < 30)
+        return m1;
+
     if (*m2mic < 0) {
         if (!genFrames[m2])
             genFrames[m2] = createWeaveFrame(prv, src, nxt, vsapi, core, m2, field);
-        *m2mic = calcMI(genFrames[m2], vsapi, blockN, chroma, cthresh, cmask, cArray, blockx, blocky);
+        *m2mic = calcMI(genFrames[m2], vsapi, blockN, chroma, cthresh, cmask, cArray, lineBuffer, blockx, blocky);
     }
 
     if (((*m2mic)*3 < *m1mic || ((*m2mic)*2 < *m1mic && *m1mic > MI)) &&
@@ -685,11 +670,8 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
         int width = vsapi->getFrameWidth(src, 0);
         int height = vsapi->getFrameHeight(src, 0);
 
-        VSFrameRef *map = vsapi->newVideoFrame(format, width, height, NULL, core);
-        VSFrameRef *cmask = vsapi->newVideoFrame(format, width, height, NULL, core);
-
-        uint8_t *tbuffer = (uint8_t *)malloc((height>>1)*vfm->tpitchy*sizeof(uint8_t));
-        int *cArray = (int *)malloc((((width+vfm->blockx/2)/vfm->blockx)+1)*(((height+vfm->blocky/2)/vfm->blocky)+1)*4*sizeof(int));
+        VFMScratch temp;
+        VFMScratch *scratch = acquireScratch(vfm, &temp, format, width, height, core, vsapi);
 
         // check if it's a scenechange so micmatch can be used
         // only relevant for mm mode 1
@@ -703,18 +685,20 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
         }
 
         // p/c selection
-        match = compareFieldsSlow(prv, src, nxt, map, fxo[mC], fxo[mP], vfm->mchroma, field, vfm->y0, vfm->y1, tbuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
+        match = compareFieldsSlow(prv, src, nxt, scratch->map, fxo[mC], fxo[mP], vfm->mchroma, field, vfm->y0, vfm->y1, scratch->tbuffer, scratch->lineBuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
         // the mode has 3-way p/c/n matches
         if (vfm->mode >= 4)
-            match = compareFieldsSlow(prv, src, nxt, map, match, fxo[mN], vfm->mchroma, field, vfm->y0, vfm->y1, tbuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
+            match = compareFieldsSlow(prv, src, nxt, scratch->map, match, fxo[mN], vfm->mchroma, field, vfm->y0, vfm->y1, scratch->tbuffer, scratch->lineBuffer, vfm->tpitchy, vfm->tpitchuv, vsapi);
 
         genFrames[mC] = vsapi->cloneFrameRef(src);
 
-        // calculate all values for mic output, checkmm calculates and prepares it for the two matches if not already done
+        // calculate all values for mic output
         if (vfm->micout) {
-            checkmm(0, 1, &mics[0], &mics[1], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-            checkmm(2, 3, &mics[2], &mics[3], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-            checkmm(4, 0, &mics[4], &mics[0], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+            for (i = 0; i < 5; i++) {
+                if (!genFrames[i])
+                    genFrames[i] = createWeaveFrame(prv, src, nxt, vsapi, core, i, field);
+                mics[i] = calcMI(genFrames[i], vsapi, &blockN, vfm->chroma, vfm->cthresh, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky);
+            }
         }
 
         // check the micmatches to see if one of the options are better
@@ -724,21 +708,21 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
             // here comes the conditional hell to try to approximate mode 0-5 in tfm
             if (vfm->mode == 0) {
                 // maybe not completely appropriate but go back and see if the discarded match is less sucky
-                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 1) {
-                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 2) {
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 3) {
-                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mN], &mics[match], &mics[fxo[mN]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
             } else if (vfm->mode == 4) {
                 // degenerate check because I'm lazy
-                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky,vsapi, core);
+                match = checkmm(match, match == fxo[mP] ? fxo[mC] : fxo[mP], &mics[match], &mics[match == fxo[mP] ? fxo[mC] : fxo[mP]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky,vsapi, core);
             } else if (vfm->mode == 5) {
-                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
-                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, cmask, &cArray[0], vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mU], &mics[match], &mics[fxo[mU]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
+                match = checkmm(match, fxo[mB], &mics[match], &mics[fxo[mB]], &blockN, vfm->mi, field, vfm->chroma, vfm->cthresh, genFrames, prv, src, nxt, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky, vsapi, core);
             }
         }
 
@@ -746,7 +730,7 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
         if (mics[match] < 0) {
             if (!genFrames[match])
                 genFrames[match] = createWeaveFrame(prv, src, nxt, vsapi, core, match, field);
-            mics[match] = calcMI(genFrames[match], vsapi, &blockN, vfm->chroma, vfm->cthresh, cmask, cArray, vfm->blockx, vfm->blocky);
+            mics[match] = calcMI(genFrames[match], vsapi, &blockN, vfm->chroma, vfm->cthresh, scratch->cmask, scratch->cArray, scratch->lineBuffer, vfm->blockx, vfm->blocky);
         }
 
         // Alternative clip handling
@@ -771,10 +755,7 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
         for (i = 0; i < 5; i++)
             vsapi->freeFrame(genFrames[i]);
 
-        free(tbuffer);
-        free(cArray);
-        vsapi->freeFrame(map);
-        vsapi->freeFrame(cmask);
+        releaseScratch(vfm, scratch, &temp, vsapi);
 
         dst2 = vsapi->copyFrame(dst1, core);
         vsapi->freeFrame(dst1);
@@ -792,8 +773,13 @@ static const VSFrameRef *VS_CC vfmGetFrame(int n, int activationReason, void **i
 
 static void VS_CC vfmFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     VFMData *vfm = (VFMData *)instanceData;
+    int i;
     vsapi->freeNode(vfm->node);
     vsapi->freeNode(vfm->clip2);
+    for (i = 0; i < vfm->numScratch; i++)
+        freeScratch(&vfm->scratch[i], vsapi);
+    free(vfm->scratch);
+    free((void *)vfm->scratchInUse);
     free(vfm);
 }
 
@@ -988,6 +974,12 @@ static void VS_CC createVFM(const VSMap *in, VSMap *out, void *userData, VSCore
     int widthuv = vi->width >> vi->format->subSamplingW;
     vfm.tpitchuv = (widthuv&15) ? widthuv+16-(widthuv&15) : widthuv;
 
+    vfm.tbufferSize = (vi->height>>1)*vfm.tpitchy;
+    vfm.cArraySize = (((vi->width+vfm.blockx/2)/vfm.blockx)+1)*(((vi->height+vfm.blocky/2)/vfm.blocky)+1)*4;
+    vfm.numScratch = vsapi->getCoreInfo(core)->numThreads;
+    vfm.scratch = (VFMScratch *)calloc(vfm.numScratch, sizeof(VFMScratch));
+    vfm.scratchInUse = (volatile long *)calloc(vfm.numScratch, sizeof(long));
+
     vfmd = (VFMData *)malloc(sizeof(vfm));
     *vfmd = vfm;
     vsapi->createFilter(in, out, "VFM", vfmInit, vfmGetFrame, vfmFree, fmParallel, 0, vfmd, core);
@@ -1005,40 +997,53 @@ typedef struct {
     int64_t totdiff;
 } VDInfo;
 
-typedef struct CycleInfo {
-    int num;                    // The number of the cycle's first frame divided by the cycle length.
-    char drop;                  // Index of the frame to drop from the cycle.
-    VDInfo *metrics;            // Metrics for the input frames in the cycle.
-    FrameDuration *durations;   // Durations of the output frames in the cycle. Allocated only if !dryrun.
-} CycleInfo;
-
-typedef struct CycleCache {
-    CycleInfo *cycles;
-    int size;                   // Number of cycles in the cache.
-} CycleCache;
+// Header of a saved metrics file, the metrics only depend on these so the
+// thresholds and cycle can be changed freely between runs
+typedef struct {
+    char magic[8];
+    int32_t version;
+    int32_t numFrames;
+    int32_t width;
+    int32_t height;
+    int32_t format;
+    int32_t chroma;
+    int32_t blockx;
+    int32_t blocky;
+} VDMetricsHeader;
+
+#define MetricsMagic "VDMETRIC"
+#define MetricsVersion 1
 
+typedef struct {
+    VSNodeRef *node;
+    const VSVideoInfo *vi;
+    int chroma;
+    int blockx;
+    int blocky;
+    int nxblocks;
+    int nyblocks;
+    int bdiffsize;
+} VDMetricsData;
 
 typedef struct {
     VSNodeRef *node;
     VSNodeRef *clip2;
+    VSNodeRef *metricsNode;
     VSVideoInfo vi;
     int inCycle;
     int outCycle;
-    int chroma;
     int tail;
     int inputNumFrames;
+    int numCycles;
     int64_t dupthresh;
     int64_t scthresh;
-    int blockx;
-    int blocky;
-    int nxblocks;
-    int nyblocks;
-    int bdiffsize;
-    int64_t *bdiffs;
-    const char *ovrfile;
     int dryrun;
-    char *drop;
-    CycleCache cache;
+    VDInfo *metrics;            // Metrics for every input frame, filled in as cycles are processed.
+    char *drop;                 // Index of the frame to drop from each cycle.
+    FrameDuration *durations;   // Durations of the output frames of each cycle. Allocated only if !dryrun.
+    char *metricsFile;
+    int metricsChanged;
+    VDMetricsHeader metricsHeader;
 } VDecimateData;
 
 
@@ -1049,88 +1054,30 @@ typedef struct {
 #define STR_(x) #x
 
 
-static void initCache(CycleCache *cache, VDecimateData *vdm) {
-    cache->size = 200 / vdm->inCycle; // Cache 200 frames.
-
-    cache->cycles = (CycleInfo *)malloc(cache->size * sizeof(CycleInfo));
-    memset(cache->cycles, 0, cache->size * sizeof(CycleInfo));
-
-    for (int i = 0; i < cache->size; i++) {
-        CycleInfo *cycle = &cache->cycles[i];
-
-        cycle->num = cycle->drop = Unknown;
-
-        cycle->metrics = (VDInfo *)malloc(vdm->inCycle * sizeof(VDInfo));
-        for (int j = 0; j < vdm->inCycle; j++)
-            cycle->metrics[j].maxbdiff = cycle->metrics[j].totdiff = Unknown;
-
-        if (!vdm->dryrun) {
-            cycle->durations = (FrameDuration *)malloc(vdm->outCycle * sizeof(FrameDuration));
-            memset(cycle->durations, 0, vdm->outCycle * sizeof(FrameDuration));
-        }
-    }
-}
-
-static void freeCache(CycleCache *cache) {
-    if (!cache->cycles)
-        return;
-
-    for (int i = 0; i < cache->size; i++) {
-        CycleInfo *cycle = &cache->cycles[i];
-
-        free(cycle->metrics);
-        if (cycle->durations)
-            free(cycle->durations);
-    }
-
-    free(cache->cycles);
-    cache->cycles = NULL;
-    cache->size = 0;
-}
-
-CycleInfo *getCycleFromCache(int cycleNum, CycleCache *cache, VDecimateData *vdm) {
-    int index = -1;
-
-    // Find the requested cycle.
-    for (int i = 0; i < cache->size; i++) {
-        if (cache->cycles[i].num == cycleNum) {
-            index = i;
-            break;
-        }
-    }
-
-    // The requested cycle was not found, so reuse the last cycle in the cache.
-    if (index == -1)
-        index = cache->size - 1;
-
-    // If the requested cycle is close to the end, move it to the top.
-    if (index > cache->size / 3 * 2) {
-        CycleInfo temp = cache->cycles[index];
-        memmove(&cache->cycles[1], &cache->cycles[0], index * sizeof(CycleInfo));
-        cache->cycles[0] = temp;
-
-        index = 0;
-    }
-
-    CycleInfo *cycle = &cache->cycles[index];
-
-    // Reset it if needed.
-    if (cycle->num != cycleNum) {
-        cycle->num = cycleNum;
-
-        cycle->drop = Unknown;
-
-        for (int i = 0; i < vdm->inCycle; i++)
-            cycle->metrics[i].maxbdiff = cycle->metrics[i].totdiff = Unknown;
-        if (cycle->durations)
-            memset(cycle->durations, 0, vdm->outCycle * sizeof(FrameDuration));
+static FILE *vdecimateOpenFile(const char *filename, const char *mode) {
+#ifdef _WIN32
+    FILE *f = NULL;
+    wchar_t wmode[4] = { 0 };
+    int len, ret;
+    wchar_t *filename_wc;
+    for (len = 0; mode[len] && len < 3; len++)
+        wmode[len] = mode[len];
+    len = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+    filename_wc = malloc(len * sizeof(wchar_t));
+    if (filename_wc) {
+        ret = MultiByteToWideChar(CP_UTF8, 0, filename, -1, filename_wc, len);
+        if (ret == len)
+            f = _wfopen(filename_wc, wmode);
+        free(filename_wc);
     }
-
-    return cycle;
+    return f;
+#else
+    return fopen(filename, mode);
+#endif
 }
 
-static int64_t calcMetric(const VSFrameRef *f1, const VSFrameRef *f2, int64_t *totdiff, VDecimateData *vdm, const VSAPI *vsapi) {
-    int64_t *bdiffs = vdm->bdiffs;
+// Differences are summed per column over a row of half blocks first so all the per pixel work is in simple loops
+static int64_t calcMetric(const VSFrameRef *f1, const VSFrameRef *f2, int64_t *totdiff, int64_t *bdiffs, uint32_t *colsums, const VDMetricsData *vdm, const VSAPI *vsapi) {
     int numplanes = vdm->chroma ? 3 : 1;
     int64_t maxdiff = -1;
     memset(bdiffs, 0, vdm->bdiffsize * sizeof(int64_t));
@@ -1151,29 +1098,29 @@ static int64_t calcMetric(const VSFrameRef *f1, const VSFrameRef *f2, int64_t *t
             hblocky /= 1 << fi->subSamplingH;
         }
 
+        memset(colsums, 0, width * sizeof(uint32_t));
+
         for (int y = 0; y < height; y++) {
-            int ydest = y / hblocky;
-            int xdest = 0;
-            // some slight code duplication to not put an if statement for 8/16 bit processing in the inner loop
             if (fi->bitsPerSample == 8) {
-                for (int x = 0; x < width; x+= hblockx) {
-                    int acc = 0;
-                    int m = VSMIN(width, x + hblockx);
-                    for (int xl = x; xl < m; xl++)
-                        acc += abs(f1p[xl] - f2p[xl]);
-                    bdiffs[ydest * nxblocks + xdest] += acc;
-                    xdest++;
-                }
+                for (int x = 0; x < width; x++)
+                    colsums[x] += abs(f1p[x] - f2p[x]);
             } else {
-                for (int x = 0; x < width; x+= hblockx) {
-                    int acc = 0;
+                for (int x = 0; x < width; x++)
+                    colsums[x] += abs(((const uint16_t *)f1p)[x] - ((const uint16_t *)f2p)[x]);
+            }
+
+            if ((y + 1) % hblocky == 0 || y == height - 1) {
+                int64_t *dst = bdiffs + (y / hblocky) * nxblocks;
+                for (int x = 0; x < width; x += hblockx) {
+                    int64_t acc = 0;
                     int m = VSMIN(width, x + hblockx);
                     for (int xl = x; xl < m; xl++)
-                        acc += abs(((const uint16_t *)f1p)[xl] - ((const uint16_t *)f2p)[xl]);
-                    bdiffs[ydest * nxblocks + xdest] += acc;
-                    xdest++;
+                        acc += colsums[xl];
+                    *dst++ += acc;
                 }
+                memset(colsums, 0, width * sizeof(uint32_t));
             }
+
             f1p += stride;
             f2p += stride;
         }
@@ -1193,25 +1140,91 @@ static int64_t calcMetric(const VSFrameRef *f1, const VSFrameRef *f2, int64_t *t
     return maxdiff;
 }
 
+// The metrics are calculated in a separate parallel filter so all frames of a cycle are processed at the same time
+
+static void VS_CC vdmetricsInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
+    VDMetricsData *vdm = (VDMetricsData *)*instanceData;
+    vsapi->setVideoInfo(vdm->vi, 1, node);
+}
+
+static const VSFrameRef *VS_CC vdmetricsGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    const VDMetricsData *vdm = (const VDMetricsData *)*instanceData;
+
+    if (activationReason == arInitial) {
+        if (n > 0)
+            vsapi->requestFrameFilter(n - 1, vdm->node, frameCtx);
+        vsapi->requestFrameFilter(n, vdm->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrameRef *prv = vsapi->getFrameFilter(VSMAX(n - 1, 0), vdm->node, frameCtx);
+        const VSFrameRef *cur = vsapi->getFrameFilter(n, vdm->node, frameCtx);
+        int64_t *bdiffs = (int64_t *)malloc(vdm->bdiffsize * sizeof(int64_t));
+        uint32_t *colsums = (uint32_t *)malloc(vdm->vi->width * sizeof(uint32_t));
+        int64_t totdiff;
+        int64_t maxbdiff = calcMetric(prv, cur, &totdiff, bdiffs, colsums, vdm, vsapi);
+        free(bdiffs);
+        free(colsums);
+        vsapi->freeFrame(prv);
+
+        VSFrameRef *dst = vsapi->copyFrame(cur, core);
+        vsapi->freeFrame(cur);
+        VSMap *dstProps = vsapi->getFramePropsRW(dst);
+        vsapi->propSetInt(dstProps, "VDecimateMaxBlockDiff", maxbdiff, paReplace);
+        vsapi->propSetInt(dstProps, "VDecimateTotalDiff", totdiff, paReplace);
+        return dst;
+    }
+
+    return NULL;
+}
+
+static void VS_CC vdmetricsFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    VDMetricsData *vdm = (VDMetricsData *)instanceData;
+    vsapi->freeNode(vdm->node);
+    free(vdm);
+}
+
+// A missing file isn't an error, it will be created when the filter is freed
+static int vdecimateLoadMetrics(const char *filename, const VDMetricsHeader *expected, VDInfo *metrics, char *err, size_t errlen) {
+    VDMetricsHeader header;
+    FILE *f = vdecimateOpenFile(filename, "rb");
+    if (!f)
+        return 0;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, MetricsMagic, sizeof(header.magic)) || header.version != MetricsVersion) {
+        snprintf(err, errlen, "VDecimate: %s is not a metrics file", filename);
+        fclose(f);
+        return 1;
+    }
+
+    if (memcmp(&header, expected, sizeof(header))) {
+        snprintf(err, errlen, "VDecimate: the metrics file was created from a different clip or with different chroma, blockx or blocky settings");
+        fclose(f);
+        return 1;
+    }
+
+    if (fread(metrics, sizeof(VDInfo), header.numFrames, f) != (size_t)header.numFrames) {
+        snprintf(err, errlen, "VDecimate: the metrics file is truncated");
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void vdecimateSaveMetrics(const char *filename, const VDMetricsHeader *header, const VDInfo *metrics) {
+    FILE *f = vdecimateOpenFile(filename, "wb");
+    if (!f)
+        return;
+    fwrite(header, sizeof(*header), 1, f);
+    fwrite(metrics, sizeof(VDInfo), header->numFrames, f);
+    fclose(f);
+}
+
 static int vdecimateLoadOVR(const char *ovrfile, char *drop, int cycle, int numFrames, char *err, size_t errlen) {
     int line = 0;
     char buf[80];
     char* pos;
-#ifdef _WIN32
-    FILE* moo = NULL;
-    int len, ret;
-    wchar_t *ovrfile_wc;
-    len = MultiByteToWideChar(CP_UTF8, 0, ovrfile, -1, NULL, 0);
-    ovrfile_wc = malloc(len * sizeof(wchar_t));
-    if (ovrfile_wc) {
-        ret = MultiByteToWideChar(CP_UTF8, 0, ovrfile, -1, ovrfile_wc, len);
-        if (ret == len)
-            moo = _wfopen(ovrfile_wc, L"rb");
-        free(ovrfile_wc);
-    }
-#else
-    FILE* moo = fopen(ovrfile, "r");
-#endif
+    FILE* moo = vdecimateOpenFile(ovrfile, "rb");
     if (!moo) {
         snprintf(err, errlen, "VDecimate: can't open ovr file");
         return 1;
@@ -1360,43 +1373,64 @@ static void calculateNewDurations(const FrameDuration *oldDurations, FrameDurati
     }
 }
 
-static inline void getCycleBoundaries(int n, int *cyclestart, int *cycleend, VDecimateData *vdm) {
+static inline void getCycleBoundaries(int n, int *cyclestart, int *cycleend, const VDecimateData *vdm) {
     *cyclestart = (n / vdm->outCycle) * vdm->inCycle;
     *cycleend = *cyclestart + vdm->inCycle;
     if (*cycleend > vdm->inputNumFrames)
         *cycleend = vdm->inputNumFrames;
 }
 
+static int cycleHasMetrics(int cyclestart, int cycleend, const VDecimateData *vdm) {
+    for (int i = cyclestart; i < cycleend; i++)
+        if (vdm->metrics[i].totdiff == Unknown)
+            return 0;
+    return 1;
+}
+
+static void getCycleMetrics(VDInfo *cycle, int cyclestart, int cycleend, const VDecimateData *vdm) {
+    memcpy(cycle, vdm->metrics + cyclestart, (cycleend - cyclestart) * sizeof(VDInfo));
+
+    // The first frame's metrics are always 0, thus it's always considered a duplicate.
+    // Unless we do something about it. Only done on the copy since it depends on scthresh
+    // and the stored metrics are reused with other thresholds.
+    if (cyclestart == 0 && cycleend > 1) {
+        cycle[0].maxbdiff = cycle[1].maxbdiff;
+        cycle[0].totdiff = vdm->scthresh + 1;
+    }
+}
+
 static const VSFrameRef *VS_CC vdecimateGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     VDecimateData *vdm = (VDecimateData *)*instanceData;
+    VSNodeRef *outputNode = vdm->clip2 ? vdm->clip2 : vdm->node;
 
     if (activationReason == arInitial) {
         int cyclestart, cycleend;
 
         getCycleBoundaries(n, &cyclestart, &cycleend, vdm);
 
-        CycleInfo *cycle = getCycleFromCache(cyclestart / vdm->inCycle, &vdm->cache, vdm);
-
-        if (vdm->drop && vdm->drop[cyclestart / vdm->inCycle] != Unknown)
-            cycle->drop = vdm->drop[cyclestart / vdm->inCycle];
-
-        if (cycle->drop == Unknown || (vdm->dryrun && cycle->metrics[0].totdiff == Unknown)) {
-            if (cyclestart > 0)
-                vsapi->requestFrameFilter(cyclestart - 1, vdm->node, frameCtx);
+        int cycleNum = cyclestart / vdm->inCycle;
+        FrameDuration *durations = vdm->durations ? vdm->durations + cycleNum * vdm->outCycle : NULL;
 
+        if ((vdm->drop[cycleNum] == Unknown || vdm->dryrun) && !cycleHasMetrics(cyclestart, cycleend, vdm)) {
             for (int i = cyclestart; i < cycleend; i++)
-                vsapi->requestFrameFilter(i, vdm->node, frameCtx);
+                if (vdm->metrics[i].totdiff == Unknown)
+                    vsapi->requestFrameFilter(i, vdm->metricsNode, frameCtx);
         }
 
-        if (cycle->drop != Unknown) {
-            int outputFrame = findOutputFrame(n, cyclestart, vdm->outCycle, cycle->drop, vdm->dryrun);
+        if (vdm->drop[cycleNum] != Unknown) {
+            int outputFrame = findOutputFrame(n, cyclestart, vdm->outCycle, vdm->drop[cycleNum], vdm->dryrun);
 
-            vsapi->requestFrameFilter(outputFrame, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
+            vsapi->requestFrameFilter(outputFrame, outputNode, frameCtx);
+        } else if (vdm->dryrun) {
+            vsapi->requestFrameFilter(n, outputNode, frameCtx);
+        } else {
+            for (int i = cyclestart; i < cycleend; i++)
+                vsapi->requestFrameFilter(i, outputNode, frameCtx);
         }
 
-        if (!vdm->dryrun && cycle->durations[n % vdm->outCycle].den == 0)
+        if (!vdm->dryrun && durations[n % vdm->outCycle].den == 0)
             for (int i = cyclestart; i < cycleend; i++)
-                vsapi->requestFrameFilter(i, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
+                vsapi->requestFrameFilter(i, outputNode, frameCtx);
 
         return NULL;
     }
@@ -1406,40 +1440,37 @@ static const VSFrameRef *VS_CC vdecimateGetFrame(int n, int activationReason, vo
 
         getCycleBoundaries(n, &cyclestart, &cycleend, vdm);
 
-        CycleInfo *cycle = getCycleFromCache(cyclestart / vdm->inCycle, &vdm->cache, vdm);
-
-        if (vdm->drop && vdm->drop[cyclestart / vdm->inCycle] != Unknown)
-            cycle->drop = vdm->drop[cyclestart / vdm->inCycle];
+        int cycleNum = cyclestart / vdm->inCycle;
+        FrameDuration *durations = vdm->durations ? vdm->durations + cycleNum * vdm->outCycle : NULL;
 
-        if (cycle->drop == Unknown || (vdm->dryrun && cycle->metrics[0].totdiff == Unknown)) {
-            // Calculate metrics
+        if ((vdm->drop[cycleNum] == Unknown || vdm->dryrun) && !cycleHasMetrics(cyclestart, cycleend, vdm)) {
+            // Collect the metrics, another request for the same cycle may already have filled in some of them
             for (int i = cyclestart; i < cycleend; i++) {
-                const VSFrameRef *prv = vsapi->getFrameFilter(VSMAX(i - 1, 0), vdm->node, frameCtx);
-                const VSFrameRef *cur = vsapi->getFrameFilter(i, vdm->node, frameCtx);
-                cycle->metrics[i - cyclestart].maxbdiff = calcMetric(prv, cur, &cycle->metrics[i - cyclestart].totdiff, vdm, vsapi);
-                vsapi->freeFrame(prv);
-                vsapi->freeFrame(cur);
-            }
-
-            // The first frame's metrics are always 0, thus it's always considered a duplicate.
-            // Unless we do something about it.
-            if (cyclestart == 0) {
-                cycle->metrics[0].maxbdiff = cycle->metrics[1].maxbdiff;
-                cycle->metrics[0].totdiff = vdm->scthresh + 1;
+                if (vdm->metrics[i].totdiff == Unknown) {
+                    const VSFrameRef *frame = vsapi->getFrameFilter(i, vdm->metricsNode, frameCtx);
+                    const VSMap *frameProps = vsapi->getFramePropsRO(frame);
+                    vdm->metrics[i].maxbdiff = vsapi->propGetInt(frameProps, "VDecimateMaxBlockDiff", 0, NULL);
+                    vdm->metrics[i].totdiff = vsapi->propGetInt(frameProps, "VDecimateTotalDiff", 0, NULL);
+                    vsapi->freeFrame(frame);
+                }
             }
 
-            if (cycle->drop == Unknown) {
-                cycle->drop = findDropFrame(cycle->metrics, cycleend - cyclestart, vdm->scthresh, vdm->dupthresh);
-                if (vdm->drop)
-                    vdm->drop[cyclestart / vdm->inCycle] = cycle->drop;
-            }
+            vdm->metricsChanged = 1;
         }
 
-        if (!vdm->dryrun && cycle->durations[n % vdm->outCycle].den == 0) {
+        VDInfo cycle[MaxCycleLength];
+        getCycleMetrics(cycle, cyclestart, cycleend, vdm);
+
+        if (vdm->drop[cycleNum] == Unknown)
+            vdm->drop[cycleNum] = findDropFrame(cycle, cycleend - cyclestart, vdm->scthresh, vdm->dupthresh);
+
+        int drop = vdm->drop[cycleNum];
+
+        if (!vdm->dryrun && durations[n % vdm->outCycle].den == 0) {
             FrameDuration oldDurations[MaxCycleLength];
 
             for (int i = cyclestart; i < cyclestart + vdm->inCycle; i++) {
-                const VSFrameRef *frame = vsapi->getFrameFilter(i, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
+                const VSFrameRef *frame = vsapi->getFrameFilter(i, outputNode, frameCtx);
                 const VSMap *frameProps = vsapi->getFramePropsRO(frame);
                 int err;
                 oldDurations[i % vdm->inCycle].num = vsapi->propGetInt(frameProps, "_DurationNum", 0, &err);
@@ -1447,24 +1478,24 @@ static const VSFrameRef *VS_CC vdecimateGetFrame(int n, int activationReason, vo
                 vsapi->freeFrame(frame);
             }
 
-            calculateNewDurations(oldDurations, cycle->durations, vdm->inCycle, cycle->drop);
+            calculateNewDurations(oldDurations, durations, vdm->inCycle, drop);
         }
 
-        int outputFrame = findOutputFrame(n, cyclestart, vdm->outCycle, cycle->drop, vdm->dryrun);
+        int outputFrame = findOutputFrame(n, cyclestart, vdm->outCycle, drop, vdm->dryrun);
 
-        const VSFrameRef *src = vsapi->getFrameFilter(outputFrame, vdm->clip2 ? vdm->clip2 : vdm->node, frameCtx);
+        const VSFrameRef *src = vsapi->getFrameFilter(outputFrame, outputNode, frameCtx);
         VSFrameRef *dst = vsapi->copyFrame(src, core);
         vsapi->freeFrame(src);
         VSMap *dstProps = vsapi->getFramePropsRW(dst);
 
         if (vdm->dryrun) {
-            vsapi->propSetInt(dstProps, "VDecimateDrop", outputFrame % vdm->inCycle == cycle->drop, paReplace);
-            vsapi->propSetInt(dstProps, "VDecimateTotalDiff", cycle->metrics[outputFrame % vdm->inCycle].totdiff, paReplace);
-            vsapi->propSetInt(dstProps, "VDecimateMaxBlockDiff", cycle->metrics[outputFrame % vdm->inCycle].maxbdiff, paReplace);
+            vsapi->propSetInt(dstProps, "VDecimateDrop", outputFrame % vdm->inCycle == drop, paReplace);
+            vsapi->propSetInt(dstProps, "VDecimateTotalDiff", cycle[outputFrame - cyclestart].totdiff, paReplace);
+            vsapi->propSetInt(dstProps, "VDecimateMaxBlockDiff", cycle[outputFrame - cyclestart].maxbdiff, paReplace);
         } else {
-            if (cycle->durations[n % vdm->outCycle].den > 0) {
-                vsapi->propSetInt(dstProps, "_DurationNum", cycle->durations[n % vdm->outCycle].num, paReplace);
-                vsapi->propSetInt(dstProps, "_DurationDen", cycle->durations[n % vdm->outCycle].den, paReplace);
+            if (durations[n % vdm->outCycle].den > 0) {
+                vsapi->propSetInt(dstProps, "_DurationNum", durations[n % vdm->outCycle].num, paReplace);
+                vsapi->propSetInt(dstProps, "_DurationDen", durations[n % vdm->outCycle].den, paReplace);
             }
         }
 
@@ -1476,29 +1507,34 @@ static const VSFrameRef *VS_CC vdecimateGetFrame(int n, int activationReason, vo
 
 static void VS_CC vdecimateFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     VDecimateData *vdm = (VDecimateData *)instanceData;
+    if (vdm->metricsFile && vdm->metricsChanged)
+        vdecimateSaveMetrics(vdm->metricsFile, &vdm->metricsHeader, vdm->metrics);
     vsapi->freeNode(vdm->node);
     vsapi->freeNode(vdm->clip2);
-    free(vdm->bdiffs);
-    if (vdm->drop)
-        free(vdm->drop);
-    freeCache(&vdm->cache);
+    vsapi->freeNode(vdm->metricsNode);
+    free(vdm->metrics);
+    free(vdm->drop);
+    free(vdm->durations);
+    free(vdm->metricsFile);
     free(vdm);
 }
 
 static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     VDecimateData vdm;
+    VDMetricsData md;
     memset(&vdm, 0, sizeof(vdm));
+    memset(&md, 0, sizeof(md));
     int err;
 
     vdm.inCycle = int64ToIntS(vsapi->propGetInt(in, "cycle", 0, &err));
     if (err)
         vdm.inCycle = 5;
-    vdm.blockx = int64ToIntS(vsapi->propGetInt(in, "blockx", 0, &err));
+    md.blockx = int64ToIntS(vsapi->propGetInt(in, "blockx", 0, &err));
     if (err)
-        vdm.blockx = 32;
-    vdm.blocky = int64ToIntS(vsapi->propGetInt(in, "blocky", 0, &err));
+        md.blockx = 32;
+    md.blocky = int64ToIntS(vsapi->propGetInt(in, "blocky", 0, &err));
     if (err)
-        vdm.blocky = 32;
+        md.blocky = 32;
     double dupthresh = vsapi->propGetFloat(in, "dupthresh", 0, &err);
     if (err)
         dupthresh = 1.1;
@@ -1511,7 +1547,7 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
         return;
     }
 
-    if (vdm.blockx < 4 || vdm.blockx > 512 || !isPowerOf2(vdm.blockx) || vdm.blocky < 4 || vdm.blocky > 512 || !isPowerOf2(vdm.blocky)) {
+    if (md.blockx < 4 || md.blockx > 512 || !isPowerOf2(md.blockx) || md.blocky < 4 || md.blocky > 512 || !isPowerOf2(md.blocky)) {
         vsapi->setError(out, "VDecimate: invalid blocksize, must be between 4 and 512 and be a power of 2");
         return;
     }
@@ -1545,16 +1581,16 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
         return;
     }
 
-    vdm.chroma = !!vsapi->propGetInt(in, "chroma", 0, &err);
+    md.chroma = !!vsapi->propGetInt(in, "chroma", 0, &err);
     if (err)
-        vdm.chroma = vi->format->colorFamily != cmGray;
+        md.chroma = vi->format->colorFamily != cmGray;
     else {
-        if (vdm.chroma && vi->format->colorFamily == cmGray) {
+        if (md.chroma && vi->format->colorFamily == cmGray) {
             vsapi->setError(out, "VDecimate: it makes no sense to enable chroma when the input clip is grayscale");
             vsapi->freeNode(vdm.node);
             vsapi->freeNode(vdm.clip2);
             return;
-        } else if (!vdm.chroma && vi->format->colorFamily == cmRGB) {
+        } else if (!md.chroma && vi->format->colorFamily == cmRGB) {
             vsapi->setError(out, "VDecimate: it makes no sense to disable chroma when the input clip is RGB");
             vsapi->freeNode(vdm.node);
             vsapi->freeNode(vdm.clip2);
@@ -1562,34 +1598,61 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
         }
     }
 
-    vdm.ovrfile = vsapi->propGetData(in, "ovr", 0, &err);
+    const char *ovrfile = vsapi->propGetData(in, "ovr", 0, &err);
+    const char *metricsFile = vsapi->propGetData(in, "metrics", 0, &err);
 
     vdm.dryrun = !!vsapi->propGetInt(in, "dryrun", 0, &err);
 
     int max_value = (1 << vi->format->bitsPerSample) - 1;
     // Casting max_value to int64_t to avoid losing the high 32 bits of the result
     vdm.scthresh = (int64_t)(((int64_t)max_value * vi->width * vi->height * scthresh)/100);
-    vdm.dupthresh = (int64_t)((max_value * vdm.blockx * vdm.blocky * dupthresh)/100);
+    vdm.dupthresh = (int64_t)((max_value * md.blockx * md.blocky * dupthresh)/100);
+
+    vdm.inputNumFrames = vdm.vi.numFrames;
+    vdm.numCycles = vdm.inputNumFrames / vdm.inCycle + 1;
 
-    vdm.nxblocks = (vdm.vi.width + vdm.blockx/2 - 1)/(vdm.blockx/2);
-    vdm.nyblocks = (vdm.vi.height + vdm.blocky/2 - 1)/(vdm.blocky/2);
-    vdm.bdiffsize = vdm.nxblocks * vdm.nyblocks;
-    vdm.bdiffs = (int64_t *)malloc(vdm.bdiffsize * sizeof(int64_t));
+    vdm.metrics = (VDInfo *)malloc(vdm.inputNumFrames * sizeof(VDInfo));
+    for (int i = 0; i < vdm.inputNumFrames; i++)
+        vdm.metrics[i].maxbdiff = vdm.metrics[i].totdiff = Unknown;
 
-    if (vdm.ovrfile) {
-        vdm.drop = (char *)malloc(vdm.vi.numFrames / vdm.inCycle + 1);
-        memset(vdm.drop, Unknown, vdm.vi.numFrames / vdm.inCycle + 1);
+    vdm.drop = (char *)malloc(vdm.numCycles);
+    memset(vdm.drop, Unknown, vdm.numCycles);
 
-        char err[80];
+    char errmsg[200];
 
-        if (vdecimateLoadOVR(vdm.ovrfile, vdm.drop, vdm.inCycle, vdm.vi.numFrames, err, sizeof(err))) {
+    if (ovrfile && vdecimateLoadOVR(ovrfile, vdm.drop, vdm.inCycle, vdm.inputNumFrames, errmsg, sizeof(errmsg))) {
+        free(vdm.metrics);
+        free(vdm.drop);
+        vsapi->freeNode(vdm.node);
+        vsapi->freeNode(vdm.clip2);
+        vsapi->setError(out, errmsg);
+        return;
+    }
+
+    if (metricsFile) {
+        VDMetricsHeader *header = &vdm.metricsHeader;
+        memset(header, 0, sizeof(*header));
+        memcpy(header->magic, MetricsMagic, sizeof(header->magic));
+        header->version = MetricsVersion;
+        header->numFrames = vi->numFrames;
+        header->width = vi->width;
+        header->height = vi->height;
+        header->format = vi->format->id;
+        header->chroma = md.chroma;
+        header->blockx = md.blockx;
+        header->blocky = md.blocky;
+
+        if (vdecimateLoadMetrics(metricsFile, header, vdm.metrics, errmsg, sizeof(errmsg))) {
+            free(vdm.metrics);
             free(vdm.drop);
-            free(vdm.bdiffs);
             vsapi->freeNode(vdm.node);
             vsapi->freeNode(vdm.clip2);
-            vsapi->setError(out, err);
+            vsapi->setError(out, errmsg);
             return;
         }
+
+        vdm.metricsFile = (char *)malloc(strlen(metricsFile) + 1);
+        strcpy(vdm.metricsFile, metricsFile);
     }
 
     if (vdm.dryrun)
@@ -1597,8 +1660,8 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
     else
         vdm.outCycle = vdm.inCycle - 1;
 
-    vdm.inputNumFrames = vdm.vi.numFrames;
     if (!vdm.dryrun) {
+        vdm.durations = (FrameDuration *)calloc(vdm.numCycles * vdm.outCycle, sizeof(FrameDuration));
         vdm.tail = vdm.vi.numFrames % vdm.inCycle;
         vdm.vi.numFrames /= vdm.inCycle;
         vdm.vi.numFrames *= vdm.outCycle;
@@ -1607,7 +1670,18 @@ static void VS_CC createVDecimate(const VSMap *in, VSMap *out, void *userData, V
             muldivRational(&vdm.vi.fpsNum, &vdm.vi.fpsDen, vdm.outCycle, vdm.inCycle);
     }
 
-    initCache(&vdm.cache, &vdm);
+    md.node = vsapi->cloneNodeRef(vdm.node);
+    md.vi = vi;
+    md.nxblocks = (vi->width + md.blockx/2 - 1)/(md.blockx/2);
+    md.nyblocks = (vi->height + md.blocky/2 - 1)/(md.blocky/2);
+    md.bdiffsize = md.nxblocks * md.nyblocks;
+
+    VDMetricsData *mdd = (VDMetricsData *)malloc(sizeof(md));
+    *mdd = md;
+    VSMap *tmp = vsapi->createMap();
+    vsapi->createFilter(in, tmp, "VDecimateMetrics", vdmetricsInit, vdmetricsGetFrame, vdmetricsFree, fmParallel, nfNoCache, mdd, core);
+    vdm.metricsNode = vsapi->propGetNode(tmp, "clip", 0, 0);
+    vsapi->freeMap(tmp);
 
     VDecimateData *d = (VDecimateData *)malloc(sizeof(vdm));
     *d = vdm;
@@ -1649,5 +1723,6 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
                  "clip2:clip:opt;"
                  "ovr:data:opt;"
                  "dryrun:int:opt;"
+                 "metrics:data:opt;"
                  , createVDecimate, NULL, plugin);
 }
@@ -30,10 +30,20 @@
 #include <chrono>
 #include <locale>
 #include <sstream>
+#include <deque>
+#include <thread>
+#include <atomic>
 #ifdef VS_TARGET_OS_WINDOWS
 #include <codecvt>
 #include <io.h>
 #include <fcntl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
 #endif
 
 #define __STDC_FORMAT_MACROS
@@ -64,25 +74,75 @@ std::string nstringToUtf8(const nstring &s) {
     std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
     return conversion.to_bytes(s);
 }
+nstring utf8ToNstring(const std::string &s) {
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conversion;
+    return conversion.from_bytes(s);
+}
 #else
 typedef std::string nstring;
 #define NSTRING(x) x
 std::string nstringToUtf8(const nstring &s) {
     return s;
 }
+nstring utf8ToNstring(const std::string &s) {
+    return s;
+}
 #endif
 
 static const VSAPI *vsapi = nullptr;
 static VSScript *se = nullptr;
-static VSNodeRef *node = nullptr;
-static FILE *outFile = nullptr;
 static FILE *timecodesFile = nullptr;
 
+// Everything needed to write one script output or one chunk of it to one file,
+// all outputs are rendered in the same pass
+struct Output {
+    int index;
+    nstring filename;
+    VSNodeRef *node = nullptr;
+    FILE *file = nullptr;
+    // only the primary output writes timecodes
+    FILE *timecodes = nullptr;
+    // chunks open their file when they're started and close it after the last frame
+    bool chunk = false;
+    // frames before outputStart are only requested to warm up temporal filters and then discarded
+    int requestStart = 0;
+    int outputStart = 0;
+    int endFrame = 0;
+    int nextRequest = 0;
+    int outputFrames = 0;
+
+    // Completed frames wait in a ring indexed by frame number until all earlier frames are done,
+    // no frame more than reorderWindow frames past the oldest pending one is ever requested
+    std::vector<const VSFrameRef *> reorderBuffer;
+    int reorderBuffered = 0;
+
+    // Frames are handed over in order to a separate writer thread so the frame done
+    // callback never blocks on output unless the queue is full
+    std::deque<std::pair<int, const VSFrameRef *>> writeQueue;
+    bool writerStop = false;
+    std::atomic<bool> writeFailed{false};
+    std::string writeErrorMessage;
+    std::condition_variable writeCondition;
+    std::condition_variable writeSpaceCondition;
+    std::mutex writeMutex;
+    std::thread writer;
+};
+
+// The first output is the one selected with --outputindex and written to outfile,
+// in chunk mode there is one output per chunk instead
+static std::deque<Output> outputs;
+// Outputs that still have frames left to request
+static std::vector<Output *> activeOutputs;
+static size_t nextOutput = 0;
+static bool chunkMode = false;
+static int parallelChunks = 1;
+static int chunkOverlap = 0;
+
 static int requests = 0;
 static int outputIndex = 0;
-static int outputFrames = 0;
 static int requestedFrames = 0;
 static int completedFrames = 0;
+static int totalRequests = 0;
 static int totalFrames = -1;
 static int startFrame = 0;
 static bool y4m = false;
@@ -94,12 +154,17 @@ static bool showVersion = false;
 static bool printFrameNumber = false;
 static double fps = 0;
 static bool hasMeaningfulFps = false;
-static std::map<int, const VSFrameRef *> reorderMap;
+static int pipeSize = 0;
+
+static int reorderWindow = 0;
+static int reorderPeak = 0;
+static int reorderStalls = 0;
+
+static size_t writeQueueSize = 1;
 
 static std::string errorMessage;
 static std::condition_variable condition;
 static std::mutex mutex;
-static std::vector<uint8_t> buffer;
 
 static std::chrono::time_point<std::chrono::high_resolution_clock> start;
 static std::chrono::time_point<std::chrono::high_resolution_clock> lastFpsReportTime;
@@ -122,124 +187,208 @@ static inline void addRational(int64_t *num, int64_t *den, int64_t addnum, int64
     }
 }
 
-static void VS_CC frameDoneCallback(void *userData, const VSFrameRef *f, int n, VSNodeRef *, const char *errorMsg) {
-    completedFrames++;
+static std::string describeOutput(const Output &o) {
+    if (o.chunk)
+        return " (chunk " + nstringToUtf8(o.filename) + ")";
+    else if (outputs.size() > 1)
+        return " (output " + std::to_string(o.index) + ")";
+    return std::string();
+}
 
-    if (printFrameNumber) {
-        std::chrono::time_point<std::chrono::high_resolution_clock> currentTime(std::chrono::high_resolution_clock::now());
-        std::chrono::duration<double> elapsedSeconds = currentTime - lastFpsReportTime;
-        if (elapsedSeconds.count() > 10) {
-            hasMeaningfulFps = true;
-            fps = (completedFrames - lastFpsReportFrame) / elapsedSeconds.count();
-            lastFpsReportTime = currentTime;
-            lastFpsReportFrame = completedFrames;
+struct WriteSpan {
+    const uint8_t *ptr;
+    size_t size;
+};
+
+// Writes all spans in as few system calls as possible, the spans are consumed in the process
+static bool writeSpans(FILE *file, std::vector<WriteSpan> &spans) {
+#ifdef VS_TARGET_OS_WINDOWS
+    for (const WriteSpan &span : spans)
+        if (fwrite(span.ptr, 1, span.size, file) != span.size)
+            return false;
+    return true;
+#else
+#ifdef IOV_MAX
+    const int maxIovecs = std::min(IOV_MAX, 1024);
+#else
+    const int maxIovecs = 1024;
+#endif
+    iovec iov[1024];
+    int fd = fileno(file);
+    size_t current = 0;
+
+    while (current < spans.size()) {
+        int count = 0;
+        for (; count < maxIovecs && current + count < spans.size(); count++) {
+            iov[count].iov_base = const_cast<uint8_t *>(spans[current + count].ptr);
+            iov[count].iov_len = spans[current + count].size;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // Partial writes are normal for pipes so skip ahead to where the write stopped
+        size_t remaining = static_cast<size_t>(written);
+        while (remaining > 0) {
+            if (remaining >= spans[current].size) {
+                remaining -= spans[current].size;
+                current++;
+            } else {
+                spans[current].ptr += remaining;
+                spans[current].size -= remaining;
+                remaining = 0;
+            }
         }
     }
+    return true;
+#endif
+}
 
-    if (f) {
-        if (requestedFrames < totalFrames) {
-            vsapi->getFrameAsync(requestedFrames, node, frameDoneCallback, nullptr);
-            requestedFrames++;
-        }
-
-        reorderMap.insert(std::make_pair(n, f));
-        while (reorderMap.count(outputFrames)) {
-            const VSFrameRef *frame = reorderMap[outputFrames];
-            reorderMap.erase(outputFrames);
-            if (!outputError) {
-                if (y4m && outFile) {
-                    if (fwrite("FRAME\n", 1, 6, outFile) != 6) {
-                        if (errorMessage.empty())
-                            errorMessage = "Error: fwrite() call failed when writing header, errno: " + std::to_string(errno);
-                        totalFrames = requestedFrames;
-                        outputError = true;
-                    }
-                }
+static bool writeFrame(Output &o, const VSFrameRef *frame, int n, std::vector<WriteSpan> &spans) {
+    if (o.file) {
+        spans.clear();
+        if (y4m)
+            spans.push_back({ reinterpret_cast<const uint8_t *>("FRAME\n"), 6 });
+
+        // Gather straight from the frame memory, planes with padding are written row by row
+        const VSFormat *fi = vsapi->getFrameFormat(frame);
+        const int rgbRemap[] = { 1, 2, 0 };
+        for (int rp = 0; rp < fi->numPlanes; rp++) {
+            int p = (fi->colorFamily == cmRGB) ? rgbRemap[rp] : rp;
+            int stride = vsapi->getStride(frame, p);
+            const uint8_t *readPtr = vsapi->getReadPtr(frame, p);
+            size_t rowSize = vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
+            int height = vsapi->getFrameHeight(frame, p);
+
+            if (rowSize == static_cast<size_t>(stride)) {
+                spans.push_back({ readPtr, rowSize * height });
+            } else {
+                for (int y = 0; y < height; y++)
+                    spans.push_back({ readPtr + y * stride, rowSize });
+            }
+        }
 
-                if (!outputError && outFile) {
-                    const VSFormat *fi = vsapi->getFrameFormat(frame);
-                    const int rgbRemap[] = { 1, 2, 0 };
-                    for (int rp = 0; rp < fi->numPlanes; rp++) {
-                        int p = (fi->colorFamily == cmRGB) ? rgbRemap[rp] : rp;
-                        int stride = vsapi->getStride(frame, p);
-                        const uint8_t *readPtr = vsapi->getReadPtr(frame, p);
-                        int rowSize = vsapi->getFrameWidth(frame, p) * fi->bytesPerSample;
-                        int height = vsapi->getFrameHeight(frame, p);
-
-                        if (rowSize != stride) {
-                            vs_bitblt(buffer.data(), rowSize, readPtr, stride, rowSize, height);
-                            readPtr = buffer.data();
-                        }
-
-                        if (fwrite(readPtr, 1, rowSize * height, outFile) != static_cast<size_t>(rowSize * height)) {
-                            if (errorMessage.empty())
-                                errorMessage = "Error: fwrite() call failed when writing frame: " + std::to_string(outputFrames) + ", plane: " + std::to_string(p) +
-                                ", errno: " + std::to_string(errno);
-                            totalFrames = requestedFrames;
-                            outputError = true;
-                            break;
-                        }
-                    }
-                }
+        if (!writeSpans(o.file, spans)) {
+            o.writeErrorMessage = "Error: failed to write frame: " + std::to_string(n) + ", errno: " + std::to_string(errno) + describeOutput(o);
+            return false;
+        }
+    }
+
+    if (o.timecodes) {
+        std::ostringstream stream;
+        stream.imbue(std::locale("C"));
+        stream.setf(std::ios::fixed, std::ios::floatfield);
+        stream << (currentTimecodeNum * 1000 / static_cast<double>(currentTimecodeDen));
+        if (fprintf(o.timecodes, "%s\n", stream.str().c_str()) < 0) {
+            o.writeErrorMessage = "Error: failed to write timecode for frame " + std::to_string(n) + ". errno: " + std::to_string(errno);
+            return false;
+        }
+
+        const VSMap *props = vsapi->getFramePropsRO(frame);
+        int err_num, err_den;
+        int64_t duration_num = vsapi->propGetInt(props, "_DurationNum", 0, &err_num);
+        int64_t duration_den = vsapi->propGetInt(props, "_DurationDen", 0, &err_den);
+
+        if (err_num || err_den) {
+            o.writeErrorMessage = "Error: missing duration at frame " + std::to_string(n);
+            return false;
+        } else if (!duration_den) {
+            o.writeErrorMessage = "Error: duration denominator is zero at frame " + std::to_string(n);
+            return false;
+        }
 
-                if (timecodesFile && !outputError) {
-                    std::ostringstream stream;
-                    stream.imbue(std::locale("C"));
-                    stream.setf(std::ios::fixed, std::ios::floatfield);
-                    stream << (currentTimecodeNum * 1000 / static_cast<double>(currentTimecodeDen));
-                    if (fprintf(timecodesFile, "%s\n", stream.str().c_str()) < 0) {
-                        if (errorMessage.empty())
-                            errorMessage = "Error: failed to write timecode for frame " + std::to_string(outputFrames) + ". errno: " + std::to_string(errno);
-                        totalFrames = requestedFrames;
-                        outputError = true;
-                    } else {
-                        const VSMap *props = vsapi->getFramePropsRO(frame);
-                        int err_num, err_den;
-                        int64_t duration_num = vsapi->propGetInt(props, "_DurationNum", 0, &err_num);
-                        int64_t duration_den = vsapi->propGetInt(props, "_DurationDen", 0, &err_den);
-
-                        if (err_num || err_den || !duration_den) {
-                            if (errorMessage.empty()) {
-                                if (err_num || err_den)
-                                    errorMessage = "Error: missing duration at frame ";
-                                else if (!duration_den)
-                                    errorMessage = "Error: duration denominator is zero at frame ";
-                                errorMessage += std::to_string(outputFrames);
-                            }
-
-                            totalFrames = requestedFrames;
-                            outputError = true;
-                        } else {
-                            addRational(&currentTimecodeNum, &currentTimecodeDen, duration_num, duration_den);
-                        }
-                    }
+        addRational(&currentTimecodeNum, &currentTimecodeDen, duration_num, duration_den);
+    }
+
+    return true;
+}
+
+static void writerLoop(Output *o) {
+    std::vector<WriteSpan> spans;
+    std::unique_lock<std::mutex> lock(o->writeMutex);
+    while (true) {
+        o->writeCondition.wait(lock, [o] { return !o->writeQueue.empty() || o->writerStop; });
+        if (o->writeQueue.empty())
+            break;
+
+        std::pair<int, const VSFrameRef *> item = o->writeQueue.front();
+        o->writeQueue.pop_front();
+        lock.unlock();
+        o->writeSpaceCondition.notify_one();
+
+        // Keep draining after a failure so nothing waiting on the queue gets stuck
+        if (!o->writeFailed && !writeFrame(*o, item.second, item.first, spans))
+            o->writeFailed = true;
+        vsapi->freeFrame(item.second);
+
+        if (item.first == o->endFrame - 1) {
+            // nothing else is queued after the last frame, free the file handle right away
+            // so a long list of chunks doesn't keep them all open
+            if (o->chunk && o->file) {
+                if (fclose(o->file) && !o->writeFailed) {
+                    o->writeErrorMessage = "Error: failed to close output, errno: " + std::to_string(errno) + describeOutput(*o);
+                    o->writeFailed = true;
                 }
+                o->file = nullptr;
             }
-            vsapi->freeFrame(frame);
-            outputFrames++;
-        }
-    } else {
-        outputError = true;
-        totalFrames = requestedFrames;
-        if (errorMessage.empty()) {
-            if (errorMsg)
-                errorMessage = "Error: Failed to retrieve frame " + std::to_string(n) + " with error: " + errorMsg;
-            else
-                errorMessage = "Error: Failed to retrieve frame " + std::to_string(n);
+            break;
         }
+
+        lock.lock();
     }
+}
 
-    if (printFrameNumber && !outputError) {
-        if (hasMeaningfulFps)
-            fprintf(stderr, "Frame: %d/%d (%.2f fps)\r", completedFrames - startFrame, totalFrames - startFrame, fps);
-        else
-            fprintf(stderr, "Frame: %d/%d\r", completedFrames - startFrame, totalFrames - startFrame);
+static void queueFrame(Output &o, int n, const VSFrameRef *frame) {
+    std::unique_lock<std::mutex> lock(o.writeMutex);
+    o.writeSpaceCondition.wait(lock, [&o] { return o.writeQueue.size() < writeQueueSize; });
+    o.writeQueue.push_back(std::make_pair(n, frame));
+    lock.unlock();
+    o.writeCondition.notify_one();
+}
+
+static void startWriter(Output &o) {
+#ifdef F_SETPIPE_SZ
+    if (pipeSize > 0 && o.file) {
+        struct stat st;
+        int fd = fileno(o.file);
+        if (!fstat(fd, &st) && S_ISFIFO(st.st_mode) && fcntl(fd, F_SETPIPE_SZ, pipeSize) < 0)
+            fprintf(stderr, "Warning: failed to set pipe size to %d, errno: %d\n", pipeSize, errno);
     }
+#endif
 
-    if (totalFrames == completedFrames) {
-        std::lock_guard<std::mutex> lock(mutex);
-        condition.notify_one();
+    // Everything written after this point bypasses the stdio buffer
+    if (o.file)
+        fflush(o.file);
+
+    o.writer = std::thread(writerLoop, &o);
+}
+
+static void stopWriter(Output &o) {
+    if (!o.writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(o.writeMutex);
+        o.writerStop = true;
     }
+    o.writeCondition.notify_one();
+    o.writer.join();
+
+    if (o.writeFailed) {
+        if (errorMessage.empty())
+            errorMessage = o.writeErrorMessage;
+        outputError = true;
+    }
+}
+
+static bool anyWriteFailed() {
+    for (const Output &o : outputs)
+        if (o.writeFailed)
+            return true;
+    return false;
 }
 
 static std::string floatBitsToLetter(int bits) {
@@ -256,92 +405,235 @@ static std::string floatBitsToLetter(int bits) {
     }
 }
 
-static bool outputNode() {
-    if (requests < 1) {
-        const VSCoreInfo *info = vsapi->getCoreInfo(vsscript_getCore(se));
-        requests = info->numThreads;
-    }
-
-    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+static bool writeY4MHeader(Output &o) {
+    const VSVideoInfo *vi = vsapi->getVideoInfo(o.node);
 
-    if (y4m && (vi->format->colorFamily != cmGray && vi->format->colorFamily != cmYUV)) {
+    if (vi->format->colorFamily != cmGray && vi->format->colorFamily != cmYUV) {
         errorMessage = "Error: Can only apply y4m headers to YUV and Gray format clips";
-        fprintf(stderr, "%s\n", errorMessage.c_str());
         return true;
     }
 
     std::string y4mFormat;
 
-    if (y4m) {
-        if (vi->format->colorFamily == cmGray) {
-            y4mFormat = "mono";
-            if (vi->format->bitsPerSample > 8)
-                y4mFormat = y4mFormat + std::to_string(vi->format->bitsPerSample);
-        } else if (vi->format->colorFamily == cmYUV) {
-            if (vi->format->subSamplingW == 1 && vi->format->subSamplingH == 1)
-                y4mFormat = "420";
-            else if (vi->format->subSamplingW == 1 && vi->format->subSamplingH == 0)
-                y4mFormat = "422";
-            else if (vi->format->subSamplingW == 0 && vi->format->subSamplingH == 0)
-                y4mFormat = "444";
-            else if (vi->format->subSamplingW == 2 && vi->format->subSamplingH == 2)
-                y4mFormat = "410";
-            else if (vi->format->subSamplingW == 2 && vi->format->subSamplingH == 0)
-                y4mFormat = "411";
-            else if (vi->format->subSamplingW == 0 && vi->format->subSamplingH == 1)
-                y4mFormat = "440";
-            else {
-                fprintf(stderr, "No y4m identifier exists for current format\n");
-                return true;
-            }
-
-            if (vi->format->bitsPerSample > 8 && vi->format->sampleType == stInteger)
-                y4mFormat += "p" + std::to_string(vi->format->bitsPerSample);
-            else if (vi->format->sampleType == stFloat)
-                y4mFormat += "p" + floatBitsToLetter(vi->format->bitsPerSample);
-        } else {
-            fprintf(stderr, "No y4m identifier exists for current format\n");
+    if (vi->format->colorFamily == cmGray) {
+        y4mFormat = "mono";
+        if (vi->format->bitsPerSample > 8 && vi->format->sampleType == stInteger)
+            y4mFormat += std::to_string(vi->format->bitsPerSample);
+        else if (vi->format->sampleType == stFloat)
+            y4mFormat += floatBitsToLetter(vi->format->bitsPerSample);
+    } else {
+        if (vi->format->subSamplingW == 1 && vi->format->subSamplingH == 1)
+            y4mFormat = "420";
+        else if (vi->format->subSamplingW == 1 && vi->format->subSamplingH == 0)
+            y4mFormat = "422";
+        else if (vi->format->subSamplingW == 0 && vi->format->subSamplingH == 0)
+            y4mFormat = "444";
+        else if (vi->format->subSamplingW == 2 && vi->format->subSamplingH == 2)
+            y4mFormat = "410";
+        else if (vi->format->subSamplingW == 2 && vi->format->subSamplingH == 0)
+            y4mFormat = "411";
+        else if (vi->format->subSamplingW == 0 && vi->format->subSamplingH == 1)
+            y4mFormat = "440";
+        else {
+            errorMessage = "No y4m identifier exists for current format";
             return true;
         }
+
+        if (vi->format->bitsPerSample > 8 && vi->format->sampleType == stInteger)
+            y4mFormat += "p" + std::to_string(vi->format->bitsPerSample);
+        else if (vi->format->sampleType == stFloat)
+            y4mFormat += "p" + floatBitsToLetter(vi->format->bitsPerSample);
     }
-    if (!y4mFormat.empty())
-        y4mFormat = " C" + y4mFormat;
 
-    std::string header = "YUV4MPEG2" + y4mFormat
+    std::string header = "YUV4MPEG2 C" + y4mFormat
         + " W" + std::to_string(vi->width)
         + " H" + std::to_string(vi->height)
         + " F" + std::to_string(vi->fpsNum) + ":" + std::to_string(vi->fpsDen)
         + " Ip A0:0"
-        + " XLENGTH=" + std::to_string(vi->numFrames) + "\n";
+        + " XLENGTH=" + std::to_string(o.chunk ? o.endFrame - o.outputStart : vi->numFrames) + "\n";
 
-    if (y4m && outFile) {
-        if (fwrite(header.c_str(), 1, header.size(), outFile) != header.size()) {
+    if (o.file) {
+        if (fwrite(header.c_str(), 1, header.size(), o.file) != header.size()) {
             errorMessage = "Error: fwrite() call failed when writing initial header, errno: " + std::to_string(errno);
-            outputError = true;
-            return outputError;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool startOutput(Output &o) {
+    if (o.chunk && o.filename != NSTRING(".")) {
+#ifdef VS_TARGET_OS_WINDOWS
+        o.file = _wfopen(o.filename.c_str(), L"wb");
+#else
+        o.file = fopen(o.filename.c_str(), "wb");
+#endif
+        if (!o.file) {
+            errorMessage = "Error: failed to open chunk output for writing, errno: " + std::to_string(errno);
+            return true;
+        }
+    }
+
+    if (y4m && writeY4MHeader(o))
+        return true;
+
+    o.nextRequest = o.requestStart;
+    o.outputFrames = o.requestStart;
+    o.reorderBuffer.assign(reorderWindow, nullptr);
+    startWriter(o);
+    activeOutputs.push_back(&o);
+    return false;
+}
+
+static void VS_CC frameDoneCallback(void *userData, const VSFrameRef *f, int n, VSNodeRef *, const char *errorMsg);
+
+// Keeps the same number of requests in flight unless that would take an output past its window,
+// all counters are updated before the first request goes out since it may complete immediately
+static void requestFrames() {
+    const size_t maxActiveOutputs = chunkMode ? static_cast<size_t>(parallelChunks) : outputs.size();
+    std::vector<std::pair<int, Output *>> pending;
+
+    while (requestedFrames < totalRequests && requestedFrames - completedFrames < requests) {
+        while (activeOutputs.size() < maxActiveOutputs && nextOutput < outputs.size()) {
+            Output &o = outputs[nextOutput++];
+            if (startOutput(o)) {
+                errorMessage += describeOutput(o);
+                outputError = true;
+                totalRequests = requestedFrames;
+                break;
+            }
+        }
+        if (requestedFrames >= totalRequests)
+            break;
+
+        // The output that is furthest behind goes next. Extra outputs cover the same range so they're
+        // requested in lockstep and filters they share only have to produce each frame once, which
+        // also means one of them reaching its window holds back the rest. Chunks are independent
+        // so a stalled one is simply skipped.
+        Output *next = nullptr;
+        for (Output *o : activeOutputs) {
+            if (chunkMode && o->nextRequest >= o->outputFrames + reorderWindow)
+                continue;
+            if (!next || o->nextRequest - o->requestStart < next->nextRequest - next->requestStart)
+                next = o;
         }
+
+        if (!next || next->nextRequest >= next->outputFrames + reorderWindow) {
+            reorderStalls++;
+            break;
+        }
+
+        pending.push_back(std::make_pair(next->nextRequest, next));
+        requestedFrames++;
+        if (++next->nextRequest == next->endFrame)
+            activeOutputs.erase(std::find(activeOutputs.begin(), activeOutputs.end(), next));
     }
 
-    if (timecodesFile && !outputError) {
+    for (const auto &request : pending)
+        vsapi->getFrameAsync(request.first, request.second->node, frameDoneCallback, request.second);
+}
+
+static void VS_CC frameDoneCallback(void *userData, const VSFrameRef *f, int n, VSNodeRef *, const char *errorMsg) {
+    Output &o = *static_cast<Output *>(userData);
+    completedFrames++;
+
+    if (!outputError && anyWriteFailed()) {
+        totalRequests = requestedFrames;
+        outputError = true;
+    }
+
+    if (printFrameNumber) {
+        std::chrono::time_point<std::chrono::high_resolution_clock> currentTime(std::chrono::high_resolution_clock::now());
+        std::chrono::duration<double> elapsedSeconds = currentTime - lastFpsReportTime;
+        if (elapsedSeconds.count() > 10) {
+            hasMeaningfulFps = true;
+            fps = (completedFrames - lastFpsReportFrame) / elapsedSeconds.count();
+            lastFpsReportTime = currentTime;
+            lastFpsReportFrame = completedFrames;
+        }
+    }
+
+    if (f) {
+        o.reorderBuffer[n % reorderWindow] = f;
+        o.reorderBuffered++;
+        reorderPeak = std::max(reorderPeak, o.reorderBuffered);
+
+        while (o.reorderBuffer[o.outputFrames % reorderWindow]) {
+            const VSFrameRef *frame = o.reorderBuffer[o.outputFrames % reorderWindow];
+            o.reorderBuffer[o.outputFrames % reorderWindow] = nullptr;
+            o.reorderBuffered--;
+            if (!outputError && o.outputFrames >= o.outputStart)
+                queueFrame(o, o.outputFrames, frame);
+            else
+                vsapi->freeFrame(frame);
+            o.outputFrames++;
+        }
+
+        requestFrames();
+    } else {
+        outputError = true;
+        totalRequests = requestedFrames;
+        if (errorMessage.empty()) {
+            if (errorMsg)
+                errorMessage = "Error: Failed to retrieve frame " + std::to_string(n) + " with error: " + errorMsg;
+            else
+                errorMessage = "Error: Failed to retrieve frame " + std::to_string(n);
+            errorMessage += describeOutput(o);
+        }
+    }
+
+    if (printFrameNumber && !outputError) {
+        if (hasMeaningfulFps)
+            fprintf(stderr, "Frame: %d/%d (%.2f fps)\r", completedFrames, totalRequests, fps);
+        else
+            fprintf(stderr, "Frame: %d/%d\r", completedFrames, totalRequests);
+    }
+
+    if (totalRequests == completedFrames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_one();
+    }
+}
+
+static bool outputNodes() {
+    if (requests < 1) {
+        const VSCoreInfo *info = vsapi->getCoreInfo(vsscript_getCore(se));
+        requests = info->numThreads;
+    }
+
+    if (timecodesFile) {
         if (fprintf(timecodesFile, "# timecode format v2\n") < 0) {
             errorMessage = "Error: failed to write timecodes file header, errno: " + std::to_string(errno);
             outputError = true;
+            fprintf(stderr, "%s\n", errorMessage.c_str());
             return outputError;
         }
     }
 
-    size_t size = vi->width * vi->height * vi->format->bytesPerSample;
-    buffer.resize(size);
+    if (reorderWindow < 1)
+        reorderWindow = requests * 2;
+    writeQueueSize = std::max(requests, 1);
+
+    totalRequests = 0;
+    for (const Output &o : outputs)
+        totalRequests += o.endFrame - o.requestStart;
 
     std::unique_lock<std::mutex> lock(mutex);
 
-    int requestStart = completedFrames;
-    int intitalRequestSize = std::min(requests, totalFrames - requestStart);
-    requestedFrames = requestStart + intitalRequestSize;
-    for (int n = requestStart; n < requestStart + intitalRequestSize; n++)
-        vsapi->getFrameAsync(n, node, frameDoneCallback, nullptr);
+    requestFrames();
 
-    condition.wait(lock);
+    // Nothing was requested if the first output couldn't be started
+    if (requestedFrames > 0)
+        condition.wait(lock);
+    lock.unlock();
+
+    for (Output &o : outputs) {
+        // Frames after a failed one never become ready for output
+        for (const VSFrameRef *frame : o.reorderBuffer)
+            vsapi->freeFrame(frame);
+        stopWriter(o);
+    }
 
     if (outputError) {
         fprintf(stderr, "%s\n", errorMessage.c_str());
@@ -350,6 +642,13 @@ static bool outputNode() {
     return outputError;
 }
 
+static void freeOutputs() {
+    for (Output &o : outputs) {
+        vsapi->freeNode(o.node);
+        o.node = nullptr;
+    }
+}
+
 static const char *colorFamilyToString(int colorFamily) {
     switch (colorFamily) {
     case cmGray: return "Gray";
@@ -374,6 +673,72 @@ static bool nstringToInt(const nstring &ns, int &result) {
     return pos == s.length();
 }
 
+// Each line of a chunk manifest is the first frame, the last frame and the file name,
+// empty lines and lines starting with # are ignored
+static bool readChunkManifest(const nstring &filename) {
+#ifdef VS_TARGET_OS_WINDOWS
+    FILE *f = _wfopen(filename.c_str(), L"rb");
+#else
+    FILE *f = fopen(filename.c_str(), "rb");
+#endif
+    if (!f) {
+        fprintf(stderr, "Failed to open chunk manifest\n");
+        return false;
+    }
+
+    std::string data;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.append(buffer, read);
+    fclose(f);
+
+    std::istringstream lines(data);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        fields.imbue(std::locale("C"));
+        int firstFrame, lastFrame;
+        std::string chunkFilename;
+        if (!(fields >> firstFrame >> lastFrame) || !std::getline(fields >> std::ws, chunkFilename) || chunkFilename.empty()) {
+            fprintf(stderr, "Invalid chunk specified on line %d of the chunk manifest\n", lineNumber);
+            return false;
+        }
+
+        if (firstFrame < 0 || lastFrame < firstFrame) {
+            fprintf(stderr, "Invalid frame range specified on line %d of the chunk manifest\n", lineNumber);
+            return false;
+        }
+
+        if (chunkFilename == "-") {
+            fprintf(stderr, "Chunks can't be written to stdout (line %d of the chunk manifest)\n", lineNumber);
+            return false;
+        }
+
+        outputs.emplace_back();
+        Output &o = outputs.back();
+        o.filename = utf8ToNstring(chunkFilename);
+        o.chunk = true;
+        o.outputStart = firstFrame;
+        o.endFrame = lastFrame + 1;
+    }
+
+    if (outputs.empty()) {
+        fprintf(stderr, "The chunk manifest contains no chunks\n");
+        return false;
+    }
+
+    return true;
+}
+
 static bool printVersion() {
     if (!vsscript_init()) {
         fprintf(stderr, "Failed to initialize VapourSynth environment\n");
@@ -411,9 +776,15 @@ static void printHelp() {
         "  -s, --start N         Set output frame range (first frame)\n"
         "  -e, --end N           Set output frame range (last frame)\n"
         "  -o, --outputindex N   Select output index\n"
+        "  --extraoutput N=FILE  Also write output index N to FILE in the same pass\n"
         "  -r, --requests N      Set number of concurrent frame requests\n"
+        "  --window N            Set how many frames past the oldest unfinished frame may be requested\n"
         "  -y, --y4m             Add YUV4MPEG headers to output\n"
         "  -t, --timecodes FILE  Write timecodes v2 file\n"
+        "  --pipe-size N         Set the pipe buffer size in bytes when outputting to a pipe (Linux only)\n"
+        "  --chunks FILE         Write the frame ranges listed in FILE to separate files instead of outfile\n"
+        "  --overlap N           Request and discard N frames before each chunk to warm up temporal filters\n"
+        "  --parallelchunks N    Set how many chunks are rendered at the same time\n"
         "  -p, --progress        Print progress to stderr\n"
         "  -i, --info            Show video info and exit\n"
         "  -v, --version         Show version info and exit\n"
@@ -431,6 +802,10 @@ static void printHelp() {
         "    vspipe --arg deinterlace=yes --arg \"message=fluffy kittens\" script.vpy output.raw\n"
         "  Pipe to x264 and write timecodes file:\n"
         "    vspipe script.vpy - --y4m --timecodes timecodes.txt | x264 --demuxer y4m -o script.mkv -\n"
+        "  Write output 0 to stdout and output 1 to a file while only evaluating the script once:\n"
+        "    vspipe --y4m --extraoutput 1=proxy.y4m script.vpy - | x264 --demuxer y4m -o script.mkv -\n"
+        "  Render the chunks listed in chunks.txt, two at a time with 10 frames of overlap:\n"
+        "    vspipe --y4m --chunks chunks.txt --overlap 10 --parallelchunks 2 script.vpy\n"
         );
 }
 
@@ -443,9 +818,10 @@ int wmain(int argc, wchar_t **argv) {
 #else
 int main(int argc, char **argv) {
 #endif
-    nstring outputFilename, scriptFilename, timecodesFilename;
+    nstring outputFilename, scriptFilename, timecodesFilename, chunksFilename;
     bool showHelp = false;
     std::map<std::string, std::string> scriptArgs;
+    std::vector<std::pair<int, nstring>> extraOutputs;
 
     for (int arg = 1; arg < argc; arg++) {
         nstring argString = argv[arg];
@@ -475,11 +851,6 @@ int main(int argc, char **argv) {
                 return 1;
             }
 
-            completedFrames = startFrame;
-            outputFrames = startFrame;
-            requestedFrames = startFrame;
-            lastFpsReportFrame = startFrame;
-
             arg++;
         } else if (argString == NSTRING("-e") || argString == NSTRING("--end")) {
             if (argc <= arg + 1) {
@@ -510,6 +881,27 @@ int main(int argc, char **argv) {
                 return 1;
             }
             arg++;
+        } else if (argString == NSTRING("--extraoutput")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No extra output specified\n");
+                return 1;
+            }
+
+            nstring eLine = argv[arg + 1];
+            size_t equalsPos = eLine.find(NSTRING("="));
+            if (equalsPos == nstring::npos || equalsPos + 1 == eLine.size()) {
+                fprintf(stderr, "No file specified for extra output: %s\n", nstringToUtf8(eLine).c_str());
+                return 1;
+            }
+
+            int index;
+            if (!nstringToInt(eLine.substr(0, equalsPos), index)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (extra output index)\n", nstringToUtf8(eLine.substr(0, equalsPos)).c_str());
+                return 1;
+            }
+
+            extraOutputs.push_back(std::make_pair(index, eLine.substr(equalsPos + 1)));
+            arg++;
         } else if (argString == NSTRING("-r") || argString == NSTRING("--requests")) {
             if (argc <= arg + 1) {
                 fprintf(stderr, "Number of requests not specified\n");
@@ -520,6 +912,16 @@ int main(int argc, char **argv) {
                 return 1;
             }
             arg++;
+        } else if (argString == NSTRING("--window")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No window size specified\n");
+                return 1;
+            }
+            if (!nstringToInt(argv[arg + 1], reorderWindow)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (window)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+            arg++;
         } else if (argString == NSTRING("-a") || argString == NSTRING("--arg")) {
             if (argc <= arg + 1) {
                 fprintf(stderr, "No argument specified\n");
@@ -544,6 +946,67 @@ int main(int argc, char **argv) {
 
             timecodesFilename = argv[arg + 1];
 
+            arg++;
+        } else if (argString == NSTRING("--pipe-size")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No pipe size specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], pipeSize)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (pipe size)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            if (pipeSize < 0) {
+                fprintf(stderr, "Negative pipe size specified\n");
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--chunks")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No chunk manifest specified\n");
+                return 1;
+            }
+
+            chunksFilename = argv[arg + 1];
+            chunkMode = true;
+
+            arg++;
+        } else if (argString == NSTRING("--overlap")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "No overlap specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], chunkOverlap)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (overlap)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            if (chunkOverlap < 0) {
+                fprintf(stderr, "Negative overlap specified\n");
+                return 1;
+            }
+
+            arg++;
+        } else if (argString == NSTRING("--parallelchunks")) {
+            if (argc <= arg + 1) {
+                fprintf(stderr, "Number of parallel chunks not specified\n");
+                return 1;
+            }
+
+            if (!nstringToInt(argv[arg + 1], parallelChunks)) {
+                fprintf(stderr, "Couldn't convert %s to an integer (parallel chunks)\n", nstringToUtf8(argv[arg + 1]).c_str());
+                return 1;
+            }
+
+            if (parallelChunks < 1) {
+                fprintf(stderr, "At least one parallel chunk must be allowed\n");
+                return 1;
+            }
+
             arg++;
         } else if (scriptFilename.empty() && !argString.empty() && argString.substr(0, 1) != NSTRING("-")) {
             scriptFilename = argString;
@@ -566,25 +1029,73 @@ int main(int argc, char **argv) {
     } else if (scriptFilename.empty()) {
         fprintf(stderr, "No script file specified\n");
         return 1;
+    } else if (chunkMode) {
+        if (!outputFilename.empty()) {
+            fprintf(stderr, "Cannot specify an output file in chunk mode\n");
+            return 1;
+        } else if (showInfo || !extraOutputs.empty() || !timecodesFilename.empty() || startFrame || totalFrames != -1) {
+            fprintf(stderr, "Cannot combine chunks with info, extra outputs, timecodes or a frame range\n");
+            return 1;
+        }
+
+        if (!readChunkManifest(chunksFilename))
+            return 1;
+
+        for (Output &o : outputs) {
+            o.index = outputIndex;
+            o.requestStart = std::max(o.outputStart - chunkOverlap, 0);
+        }
     } else if (outputFilename.empty()) {
         fprintf(stderr, "No output file specified\n");
         return 1;
     }
 
-    if (outputFilename == NSTRING("-")) {
-        outFile = stdout;
-    } else if (outputFilename == NSTRING(".")) {
-        // do nothing
-    } else {
+    if (!chunkMode) {
+        outputs.emplace_back();
+        outputs.back().index = outputIndex;
+        outputs.back().filename = outputFilename;
+        for (const auto &iter : extraOutputs) {
+            outputs.emplace_back();
+            outputs.back().index = iter.first;
+            outputs.back().filename = iter.second;
+        }
+    }
+
+    if (!showInfo) {
+        int stdoutOutputs = 0;
+        for (const Output &o : outputs)
+            if (o.filename == NSTRING("-"))
+                stdoutOutputs++;
+        if (stdoutOutputs > 1) {
+            fprintf(stderr, "Only one output can be written to stdout\n");
+            return 1;
+        }
+    }
+
+    for (Output &o : outputs) {
+        // Chunks open their files once they're started
+        if (o.chunk)
+            break;
+
+        if (o.filename == NSTRING("-")) {
+            o.file = stdout;
+        } else if (o.filename == NSTRING(".")) {
+            // do nothing
+        } else {
 #ifdef VS_TARGET_OS_WINDOWS
-        outFile = _wfopen(outputFilename.c_str(), L"wb");
+            o.file = _wfopen(o.filename.c_str(), L"wb");
 #else
-        outFile = fopen(outputFilename.c_str(), "wb");
+            o.file = fopen(o.filename.c_str(), "wb");
 #endif
-        if (!outFile) {
-            fprintf(stderr, "Failed to open output for writing\n");
-            return 1;
+            if (!o.file) {
+                fprintf(stderr, "Failed to open output for writing: %s\n", nstringToUtf8(o.filename).c_str());
+                return 1;
+            }
         }
+
+        // Info is only shown for the primary output
+        if (showInfo)
+            break;
     }
 
     if (!timecodesFilename.empty()) {
@@ -597,6 +1108,7 @@ int main(int argc, char **argv) {
             fprintf(stderr, "Failed to open timecodes file for writing\n");
             return 1;
         }
+        outputs.front().timecodes = timecodesFile;
     }
 
     if (!vsscript_init()) {
@@ -635,16 +1147,24 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    node = vsscript_getOutput(se, outputIndex);
-    if (!node) {
-       fprintf(stderr, "Failed to retrieve output node. Invalid index specified?\n");
-       vsscript_freeScript(se);
-       vsscript_finalize();
-       return 1;
+    for (Output &o : outputs) {
+        o.node = vsscript_getOutput(se, o.index);
+        if (!o.node) {
+            fprintf(stderr, "Failed to retrieve output node. Invalid index specified?\n");
+            freeOutputs();
+            vsscript_freeScript(se);
+            vsscript_finalize();
+            return 1;
+        }
+
+        if (showInfo)
+            break;
     }
 
     bool error = false;
-    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    Output &primary = outputs.front();
+    const VSVideoInfo *vi = vsapi->getVideoInfo(primary.node);
+    FILE *outFile = primary.file;
 
     if (showInfo) {
         if (outFile) {
@@ -672,41 +1192,93 @@ int main(int argc, char **argv) {
                 fprintf(outFile, "Format Name: Variable\n");
             }
         }
-    } else {
-        const VSVideoInfo *vi = vsapi->getVideoInfo(node);
-        if (totalFrames == -1)
-            totalFrames = vi->numFrames;
-        if ((vi->numFrames && vi->numFrames < totalFrames) || completedFrames >= totalFrames) {
-            fprintf(stderr, "Invalid range of frames to output specified:\nfirst: %d\nlast: %d\nclip length: %d\nframes to output: %d\n", completedFrames, totalFrames, vi->numFrames, totalFrames - completedFrames);
-            vsapi->freeNode(node);
+    } else if (chunkMode) {
+        for (Output &o : outputs) {
+            if (vi->numFrames && vi->numFrames < o.endFrame) {
+                fprintf(stderr, "Invalid range of frames to output specified:\nfirst: %d\nlast: %d\nclip length: %d\n", o.outputStart, o.endFrame - 1, vi->numFrames);
+                freeOutputs();
+                vsscript_freeScript(se);
+                vsscript_finalize();
+                return 1;
+            }
+        }
+
+        if (!isConstantFormat(vi)) {
+            fprintf(stderr, "Cannot output clips with varying dimensions\n");
+            freeOutputs();
             vsscript_freeScript(se);
             vsscript_finalize();
             return 1;
         }
 
-        if (!isConstantFormat(vi)) {
-            fprintf(stderr, "Cannot output clips with varying dimensions\n");
-            vsapi->freeNode(node);
+        lastFpsReportTime = std::chrono::high_resolution_clock::now();
+        error = outputNodes();
+    } else {
+        int endFrame = (totalFrames == -1) ? vi->numFrames : totalFrames;
+        if ((vi->numFrames && vi->numFrames < endFrame) || startFrame >= endFrame) {
+            fprintf(stderr, "Invalid range of frames to output specified:\nfirst: %d\nlast: %d\nclip length: %d\nframes to output: %d\n", startFrame, endFrame, vi->numFrames, endFrame - startFrame);
+            freeOutputs();
             vsscript_freeScript(se);
             vsscript_finalize();
             return 1;
         }
 
+        for (Output &o : outputs) {
+            const VSVideoInfo *ovi = vsapi->getVideoInfo(o.node);
+            if (!isConstantFormat(ovi)) {
+                fprintf(stderr, "Cannot output clips with varying dimensions\n");
+                freeOutputs();
+                vsscript_freeScript(se);
+                vsscript_finalize();
+                return 1;
+            }
+
+            // Extra outputs cover the same range but stop early if they're shorter, one that ends
+            // before the first frame would have nothing to write at all
+            if (ovi->numFrames && ovi->numFrames <= startFrame) {
+                fprintf(stderr, "Invalid range of frames to output specified for output %d:\nfirst: %d\nclip length: %d\n", o.index, startFrame, ovi->numFrames);
+                freeOutputs();
+                vsscript_freeScript(se);
+                vsscript_finalize();
+                return 1;
+            }
+
+            o.requestStart = startFrame;
+            o.outputStart = startFrame;
+            o.endFrame = ovi->numFrames ? std::min(endFrame, ovi->numFrames) : endFrame;
+        }
+
         lastFpsReportTime = std::chrono::high_resolution_clock::now();;
-        error = outputNode();
+        error = outputNodes();
     }
 
-    if (outFile)
-        fflush(outFile);
+    for (Output &o : outputs) {
+        if (o.file == stdout)
+            fflush(o.file);
+        else if (o.file)
+            fclose(o.file);
+    }
     if (timecodesFile)
         fclose(timecodesFile);
 
     if (!showInfo) {
-        int totalFrames = outputFrames - startFrame;
+        int totalFrames = 0;
+        if (chunkMode) {
+            for (const Output &o : outputs)
+                totalFrames += std::max(o.outputFrames - o.outputStart, 0);
+        } else {
+            totalFrames = primary.outputFrames - startFrame;
+        }
         std::chrono::duration<double> elapsedSeconds = std::chrono::high_resolution_clock::now() - start;
         fprintf(stderr, "Output %d frames in %.2f seconds (%.2f fps)\n", totalFrames, elapsedSeconds.count(), totalFrames / elapsedSeconds.count());
+        if (!chunkMode) {
+            for (size_t i = 1; i < outputs.size(); i++)
+                fprintf(stderr, "Output %d frames from output %d\n", outputs[i].outputFrames - startFrame, outputs[i].index);
+        }
+        if (printFrameNumber)
+            fprintf(stderr, "Reorder buffer: %d frames at most, %d stalls with a window of %d frames\n", reorderPeak, reorderStalls, reorderWindow);
     }
-    vsapi->freeNode(node);
+    freeOutputs();
     vsscript_freeScript(se);
     vsscript_finalize();
 
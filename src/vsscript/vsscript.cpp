@@ -24,6 +24,9 @@
 #include <mutex>
 #include <atomic>
 #include <vector>
+#include <deque>
+#include <thread>
+#include <condition_variable>
 
 #ifdef VS_TARGET_OS_WINDOWS
 #define WIN32_LEAN_AND_MEAN
@@ -42,6 +45,72 @@ static bool initialized = false;
 static PyThreadState *ts = nullptr;
 static PyGILState_STATE s;
 
+// Cores created in advance by a background thread so new environments don't have to wait for plugin loading
+static std::mutex poolLock;
+static std::condition_variable poolCond;
+static std::deque<VSCore *> corePool;
+static size_t corePoolSize = 0;
+// not a plain object so a process exiting without vsscript_finalize() isn't terminated by its destructor
+static std::thread *poolThread = nullptr;
+static bool stopPoolThread = false;
+
+static void poolThreadFunc() {
+    const VSAPI *vsapi = vpy_getVSApi();
+    std::unique_lock<std::mutex> lock(poolLock);
+    while (!stopPoolThread) {
+        if (corePool.size() > corePoolSize) {
+            VSCore *core = corePool.back();
+            corePool.pop_back();
+            lock.unlock();
+            vsapi->freeCore(core);
+            lock.lock();
+        } else if (corePool.size() < corePoolSize) {
+            lock.unlock();
+            VSCore *core = vsapi->createCore(0);
+            lock.lock();
+            corePool.push_back(core);
+        } else {
+            poolCond.wait(lock);
+        }
+    }
+}
+
+static void stopCorePool() {
+    {
+        std::lock_guard<std::mutex> lock(poolLock);
+        stopPoolThread = true;
+    }
+    poolCond.notify_one();
+    if (poolThread) {
+        poolThread->join();
+        delete poolThread;
+        poolThread = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(poolLock);
+    const VSAPI *vsapi = vpy_getVSApi();
+    for (VSCore *core : corePool)
+        vsapi->freeCore(core);
+    corePool.clear();
+    corePoolSize = 0;
+    stopPoolThread = false;
+}
+
+static void assignPooledCore(VSScript *handle) {
+    VSCore *core = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(poolLock);
+        if (corePool.empty())
+            return;
+        core = corePool.front();
+        corePool.pop_front();
+    }
+    poolCond.notify_one();
+    // fall back to creating a core when needed like without a pool
+    if (vpy_setCore(handle, core))
+        vpy_getVSApi()->freeCore(core);
+}
+
 static void real_init(void) {
 #ifdef VS_TARGET_OS_WINDOWS
     // portable
@@ -107,15 +176,31 @@ VS_API(int) vsscript_init() {
 VS_API(int) vsscript_finalize(void) {
     int count = --initializationCount;
     assert(count >= 0);
+    if (count == 0)
+        stopCorePool();
     return count;
 }
 
+VS_API(int) vsscript_setCorePoolSize(int size) {
+    if (initializationCount <= 0 || size < 0)
+        return 1;
+    {
+        std::lock_guard<std::mutex> lock(poolLock);
+        corePoolSize = size;
+        if (!poolThread && size > 0)
+            poolThread = new std::thread(poolThreadFunc);
+    }
+    poolCond.notify_one();
+    return 0;
+}
+
 VS_API(int) vsscript_createScript(VSScript **handle) {
     *handle = new(std::nothrow)VSScript();
     if (*handle) {
         (*handle)->pyenvdict = nullptr;
         (*handle)->errstr = nullptr;
         (*handle)->id = ++scriptId;
+        assignPooledCore(*handle);
         return vpy_createScript(*handle);
     } else {
         return 1;
@@ -129,6 +214,7 @@ VS_API(int) vsscript_evaluateScript(VSScript **handle, const char *script, const
             (*handle)->pyenvdict = nullptr;
             (*handle)->errstr = nullptr;
             (*handle)->id = ++scriptId;
+            assignPooledCore(*handle);
         } else {
             return 1;
         }
@@ -143,6 +229,7 @@ VS_API(int) vsscript_evaluateFile(VSScript **handle, const char *scriptFilename,
             (*handle)->pyenvdict = nullptr;
             (*handle)->errstr = nullptr;
             (*handle)->id = ++scriptId;
+            assignPooledCore(*handle);
         } else {
             return 1;
         }
@@ -0,0 +1,109 @@
+import os
+import shutil
+import tempfile
+import unittest
+import vapoursynth as vs
+
+class DiskCacheTestSequence(unittest.TestCase):
+
+    def setUp(self):
+        self.core = vs.get_core()
+        self.path = tempfile.mkdtemp()
+        self.calls = []
+
+    def tearDown(self):
+        shutil.rmtree(self.path, ignore_errors=True)
+
+    # Every frame has its number as color and in its properties, frames that are
+    # actually generated are recorded in self.calls
+    def source(self, length=10, width=64, height=64):
+        frames = [self.core.std.BlankClip(format=vs.YUV420P8, width=width, height=height, length=1, color=[n, 128, 128]) for n in range(length)]
+        clip = self.core.std.Splice(frames)
+        def generate(n, f):
+            self.calls.append(n)
+            fout = f.copy()
+            fout.props.IntProp = [n, -n]
+            fout.props.FloatProp = n + 0.5
+            fout.props.DataProp = ['frame', str(n)]
+            return fout
+        return self.core.std.ModifyFrame(clip, clip, generate)
+
+    def checkFrame(self, frame, n):
+        self.assertEqual(list(frame.props.IntProp), [n, -n])
+        self.assertEqual(frame.props.FloatProp, n + 0.5)
+        self.assertEqual(list(frame.props.DataProp), [b'frame', str(n).encode()])
+        for plane, value in enumerate((n, 128, 128)):
+            arr = frame.get_read_array(plane)
+            self.assertEqual(arr[0][0], value)
+            self.assertEqual(arr[frame.height // (2 if plane else 1) - 1][frame.width // (2 if plane else 1) - 1], value)
+
+    def cacheFiles(self):
+        return sorted(f for f in os.listdir(self.path) if f.endswith('.vscache'))
+
+    def testMissThenHit(self):
+        clip = self.core.std.DiskCache(self.source(), self.path, key='test')
+        for n in range(clip.num_frames):
+            self.checkFrame(clip.get_frame(n), n)
+        self.assertEqual(sorted(self.calls), list(range(10)))
+        del clip
+
+        # a new instance reads everything back from the file
+        self.calls = []
+        clip = self.core.std.DiskCache(self.source(), self.path, key='test')
+        for n in range(clip.num_frames):
+            self.checkFrame(clip.get_frame(n), n)
+        self.assertEqual(self.calls, [])
+        self.assertEqual(len(self.cacheFiles()), 1)
+
+    def testKeySelectsFile(self):
+        clip = self.core.std.DiskCache(self.source(), self.path, key='a')
+        clip.get_frame(0)
+        del clip
+        clip = self.core.std.DiskCache(self.source(), self.path, key='b')
+        clip.get_frame(0)
+        del clip
+        self.assertEqual(len(self.cacheFiles()), 2)
+        self.assertEqual(self.calls, [0, 0])
+
+    def testRecognizedGraph(self):
+        # clips made without python functions need no key
+        def blank(color):
+            return self.core.std.Invert(self.core.std.BlankClip(format=vs.GRAY8, width=64, height=64, length=2, color=color))
+        for color in (16, 16, 32):
+            clip = self.core.std.DiskCache(blank(color), self.path)
+            clip.get_frame(0)
+            del clip
+        self.assertEqual(len(self.cacheFiles()), 2)
+
+        # different functions with the same arguments make different clips
+        for clip in (self.core.std.Minimum(blank(16)), self.core.std.Maximum(blank(16))):
+            clip = self.core.std.DiskCache(clip, self.path)
+            clip.get_frame(0)
+            del clip
+        self.assertEqual(len(self.cacheFiles()), 4)
+
+    def testFunctionGraphNeedsKey(self):
+        with self.assertRaisesRegex(vs.Error, 'contains functions'):
+            self.core.std.DiskCache(self.source(), self.path)
+        self.assertEqual(self.cacheFiles(), [])
+
+    def testMaxSize(self):
+        # each frame takes a bit more than 1 MB so only the 3 most recently used ones fit in 4 MB
+        clip = self.core.std.DiskCache(self.source(width=1024, height=720), self.path, maxsize=4, key='test')
+        for n in range(clip.num_frames):
+            clip.get_frame(n)
+        del clip
+        self.assertLessEqual(os.path.getsize(os.path.join(self.path, self.cacheFiles()[0])), 4 * 1024 * 1024)
+
+        self.calls = []
+        clip = self.core.std.DiskCache(self.source(width=1024, height=720), self.path, maxsize=4, key='test')
+        for n in reversed(range(clip.num_frames)):
+            self.checkFrame(clip.get_frame(n), n)
+        self.assertEqual(sorted(self.calls), list(range(7)))
+
+    def testMaxSizeTooSmall(self):
+        with self.assertRaisesRegex(vs.Error, 'too small'):
+            self.core.std.DiskCache(self.source(width=1024, height=1024), self.path, maxsize=1, key='test')
+
+if __name__ == '__main__':
+    unittest.main()
@@ -87,5 +87,31 @@ class FilterTestSequence(unittest.TestCase):
         comp = self.BlankClip(format=vs.YUV420P8, color=[128, 10, 244])
         self.checkDifference(comp, ret)
 
+    def testLUTBitsOut(self):
+        clip = self.BlankClip(format=vs.YUV420P8, color=[69, 242, 115])
+
+        ret = self.Lut(clip, planes=[0, 1, 2], function=lambda x: x * 4, bits=10)
+        self.assertEqual(ret.get_frame(0).format.id, vs.YUV420P10)
+        comp = self.BlankClip(format=vs.YUV420P10, color=[276, 968, 460])
+        self.checkDifference(comp, ret)
+
+    def testLUTExpr16Bit(self):
+        clip = self.BlankClip(format=vs.YUV420P16, color=[69, 242, 115])
+
+        ret = self.Lut(clip, planes=[0, 1, 2], expr="x")
+        self.checkDifference(clip, ret)
+
+        ret = self.Lut(clip, planes=[0, 1, 2], expr="x 2 * 100 -", bits=8)
+        comp = self.BlankClip(format=vs.YUV420P8, color=[38, 255, 130])
+        self.checkDifference(comp, ret)
+
+    def testLUT2Expr_10Bit(self):
+        clipx = self.BlankClip(format=vs.YUV420P10, color=[384, 10, 500])
+        clipy = self.BlankClip(format=vs.YUV420P10, color=[15, 600, 900])
+
+        ret = self.Lut2(clipa=clipx, clipb=clipy, planes=[0, 1, 2], expr="x y + 2 /")
+        comp = self.BlankClip(format=vs.YUV420P10, color=[200, 305, 700])
+        self.checkDifference(comp, ret)
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,163 @@
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+import sysconfig
+import tempfile
+import unittest
+
+# A minimal plugin that logs every time it's initialized so the tests can tell
+# when the library actually gets loaded
+PLUGIN_SOURCE = r'''
+#include <stdio.h>
+#include <stdlib.h>
+#include "VapourSynth.h"
+
+static void VS_CC valueCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    vsapi->propSetInt(out, "val", 42, paReplace);
+}
+
+VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
+    const char *log = getenv("PLUGINCACHE_TEST_LOG");
+    if (log) {
+        FILE *f = fopen(log, "a");
+        if (f) {
+            fputs("init\n", f);
+            fclose(f);
+        }
+    }
+    configFunc("com.vapoursynth.plugincachetest", "pctest", "Plugin cache test", VAPOURSYNTH_API_VERSION, 1, plugin);
+    registerFunc("Value", "", valueCreate, 0, plugin);
+}
+'''
+
+SCRIPT = '''
+import sys
+import vapoursynth as vs
+core = vs.get_core()
+if 'use' in sys.argv:
+    print(core.pctest.Value())
+'''
+
+INCLUDE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'include')
+
+
+@unittest.skipIf(sys.platform.startswith('win'), 'the plugin cache location is fixed on windows')
+class PluginCacheTestSequence(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.builddir = tempfile.mkdtemp()
+        cls.suffix = '.dylib' if sys.platform == 'darwin' else '.so'
+        src = os.path.join(cls.builddir, 'pctest.c')
+        with open(src, 'w') as f:
+            f.write(PLUGIN_SOURCE)
+        cls.library = os.path.join(cls.builddir, 'libpctest' + cls.suffix)
+        cc = shlex.split(sysconfig.get_config_var('CC') or 'cc')
+        try:
+            subprocess.check_call(cc + ['-shared', '-fPIC', '-I' + INCLUDE_DIR, src, '-o', cls.library])
+        except (OSError, subprocess.CalledProcessError):
+            raise unittest.SkipTest('no compiler to build the test plugin')
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.builddir, ignore_errors=True)
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.plugindir = os.path.join(self.dir, 'plugins')
+        self.plugin = os.path.join(self.plugindir, os.path.basename(self.library))
+        self.log = os.path.join(self.dir, 'log')
+        os.makedirs(self.plugindir)
+        shutil.copy(self.library, self.plugin)
+
+        # the configuration and cache locations all follow the home and xdg dirs
+        self.env = dict(os.environ, HOME=self.dir, XDG_CONFIG_HOME=os.path.join(self.dir, 'config'), XDG_CACHE_HOME=os.path.join(self.dir, 'cache'), PLUGINCACHE_TEST_LOG=self.log)
+        if sys.platform == 'darwin':
+            configfile = os.path.join(self.dir, 'Library', 'Application Support', 'VapourSynth', 'vapoursynth.conf')
+            self.cachefile = os.path.join(self.dir, 'Library', 'Caches', 'VapourSynth', 'plugincache')
+        else:
+            configfile = os.path.join(self.dir, 'config', 'vapoursynth', 'vapoursynth.conf')
+            self.cachefile = os.path.join(self.dir, 'cache', 'vapoursynth', 'plugincache')
+        os.makedirs(os.path.dirname(configfile))
+        with open(configfile, 'w') as f:
+            f.write('SystemPluginDir=%s\nAutoloadUserPluginDir=false\n' % self.plugindir)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+    def run_core(self, use=False):
+        out = subprocess.check_output([sys.executable, '-c', SCRIPT] + (['use'] if use else []), env=self.env)
+        return out.decode().strip()
+
+    def loads(self):
+        if not os.path.exists(self.log):
+            return 0
+        with open(self.log) as f:
+            return len(f.readlines())
+
+    def test_cache_created(self):
+        self.run_core()
+        self.assertEqual(self.loads(), 1)
+        self.assertTrue(os.path.exists(self.cachefile))
+        with open(self.cachefile) as f:
+            self.assertIn('com.vapoursynth.plugincachetest', f.read())
+
+    def test_deferred_loading(self):
+        self.run_core()
+        self.run_core()
+        self.assertEqual(self.loads(), 1)
+        self.assertEqual(self.run_core(use=True), '42')
+        self.assertEqual(self.loads(), 2)
+
+    def test_mtime_change(self):
+        self.run_core()
+        st = os.stat(self.plugin)
+        os.utime(self.plugin, (st.st_atime, st.st_mtime + 10))
+        self.run_core()
+        self.assertEqual(self.loads(), 2)
+        # the new timestamp was cached
+        self.run_core()
+        self.assertEqual(self.loads(), 2)
+
+    def test_size_change(self):
+        self.run_core()
+        st = os.stat(self.plugin)
+        with open(self.plugin, 'ab') as f:
+            f.write(b'\0' * 16)
+        # keep the timestamp so only the size differs
+        os.utime(self.plugin, ns=(st.st_atime_ns, st.st_mtime_ns))
+        self.run_core()
+        self.assertEqual(self.loads(), 2)
+        self.assertEqual(self.run_core(use=True), '42')
+
+    def test_corrupt_cache(self):
+        self.run_core()
+        with open(self.cachefile, 'wb') as f:
+            f.write(b'VapourSynthPluginCache\tgarbage\nP\t\xff\n')
+        self.assertEqual(self.run_core(use=True), '42')
+        self.assertEqual(self.loads(), 2)
+        # the broken cache was replaced with a working one
+        self.run_core()
+        self.assertEqual(self.loads(), 2)
+
+    def test_truncated_cache(self):
+        self.run_core()
+        with open(self.cachefile, 'rb') as f:
+            data = f.read()
+        with open(self.cachefile, 'wb') as f:
+            f.write(data[:len(data) // 2])
+        self.assertEqual(self.run_core(use=True), '42')
+        self.assertEqual(self.loads(), 2)
+
+    def test_removed_plugin(self):
+        self.run_core()
+        os.remove(self.plugin)
+        self.run_core()
+        with open(self.cachefile) as f:
+            self.assertNotIn('com.vapoursynth.plugincachetest', f.read())
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,86 @@
+# Measures the speed of every RemoveGrain and Repair mode on one thread.
+#
+# usage: python3 rgvsbench.py [plugin ...]
+#
+# Each plugin is a path to a build of the rgvs plugin and gets its own column.
+# Without any, the one already loaded by the core is measured. Each plugin is
+# benchmarked in a separate process since a namespace can only be loaded once.
+# The SSE2 path is only used when the cpu lacks AVX2, so comparing the two on
+# the same machine needs a build where cpuHasAVX2() returns false.
+#
+# The environment variables RGVS_FORMAT (GRAY8), RGVS_WIDTH (1920),
+# RGVS_HEIGHT (1080) and RGVS_FRAMES (100) change the clip that is filtered,
+# RGVS_RUNS (3) sets how many times each mode is run.
+
+import os
+import subprocess
+import sys
+import time
+
+def bench(plugin):
+    import ctypes
+    import vapoursynth as vs
+    core = vs.get_core(threads=1)
+    if plugin:
+        core.std.LoadPlugin(plugin)
+
+    fmt = getattr(vs, os.environ.get('RGVS_FORMAT', 'GRAY8'))
+    width = int(os.environ.get('RGVS_WIDTH', 1920))
+    height = int(os.environ.get('RGVS_HEIGHT', 1080))
+    frames = int(os.environ.get('RGVS_FRAMES', 100))
+    runs = int(os.environ.get('RGVS_RUNS', 3))
+
+    # A single frame of noise is repeated so producing the source costs nothing
+    def noise():
+        blank = core.std.BlankClip(width=width, height=height, format=fmt, length=1)
+        def fill(n, f):
+            fout = f.copy()
+            for p in range(fout.format.num_planes):
+                size = fout.get_stride(p) * fout.height
+                if fout.format.sample_type == vs.INTEGER and fout.format.bits_per_sample < 16 and fout.format.bytes_per_sample == 2:
+                    mask = (1 << fout.format.bits_per_sample) - 1
+                    data = bytes(b & (mask >> 8) if i & 1 else b for i, b in enumerate(os.urandom(size)))
+                else:
+                    data = os.urandom(size)
+                ctypes.memmove(fout.get_write_ptr(p).value, data, size)
+            return fout
+        return core.std.Loop(core.std.ModifyFrame(blank, blank, fill), frames)
+
+    src = noise()
+    ref = noise()
+    src.get_frame(0)
+    ref.get_frame(0)
+
+    for name in ('RemoveGrain', 'Repair'):
+        for mode in range(1, 25):
+            if name == 'RemoveGrain':
+                clip = core.rgvs.RemoveGrain(src, mode)
+            else:
+                clip = core.rgvs.Repair(src, ref, mode)
+            # The best of several runs is the least disturbed by everything else running
+            best = 0
+            for run in range(runs):
+                start = time.perf_counter()
+                for n in range(frames):
+                    clip.get_frame(n)
+                best = max(best, frames / (time.perf_counter() - start))
+            print('%.1f' % best)
+            sys.stdout.flush()
+
+if __name__ == '__main__':
+    if len(sys.argv) > 1 and sys.argv[1] == '--run':
+        bench(sys.argv[2] if len(sys.argv) > 2 else None)
+        sys.exit(0)
+
+    plugins = sys.argv[1:] or ['']
+    columns = []
+    for plugin in plugins:
+        out = subprocess.check_output([sys.executable, __file__, '--run'] + ([plugin] if plugin else []))
+        columns.append(out.decode().split())
+
+    names = [os.path.basename(p) or 'loaded' for p in plugins]
+    widths = [max(len(name), 8) for name in names]
+    print('%-16s %s' % ('fps', ' '.join(name.rjust(width) for name, width in zip(names, widths))))
+    for i in range(48):
+        label = '%s %d' % ('RemoveGrain' if i < 24 else 'Repair', i % 24 + 1)
+        print('%-16s %s' % (label, ' '.join(col[i].rjust(width) for col, width in zip(columns, widths))))
@@ -0,0 +1,73 @@
+import ctypes
+import unittest
+import vapoursynth as vs
+
+# A filled square drawn with ass drawing commands, so no fonts are needed
+SQUARE = r'{\an7\pos(10,20)\p1}m 0 0 l 40 0 40 30 0 30'
+
+
+# the visible part of a plane
+def plane_rows(frame, plane):
+    width = frame.width * frame.format.bytes_per_sample
+    ptr = frame.get_read_ptr(plane).value
+    stride = frame.get_stride(plane)
+    return [ctypes.string_at(ptr + y * stride, width) for y in range(frame.height)]
+
+
+class SubtextTestSequence(unittest.TestCase):
+
+    def setUp(self):
+        self.core = vs.get_core()
+        if not hasattr(self.core, 'sub'):
+            self.skipTest('the subtext plugin isn\'t loaded')
+        self.clip = self.core.std.BlankClip(format=vs.RGB24, width=160, height=120, length=30, color=[30, 60, 90], fpsnum=25, fpsden=1)
+
+    def checkOutsideRect(self, frame, ref, rect):
+        left, top, width, height = rect
+        for plane in range(frame.format.num_planes):
+            rows = plane_rows(frame, plane)
+            ref_rows = plane_rows(ref, plane)
+            bpp = frame.format.bytes_per_sample
+            for y in range(frame.height):
+                if top <= y < top + height:
+                    self.assertEqual(rows[y][:left * bpp], ref_rows[y][:left * bpp])
+                    self.assertEqual(rows[y][(left + width) * bpp:], ref_rows[y][(left + width) * bpp:])
+                else:
+                    self.assertEqual(rows[y], ref_rows[y])
+
+    def testSubtitleRect(self):
+        subs, alpha = self.core.sub.Subtitle(self.clip, SQUARE, start=10, end=20, blend=False)
+        blank_alpha = self.core.std.BlankClip(alpha)
+        for n in range(self.clip.num_frames):
+            # both outputs are requested at once like the blending does
+            fsubs = subs.get_frame_async(n)
+            falpha = alpha.get_frame_async(n)
+            fsubs = fsubs.result()
+            falpha = falpha.result()
+            rect = list(fsubs.props.SubtitleRect)
+            self.assertEqual(list(falpha.props.SubtitleRect), rect)
+            if 10 <= n < 20:
+                self.assertGreater(rect[2], 0)
+                self.assertGreater(rect[3], 0)
+                self.assertGreaterEqual(rect[0], 0)
+                self.assertGreaterEqual(rect[1], 0)
+                self.assertLessEqual(rect[0] + rect[2], self.clip.width)
+                self.assertLessEqual(rect[1] + rect[3], self.clip.height)
+            else:
+                self.assertEqual(rect[2], 0)
+            self.checkOutsideRect(falpha, blank_alpha.get_frame(n), rect)
+
+    def testBlendWithinRect(self):
+        blended = self.core.sub.Subtitle(self.clip, SQUARE, start=10, end=20)
+        subs = self.core.sub.Subtitle(self.clip, SQUARE, start=10, end=20, blend=False)[0]
+        for n in range(self.clip.num_frames):
+            rect = list(subs.get_frame(n).props.SubtitleRect)
+            frame = blended.get_frame(n)
+            ref = self.clip.get_frame(n)
+            # frames without subtitles are passed through untouched
+            self.checkOutsideRect(frame, ref, rect)
+            if 10 <= n < 20:
+                self.assertNotEqual(plane_rows(frame, 0), plane_rows(ref, 0))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,3 +1,5 @@
+import io
+import tempfile
 import unittest
 import vapoursynth as vs
 
@@ -26,6 +28,28 @@ class CoreTestSequence(unittest.TestCase):
             self.assertIsInstance(frame, vs.VideoFrame)
         self.assertEquals(e, 199)
 
+    def test_frames_generator_order(self):
+        blank = self.core.std.BlankClip(length=100)
+        clip = self.core.std.FrameEval(blank, lambda n: blank.std.SetFrameProp(prop="n", intval=n))
+        for n, frame in enumerate(clip.frames(prefetch=4, backlog=6)):
+            self.assertEqual(frame.props.n, n)
+
+    def test_frames_generator_break(self):
+        clip = self.core.std.BlankClip(length=100)
+        for n, frame in enumerate(clip.frames()):
+            if n == 10:
+                break
+        self.assertIsInstance(next(clip.frames()), vs.VideoFrame)
+
+    def test_output_native(self):
+        clip = self.core.std.BlankClip(format=vs.YUV420P10, length=20, color=[100, 200, 300])
+        buf = io.BytesIO()
+        clip.output(buf, y4m=True)
+        with tempfile.TemporaryFile() as f:
+            clip.output(f, y4m=True)
+            f.seek(0)
+            self.assertEqual(f.read(), buf.getvalue())
+
 ### Filter-Call-Tests
 
     def test_func1(self):
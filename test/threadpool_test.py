@@ -0,0 +1,76 @@
+import os
+import subprocess
+import sys
+import unittest
+
+# Runs in a separate process so the thread count only includes the threads
+# of a single core that starts out without any workers
+HOST = '''
+import os
+import sys
+import vapoursynth as vs
+
+def thread_count():
+    return len(os.listdir('/proc/self/task'))
+
+mode = sys.argv[1]
+threads = int(sys.argv[2])
+core = vs.get_core(threads=threads)
+base = core.std.BlankClip(format=vs.GRAY8, width=64, height=64, length=100)
+before = thread_count()
+peak = [0]
+
+if mode == 'requests':
+    # filters that request overlapping frames synchronously from inside a worker
+    heavy = base
+    for i in range(4):
+        heavy = core.std.BoxBlur(heavy, hradius=3, vradius=3)
+    def request(n, f):
+        for k in range(3):
+            heavy.get_frame(min(n + k, base.num_frames - 1))
+        peak[0] = max(peak[0], thread_count())
+        return f
+    out = core.std.Merge(core.std.ModifyFrame(base, base, request), core.std.ModifyFrame(base, base, request))
+    frames = [out.get_frame_async(n) for n in range(base.num_frames)]
+    for f in frames:
+        f.result()
+    print(peak[0] - before)
+elif mode == 'nested':
+    # every level only requests the frame from the level below inside its callback,
+    # so the requests nest deeper than workers help out
+    depth = int(sys.argv[3])
+    def nest(clip):
+        def request(n, f):
+            fout = f.copy()
+            fout.props.Level = clip.get_frame(n).props.Level + 1
+            return fout
+        return core.std.ModifyFrame(base, base, request)
+    out = core.std.SetFrameProp(base, prop='Level', intval=0)
+    for level in range(depth):
+        out = nest(out)
+    frames = [out.get_frame_async(n) for n in range(8)]
+    print(' '.join(str(f.result().props.Level) for f in frames))
+'''
+
+
+@unittest.skipUnless(os.path.isdir('/proc/self/task'), 'threads can only be counted on linux')
+class ThreadPoolTestSequence(unittest.TestCase):
+
+    def run_host(self, *args):
+        out = subprocess.check_output([sys.executable, '-c', HOST] + [str(x) for x in args], timeout=300)
+        return out.decode().strip()
+
+    def test_requests_from_workers(self):
+        # workers waiting for their requested frames aren't replaced by new threads
+        for threads in (1, 4):
+            with self.subTest(threads=threads):
+                self.assertLessEqual(int(self.run_host('requests', threads)), threads)
+
+    def test_nested_requests(self):
+        for threads in (1, 4):
+            with self.subTest(threads=threads):
+                self.assertEqual(self.run_host('nested', threads, 12), ' '.join(['12'] * 8))
+
+
+if __name__ == '__main__':
+    unittest.main()
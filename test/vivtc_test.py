@@ -0,0 +1,42 @@
+import os
+import shutil
+import tempfile
+import unittest
+import vapoursynth as vs
+
+class VIVTCTestSequence(unittest.TestCase):
+
+    def setUp(self):
+        self.core = vs.get_core()
+        if not hasattr(self.core, 'vivtc'):
+            self.skipTest('the vivtc plugin isn\'t loaded')
+        self.path = tempfile.mkdtemp()
+        self.metrics = os.path.join(self.path, 'metrics')
+
+    def tearDown(self):
+        shutil.rmtree(self.path, ignore_errors=True)
+
+    # A cycle of 5 with one duplicate in each cycle
+    def source(self):
+        colors = [16, 40, 40, 90, 150, 20, 60, 110, 110, 200]
+        return self.core.std.Splice([self.core.std.BlankClip(format=vs.YUV420P8, width=64, height=64, length=1, color=[c, 128, 128]) for c in colors])
+
+    def dryrunProps(self, **args):
+        clip = self.core.vivtc.VDecimate(self.source(), dryrun=True, **args)
+        result = []
+        for n in range(clip.num_frames):
+            props = clip.get_frame(n).props
+            result.append((props.VDecimateDrop, props.VDecimateTotalDiff, props.VDecimateMaxBlockDiff))
+        del clip
+        return result
+
+    def testMetricsReloadedWithOtherThreshold(self):
+        # the first frame's substituted metrics depend on scthresh and are never stored
+        self.dryrunProps(scthresh=0.1, metrics=self.metrics)
+        self.assertTrue(os.path.exists(self.metrics))
+        for scthresh in (0.1, 100):
+            with self.subTest(scthresh=scthresh):
+                self.assertEqual(self.dryrunProps(scthresh=scthresh, metrics=self.metrics), self.dryrunProps(scthresh=scthresh))
+
+if __name__ == '__main__':
+    unittest.main()
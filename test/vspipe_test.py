@@ -0,0 +1,130 @@
+import ctypes
+import os
+import shutil
+import subprocess
+import tempfile
+import unittest
+import vapoursynth as vs
+
+# Every frame is filled with its own frame number so the written range can be checked,
+# output 1 is shorter than output 0
+SCRIPT = '''
+import vapoursynth as vs
+core = vs.get_core()
+def numbered(length):
+    return core.std.Splice([core.std.BlankClip(format=vs.GRAY8, width=16, height=16, length=1, color=n) for n in range(length)])
+numbered(10).set_output()
+numbered(4).set_output(1)
+'''
+
+FRAME_SIZE = 16 * 16
+
+# Every frame and plane is filled with its own noise so anything put in the wrong place shows up,
+# the format is passed in with -a as the arguments of register_format()
+Y4M_SCRIPT = '''
+import ctypes
+import random
+import vapoursynth as vs
+core = vs.get_core()
+fmt = core.register_format(*[int(x) for x in format.split(b',')])
+blank = core.std.BlankClip(format=fmt.id, width=32, height=16, length=3)
+def fill(n, f):
+    fout = f.copy()
+    for p in range(fout.format.num_planes):
+        size = fout.get_stride(p) * (fout.height >> (fout.format.subsampling_h if p else 0))
+        data = random.Random(n * 3 + p).getrandbits(size * 8).to_bytes(size, 'little')
+        ctypes.memmove(fout.get_write_ptr(p).value, data, size)
+    return fout
+core.std.ModifyFrame(blank, blank, fill).set_output()
+'''
+
+
+# the visible part of a plane, get_read_array() has no half precision type
+def plane_bytes(frame, plane):
+    fmt = frame.format
+    width = (frame.width >> (fmt.subsampling_w if plane else 0)) * fmt.bytes_per_sample
+    height = frame.height >> (fmt.subsampling_h if plane else 0)
+    ptr = frame.get_read_ptr(plane).value
+    stride = frame.get_stride(plane)
+    return b''.join(ctypes.string_at(ptr + y * stride, width) for y in range(height))
+
+
+class VSPipeTestSequence(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.vspipe = os.environ.get('VSPIPE') or shutil.which('vspipe')
+        if not cls.vspipe:
+            raise unittest.SkipTest('vspipe can\'t be found, set VSPIPE to its path')
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.script = os.path.join(self.dir, 'script.vpy')
+        with open(self.script, 'w') as f:
+            f.write(SCRIPT)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+    def run_vspipe(self, *args):
+        p = subprocess.run([self.vspipe] + list(args), stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=300)
+        return p.returncode, p.stderr.decode()
+
+    def frames(self, filename):
+        with open(os.path.join(self.dir, filename), 'rb') as f:
+            data = f.read()
+        self.assertEqual(len(data) % FRAME_SIZE, 0)
+        return [data[i] for i in range(0, len(data), FRAME_SIZE)]
+
+    def test_extra_output(self):
+        ret, err = self.run_vspipe('--extraoutput', '1=' + os.path.join(self.dir, 'extra.raw'), self.script, os.path.join(self.dir, 'main.raw'))
+        self.assertEqual(ret, 0, err)
+        self.assertEqual(self.frames('main.raw'), list(range(10)))
+        self.assertEqual(self.frames('extra.raw'), list(range(4)))
+
+    def test_shorter_extra_output(self):
+        ret, err = self.run_vspipe('--start', '2', '--extraoutput', '1=' + os.path.join(self.dir, 'extra.raw'), self.script, os.path.join(self.dir, 'main.raw'))
+        self.assertEqual(ret, 0, err)
+        self.assertEqual(self.frames('main.raw'), list(range(2, 10)))
+        self.assertEqual(self.frames('extra.raw'), [2, 3])
+
+    def test_extra_output_ends_before_start(self):
+        for start in ('4', '6'):
+            ret, err = self.run_vspipe('--start', start, '--extraoutput', '1=' + os.path.join(self.dir, 'extra.raw'), self.script, os.path.join(self.dir, 'main.raw'))
+            self.assertEqual(ret, 1)
+            self.assertIn('Invalid range of frames to output specified for output 1', err)
+
+    def test_y4m_round_trip(self):
+        core = vs.get_core()
+        script = os.path.join(self.dir, 'y4m.vpy')
+        with open(script, 'w') as f:
+            f.write(Y4M_SCRIPT)
+        filename = os.path.join(self.dir, 'out.y4m')
+
+        # everything vspipe can put in a y4m file
+        formats = [(vs.GRAY, 0, 0)] + [(vs.YUV, w, h) for w, h in ((1, 1), (1, 0), (0, 0), (2, 2), (2, 0), (0, 1))]
+        depths = [(vs.INTEGER, bits) for bits in (8, 9, 10, 12, 14, 16, 24, 32)] + [(vs.FLOAT, 16), (vs.FLOAT, 32)]
+        for family, ssw, ssh in formats:
+            for sample_type, bits in depths:
+                args = (int(family), int(sample_type), bits, ssw, ssh)
+                with self.subTest(format=args):
+                    ret, err = self.run_vspipe('--y4m', '-a', 'format=' + ','.join(str(x) for x in args), script, filename)
+                    self.assertEqual(ret, 0, err)
+
+                    env = {'format': ','.join(str(x) for x in args).encode()}
+                    exec(Y4M_SCRIPT, env)
+                    src = vs.get_output(0)
+                    vs.clear_output(0)
+                    clip = core.std.RawSource(filename)
+                    self.assertEqual(clip.format.id, src.format.id)
+                    self.assertEqual(clip.num_frames, src.num_frames)
+                    for n in range(clip.num_frames):
+                        a = clip.get_frame(n)
+                        b = src.get_frame(n)
+                        for p in range(a.format.num_planes):
+                            self.assertEqual(plane_bytes(a, p), plane_bytes(b, p))
+                    del clip
+
+
+if __name__ == '__main__':
+    unittest.main()
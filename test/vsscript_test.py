@@ -0,0 +1,178 @@
+import ctypes.util
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+import sysconfig
+import tempfile
+import unittest
+
+# A minimal plugin that logs the thread that initialized it so the tests can
+# tell in which thread a core was created
+PLUGIN_SOURCE = r'''
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "VapourSynth.h"
+
+static void VS_CC valueCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    vsapi->propSetInt(out, "val", 42, paReplace);
+}
+
+VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
+    const char *log = getenv("VSSCRIPT_TEST_LOG");
+    if (log) {
+        FILE *f = fopen(log, "a");
+        if (f) {
+            fprintf(f, "%lu\n", (unsigned long)pthread_self());
+            fclose(f);
+        }
+    }
+    configFunc("com.vapoursynth.vsscripttest", "vstest", "VSScript test", VAPOURSYNTH_API_VERSION, 1, plugin);
+    registerFunc("Value", "", valueCreate, 0, plugin);
+}
+'''
+
+# Runs in a separate process that uses the vsscript library the same way any other
+# application would, the pool thread and the python state are never shared with the test runner
+HOST = '''
+import ctypes
+import os
+import sys
+import threading
+import time
+
+lib = ctypes.CDLL(os.environ['VSSCRIPT_LIBRARY'])
+lib.vsscript_getError.argtypes = [ctypes.c_void_p]
+lib.vsscript_getError.restype = ctypes.c_char_p
+lib.vsscript_freeScript.argtypes = [ctypes.c_void_p]
+
+def inits():
+    if not os.path.exists(os.environ['VSSCRIPT_TEST_LOG']):
+        return []
+    with open(os.environ['VSSCRIPT_TEST_LOG']) as f:
+        return [int(line) for line in f]
+
+def wait_for_inits(count):
+    deadline = time.time() + 60
+    while len(inits()) < count and time.time() < deadline:
+        time.sleep(0.05)
+    # give the pool thread the chance to create more cores than it should
+    time.sleep(0.5)
+    return len(inits())
+
+def evaluate(script, filename=b'script.vpy'):
+    handle = ctypes.c_void_p()
+    if lib.vsscript_evaluateScript(ctypes.byref(handle), script, filename, 0):
+        raise Exception(lib.vsscript_getError(handle).decode())
+    lib.vsscript_freeScript(handle)
+
+USE_PLUGIN = b'import vapoursynth as vs\\nassert vs.get_core().vstest.Value() == 42\\n'
+
+assert lib.vsscript_init() == 1
+mode = sys.argv[1]
+if mode == 'nopool':
+    evaluate(USE_PLUGIN)
+    print(threading.get_ident() in inits())
+elif mode == 'reuse':
+    assert lib.vsscript_setCorePoolSize(1) == 0
+    wait_for_inits(1)
+    evaluate(USE_PLUGIN)
+    print(threading.get_ident() in inits())
+elif mode == 'limit':
+    assert lib.vsscript_setCorePoolSize(2) == 0
+    print(wait_for_inits(2))
+    evaluate(USE_PLUGIN)
+    # the used core is replaced
+    print(wait_for_inits(3))
+    # shrinking the pool frees the surplus without creating anything
+    assert lib.vsscript_setCorePoolSize(1) == 0
+    print(wait_for_inits(3))
+elif mode == 'invalid':
+    print(lib.vsscript_setCorePoolSize(-1))
+    lib.vsscript_finalize()
+    print(lib.vsscript_setCorePoolSize(1))
+    sys.exit(0)
+elif mode == 'lru':
+    import vapoursynth
+    vapoursynth._max_compiled_scripts = 2
+    for name in 'abcbd':
+        evaluate(('x = "%s"\\n' % name).encode())
+    print(' '.join(script.decode().split('"')[1] for filename, script in vapoursynth._compiled_scripts))
+    # the same source with a different file name is compiled separately
+    evaluate(b'x = "d"\\n', b'other.vpy')
+    print(' '.join(filename for filename, script in vapoursynth._compiled_scripts))
+lib.vsscript_finalize()
+'''
+
+INCLUDE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'include')
+
+
+@unittest.skipIf(sys.platform.startswith('win'), 'the configuration location is fixed on windows')
+class VSScriptTestSequence(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.vsscript = os.environ.get('VSSCRIPT_LIBRARY') or ctypes.util.find_library('vapoursynth-script')
+        if not cls.vsscript:
+            raise unittest.SkipTest('the vsscript library can\'t be found, set VSSCRIPT_LIBRARY to its path')
+        cls.builddir = tempfile.mkdtemp()
+        suffix = '.dylib' if sys.platform == 'darwin' else '.so'
+        src = os.path.join(cls.builddir, 'vstest.c')
+        with open(src, 'w') as f:
+            f.write(PLUGIN_SOURCE)
+        cls.library = os.path.join(cls.builddir, 'libvstest' + suffix)
+        cc = shlex.split(sysconfig.get_config_var('CC') or 'cc')
+        try:
+            subprocess.check_call(cc + ['-shared', '-fPIC', '-I' + INCLUDE_DIR, src, '-o', cls.library, '-lpthread'])
+        except (OSError, subprocess.CalledProcessError):
+            raise unittest.SkipTest('no compiler to build the test plugin')
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.builddir, ignore_errors=True)
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        plugindir = os.path.join(self.dir, 'plugins')
+        os.makedirs(plugindir)
+        shutil.copy(self.library, plugindir)
+
+        # the plugin cache is off so every new core initializes the plugin
+        self.env = dict(os.environ, HOME=self.dir, XDG_CONFIG_HOME=os.path.join(self.dir, 'config'), XDG_CACHE_HOME=os.path.join(self.dir, 'cache'),
+            VSSCRIPT_LIBRARY=self.vsscript, VSSCRIPT_TEST_LOG=os.path.join(self.dir, 'log'))
+        if sys.platform == 'darwin':
+            configfile = os.path.join(self.dir, 'Library', 'Application Support', 'VapourSynth', 'vapoursynth.conf')
+        else:
+            configfile = os.path.join(self.dir, 'config', 'vapoursynth', 'vapoursynth.conf')
+        os.makedirs(os.path.dirname(configfile))
+        with open(configfile, 'w') as f:
+            f.write('SystemPluginDir=%s\nAutoloadUserPluginDir=false\nPluginCache=false\n' % plugindir)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+    def run_host(self, mode):
+        out = subprocess.check_output([sys.executable, '-c', HOST, mode], env=self.env, timeout=300)
+        return out.decode().split('\n')[:-1]
+
+    def test_no_pool(self):
+        # without a pool the core is created by the thread evaluating the script
+        self.assertEqual(self.run_host('nopool'), ['True'])
+
+    def test_pool_core_used(self):
+        self.assertEqual(self.run_host('reuse'), ['False'])
+
+    def test_pool_size_limit(self):
+        self.assertEqual(self.run_host('limit'), ['2', '3', '3'])
+
+    def test_pool_invalid_size(self):
+        self.assertEqual(self.run_host('invalid'), ['1', '1'])
+
+    def test_compiled_script_lru(self):
+        self.assertEqual(self.run_host('lru'), ['b d', 'script.vpy other.vpy'])
+
+
+if __name__ == '__main__':
+    unittest.main()